@@ -34,10 +34,13 @@ set UNITY_BUILD_FILE="%SRC_DIR%\Build.c"
 set APPNAME=PS1Emu.exe
 
 set MSVC_COMP=/DDEBUG /Zi /Od
+set MSVC_BENCH_COMP=/O2
 set MSVC_INC=/I"%SRC_DIR%\Include" /I"%RAYLIB_SRC%" /I"%EXTERN_DIR%\glew"
 set CC=gcc
 set CC_COMP=-O2 -DDEBUG -Wall -Wextra -Wpedantic -Wno-missing-braces
+set CC_BENCH_COMP=-O2 -Wall -Wextra -Wpedantic -Wno-missing-braces
 set CC_INC=-I"%SRC_DIR%\Include" -I"%RAYLIB_SRC%" -I"%EXTERN_DIR%\glew"
+set CC_LINK=-lws2_32
 
 
 REM ------------------------------------------------------------------------------------------------
@@ -60,7 +63,14 @@ if "clean"=="%1" (
     if "cl"=="%1" (
         if "%VisualStudioVersion%"=="" call "C:\Program Files\Microsoft Visual Studio\2022\Community\VC\Auxiliary\Build\vcvarsall.bat" x64
 
-        REM compile external libraries (only glew for now)
+        REM compile external libraries
+        if not exist "%EXTERN_DIR%\bin\raylib.lib" (
+            if not exist "%EXTERN_DIR%\bin" mkdir "%EXTERN_DIR%\bin"
+            pushd "%EXTERN_DIR%\bin"
+                cl /c %RAYLIB_MSVC_COMP% %RAYLIB_MSVC_INC% %RAYLIB_MSVC_DEFINES% %RAYLIB_C_FILES%
+                lib /OUT:raylib.lib rcore.obj rshapes.obj rtextures.obj rtext.obj rmodels.obj utils.obj raudio.obj rglfw.obj
+            popd
+        )
         if not exist "%EXTERN_DIR%\bin\glew.obj" (
             if not exist "%EXTERN_DIR%\bin" mkdir "%EXTERN_DIR%\bin"
             pushd "%EXTERN_DIR%\bin"
@@ -69,14 +79,24 @@ if "clean"=="%1" (
             popd
         )
         pushd %BIN_DIR%
-            cl %MSVC_COMP% %MSVC_INC% %UNITY_BUILD_FILE% /Fe%APPNAME%
+            cl %MSVC_COMP% %MSVC_INC% %UNITY_BUILD_FILE% /Fe%APPNAME% %RAYLIB_MSVC_LINK% "%EXTERN_DIR%\bin\raylib.lib"
             cl %MSVC_COMP% %MSVC_INC% /DSTANDALONE "%SRC_DIR%\Disassembler.c" /FeDisassembler.exe
             cl %MSVC_COMP% %MSVC_INC% /DSTANDALONE "%SRC_DIR%\Assembler.c" /FeAssembler.exe
+            cl %MSVC_BENCH_COMP% %MSVC_INC% "%SRC_DIR%\Bench.c" /FeBench.exe
+            cl %MSVC_BENCH_COMP% %MSVC_INC% "%SRC_DIR%\Replay.c" /FeReplay.exe
+            cl %MSVC_BENCH_COMP% %MSVC_INC% "%SRC_DIR%\PackDisc.c" /FePackDisc.exe
         popd 
 
     ) else ( REM compile with other compilers
 
-        REM compile external library (only glew for now)
+        REM compile external libraries
+        if not exist "%EXTERN_DIR%\bin\libraylib.a" (
+            if not exist "%EXTERN_DIR%\bin" mkdir "%EXTERN_DIR%\bin"
+            pushd "%EXTERN_DIR%\bin"
+                %CC% -c %RAYLIB_CC_COMP% %RAYLIB_CC_INC% %RAYLIB_CC_DEFINES% %RAYLIB_C_FILES%
+                ar rcs libraylib.a rcore.o rshapes.o rtextures.o rtext.o rmodels.o utils.o raudio.o rglfw.o
+            popd
+        )
         if not exist "%EXTERN_DIR%\bin\glew.o" (
             if not exist "%EXTERN_DIR%\bin" mkdir "%EXTERN_DIR%\bin"
             pushd "%EXTERN_DIR%\bin"
@@ -85,9 +105,12 @@ if "clean"=="%1" (
             popd
         )
 
-        %CC% %CC_COMP% %CC_INC% %UNITY_BUILD_FILE% -o "%BIN_DIR%\%APPNAME%"
+        %CC% %CC_COMP% %CC_INC% %UNITY_BUILD_FILE% -o "%BIN_DIR%\%APPNAME%" "%EXTERN_DIR%\bin\libraylib.a" %RAYLIB_CC_LINK% %CC_LINK%
         %CC% %CC_COMP% %CC_INC% -DSTANDALONE "%SRC_DIR%\Disassembler.c" -o "%BIN_DIR%\Disassembler.exe"
         %CC% %CC_COMP% %CC_INC% -DSTANDALONE "%SRC_DIR%\Assembler.c" -o "%BIN_DIR%\Assembler.exe"
+        %CC% %CC_BENCH_COMP% %CC_INC% "%SRC_DIR%\Bench.c" -o "%BIN_DIR%\Bench.exe" %CC_LINK%
+        %CC% %CC_BENCH_COMP% %CC_INC% "%SRC_DIR%\Replay.c" -o "%BIN_DIR%\Replay.exe" %CC_LINK%
+        %CC% %CC_BENCH_COMP% %CC_INC% "%SRC_DIR%\PackDisc.c" -o "%BIN_DIR%\PackDisc.exe" %CC_LINK%
     )
 
     echo:
@@ -0,0 +1,240 @@
+#include <string.h> /* memcpy, memset */
+
+#include "Common.h"
+#include "Platform.h"
+#include "Audio.h"
+
+#ifndef PS1_NO_FRONTEND
+/*
+ * the implementation is in raylib's raudio.c, compiled with these:
+ * they change miniaudio's structs, they have to match
+ */
+#  define MA_NO_JACK
+#  define MA_NO_WAV
+#  define MA_NO_FLAC
+#  define MA_NO_MP3
+#  define MA_NO_RESOURCE_MANAGER
+#  define MA_NO_NODE_GRAPH
+#  define MA_NO_ENGINE
+#  define MA_NO_GENERATION
+#  if defined(__GNUC__)
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wpedantic"
+#    pragma GCC diagnostic ignored "-Wunused-parameter"
+#  endif /* __GNUC__ */
+#  include "external/miniaudio.h"
+#  if defined(__GNUC__)
+#    pragma GCC diagnostic pop
+#  endif /* __GNUC__ */
+#  define AUDIO_HAS_DEVICE 1
+#endif /* PS1_NO_FRONTEND */
+
+
+#define AUDIO_WAV_HEADER_SIZE 44
+#define AUDIO_FILL_SMOOTHING 0.05   /* of the ring's fill level, per pull */
+
+
+
+/*
+ * RIFF header of 16 bit stereo PCM at AUDIO_SAMPLE_RATE, FrameCount frames;
+ * the samples themselves are written as they are, WAV is little endian like every host this runs on
+ */
+static void Audio_WriteWavHeader(FILE *File, u64 FrameCount)
+{
+    u32 DataSize = (u32)MIN(FrameCount*4, 0xFFFFFFFFu - AUDIO_WAV_HEADER_SIZE);
+    u32 Fields[] = {
+        DataSize + AUDIO_WAV_HEADER_SIZE - 8,
+        16,                             /* fmt chunk size */
+        1 | 2 << 16,                    /* PCM, 2 channels */
+        AUDIO_SAMPLE_RATE,
+        AUDIO_SAMPLE_RATE * 4,          /* bytes per second */
+        4 | 16 << 16,                   /* bytes per frame, bits per sample */
+        DataSize,
+    };
+    u8 Header[AUDIO_WAV_HEADER_SIZE];
+    u8 *Field = Header;
+    for (uint i = 0; i < STATIC_ARRAY_SIZE(Fields); i++)
+    {
+        static const char *sTags[] = { "RIFF", "WAVEfmt ", NULL, NULL, NULL, NULL, "data" };
+        if (sTags[i])
+        {
+            memcpy(Field, sTags[i], strlen(sTags[i]));
+            Field += strlen(sTags[i]);
+        }
+        for (uint k = 0; k < 4; k++)
+            *Field++ = (u8)(Fields[i] >> k*8);
+    }
+    fseek(File, 0, SEEK_SET);
+    fwrite(Header, 1, sizeof Header, File);
+}
+
+#ifdef AUDIO_HAS_DEVICE
+typedef struct Audio_Device
+{
+    ma_device Device;
+} Audio_Device;
+
+static void Audio_DeviceCallback(ma_device *Device, void *Output, const void *Input, ma_uint32 FrameCount)
+{
+    (void)Input;
+    Audio_Pull(Device->pUserData, Output, FrameCount);
+}
+
+static Bool8 Audio_OpenDevice(Audio *Audio)
+{
+    Audio_Device *Device = malloc(sizeof *Device);
+    if (NULL == Device)
+        return false;
+
+    ma_device_config Config = ma_device_config_init(ma_device_type_playback);
+    Config.playback.format = ma_format_s16;
+    Config.playback.channels = 2;
+    Config.sampleRate = 0;              /* the device's own, the callback resamples to it */
+    Config.dataCallback = Audio_DeviceCallback;
+    Config.pUserData = Audio;
+    if (MA_SUCCESS != ma_device_init(NULL, &Config, &Device->Device))
+    {
+        free(Device);
+        return false;
+    }
+    /* before the callback can run */
+    Audio->DeviceRate = Device->Device.sampleRate;
+    Audio->Device = Device;
+    if (MA_SUCCESS != ma_device_start(&Device->Device))
+    {
+        ma_device_uninit(&Device->Device);
+        free(Device);
+        Audio->Device = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void Audio_CloseDevice(Audio *Audio)
+{
+    ma_device_uninit(&Audio->Device->Device);
+    free(Audio->Device);
+    Audio->Device = NULL;
+}
+#endif /* AUDIO_HAS_DEVICE */
+
+
+
+Bool8 Audio_Init(Audio *Audio, Audio_Backend Backend, const char *WavPath)
+{
+    memset(Audio, 0, sizeof *Audio); /* too big for a compound literal */
+    if (WavPath)
+    {
+        Audio->WavFile = fopen(WavPath, "wb");
+        if (NULL == Audio->WavFile)
+            return false;
+        Audio_WriteWavHeader(Audio->WavFile, 0);
+    }
+
+    if (AUDIO_BACKEND_DEVICE == Backend)
+    {
+#ifdef AUDIO_HAS_DEVICE
+        if (Audio_OpenDevice(Audio))
+            Audio->Backend = AUDIO_BACKEND_DEVICE;
+        else LOG("Audio: no output device, the sound is thrown away\n");
+#else
+        LOG("Audio: built without the frontend, the sound is thrown away\n");
+#endif /* AUDIO_HAS_DEVICE */
+    }
+    return true;
+}
+
+void Audio_Destroy(Audio *Audio)
+{
+#ifdef AUDIO_HAS_DEVICE
+    if (Audio->Device)
+        Audio_CloseDevice(Audio);
+#endif /* AUDIO_HAS_DEVICE */
+    if (Audio->WavFile)
+    {
+        Audio_WriteWavHeader(Audio->WavFile, Audio->FramesPushed);
+        fclose(Audio->WavFile);
+        Audio->WavFile = NULL;
+    }
+}
+
+void Audio_Push(Audio *Audio, const i16 *Frames, uint FrameCount)
+{
+    Audio->FramesPushed += FrameCount;
+    if (Audio->WavFile && fwrite(Frames, 4, FrameCount, Audio->WavFile) != FrameCount)
+    {
+        LOG("Unable to write the WAV file, stopped recording\n");
+        fclose(Audio->WavFile);
+        Audio->WavFile = NULL;
+    }
+    if (AUDIO_BACKEND_NULL == Audio->Backend)
+        return;
+
+    u32 Write = Audio->WritePos;
+    u32 Free = AUDIO_RING_FRAMES - (Write - Platform_AtomicLoad(&Audio->ReadPos));
+    uint Count = MIN(FrameCount, Free);
+    uint Index = Write % AUDIO_RING_FRAMES;
+    uint First = MIN(Count, AUDIO_RING_FRAMES - Index);
+    memcpy(Audio->Ring[Index], Frames, First*sizeof Audio->Ring[0]);
+    memcpy(Audio->Ring[0], Frames + First*2, (Count - First)*sizeof Audio->Ring[0]);
+    /* the frames are there before the reader can see them (a full barrier) */
+    Platform_AtomicStore(&Audio->WritePos, Write + Count);
+    Audio->FramesDropped += FrameCount - Count;
+}
+
+void Audio_Pull(Audio *Audio, i16 *Frames, uint FrameCount)
+{
+    u32 Read = Audio->ReadPos;
+    u32 Available = Platform_AtomicLoad(&Audio->WritePos) - Read;
+    if (!Audio->Playing)
+    {
+        if (Available < AUDIO_TARGET_FRAMES)
+        {
+            memset(Frames, 0, FrameCount*4);
+            return;
+        }
+        Audio->Playing = true;
+        Audio->AverageFill = Available;
+    }
+
+    /*
+     * the further the ring is from the target, the faster (fuller) or slower (emptier) it's read;
+     * smoothed, the fill level jumps by a video frame's worth of audio with every push
+     */
+    Audio->AverageFill += ((double)Available - Audio->AverageFill) * AUDIO_FILL_SMOOTHING;
+    double Error = (Audio->AverageFill - AUDIO_TARGET_FRAMES) / AUDIO_TARGET_FRAMES;
+    double Ratio = 1.0 + MIN(MAX(Error, -1.0), 1.0)*AUDIO_MAX_RATE_ADJUST;
+    u64 Step = (u64)((double)AUDIO_SAMPLE_RATE / Audio->DeviceRate * Ratio * 4294967296.0);
+
+    /* linear interpolation between the last 2 input frames */
+    for (uint i = 0; i < FrameCount; i++)
+    {
+        while (Audio->Phase >= 1ull << 32)
+        {
+            Audio->Phase -= 1ull << 32;
+            memcpy(Audio->Prev, Audio->Next, sizeof Audio->Prev);
+            if (Available)
+            {
+                memcpy(Audio->Next, Audio->Ring[Read % AUDIO_RING_FRAMES], sizeof Audio->Next);
+                Read++;
+                Available--;
+            }
+            else
+            {
+                /* holds the last frame, and waits for the ring to fill up again */
+                Audio->FramesMissed++;
+                Audio->Playing = false;
+            }
+        }
+        i32 Fraction = (i32)(Audio->Phase >> 17);   /* 15 bits */
+        for (uint Side = 0; Side < 2; Side++)
+            Frames[i*2 + Side] = (i16)(Audio->Prev[Side] + (((Audio->Next[Side] - Audio->Prev[Side]) * Fraction) >> 15));
+        Audio->Phase += Step;
+    }
+    Platform_AtomicStore(&Audio->ReadPos, Read);
+
+    Audio->FramesPlayed += FrameCount;
+    Audio->Pulls++;
+    Audio->RatioSum += Ratio;
+}
+
@@ -0,0 +1,981 @@
+
+/*
+ * Microbenchmarks for the emulator's hot paths.
+ * This is a separate executable built from the same sources as Build.c, see build.bat.
+ * Usage: Bench [benchmark name...], runs all of them when no name is given
+ */
+
+#define PS1_NO_MAIN
+#define PS1_NO_FRONTEND
+#include "Build.c"
+
+#include <string.h> /* strcmp, memset */
+#include <time.h>   /* clock */
+
+
+#define BENCH_MIN_SECONDS 1.0
+
+typedef struct BenchContext
+{
+    PS1 Ps1;
+    Bool8 Failed;           /* a benchmark's output was wrong, the exit code says so */
+} BenchContext;
+
+typedef void (*BenchFn)(BenchContext *);
+
+
+static double Bench_Seconds(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void Bench_Reset(BenchContext *Context)
+{
+    PS1_Reset(&Context->Ps1);
+    memset(Context->Ps1.Ram, 0, PS1_RAM_SIZE);
+}
+
+static void Bench_Report(const char *Name, double Amount, const char *Unit, double Seconds)
+{
+    printf("    %-28s %12.2f M%s/s\n", Name, Amount / Seconds / 1e6, Unit);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  GP0
+ *
+ *==================================================================================*/
+
+#define BENCH_OT_PACKETS 4096
+
+/*
+ * Builds an ordering table of packets like the ones a typical game sends every frame:
+ * draw mode changes, small flat, shaded and textured polygons, and the occasional image upload.
+ * Returns the address of the first header.
+ */
+static u32 Bench_BuildOrderingTable(PS1 *Ps1, u32 *OutWordCount)
+{
+    static const u32 sMonoQuad[] = {
+        0x28404040,
+        0x00100010, 0x00100014, 0x00140010, 0x00140014,
+    };
+    static const u32 sShadedTri[] = {
+        0x300000FF, 0x00200020,
+        0x0000FF00, 0x00200026,
+        0x00FF0000, 0x00260020,
+    };
+    static const u32 sTexturedQuad[] = {
+        0x2C808080, 0x00300030, 0x7F000000,
+        0x00300036, 0x00080808,
+        0x00360030, 0x00000800,
+        0x00360036, 0x00000808,
+    };
+    static const u32 sDrawMode[] = {
+        0xE1000208,
+    };
+    static const u32 sLoadImage[] = {
+        0xA0000000, 0x01000300, 0x00040008, /* 8x4 halfwords to (768, 256) */
+        0x7FFF0000, 0x7FFF0000, 0x7FFF0000, 0x7FFF0000,
+        0x7FFF0000, 0x7FFF0000, 0x7FFF0000, 0x7FFF0000,
+        0x7FFF0000, 0x7FFF0000, 0x7FFF0000, 0x7FFF0000,
+        0x7FFF0000, 0x7FFF0000, 0x7FFF0000, 0x7FFF0000,
+    };
+    static const struct { const u32 *Words; uint Count; } sPackets[] = {
+        { sDrawMode, STATIC_ARRAY_SIZE(sDrawMode) },
+        { sMonoQuad, STATIC_ARRAY_SIZE(sMonoQuad) },
+        { sShadedTri, STATIC_ARRAY_SIZE(sShadedTri) },
+        { sTexturedQuad, STATIC_ARRAY_SIZE(sTexturedQuad) },
+        { sMonoQuad, STATIC_ARRAY_SIZE(sMonoQuad) },
+        { sShadedTri, STATIC_ARRAY_SIZE(sShadedTri) },
+        { sTexturedQuad, STATIC_ARRAY_SIZE(sTexturedQuad) },
+        { sLoadImage, STATIC_ARRAY_SIZE(sLoadImage) },
+    };
+
+    u32 Addr = 0x1000;
+    u32 WordCount = 0;
+    for (uint i = 0; i < BENCH_OT_PACKETS; i++)
+    {
+        const u32 *Words = sPackets[i % STATIC_ARRAY_SIZE(sPackets)].Words;
+        uint Count = sPackets[i % STATIC_ARRAY_SIZE(sPackets)].Count;
+        u32 Next = Addr + (1 + Count)*sizeof(u32);
+        u32 Header = (u32)Count << 24 | (i == BENCH_OT_PACKETS - 1? 0xFFFFFF : Next);
+
+        PS1_Ram_Write32(Ps1, Addr, Header);
+        memcpy(Ps1->Ram + Addr + sizeof(u32), Words, Count*sizeof(u32));
+        WordCount += Count;
+        Addr = Next;
+    }
+
+    *OutWordCount = WordCount;
+    return 0x1000;
+}
+
+static void Bench_GP0SetupDrawingArea(GPU *Gpu)
+{
+    /* the drawing area is (0, 0)..(7, 7), so the polygons get clipped away 
+     * and this measures command transport and decoding rather than fill rate */
+    GPU_WriteGP0(Gpu, 0xE3000000);
+    GPU_WriteGP0(Gpu, 0xE4000000 | (7 << 10) | 7);
+    GPU_WriteGP0(Gpu, 0xE5000000);
+}
+
+static void Bench_GP0(BenchContext *Context)
+{
+    PS1 *Ps1 = &Context->Ps1;
+    GPU *Gpu = &Ps1->Gpu;
+    Bench_Reset(Context);
+    Bench_GP0SetupDrawingArea(Gpu);
+
+    u32 WordCount;
+    u32 FirstHeader = Bench_BuildOrderingTable(Ps1, &WordCount);
+
+    /* one GPU_WriteGP0 call per word */
+    double Words = 0;
+    double Start = Bench_Seconds(), Elapsed;
+    do {
+        u32 Addr = FirstHeader;
+        for (uint i = 0; i < BENCH_OT_PACKETS; i++)
+        {
+            u32 Header;
+            PS1_Ram_Read32(Ps1, Addr, &Header);
+            for (u32 k = 1; k <= Header >> 24; k++)
+            {
+                u32 Word;
+                PS1_Ram_Read32(Ps1, Addr + k*sizeof(u32), &Word);
+                GPU_WriteGP0(Gpu, Word);
+            }
+            Addr = Header & 0xFFFFFF;
+        }
+        Words += WordCount;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("GPU_WriteGP0 per word", Words, "words", Elapsed);
+
+    /* one GPU_WriteGP0Block call per packet */
+    Words = 0;
+    Start = Bench_Seconds();
+    do {
+        u32 Addr = FirstHeader;
+        for (uint i = 0; i < BENCH_OT_PACKETS; i++)
+        {
+            u32 Header;
+            PS1_Ram_Read32(Ps1, Addr, &Header);
+            GPU_WriteGP0Block(Gpu, (const u32 *)(Ps1->Ram + Addr + sizeof(u32)), Header >> 24);
+            Addr = Header & 0xFFFFFF;
+        }
+        Words += WordCount;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("GPU_WriteGP0Block per packet", Words, "words", Elapsed);
+
+    /* the whole linked list through the DMA */
+    Words = 0;
+    Start = Bench_Seconds();
+    do {
+        DMA_Chanel *Chanel = &Ps1->Dma.Chanels[DMA_PORT_GPU];
+        Chanel->BaseAddr = FirstHeader;
+        Chanel->Ctrl.RamToDevice = 1;
+        Chanel->Ctrl.SyncMode = DMA_SYNCMODE_LINKEDLIST;
+        PS1_DoDMATransfer(Ps1, DMA_PORT_GPU);
+        Words += WordCount;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("linked list DMA", Words, "words", Elapsed);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Blits
+ *
+ *==================================================================================*/
+
+static void Bench_Blit(BenchContext *Context)
+{
+    GPU *Gpu = &Context->Ps1.Gpu;
+    Bench_Reset(Context);
+    GPU_WriteGP0(Gpu, 0xE3000000);
+    GPU_WriteGP0(Gpu, 0xE4000000 | 511 << 10 | 1023);
+    GPU_WriteGP0(Gpu, 0xE1000000 | 1 << 7 | 8);    /* 8 bit texture page at (512, 0) */
+
+    /* 320x240 fills, like clearing the back buffer */
+    double Pixels = 0;
+    double Start = Bench_Seconds(), Elapsed;
+    do {
+        GPU_WriteGP0(Gpu, 0x02204060);
+        GPU_WriteGP0(Gpu, 0x00000000);
+        GPU_WriteGP0(Gpu, 240 << 16 | 320);
+        Pixels += 320*240;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("fill 320x240", Pixels, "pixels", Elapsed);
+
+    /* 320x240 VRAM to VRAM copies */
+    Pixels = 0;
+    Start = Bench_Seconds();
+    do {
+        GPU_WriteGP0(Gpu, 0x80000000);
+        GPU_WriteGP0(Gpu, 0x00000000);
+        GPU_WriteGP0(Gpu, 256 << 16 | 0);
+        GPU_WriteGP0(Gpu, 240 << 16 | 320);
+        Pixels += 320*240;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("copy 320x240", Pixels, "pixels", Elapsed);
+
+    /* 16x16 8 bit textured sprites, all over a 320x240 screen */
+    Pixels = 0;
+    Start = Bench_Seconds();
+    u32 i = 0;
+    do {
+        for (uint k = 0; k < 256; k++, i++)
+        {
+            u32 X = (i * 37) % 304, Y = (i * 17) % 224;
+            GPU_WriteGP0(Gpu, 0x7C808080);
+            GPU_WriteGP0(Gpu, Y << 16 | X);
+            GPU_WriteGP0(Gpu, 0x78000000 | (i & 0xF0) << 8 | (i & 0xF0));
+        }
+        Pixels += 256*16*16;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("16x16 8 bit sprites", Pixels, "pixels", Elapsed);
+
+    /* the same, tinted: the texels go through the shading and span kernel */
+    Pixels = 0;
+    Start = Bench_Seconds();
+    do {
+        for (uint k = 0; k < 256; k++, i++)
+        {
+            u32 X = (i * 37) % 304, Y = (i * 17) % 224;
+            GPU_WriteGP0(Gpu, 0x7C604020);
+            GPU_WriteGP0(Gpu, Y << 16 | X);
+            GPU_WriteGP0(Gpu, 0x78000000 | (i & 0xF0) << 8 | (i & 0xF0));
+        }
+        Pixels += 256*16*16;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("16x16 8 bit sprites, tinted", Pixels, "pixels", Elapsed);
+
+    /* 256x240 4 bit raw backgrounds */
+    GPU_WriteGP0(Gpu, 0xE1000000 | 8);             /* 4 bit texture page at (512, 0) */
+    Pixels = 0;
+    Start = Bench_Seconds();
+    do {
+        GPU_WriteGP0(Gpu, 0x65000000);
+        GPU_WriteGP0(Gpu, 0x00000000);
+        GPU_WriteGP0(Gpu, 0x78000000);
+        GPU_WriteGP0(Gpu, 240 << 16 | 256);
+        Pixels += 256*240;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("256x240 4 bit raw background", Pixels, "pixels", Elapsed);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Lines
+ *
+ *==================================================================================*/
+
+static void Bench_Lines(BenchContext *Context)
+{
+    GPU *Gpu = &Context->Ps1.Gpu;
+    Bench_Reset(Context);
+    GPU_WriteGP0(Gpu, 0xE3000000);
+    GPU_WriteGP0(Gpu, 0xE4000000 | 511 << 10 | 1023);
+    GPU_WriteGP0(Gpu, 0xE1000000 | 1 << 9);     /* dithered, like most games */
+
+    /* wireframe: one shaded polyline of 64 segments zigzagging across a 320x240 screen */
+    u32 Packet[2 + 2*64 + 1];
+    uint WordCount = 0;
+    double PixelsPerPacket = 0;
+    i32 LastX = 0, LastY = 8;
+    Packet[WordCount++] = 0x58FF0000;
+    Packet[WordCount++] = LastY << 16 | LastX;
+    for (i32 k = 1; k <= 64; k++)
+    {
+        i32 X = (k & 7) * 40, Y = 8 + (k / 8) * 28 + (k & 1) * 12;
+        Packet[WordCount++] = (k * 0x0F0F0F) & 0xFFFFFF;
+        Packet[WordCount++] = Y << 16 | X;
+        PixelsPerPacket += MAX(abs(X - LastX), abs(Y - LastY)) + 1;
+        LastX = X;
+        LastY = Y;
+    }
+    Packet[WordCount++] = 0x55555555;
+
+    double Pixels = 0, Segments = 0;
+    double Start = Bench_Seconds(), Elapsed;
+    do {
+        for (uint k = 0; k < 64; k++)
+            GPU_WriteGP0Block(Gpu, Packet, WordCount);
+        Segments += 64*64;
+        Pixels += 64*PixelsPerPacket;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("shaded polyline segments", Segments, "segments", Elapsed);
+    Bench_Report("shaded polyline pixels", Pixels, "pixels", Elapsed);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Upscaling
+ *
+ *==================================================================================*/
+
+static u32 Bench_Random(u32 *Seed, u32 Range)
+{
+    *Seed = *Seed*1103515245 + 12345;
+    return (*Seed >> 8) % Range;
+}
+
+/*
+ * a 320x240 frame like a 3D game's: 2000 small shaded textured triangles, 64 sprites and a HUD of lines over them,
+ * then the shadow is finished like the display does
+ */
+static void Bench_UpscaleFrame(GPU *Gpu, u32 Frame)
+{
+    u32 Seed = Frame * 2654435761u + 1;
+    GPU_WriteGP0(Gpu, 0x02000000);
+    GPU_WriteGP0(Gpu, 0x00000000);
+    GPU_WriteGP0(Gpu, 240 << 16 | 320);
+    for (uint i = 0; i < 2000; i++)
+    {
+        u32 X = Bench_Random(&Seed, 300), Y = Bench_Random(&Seed, 220);
+        u32 U = Bench_Random(&Seed, 224), V = Bench_Random(&Seed, 224);
+        GPU_WriteGP0(Gpu, 0x34000000 | Bench_Random(&Seed, 0x1000000));
+        GPU_WriteGP0(Gpu, Y << 16 | X);
+        GPU_WriteGP0(Gpu, 0x78000000 | V << 8 | U);     /* CLUT at (0, 480) */
+        GPU_WriteGP0(Gpu, Bench_Random(&Seed, 0x1000000));
+        GPU_WriteGP0(Gpu, (Y + Bench_Random(&Seed, 24)) << 16 | (X + 20));
+        GPU_WriteGP0(Gpu, (1 << 7 | 8) << 16 | V << 8 | (U + 31)); /* 8 bit page at (512, 0) */
+        GPU_WriteGP0(Gpu, Bench_Random(&Seed, 0x1000000));
+        GPU_WriteGP0(Gpu, (Y + 20) << 16 | (X + Bench_Random(&Seed, 24)));
+        GPU_WriteGP0(Gpu, (V + 31) << 8 | U);
+    }
+    for (uint i = 0; i < 64; i++)
+    {
+        u32 X = Bench_Random(&Seed, 304), Y = Bench_Random(&Seed, 224);
+        GPU_WriteGP0(Gpu, 0x7C808080);
+        GPU_WriteGP0(Gpu, Y << 16 | X);
+        GPU_WriteGP0(Gpu, 0x78000000 | Bench_Random(&Seed, 0x10000));
+    }
+    for (uint i = 0; i < 16; i++)
+    {
+        u32 X0 = Bench_Random(&Seed, 320), Y0 = Bench_Random(&Seed, 240);
+        u32 X1 = Bench_Random(&Seed, 320), Y1 = Bench_Random(&Seed, 240);
+        GPU_WriteGP0(Gpu, 0x40FFFFFF);
+        GPU_WriteGP0(Gpu, Y0 << 16 | X0);
+        GPU_WriteGP0(Gpu, Y1 << 16 | X1);
+    }
+    uint Scale;
+    Raster_GetUpscaledVram(Gpu, &Scale);
+}
+
+static void Bench_UpscaleRun(BenchContext *Context, const char *Name, uint Scale)
+{
+    GPU *Gpu = &Context->Ps1.Gpu;
+    if (Scale > 1 && !Raster_AttachUpscaler(Gpu, Scale, Platform_CpuCount()))
+    {
+        printf("    %-28s out of memory\n", Name);
+        return;
+    }
+
+    /* wall clock time, clock() adds up the time of every thread */
+    u32 Frames = 0;
+    u64 Start = Platform_GetTicks(), Elapsed;
+    do {
+        Bench_UpscaleFrame(Gpu, Frames++);
+        Elapsed = Platform_GetTicks() - Start;
+    } while (Elapsed < Platform_TicksPerSecond() * BENCH_MIN_SECONDS);
+
+    printf("    %-28s %12.2f ms per frame, %u threads\n",
+        Name, (double)Elapsed * 1e3 / (double)Platform_TicksPerSecond() / Frames, MAX(1, Raster_GetUpscalerThreadCount(Gpu))
+    );
+    Raster_DetachUpscaler(Gpu);
+}
+
+static void Bench_Upscale(BenchContext *Context)
+{
+    GPU *Gpu = &Context->Ps1.Gpu;
+    Bench_Reset(Context);
+    GPU_WriteGP0(Gpu, 0xE3000000);
+    GPU_WriteGP0(Gpu, 0xE4000000 | 239 << 10 | 319);
+    for (uint i = 0; i < GPU_VRAM_SIZE / 2; i++)   /* something in the textures and CLUTs */
+        Gpu->Vram[i] = (u16)(i * 0x9E37);
+
+    Bench_UpscaleRun(Context, "native", 1);
+    Bench_UpscaleRun(Context, "2x", 2);
+    Bench_UpscaleRun(Context, "4x", 4);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  CPU
+ *
+ *==================================================================================*/
+
+static void Bench_CPURun(BenchContext *Context, const char *Name)
+{
+    PS1 *Ps1 = &Context->Ps1;
+    double Instructions = 0;
+    double Start = Bench_Seconds(), Elapsed;
+    do {
+        Instructions += PS1_RunFrame(Ps1);
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report(Name, Instructions, "cycles", Elapsed);
+}
+
+static void Bench_CPU(BenchContext *Context)
+{
+    /* a loop storing a counter in RAM, from the reset vector */
+    static const u32 sLoop[] = {
+        0x3C088000,     /* lui t0, 0x8000 */
+        0x35081000,     /* ori t0, t0, 0x1000 */
+        0x24090000,     /* addiu t1, zero, 0 */
+        0xAD090000,     /* sw t1, 0(t0) */
+        0x8D0A0000,     /* lw t2, 0(t0) */
+        0x25290001,     /* addiu t1, t1, 1 */
+        0x0BF00003,     /* j 0xBFC0000C */
+        0x00000000,     /* nop */
+    };
+    PS1 *Ps1 = &Context->Ps1;
+    u8 SavedBios[sizeof sLoop];
+    memcpy(SavedBios, Ps1->Bios, sizeof sLoop);
+    memcpy(Ps1->Bios, sLoop, sizeof sLoop);
+
+    Bench_Reset(Context);
+    Bench_CPURun(Context, "no monitor");
+
+    /* the breakpoints and the watchpoint are on other pages, the loop never hits them */
+    Monitor Mon;
+    Monitor_Init(&Mon);
+    Monitor_AddBreakpoint(&Mon, 0x00010000);
+    Monitor_AddBreakpoint(&Mon, 0x1FC01000);
+    Monitor_AddWatchpoint(&Mon, Ps1->WatchedRamPages, 0x00008000, 256, MONITOR_WATCH_READ | MONITOR_WATCH_WRITE);
+    Bench_Reset(Context);
+    Ps1->Monitor = &Mon;
+    Bench_CPURun(Context, "monitor, nothing hit");
+
+    Ps1->Monitor = NULL;
+    memset(Ps1->WatchedRamPages, 0, sizeof Ps1->WatchedRamPages);
+    memcpy(Ps1->Bios, SavedBios, sizeof sLoop);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  DMA
+ *
+ *==================================================================================*/
+
+#define BENCH_DMA_OT_ENTRIES 0x4000
+#define BENCH_DMA_IMAGE_SIZE 256 /* halfwords, square */
+
+/* starts a transfer the way the CPU does, by writing the channel's control register, and finishes it right away */
+static void Bench_DMAStart(PS1 *Ps1, DMA_Port Port, u32 Addr, u32 BlockCtrl, u32 ChanelCtrl)
+{
+    DMA_Write32(&Ps1->Dma, Port*0x10 + 0, Addr);
+    DMA_Write32(&Ps1->Dma, Port*0x10 + 4, BlockCtrl);
+    DMA_Write32(&Ps1->Dma, Port*0x10 + 8, ChanelCtrl);
+    DMA_Update(&Ps1->Dma, Ps1->Dma.NextEventCycle);
+}
+
+static void Bench_DMA(BenchContext *Context)
+{
+    PS1 *Ps1 = &Context->Ps1;
+    GPU *Gpu = &Ps1->Gpu;
+    Bench_Reset(Context);
+
+    /* ordering table clear, from its last entry down */
+    double Bytes = 0;
+    double Start = Bench_Seconds(), Elapsed;
+    do {
+        Bench_DMAStart(Ps1, DMA_PORT_OTC, 0x100000 + (BENCH_DMA_OT_ENTRIES - 1)*sizeof(u32), 
+            BENCH_DMA_OT_ENTRIES, 0x11000000
+        );
+        Bytes += BENCH_DMA_OT_ENTRIES*sizeof(u32);
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("OTC clear", Bytes, "B", Elapsed);
+
+    /* image upload, RAM to GP0 in request mode, 16 word blocks */
+    u32 ImageWords = BENCH_DMA_IMAGE_SIZE*BENCH_DMA_IMAGE_SIZE / 2;
+    u32 ImageSize = (u32)BENCH_DMA_IMAGE_SIZE << 16 | BENCH_DMA_IMAGE_SIZE;
+    for (u32 i = 0; i < ImageWords; i++)
+    {
+        PS1_Ram_Write32(Ps1, 0x10000 + i*sizeof(u32), i * 0x00010001);
+    }
+    Bytes = 0;
+    Start = Bench_Seconds();
+    do {
+        GPU_WriteGP0(Gpu, 0xA0000000);
+        GPU_WriteGP0(Gpu, 0x00000000);
+        GPU_WriteGP0(Gpu, ImageSize);
+        Bench_DMAStart(Ps1, DMA_PORT_GPU, 0x10000, (ImageWords / 16) << 16 | 16, 0x01000201);
+        Bytes += ImageWords*sizeof(u32);
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("GPU, RAM to VRAM", Bytes, "B", Elapsed);
+
+    /* and back, GPUREAD to RAM */
+    Bytes = 0;
+    Start = Bench_Seconds();
+    do {
+        GPU_WriteGP0(Gpu, 0xC0000000);
+        GPU_WriteGP0(Gpu, 0x00000000);
+        GPU_WriteGP0(Gpu, ImageSize);
+        Bench_DMAStart(Ps1, DMA_PORT_GPU, 0x80000, (ImageWords / 16) << 16 | 16, 0x01000200);
+        Bytes += ImageWords*sizeof(u32);
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+    Bench_Report("GPU, VRAM to RAM", Bytes, "B", Elapsed);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Display
+ *
+ *==================================================================================*/
+
+static void Bench_DisplayRun(BenchContext *Context, const char *Name, Bool8 DrawEachFrame)
+{
+    GPU *Gpu = &Context->Ps1.Gpu;
+    Display_MemorySink *Memory = calloc(1, sizeof *Memory);
+    ASSERT(Memory != NULL);
+    Display_Sink Sink = Display_MemorySinkInterface(Memory);
+    Display_State State = { 0 };
+
+    double Frames = 0;
+    double Start = Bench_Seconds(), Elapsed;
+    do {
+        if (DrawEachFrame)
+        {
+            /* a small sprite-sized quad moving down the screen */
+            u32 Y = (u32)Frames % 448;
+            GPU_WriteGP0(Gpu, 0x28FFFFFF);
+            GPU_WriteGP0(Gpu, Y << 16 | 100);
+            GPU_WriteGP0(Gpu, Y << 16 | 132);
+            GPU_WriteGP0(Gpu, (Y + 32) << 16 | 100);
+            GPU_WriteGP0(Gpu, (Y + 32) << 16 | 132);
+        }
+        else
+        {
+            /* everything dirty, like without the tracking */
+            memset(Gpu->DirtyTiles, 0xFF, sizeof Gpu->DirtyTiles);
+        }
+        Display_Output(&State, Gpu, &Sink);
+        Frames++;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+
+    printf("    %-28s %12.2f frames/s, %.1f%% rows skipped\n", 
+        Name, Frames / Elapsed, 100.0 * Display_SkippedFraction(&State)
+    );
+    Display_MemorySinkDestroy(Memory);
+    free(Memory);
+}
+
+static void Bench_Display(BenchContext *Context)
+{
+    GPU *Gpu = &Context->Ps1.Gpu;
+    Bench_Reset(Context);
+    GPU_WriteGP1(Gpu, 0x03000000);                  /* display on */
+    GPU_WriteGP1(Gpu, 0x08000000 | 0x03 | 1 << 2 | 1 << 5);  /* 640x480i */
+    GPU_WriteGP1(Gpu, 0x07000000 | 0x10 | (0x10 + 240) << 12);
+    GPU_WriteGP0(Gpu, 0xE3000000);
+    GPU_WriteGP0(Gpu, 0xE4000000 | 511 << 10 | 1023);
+
+    Bench_DisplayRun(Context, "640x480 full conversion", false);
+    Bench_DisplayRun(Context, "640x480 32x32 quad per frame", true);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  XA-ADPCM
+ *
+ *==================================================================================*/
+
+static void Bench_XARun(const char *Name, u8 Coding)
+{
+    /* random sound data, with the filters and shifts in range */
+    static u8 Sector[CDROM_SECTOR_SIZE];
+    static i16 Frames[XA_MAX_SECTOR_FRAMES * 2];
+    static XA_Decoder Xa;
+    u32 Seed = 0x12345678;
+    for (uint i = 0; i < CDROM_SECTOR_SIZE; i++)
+    {
+        Seed = Seed*1103515245 + 12345;
+        Sector[i] = Seed >> 24;
+    }
+    for (uint i = 0; i < XA_GROUPS_PER_SECTOR; i++)
+    {
+        u8 *Group = Sector + 24 + i*XA_GROUP_SIZE;
+        for (uint k = 0; k < 16; k++)
+            Group[k] &= 0x3B;
+    }
+    Sector[19] = Coding;
+    XA_Reset(&Xa);
+
+    double Sectors = 0, FrameCount = 0;
+    double Start = Bench_Seconds(), Elapsed;
+    do {
+        for (uint i = 0; i < 64; i++)
+            FrameCount += XA_DecodeSector(&Xa, Sector, Frames);
+        Sectors += 64;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+
+    /* a double speed drive reads 150 sectors/s, far fewer of them are a stream's audio */
+    printf("    %-28s %12.0f sectors/s, %.0fx real time\n", 
+        Name, Sectors / Elapsed, FrameCount / Elapsed / XA_OUTPUT_RATE
+    );
+}
+
+static void Bench_XA(BenchContext *Context)
+{
+    (void)Context;
+    Bench_XARun("4 bit stereo 37.8 kHz", 0x01);
+    Bench_XARun("4 bit mono 37.8 kHz", 0x00);
+    Bench_XARun("4 bit stereo 18.9 kHz", 0x05);
+    Bench_XARun("8 bit stereo 37.8 kHz", 0x11);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  MDEC
+ *
+ *==================================================================================*/
+
+#define BENCH_MDEC_MACROBLOCKS (320 / 16 * 240 / 16)
+
+static void Bench_MDECRun(BenchContext *Context, const char *Name, const u32 *Input, u32 InputWords, u32 Depth)
+{
+    PS1 *Ps1 = &Context->Ps1;
+    u32 MacroblockWords = 3 == Depth? 128 : 192;
+    double Macroblocks = 0;
+    double Start = Bench_Seconds(), Elapsed;
+    do {
+        /* a 320x240 frame: the input through DMA 0, the whole picture back through DMA 1 */
+        MDEC_WriteCommand(&Ps1->Mdec, 0x20000000 | Depth << 27 | InputWords);
+        MDEC_WriteBlock(&Ps1->Mdec, Input, InputWords);
+        Bench_DMAStart(Ps1, DMA_PORT_MDEC_OUT, 0x100000, 
+            (BENCH_MDEC_MACROBLOCKS*MacroblockWords / 32) << 16 | 32, 0x01000200
+        );
+        Macroblocks += BENCH_MDEC_MACROBLOCKS;
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+
+    printf("    %-28s %12.0f macroblocks/s, %.0f frames/s\n", 
+        Name, Macroblocks / Elapsed, Macroblocks / BENCH_MDEC_MACROBLOCKS / Elapsed
+    );
+}
+
+static void Bench_MDEC(BenchContext *Context)
+{
+    PS1 *Ps1 = &Context->Ps1;
+    Bench_Reset(Context);
+    MDEC_WriteControl(&Ps1->Mdec, 0x60000000);
+
+    /* flat quantization, and the IDCT matrix every game uploads */
+    static const i16 sScaleTable[64] = {
+        0x5A82,  0x5A82,  0x5A82,  0x5A82,  0x5A82,  0x5A82,  0x5A82,  0x5A82,
+        0x7D8A,  0x6A6D,  0x471C,  0x18F8, -0x18F8, -0x471C, -0x6A6D, -0x7D8A,
+        0x7642,  0x30FB, -0x30FB, -0x7642, -0x7642, -0x30FB,  0x30FB,  0x7642,
+        0x6A6D, -0x18F8, -0x7D8A, -0x471C,  0x471C,  0x7D8A,  0x18F8, -0x6A6D,
+        0x5A82, -0x5A82, -0x5A82,  0x5A82,  0x5A82, -0x5A82, -0x5A82,  0x5A82,
+        0x471C, -0x7D8A,  0x18F8,  0x6A6D, -0x6A6D, -0x18F8,  0x7D8A, -0x471C,
+        0x30FB, -0x7642,  0x7642, -0x30FB, -0x30FB,  0x7642, -0x7642,  0x30FB,
+        0x18F8, -0x471C,  0x6A6D, -0x7D8A,  0x7D8A, -0x6A6D,  0x471C, -0x18F8,
+    };
+    MDEC_WriteCommand(&Ps1->Mdec, 0x40000001);
+    for (uint i = 0; i < 32; i++)
+        MDEC_WriteCommand(&Ps1->Mdec, 0x08080808);
+    MDEC_WriteCommand(&Ps1->Mdec, 0x60000000);
+    for (uint i = 0; i < 64; i += 2)
+        MDEC_WriteCommand(&Ps1->Mdec, (u16)sScaleTable[i] | (u32)(u16)sScaleTable[i + 1] << 16);
+
+    /* 6 blocks per macroblock, each a DC and 12 pseudo random AC coefficients, like a busy FMV frame */
+    u32 *Input = malloc(MDEC_MAX_PARAM_WORDS * sizeof(u32));
+    ASSERT(Input != NULL);
+    u16 *Codes = (u16 *)Input;
+    uint Count = 0;
+    u32 Seed = 1;
+    for (uint i = 0; i < BENCH_MDEC_MACROBLOCKS*6; i++)
+    {
+        Seed = Seed*1103515245 + 12345;
+        Codes[Count++] = 1 << 10 | ((Seed >> 16) & 0x1FF);
+        for (uint k = 0; k < 12; k++)
+        {
+            Seed = Seed*1103515245 + 12345;
+            Codes[Count++] = (u16)(((Seed >> 28) & 3) << 10 | ((((Seed >> 8) & 0x3F) - 32) & 0x3FF));
+        }
+        Codes[Count++] = 0xFE00;
+    }
+    if (Count % 2)
+        Codes[Count++] = 0xFE00;
+    u32 InputWords = Count / 2;
+
+    uint ThreadCount = Platform_CpuCount();
+    Bench_MDECRun(Context, "15 bit, 1 thread", Input, InputWords, 3);
+    Bench_MDECRun(Context, "24 bit, 1 thread", Input, InputWords, 2);
+    if (ThreadCount > 1 && MDEC_AttachWorkers(&Ps1->Mdec, ThreadCount))
+    {
+        char Name[64];
+        snprintf(Name, sizeof Name, "24 bit, %u threads", MDEC_GetThreadCount(&Ps1->Mdec));
+        Bench_MDECRun(Context, Name, Input, InputWords, 2);
+        MDEC_DetachWorkers(&Ps1->Mdec);
+    }
+    free(Input);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  SPU
+ *
+ *==================================================================================*/
+
+#define BENCH_SPU_BLOCKS 4096   /* ADPCM blocks of the looping sample, 64KB */
+
+/* 
+ * reverb registers (1F801DC0h..) like libspu's hall and room presets: 
+ * the hall's taps are far enough apart to do blocks a stage at a time, the room's aren't 
+ */
+typedef struct Bench_ReverbPreset
+{
+    u32 Size;   /* of the work area, in bytes */
+    u16 Regs[32];
+} Bench_ReverbPreset;
+
+static const Bench_ReverbPreset sBench_ReverbHall = {
+    0xADE0, {
+        0x01A5, 0x0139, 0x6000, 0x5000, 0x4C00, 0xB800, 0xBC00, 0xC000, 0x6000, 0x5C00, 0x15BA, 0x11BB, 0x14C2, 0x10BD, 0x11BC, 0x0DC1,
+        0x11C0, 0x0DC3, 0x0DC0, 0x09C1, 0x0BC4, 0x07C1, 0x0A00, 0x06CD, 0x09C2, 0x05C1, 0x05C0, 0x041A, 0x0274, 0x013A, 0x8000, 0x8000,
+    }
+};
+static const Bench_ReverbPreset sBench_ReverbRoom = {
+    0x26C0, {
+        0x007D, 0x005B, 0x6D80, 0x54B8, 0xBED0, 0x0000, 0x0000, 0xBA80, 0x5800, 0x5300, 0x04D6, 0x0333, 0x03F0, 0x0227, 0x0374, 0x01EF,
+        0x0334, 0x01B5, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x01B4, 0x0136, 0x00B8, 0x005C, 0x8000, 0x8000,
+    }
+};
+
+/* a sound RAM with one long looping sample of random ADPCM (every filter and shift), past the capture buffers */
+static void Bench_SPUReset(BenchContext *Context)
+{
+    static u8 Sample[BENCH_SPU_BLOCKS][16];
+    SPU *Spu = &Context->Ps1.Spu;
+    Bench_Reset(Context);
+    u32 Seed = 1;
+    for (uint i = 0; i < BENCH_SPU_BLOCKS; i++)
+    {
+        for (uint k = 0; k < 16; k++)
+        {
+            Seed = Seed*1103515245 + 12345;
+            Sample[i][k] = Seed >> 24;
+        }
+        Sample[i][0] &= 0x4F;
+        Sample[i][1] = 0 == i? 0x04 : BENCH_SPU_BLOCKS - 1 == i? 0x03 : 0;
+    }
+    SPU_Write16(Spu, 0x1AA, 0xC000 | 2 << 4);
+    SPU_Write16(Spu, 0x1A6, 0x1000 / 8);
+    SPU_WriteBlock(Spu, (const u32 *)Sample, sizeof Sample / sizeof(u32));
+    SPU_Write16(Spu, 0x1AA, 0xC000);
+    SPU_Write16(Spu, 0x180, 0x3FFF);
+    SPU_Write16(Spu, 0x182, 0x3FFF);
+}
+
+/* Reverb: every voice goes through it, NULL for none */
+static void Bench_SPUSetup(BenchContext *Context, uint VoiceCount, Bool8 Varied, const Bench_ReverbPreset *Reverb)
+{
+    SPU *Spu = &Context->Ps1.Spu;
+    Bench_SPUReset(Context);
+    for (uint v = 0; v < VoiceCount; v++)
+    {
+        u32 Reg = v*0x10;
+        /* the varied ones sweep their left volume, have pitches all over and every other one modulated */
+        SPU_Write16(Spu, Reg + 0x0, Varied? 0x8000 | 0x10 | v : 0x1000);
+        SPU_Write16(Spu, Reg + 0x2, 0x1000);
+        SPU_Write16(Spu, Reg + 0x4, Varied? 0x400 + v*0x2A0 : 0x1000);
+        SPU_Write16(Spu, Reg + 0x6, 0x1000 / 8);
+        SPU_Write16(Spu, Reg + 0x8, 0x0F0F);
+        SPU_Write16(Spu, Reg + 0xA, 0x1FC0);
+    }
+    SPU_Write16(Spu, 0x190, Varied? 0xAAAA : 0);
+    SPU_Write16(Spu, 0x192, Varied? 0x00AA : 0);
+    if (Reverb)
+    {
+        SPU_Write16(Spu, 0x184, 0x3000);
+        SPU_Write16(Spu, 0x186, 0x3000);
+        SPU_Write16(Spu, 0x198, (u16)((1u << VoiceCount) - 1));
+        SPU_Write16(Spu, 0x19A, (u16)(((1u << VoiceCount) - 1) >> 16));
+        SPU_Write16(Spu, 0x1A2, (u16)((SPU_RAM_SIZE - Reverb->Size) / 8));
+        for (uint i = 0; i < 32; i++)
+            SPU_Write16(Spu, 0x1C0 + i*2, Reverb->Regs[i]);
+        SPU_Write16(Spu, 0x1AA, 0xC000 | 0x80);
+    }
+    SPU_Write16(Spu, 0x188, (u16)((1u << VoiceCount) - 1));
+    SPU_Write16(Spu, 0x18A, (u16)(((1u << VoiceCount) - 1) >> 16));
+}
+
+static void Bench_SPURun(BenchContext *Context, const char *Name, uint VoiceCount, Bool8 Varied, const Bench_ReverbPreset *Reverb)
+{
+    PS1 *Ps1 = &Context->Ps1;
+    SPU *Spu = &Ps1->Spu;
+    Bench_SPUSetup(Context, VoiceCount, Varied, Reverb);
+
+    static i16 Frames[SPU_OUTPUT_FRAMES * 2];
+    u64 ReverbBlocks = Spu->ReverbBlocks;
+    u64 ReverbTicks = Spu->ReverbTicks;
+    double FrameCount = 0;
+    double Start = Bench_Seconds(), Elapsed;
+    do {
+        /* a 60 Hz video frame of audio at a time, like the run loop */
+        Ps1->Gpu.Cycle += PS1_CPU_CLOCK / 60;
+        SPU_Update(Spu, Ps1->Gpu.Cycle);
+        FrameCount += SPU_ReadAudio(Spu, Frames, SPU_OUTPUT_FRAMES);
+        Elapsed = Bench_Seconds() - Start;
+    } while (Elapsed < BENCH_MIN_SECONDS);
+
+    double Seconds = FrameCount / SPU_SAMPLE_RATE;
+    printf("    %-28s %12.0f voice seconds/s, %.0fx real time", 
+        Name, Seconds*VoiceCount / Elapsed, Seconds / Elapsed
+    );
+    ReverbBlocks = Spu->ReverbBlocks - ReverbBlocks;
+    if (ReverbBlocks)
+    {
+        /* the same counters main logs at exit */
+        printf(", reverb %.2f us per block%s", 
+            (double)(Spu->ReverbTicks - ReverbTicks) * 1e6 / (double)Platform_TicksPerSecond() / (double)ReverbBlocks,
+            Spu->Reverb.Overlaps? " (a step at a time)" : ""
+        );
+    }
+    printf("\n");
+}
+
+#define BENCH_SPU_CHECK_FRAMES 120  /* 2 seconds */
+
+/* 
+ * mixes BENCH_SPU_CHECK_FRAMES video frames of audio into Out, 
+ * a step at a time through sound RAM (SPU_ReverbStep) instead of a stage at a time when Steps is set
+ */
+static void Bench_SPUMix(BenchContext *Context, const Bench_ReverbPreset *Reverb, Bool8 Steps, i16 *Out, uint *OutFrameCount)
+{
+    PS1 *Ps1 = &Context->Ps1;
+    SPU *Spu = &Ps1->Spu;
+    Bench_SPUSetup(Context, 24, true, Reverb);
+    if (Steps)
+        Spu->Reverb.Overlaps = true;
+    uint Count = 0;
+    for (uint i = 0; i < BENCH_SPU_CHECK_FRAMES; i++)
+    {
+        Ps1->Gpu.Cycle += PS1_CPU_CLOCK / 60;
+        SPU_Update(Spu, Ps1->Gpu.Cycle);
+        Count += SPU_ReadAudio(Spu, Out + Count*2, SPU_OUTPUT_FRAMES);
+    }
+    *OutFrameCount = Count;
+}
+
+/* the stage at a time reverb has to come out the same as the reference, a step at a time, samples and work area */
+static void Bench_SPUCheckReverb(BenchContext *Context, const char *Name, const Bench_ReverbPreset *Reverb)
+{
+    static i16 Stages[BENCH_SPU_CHECK_FRAMES * SPU_OUTPUT_FRAMES * 2];
+    static i16 Steps[BENCH_SPU_CHECK_FRAMES * SPU_OUTPUT_FRAMES * 2];
+    static u8 StagesRam[SPU_RAM_SIZE];
+    SPU *Spu = &Context->Ps1.Spu;
+    uint StageCount, StepCount;
+
+    u64 SerialBlocks = Spu->ReverbSerialBlocks;
+    Bench_SPUMix(Context, Reverb, false, Stages, &StageCount);
+    Bool8 Staged = Spu->ReverbSerialBlocks == SerialBlocks;
+    memcpy(StagesRam, Spu->Ram, SPU_RAM_SIZE);
+    Bench_SPUMix(Context, Reverb, true, Steps, &StepCount);
+
+    uint Frame = 0;
+    while (Frame < MIN(StageCount, StepCount) && 0 == memcmp(&Stages[Frame*2], &Steps[Frame*2], 2*sizeof(i16)))
+        Frame++;
+    Bool8 SameRam = 0 == memcmp(StagesRam, Spu->Ram, SPU_RAM_SIZE);
+    if (!Staged)
+    {
+        printf("    %-28s FAILED: the reverb didn't run a stage at a time\n", Name);
+        Context->Failed = true;
+    }
+    else if (StageCount != StepCount || Frame != StageCount || !SameRam)
+    {
+        printf("    %-28s FAILED: the output differs from frame %u (of %u), work area %s\n",
+            Name, Frame, StageCount, SameRam? "identical" : "differs"
+        );
+        Context->Failed = true;
+    }
+    else printf("    %-28s %12u frames identical, stages vs steps\n", Name, StageCount);
+}
+
+static void Bench_SPU(BenchContext *Context)
+{
+    Bench_SPUCheckReverb(Context, "hall reverb, checked", &sBench_ReverbHall);
+    Bench_SPURun(Context, "24 voices, pitch 1.0", 24, false, NULL);
+    Bench_SPURun(Context, "24 voices, varied", 24, true, NULL);
+    Bench_SPURun(Context, "8 voices, pitch 1.0", 8, false, NULL);
+    Bench_SPURun(Context, "24 voices, hall reverb", 24, false, &sBench_ReverbHall);
+    Bench_SPURun(Context, "24 voices, room reverb", 24, false, &sBench_ReverbRoom);
+}
+
+
+
+static const struct {
+    const char *Name;
+    BenchFn Fn;
+} sBenchmarks[] = {
+    { "gp0", Bench_GP0 },
+    { "display", Bench_Display },
+    { "blit", Bench_Blit },
+    { "lines", Bench_Lines },
+    { "upscale", Bench_Upscale },
+    { "cpu", Bench_CPU },
+    { "dma", Bench_DMA },
+    { "xa", Bench_XA },
+    { "mdec", Bench_MDEC },
+    { "spu", Bench_SPU },
+};
+
+int main(int argc, char **argv)
+{
+    BenchContext *Context = calloc(1, sizeof *Context);
+    ASSERT(Context != NULL);
+    Context->Ps1.Bios = calloc(1, PS1_BIOS_SIZE + PS1_RAM_SIZE + GPU_VRAM_SIZE);
+    ASSERT(Context->Ps1.Bios != NULL);
+    Context->Ps1.Ram = Context->Ps1.Bios + PS1_BIOS_SIZE;
+    Context->Ps1.Gpu.Vram = (u16 *)(Context->Ps1.Ram + PS1_RAM_SIZE);
+
+    for (uint i = 0; i < STATIC_ARRAY_SIZE(sBenchmarks); i++)
+    {
+        Bool8 Selected = argc < 2;
+        for (int k = 1; k < argc && !Selected; k++)
+            Selected = 0 == strcmp(argv[k], sBenchmarks[i].Name);
+        if (!Selected)
+            continue;
+
+        printf("%s:\n", sBenchmarks[i].Name);
+        sBenchmarks[i].Fn(Context);
+    }
+    return Context->Failed? 1 : 0;
+}
+
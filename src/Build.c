@@ -1,13 +1,51 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+/* Platform.c needs POSIX declarations, they have to be asked for before the first system header */
+#  define _POSIX_C_SOURCE 200809L
+#endif
 
 #include "Common.h"
 #include "CPU.h"
 #include "DMA.h"
 #include "Ps1.h"
 #include "Disassembler.h"
+#include "Rasterizer.h"
+#include "Display.h"
+#include "Platform.h"
+#include "Disc.h"
+#include "XA.h"
+#include "CDROM.h"
+#include "MDEC.h"
+#include "SPU.h"
+#include "Audio.h"
+#include "FrameDump.h"
+#include "Capture.h"
+#include "TripleBuffer.h"
+#include "DebugSnapshot.h"
+#include "Monitor.h"
+#include "GdbStub.h"
 
 #include "CPU.c"
 #include "Disassembler.c"
 #include "DMA.c"
+#include "Rasterizer.c"
+#include "Display.c"
+#include "Platform.c"
+#include "Disc.c"
+#include "XA.c"
+#include "CDROM.c"
+#include "MDEC.c"
+#include "SPU.c"
+#include "Audio.c"
+#include "FrameDump.c"
+#include "Capture.c"
+#include "TripleBuffer.c"
+#include "DebugSnapshot.c"
+#include "Monitor.c"
+#include "GdbStub.c"
+#ifndef PS1_NO_FRONTEND
+#  include "Frontend.c"
+#  include "Debugger.c"
+#endif /* PS1_NO_FRONTEND */
 
 #include "main.c"
 
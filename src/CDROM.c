@@ -0,0 +1,634 @@
+
+#include <string.h> /* memcpy, memset */
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Disc.h"
+#include "CDROM.h"
+
+
+/* rough timings, in CPU cycles */
+#define CDROM_ACK_CYCLES 25000                      /* first response of most commands, ~0.75ms */
+#define CDROM_INIT_ACK_CYCLES 80000
+#define CDROM_GETID_CYCLES 33000                    /* second response after the first one */
+#define CDROM_PAUSE_CYCLES 7000                     /* when the drive wasn't reading */
+#define CDROM_STOP_CYCLES (PS1_CPU_CLOCK / 10)      /* spinning the motor down */
+#define CDROM_TOC_CYCLES (PS1_CPU_CLOCK / 2)
+#define CDROM_SEEK_BASE_CYCLES 20000
+#define CDROM_SEEK_CYCLES_PER_SECTOR 100            /* across the whole disc in about a second */
+#define CDROM_SECTOR_CYCLES (PS1_CPU_CLOCK / 75)    /* single speed */
+#define CDROM_SECTOR_RETRY_CYCLES (CDROM_SECTOR_CYCLES / 16)
+
+/* Stat bits */
+#define CDROM_STAT_ERROR 0x01
+#define CDROM_STAT_MOTOR 0x02
+#define CDROM_STAT_ID_ERROR 0x08
+#define CDROM_STAT_READING 0x20
+#define CDROM_STAT_SEEKING 0x40
+
+/* Mode bits */
+#define CDROM_MODE_DOUBLE_SPEED 0x80
+#define CDROM_MODE_XA_ADPCM 0x40
+#define CDROM_MODE_WHOLE_SECTOR 0x20                /* 2340 bytes (all but the sync pattern) instead of 2048 */
+#define CDROM_MODE_XA_FILTER 0x08
+
+/* subheader */
+#define CDROM_SUBMODE_AUDIO 0x04
+
+/* second byte of INT5 responses */
+#define CDROM_ERROR_INVALID_PARAM 0x10
+#define CDROM_ERROR_PARAM_COUNT 0x20
+#define CDROM_ERROR_INVALID_COMMAND 0x40
+#define CDROM_ERROR_NOT_READY 0x80
+
+
+
+static u8 CDROM_FromBCD(u8 Value)
+{
+    return (Value >> 4)*10 + (Value & 0xF);
+}
+
+static u8 CDROM_ToBCD(uint Value)
+{
+    return (u8)((Value / 10) << 4 | (Value % 10));
+}
+
+static Bool8 CDROM_IsBCD(u8 Value)
+{
+    return (Value & 0xF) < 10 && (Value >> 4) < 10;
+}
+
+static u64 CDROM_Now(const CDROM *Cdrom)
+{
+    return Cdrom->Bus->Gpu.Cycle;
+}
+
+static u32 CDROM_SectorCycles(const CDROM *Cdrom)
+{
+    return Cdrom->Mode & CDROM_MODE_DOUBLE_SPEED
+        ? CDROM_SECTOR_CYCLES / 2
+        : CDROM_SECTOR_CYCLES;
+}
+
+static void CDROM_SetResponse(CDROM_Response *Response, u64 Cycle, CDROM_Int Int, const u8 *Bytes, uint Size)
+{
+    ASSERT(Size <= CDROM_FIFO_SIZE);
+    Response->Cycle = Cycle;
+    Response->Int = Int;
+    Response->Size = (u8)Size;
+    memcpy(Response->Bytes, Bytes, Size);
+}
+
+static void CDROM_Acknowledge(CDROM *Cdrom, CDROM_Int Int, const u8 *Bytes, uint Size)
+{
+    CDROM_SetResponse(&Cdrom->Ack, CDROM_Now(Cdrom) + CDROM_ACK_CYCLES, Int, Bytes, Size);
+}
+
+static void CDROM_AcknowledgeStat(CDROM *Cdrom)
+{
+    CDROM_Acknowledge(Cdrom, CDROM_INT3_ACKNOWLEDGE, &Cdrom->Stat, 1);
+}
+
+static void CDROM_Error(CDROM *Cdrom, u8 Error)
+{
+    u8 Bytes[] = { Cdrom->Stat | CDROM_STAT_ERROR, Error };
+    CDROM_Acknowledge(Cdrom, CDROM_INT5_ERROR, Bytes, sizeof Bytes);
+}
+
+/* the second response, Cycles after the first one */
+static void CDROM_Complete(CDROM *Cdrom, u64 Cycles, CDROM_Int Int, const u8 *Bytes, uint Size)
+{
+    CDROM_SetResponse(&Cdrom->Complete, Cdrom->Ack.Cycle + Cycles, Int, Bytes, Size);
+}
+
+static void CDROM_CompleteStat(CDROM *Cdrom, u64 Cycles)
+{
+    CDROM_Complete(Cdrom, Cycles, CDROM_INT2_COMPLETE, &Cdrom->Stat, 1);
+}
+
+static void CDROM_Schedule(CDROM *Cdrom)
+{
+    u64 Next = ~(u64)0;
+    if (Cdrom->Reading)
+        Next = Cdrom->SectorCycle;
+    /* responses wait for the CPU to acknowledge the interrupt that's up */
+    if (0 == Cdrom->IntFlags)
+    {
+        const CDROM_Response *Pending[] = { &Cdrom->Ack, &Cdrom->Complete, &Cdrom->DataReady };
+        for (uint i = 0; i < STATIC_ARRAY_SIZE(Pending); i++)
+        {
+            if (Pending[i]->Int)
+                Next = MIN(Next, Pending[i]->Cycle);
+        }
+    }
+    Cdrom->NextEventCycle = Next;
+    PS1_ScheduleEvent(Cdrom->Bus, Next);
+}
+
+static void CDROM_Raise(CDROM *Cdrom, CDROM_Response *Response)
+{
+    memcpy(Cdrom->Response, Response->Bytes, Response->Size);
+    Cdrom->ResponseSize = Response->Size;
+    Cdrom->ResponseRead = 0;
+    Cdrom->IntFlags = Response->Int;
+    Response->Int = CDROM_INT_NONE;
+    /* TODO: when IntFlags & IntEnable, this is interrupt 2 (I_STAT bit 2), there's no interrupt controller yet */
+}
+
+static u64 CDROM_SeekCycles(const CDROM *Cdrom, u32 Target)
+{
+    u32 Distance = Target > Cdrom->Position
+        ? Target - Cdrom->Position
+        : Cdrom->Position - Target;
+    return CDROM_SEEK_BASE_CYCLES + MIN((u64)Distance * CDROM_SEEK_CYCLES_PER_SECTOR, PS1_CPU_CLOCK);
+}
+
+/* to Setloc's target if there's one, returns how long it takes */
+static u64 CDROM_Seek(CDROM *Cdrom)
+{
+    u64 Cycles = 0;
+    if (Cdrom->SetlocPending)
+    {
+        Cycles = CDROM_SeekCycles(Cdrom, Cdrom->SetlocLBA);
+        Cdrom->Position = Cdrom->SetlocLBA;
+        Cdrom->SetlocPending = false;
+        XA_Reset(&Cdrom->Xa);
+    }
+    if (Cdrom->Disc)
+        Disc_Prefetch(Cdrom->Disc, Cdrom->Position);
+    return Cycles;
+}
+
+static void CDROM_StopReading(CDROM *Cdrom)
+{
+    Cdrom->Reading = false;
+    Cdrom->DataReady.Int = CDROM_INT_NONE;
+    Cdrom->Stat &= ~(CDROM_STAT_READING | CDROM_STAT_SEEKING);
+}
+
+static void CDROM_PushAudio(CDROM *Cdrom, const i16 *Frames, uint FrameCount)
+{
+    uint Free = CDROM_AUDIO_FRAMES - (Cdrom->AudioWrite - Cdrom->AudioRead);
+    uint Count = MIN(FrameCount, Free);
+    for (uint i = 0; i < Count; i++)
+    {
+        i16 *Frame = Cdrom->AudioFrames[(Cdrom->AudioWrite + i) % CDROM_AUDIO_FRAMES];
+        Frame[0] = Frames[i*2 + 0];
+        Frame[1] = Frames[i*2 + 1];
+    }
+    Cdrom->AudioWrite += Count;
+    Cdrom->AudioFramesDropped += FrameCount - Count;
+}
+
+/* an XA audio sector goes to the decoder instead of the CPU */
+static Bool8 CDROM_IsXASector(const CDROM *Cdrom)
+{
+    const u8 *SubHeader = Cdrom->Sector + 16;
+    return (Cdrom->Mode & CDROM_MODE_XA_ADPCM) && (SubHeader[2] & CDROM_SUBMODE_AUDIO);
+}
+
+/* the sectors of the other channels of an interleaved stream are skipped */
+static void CDROM_DecodeXASector(CDROM *Cdrom)
+{
+    const u8 *SubHeader = Cdrom->Sector + 16;
+    if ((Cdrom->Mode & CDROM_MODE_XA_FILTER)
+    && (SubHeader[0] != Cdrom->FilterFile || SubHeader[1] != Cdrom->FilterChanel))
+        return;
+
+    uint FrameCount = XA_DecodeSector(&Cdrom->Xa, Cdrom->Sector, Cdrom->XAFrames);
+    CDROM_PushAudio(Cdrom, Cdrom->XAFrames, FrameCount);
+    Cdrom->XASectors++;
+}
+
+static void CDROM_ReadSector(CDROM *Cdrom, u64 Cycle)
+{
+    Disc_SectorStatus Status = Disc_ReadSector(Cdrom->Disc, Cdrom->Position, Cdrom->Sector);
+    switch (Status)
+    {
+    case DISC_SECTOR_READY:
+    {
+        Cdrom->Position++;
+        Cdrom->SectorsRead++;
+        Cdrom->SectorCycle += CDROM_SectorCycles(Cdrom);
+        if (CDROM_IsXASector(Cdrom))
+        {
+            CDROM_DecodeXASector(Cdrom);
+            break;
+        }
+        /* the next sector replaces this one if the CPU is too slow to take it */
+        CDROM_SetResponse(&Cdrom->DataReady, Cycle, CDROM_INT1_DATA_READY, &Cdrom->Stat, 1);
+    } break;
+    case DISC_SECTOR_PENDING:
+    {
+        Cdrom->SectorWaits++;
+        Cdrom->SectorCycle = Cycle + CDROM_SECTOR_RETRY_CYCLES;
+    } break;
+    case DISC_SECTOR_OUT_OF_RANGE:
+    {
+        CDROM_StopReading(Cdrom);
+        CDROM_SetResponse(&Cdrom->DataReady, Cycle, CDROM_INT4_DATA_END, &Cdrom->Stat, 1);
+    } break;
+    }
+}
+
+static void CDROM_LoadDataFifo(CDROM *Cdrom)
+{
+    if (Cdrom->Mode & CDROM_MODE_WHOLE_SECTOR)
+    {
+        Cdrom->DataSize = 2340;
+        memcpy(Cdrom->Data, Cdrom->Sector + 12, Cdrom->DataSize);
+    }
+    else /* mode 2 form 1 user data, after the sync pattern, the header and the subheader */
+    {
+        Cdrom->DataSize = 2048;
+        memcpy(Cdrom->Data, Cdrom->Sector + 24, Cdrom->DataSize);
+    }
+    Cdrom->DataRead = 0;
+}
+
+static void CDROM_GetlocP(CDROM *Cdrom)
+{
+    u32 LBA = Cdrom->Position;
+    const Disc_Track *Track = Cdrom->Disc? Disc_FindTrack(Cdrom->Disc, LBA) : NULL;
+    uint Number = Track? Track->Number : 1;
+    Bool8 InPregap = Track && LBA < Track->Start;
+    u32 Relative = !Track? 0
+        : InPregap? Track->Start - LBA
+        : LBA - Track->Start;
+    u32 Absolute = LBA + DISC_PREGAP_SECTORS;
+
+    u8 Bytes[] = {
+        CDROM_ToBCD(Number), InPregap? 0 : 1,
+        CDROM_ToBCD(Relative / 75 / 60), CDROM_ToBCD(Relative / 75 % 60), CDROM_ToBCD(Relative % 75),
+        CDROM_ToBCD(Absolute / 75 / 60), CDROM_ToBCD(Absolute / 75 % 60), CDROM_ToBCD(Absolute % 75),
+    };
+    CDROM_Acknowledge(Cdrom, CDROM_INT3_ACKNOWLEDGE, Bytes, sizeof Bytes);
+}
+
+static void CDROM_GetTD(CDROM *Cdrom)
+{
+    const Disc *Disc = Cdrom->Disc;
+    u8 Number = CDROM_FromBCD(Cdrom->Params[0]);
+    u32 LBA = Disc->SectorCount; /* track 0 is the lead-out */
+    if (Number)
+    {
+        uint i = 0;
+        while (i < Disc->TrackCount && Disc->Tracks[i].Number != Number)
+            i++;
+        if (i == Disc->TrackCount)
+        {
+            CDROM_Error(Cdrom, CDROM_ERROR_INVALID_PARAM);
+            return;
+        }
+        LBA = Disc->Tracks[i].Start;
+    }
+
+    u32 Absolute = LBA + DISC_PREGAP_SECTORS;
+    u8 Bytes[] = { Cdrom->Stat, CDROM_ToBCD(Absolute / 75 / 60), CDROM_ToBCD(Absolute / 75 % 60) };
+    CDROM_Acknowledge(Cdrom, CDROM_INT3_ACKNOWLEDGE, Bytes, sizeof Bytes);
+}
+
+static void CDROM_Command(CDROM *Cdrom, u8 Command)
+{
+    /* parameters each command takes, the others take none */
+    uint ParamCount = Cdrom->ParamCount;
+    Cdrom->ParamCount = 0;
+    uint Expected = 0;
+    switch (Command)
+    {
+    case 0x02: Expected = 3; break; /* Setloc */
+    case 0x0D: Expected = 2; break; /* Setfilter */
+    case 0x0E: Expected = 1; break; /* Setmode */
+    case 0x14: Expected = 1; break; /* GetTD */
+    case 0x19: Expected = 1; break; /* Test */
+    }
+    Cdrom->CommandBusy = true;
+    Cdrom->Complete.Int = CDROM_INT_NONE;
+    if (ParamCount != Expected && 0x19 != Command) /* some Test functions take more */
+    {
+        CDROM_Error(Cdrom, CDROM_ERROR_PARAM_COUNT);
+        return;
+    }
+
+    /* commands that need a disc */
+    switch (Command)
+    {
+    case 0x06: case 0x1B: case 0x15: case 0x16:
+    case 0x10: case 0x13: case 0x14: case 0x1E:
+    {
+        if (NULL == Cdrom->Disc)
+        {
+            CDROM_Error(Cdrom, CDROM_ERROR_NOT_READY);
+            return;
+        }
+    } break;
+    }
+
+    switch (Command)
+    {
+    case 0x01: /* GetStat */
+    {
+        CDROM_AcknowledgeStat(Cdrom);
+    } break;
+    case 0x02: /* Setloc amm, ass, asect */
+    {
+        u8 *P = Cdrom->Params;
+        if (!CDROM_IsBCD(P[0]) || !CDROM_IsBCD(P[1]) || !CDROM_IsBCD(P[2])
+        || CDROM_FromBCD(P[1]) >= 60 || CDROM_FromBCD(P[2]) >= 75)
+        {
+            CDROM_Error(Cdrom, CDROM_ERROR_INVALID_PARAM);
+            break;
+        }
+        u32 Sectors = (CDROM_FromBCD(P[0])*60 + CDROM_FromBCD(P[1]))*75 + CDROM_FromBCD(P[2]);
+        Cdrom->SetlocLBA = Sectors - DISC_PREGAP_SECTORS; /* the first 2 seconds wrap around, past the end of any disc */
+        Cdrom->SetlocPending = true;
+        CDROM_AcknowledgeStat(Cdrom);
+    } break;
+    case 0x06: /* ReadN */
+    case 0x1B: /* ReadS */
+    {
+        /* reading on from where it is, unless there's a new Setloc */
+        if (!Cdrom->Reading || Cdrom->SetlocPending)
+        {
+            Cdrom->SectorCycle = CDROM_Now(Cdrom) + CDROM_Seek(Cdrom) + CDROM_SectorCycles(Cdrom);
+            Cdrom->Reading = true;
+        }
+        Cdrom->Stat |= CDROM_STAT_MOTOR | CDROM_STAT_READING;
+        CDROM_AcknowledgeStat(Cdrom);
+    } break;
+    case 0x07: /* Standby */
+    {
+        CDROM_AcknowledgeStat(Cdrom);
+        Cdrom->Stat |= CDROM_STAT_MOTOR;
+        CDROM_CompleteStat(Cdrom, CDROM_GETID_CYCLES);
+    } break;
+    case 0x08: /* Stop */
+    {
+        u64 Cycles = Cdrom->Stat & CDROM_STAT_MOTOR? CDROM_STOP_CYCLES : CDROM_PAUSE_CYCLES;
+        CDROM_StopReading(Cdrom);
+        CDROM_AcknowledgeStat(Cdrom);
+        Cdrom->Stat &= ~CDROM_STAT_MOTOR;
+        CDROM_CompleteStat(Cdrom, Cycles);
+    } break;
+    case 0x09: /* Pause */
+    {
+        u64 Cycles = Cdrom->Reading? CDROM_SectorCycles(Cdrom) : CDROM_PAUSE_CYCLES;
+        CDROM_AcknowledgeStat(Cdrom);
+        CDROM_StopReading(Cdrom);
+        CDROM_CompleteStat(Cdrom, Cycles);
+    } break;
+    case 0x0A: /* Init */
+    {
+        CDROM_StopReading(Cdrom);
+        Cdrom->Mode = 0;
+        Cdrom->Stat = Cdrom->Disc? CDROM_STAT_MOTOR : 0;
+        CDROM_SetResponse(&Cdrom->Ack, CDROM_Now(Cdrom) + CDROM_INIT_ACK_CYCLES, CDROM_INT3_ACKNOWLEDGE, &Cdrom->Stat, 1);
+        CDROM_CompleteStat(Cdrom, CDROM_GETID_CYCLES);
+    } break;
+    case 0x0B: /* Mute */
+    case 0x0C: /* Demute */
+    {
+        Cdrom->Muted = 0x0B == Command;
+        CDROM_AcknowledgeStat(Cdrom);
+    } break;
+    case 0x0D: /* Setfilter file, channel */
+    {
+        Cdrom->FilterFile = Cdrom->Params[0];
+        Cdrom->FilterChanel = Cdrom->Params[1];
+        CDROM_AcknowledgeStat(Cdrom);
+    } break;
+    case 0x0E: /* Setmode */
+    {
+        Cdrom->Mode = Cdrom->Params[0];
+        CDROM_AcknowledgeStat(Cdrom);
+    } break;
+    case 0x10: /* GetlocL: the header and subheader of the last sector read */
+    {
+        CDROM_Acknowledge(Cdrom, CDROM_INT3_ACKNOWLEDGE, Cdrom->Sector + 12, 8);
+    } break;
+    case 0x11: /* GetlocP */
+    {
+        CDROM_GetlocP(Cdrom);
+    } break;
+    case 0x13: /* GetTN */
+    {
+        const Disc *Disc = Cdrom->Disc;
+        u8 Bytes[] = {
+            Cdrom->Stat,
+            CDROM_ToBCD(Disc->Tracks[0].Number),
+            CDROM_ToBCD(Disc->Tracks[Disc->TrackCount - 1].Number),
+        };
+        CDROM_Acknowledge(Cdrom, CDROM_INT3_ACKNOWLEDGE, Bytes, sizeof Bytes);
+    } break;
+    case 0x14: /* GetTD track */
+    {
+        CDROM_GetTD(Cdrom);
+    } break;
+    case 0x15: /* SeekL */
+    case 0x16: /* SeekP */
+    {
+        CDROM_StopReading(Cdrom);
+        Cdrom->Stat |= CDROM_STAT_MOTOR;
+        CDROM_AcknowledgeStat(Cdrom);
+        CDROM_CompleteStat(Cdrom, CDROM_Seek(Cdrom));
+    } break;
+    case 0x19: /* Test */
+    {
+        if (0x20 == Cdrom->Params[0] && 1 == ParamCount) /* controller version: PU-7, 19 Sep 1994 */
+        {
+            static const u8 sVersion[] = { 0x94, 0x09, 0x19, 0xC0 };
+            CDROM_Acknowledge(Cdrom, CDROM_INT3_ACKNOWLEDGE, sVersion, sizeof sVersion);
+        }
+        else
+        {
+            LOG("CD-ROM: Test %02x is not supported\n", Cdrom->Params[0]);
+            CDROM_Error(Cdrom, CDROM_ERROR_INVALID_PARAM);
+        }
+    } break;
+    case 0x1A: /* GetID */
+    {
+        CDROM_AcknowledgeStat(Cdrom);
+        if (Cdrom->Disc)
+        {
+            /* a licensed data disc */
+            const char *Region = Cdrom->Disc->Region;
+            u8 Bytes[] = { Cdrom->Stat, 0x00, 0x20, 0x00, Region[0], Region[1], Region[2], Region[3] };
+            CDROM_Complete(Cdrom, CDROM_GETID_CYCLES, CDROM_INT2_COMPLETE, Bytes, sizeof Bytes);
+        }
+        else
+        {
+            u8 Bytes[] = { CDROM_STAT_ID_ERROR, 0x40, 0, 0, 0, 0, 0, 0 };
+            CDROM_Complete(Cdrom, CDROM_GETID_CYCLES, CDROM_INT5_ERROR, Bytes, sizeof Bytes);
+        }
+    } break;
+    case 0x1E: /* ReadTOC */
+    {
+        CDROM_AcknowledgeStat(Cdrom);
+        CDROM_CompleteStat(Cdrom, CDROM_TOC_CYCLES);
+    } break;
+    default: /* Play, Forward, Backward, SetSession, GetQ... */
+    {
+        LOG("CD-ROM: command %02x is not supported\n", Command);
+        CDROM_Error(Cdrom, CDROM_ERROR_INVALID_COMMAND);
+    } break;
+    }
+}
+
+
+
+void CDROM_Reset(CDROM *Cdrom, PS1 *Bus)
+{
+    *Cdrom = (CDROM) {
+        .Bus = Bus,
+        .Disc = Cdrom->Disc,
+        .Stat = Cdrom->Disc? CDROM_STAT_MOTOR : 0,
+        .NextEventCycle = ~(u64)0,
+        .PendingVolume = { 0x80, 0, 0x80, 0 },
+        .Volume = { 0x80, 0, 0x80, 0 },
+        .SectorsRead = Cdrom->SectorsRead,
+        .SectorWaits = Cdrom->SectorWaits,
+        .XASectors = Cdrom->XASectors,
+        .AudioFramesDropped = Cdrom->AudioFramesDropped,
+    };
+    XA_Reset(&Cdrom->Xa);
+}
+
+u8 CDROM_Read8(CDROM *Cdrom, u32 Offset)
+{
+    switch (Offset)
+    {
+    case 0: /* HSTS */
+    {
+        return Cdrom->Index
+            | (Cdrom->ParamCount == 0) << 3
+            | (Cdrom->ParamCount < CDROM_FIFO_SIZE) << 4
+            | (Cdrom->ResponseRead < Cdrom->ResponseSize) << 5
+            | (Cdrom->DataRead < Cdrom->DataSize) << 6
+            | Cdrom->CommandBusy << 7;
+    } break;
+    case 1: /* response FIFO */
+    {
+        if (Cdrom->ResponseRead < Cdrom->ResponseSize)
+            return Cdrom->Response[Cdrom->ResponseRead++];
+        return 0;
+    } break;
+    case 2: /* data FIFO */
+    {
+        if (Cdrom->DataRead < Cdrom->DataSize)
+            return Cdrom->Data[Cdrom->DataRead++];
+        return 0;
+    } break;
+    case 3: /* HINTMSK, HINTSTS */
+    {
+        /* the unused bits read as 1 */
+        return Cdrom->Index & 1
+            ? Cdrom->IntFlags | 0xE0
+            : Cdrom->IntEnable | 0xE0;
+    } break;
+    }
+    return 0;
+}
+
+void CDROM_Write8(CDROM *Cdrom, u32 Offset, u8 Data)
+{
+    if (0 == Offset)
+    {
+        Cdrom->Index = Data & 0x3;
+        return;
+    }
+
+    /* the sound map (bank 1 and 2 of register 1) plays XA from RAM, which isn't emulated */
+    switch (Cdrom->Index << 2 | Offset)
+    {
+    case 0 << 2 | 1: /* command */
+    {
+        CDROM_Command(Cdrom, Data);
+        CDROM_Schedule(Cdrom);
+    } break;
+    case 0 << 2 | 2: /* parameter FIFO */
+    {
+        if (Cdrom->ParamCount < CDROM_FIFO_SIZE)
+            Cdrom->Params[Cdrom->ParamCount++] = Data;
+    } break;
+    case 0 << 2 | 3: /* HCHPCTL, bit 7 loads the data FIFO with the last sector, clears it otherwise */
+    {
+        if (Data & 0x80)
+            CDROM_LoadDataFifo(Cdrom);
+        else Cdrom->DataSize = Cdrom->DataRead = 0;
+    } break;
+    case 1 << 2 | 2: /* HINTMSK */
+    {
+        Cdrom->IntEnable = Data & 0x1F;
+    } break;
+    case 2 << 2 | 2: Cdrom->PendingVolume[0] = Data; break;    /* left to left */
+    case 2 << 2 | 3: Cdrom->PendingVolume[1] = Data; break;    /* left to right */
+    case 3 << 2 | 1: Cdrom->PendingVolume[2] = Data; break;    /* right to right */
+    case 3 << 2 | 2: Cdrom->PendingVolume[3] = Data; break;    /* right to left */
+    case 3 << 2 | 3: /* ADPCTL */
+    {
+        Cdrom->AdpcmMuted = Data & 0x01;
+        if (Data & 0x20)
+            memcpy(Cdrom->Volume, Cdrom->PendingVolume, sizeof Cdrom->Volume);
+    } break;
+    case 1 << 2 | 3: /* HCLRCTL: acknowledges interrupts, bit 6 clears the parameter FIFO */
+    {
+        Cdrom->IntFlags &= ~(Data & 0x1F);
+        if (Data & 0x40)
+            Cdrom->ParamCount = 0;
+        /* the next response can come up now */
+        CDROM_Schedule(Cdrom);
+    } break;
+    }
+}
+
+void CDROM_ReadDataBlock(CDROM *Cdrom, u32 *Words, uint WordCount)
+{
+    uint Size = MIN(WordCount*sizeof(u32), Cdrom->DataSize - Cdrom->DataRead);
+    memcpy(Words, Cdrom->Data + Cdrom->DataRead, Size);
+    memset((u8 *)Words + Size, 0, WordCount*sizeof(u32) - Size);
+    Cdrom->DataRead += Size;
+}
+
+void CDROM_ReadAudio(CDROM *Cdrom, i16 *Frames, uint FrameCount)
+{
+    uint Count = MIN(FrameCount, Cdrom->AudioWrite - Cdrom->AudioRead);
+    Bool8 Silent = Cdrom->Muted || Cdrom->AdpcmMuted;
+    i32 LeftToLeft = Cdrom->Volume[0], LeftToRight = Cdrom->Volume[1];
+    i32 RightToRight = Cdrom->Volume[2], RightToLeft = Cdrom->Volume[3];
+    for (uint i = 0; i < Count; i++)
+    {
+        const i16 *Frame = Cdrom->AudioFrames[(Cdrom->AudioRead + i) % CDROM_AUDIO_FRAMES];
+        i32 Left = (Frame[0]*LeftToLeft + Frame[1]*RightToLeft) >> 7;
+        i32 Right = (Frame[0]*LeftToRight + Frame[1]*RightToRight) >> 7;
+        Frames[i*2 + 0] = Silent? 0 : (i16)MIN(MAX(Left, -0x8000), 0x7FFF);
+        Frames[i*2 + 1] = Silent? 0 : (i16)MIN(MAX(Right, -0x8000), 0x7FFF);
+    }
+    memset(Frames + Count*2, 0, (FrameCount - Count)*2*sizeof(i16));
+    Cdrom->AudioRead += Count;
+}
+
+void CDROM_Update(CDROM *Cdrom, u64 Cycle)
+{
+    if (Cdrom->Reading && Cycle >= Cdrom->SectorCycle)
+        CDROM_ReadSector(Cdrom, Cycle);
+
+    /* one interrupt at a time, in order */
+    if (0 == Cdrom->IntFlags)
+    {
+        CDROM_Response *Pending[] = { &Cdrom->Ack, &Cdrom->Complete, &Cdrom->DataReady };
+        for (uint i = 0; i < STATIC_ARRAY_SIZE(Pending); i++)
+        {
+            if (Pending[i]->Int && Cycle >= Pending[i]->Cycle)
+            {
+                if (&Cdrom->Ack == Pending[i])
+                    Cdrom->CommandBusy = false;
+                CDROM_Raise(Cdrom, Pending[i]);
+                break;
+            }
+            if (Pending[i]->Int) /* the second response doesn't overtake the first one */
+                break;
+        }
+    }
+    CDROM_Schedule(Cdrom);
+}
+
@@ -0,0 +1,100 @@
+
+#include <string.h> /* memcpy */
+
+#include "Common.h"
+#include "Capture.h"
+
+
+
+static void Capture_Flush(Capture *Cap)
+{
+    if (Cap->File && Cap->BufferCount)
+    {
+        if (fwrite(Cap->Buffer, sizeof(u32), Cap->BufferCount, Cap->File) != Cap->BufferCount)
+        {
+            LOG("Unable to write the GPU capture, stopped recording\n");
+            fclose(Cap->File);
+            Cap->File = NULL;
+        }
+    }
+    Cap->BufferCount = 0;
+    /* the header of the open record is gone with the buffer, the next words start a new one */
+    Cap->HasOpenRecord = false;
+}
+
+static void Capture_Reserve(Capture *Cap, uint WordCount)
+{
+    if (Cap->BufferCount + WordCount > CAPTURE_BUFFER_WORDS)
+        Capture_Flush(Cap);
+}
+
+
+Bool8 Capture_Open(Capture *Cap, const char *FileName)
+{
+    Cap->File = fopen(FileName, "wb");
+    Cap->BufferCount = 0;
+    Cap->HasOpenRecord = false;
+    Cap->FrameCount = 0;
+    Cap->GP0WordCount = 0;
+    Cap->GP1WordCount = 0;
+    if (NULL == Cap->File)
+        return false;
+
+    Cap->Buffer[Cap->BufferCount++] = CAPTURE_MAGIC;
+    Cap->Buffer[Cap->BufferCount++] = CAPTURE_VERSION;
+    return true;
+}
+
+void Capture_Close(Capture *Cap)
+{
+    Capture_Flush(Cap);
+    if (Cap->File)
+        fclose(Cap->File);
+    Cap->File = NULL;
+}
+
+void Capture_GP0(Capture *Cap, const u32 *Data, uint WordCount)
+{
+    Cap->GP0WordCount += WordCount;
+    while (WordCount)
+    {
+        if (!Cap->HasOpenRecord
+        || CAPTURE_MAX_RECORD_WORDS == CAPTURE_RECORD_COUNT(Cap->Buffer[Cap->OpenRecord]))
+        {
+            Capture_Reserve(Cap, 2);
+            Cap->OpenRecord = Cap->BufferCount++;
+            Cap->Buffer[Cap->OpenRecord] = (u32)CAPTURE_GP0 << 24;
+            Cap->HasOpenRecord = true;
+        }
+
+        u32 *Header = &Cap->Buffer[Cap->OpenRecord];
+        uint Count = MIN(WordCount, CAPTURE_BUFFER_WORDS - Cap->BufferCount);
+        Count = MIN(Count, CAPTURE_MAX_RECORD_WORDS - CAPTURE_RECORD_COUNT(*Header));
+        memcpy(&Cap->Buffer[Cap->BufferCount], Data, Count*sizeof(u32));
+        Cap->BufferCount += Count;
+        *Header += Count;
+
+        Data += Count;
+        WordCount -= Count;
+        if (CAPTURE_BUFFER_WORDS == Cap->BufferCount)
+            Capture_Flush(Cap);
+    }
+}
+
+void Capture_GP1(Capture *Cap, u32 Data)
+{
+    Capture_Reserve(Cap, 2);
+    Cap->Buffer[Cap->BufferCount++] = (u32)CAPTURE_GP1 << 24 | 1;
+    Cap->Buffer[Cap->BufferCount++] = Data;
+    Cap->HasOpenRecord = false;
+    Cap->GP1WordCount++;
+}
+
+void Capture_VBlank(Capture *Cap)
+{
+    Capture_Reserve(Cap, 1);
+    Cap->Buffer[Cap->BufferCount++] = (u32)CAPTURE_VBLANK << 24;
+    Cap->HasOpenRecord = false;
+    Cap->FrameCount++;
+}
+
@@ -11,11 +11,70 @@ static inline Bool8 DMA_IsChanelActive(const DMA_ChanelCtrl *Chanel)
     return Chanel->Enable && TriggerSet;
 }
 
+static void DMA_UpdateMasterIRQFlag(DMA *Dma)
+{
+    DMA_InterruptCtrl *Dicr = &Dma->InterruptCtrlReg;
+    /* TODO: its 0 to 1 edge is DMA interrupt (I_STAT bit 3), there's no interrupt controller yet */
+    Dicr->IRQMasterFlag = 
+        Dicr->ForceIRQ 
+        || (Dicr->IRQMasterEnable && (Dicr->IRQChanelEnable & Dicr->IRQChanelFlags));
+}
+
+static void DMA_UpdateNextEvent(DMA *Dma)
+{
+    Dma->NextEventCycle = ~(u64)0;
+    for (u32 Busy = Dma->BusyChanels; Busy; Busy &= Busy - 1)
+    {
+        uint Port = LowestSetBit64(Busy);
+        Dma->NextEventCycle = MIN(Dma->NextEventCycle, Dma->FinishCycle[Port]);
+    }
+    PS1_ScheduleEvent(Dma->Bus, Dma->NextEventCycle);
+}
+
+static void DMA_StartTransfer(DMA *Dma, DMA_Port Port)
+{
+    DMA_Chanel *Chanel = &Dma->Chanels[Port];
+    DMA_TransferSize Size = PS1_DoDMATransfer(Dma->Bus, Port);
+
+    /* the data is already there, but the channel stays busy for as long as the transfer takes */
+    Dma->FinishCycle[Port] = Dma->Bus->Gpu.Cycle + DMA_GetTransferCycles(Chanel, Port, Size);
+    Dma->BusyChanels |= 1u << Port;
+    DMA_UpdateNextEvent(Dma);
+}
+
+/* in request mode, the device says when it's ready */
+static Bool8 DMA_IsDeviceReady(DMA *Dma, DMA_Port Port)
+{
+    if (DMA_SYNCMODE_REQUEST != Dma->Chanels[Port].Ctrl.SyncMode)
+        return true;
+    switch (Port)
+    {
+    case DMA_PORT_MDEC_OUT: return MDEC_IsOutputReady(&Dma->Bus->Mdec);
+    case DMA_PORT_SPU: return SPU_IsDMAReady(&Dma->Bus->Spu, Dma->Chanels[Port].Ctrl.RamToDevice);
+    default: return true;
+    }
+}
+
+static void DMA_FinishTransfer(DMA *Dma, DMA_Port Port)
+{
+    DMA_Chanel *Chanel = &Dma->Chanels[Port];
+    Chanel->Ctrl.Enable = 0;
+    Chanel->Ctrl.ManualTrigger = 0;
+    Dma->BusyChanels &= ~(1u << Port);
+
+    if ((Dma->InterruptCtrlReg.IRQChanelEnable >> Port) & 1)
+    {
+        Dma->InterruptCtrlReg.IRQChanelFlags |= 1u << Port;
+        DMA_UpdateMasterIRQFlag(Dma);
+    }
+}
+
 
 void DMA_Reset(DMA *Dma, PS1 *Bus)
 {
     *Dma = (DMA) {
         .PriorityCtrlReg = 0x07654321, /* default priority */
+        .NextEventCycle = ~(u64)0,
         .Bus = Bus,
         .Chanels[DMA_PORT_OTC].Ctrl.Decrement = 1, /* OTC always decrement */
     };
@@ -64,7 +123,7 @@ u32 DMA_Read32(DMA *Dma, u32 Offset)
         {
             Data = Chanel->Ctrl.RamToDevice
                 | (u32)Chanel->Ctrl.Decrement << 1
-                | (u32)Chanel->Ctrl.ChoppingEnable << 2
+                | (u32)Chanel->Ctrl.ChoppingEnable << 8
                 | (u32)Chanel->Ctrl.SyncMode << 9
                 | (u32)Chanel->Ctrl.ChoppingDMAWindow << 16 
                 | (u32)Chanel->Ctrl.ChoppingCPUWindow << 20 
@@ -102,12 +161,7 @@ void DMA_Write32(DMA *Dma, u32 Offset, u32 Data)
 
             /* writing 1 to a flag resets it, flag value stays otherwise */
             Dma->InterruptCtrlReg.IRQChanelFlags &= ~(Data >> 24);
-
-#if 0 /* TODO: move this somwhere else? */
-            Dma->InterruptCtrlReg.IRQMasterFlag = 
-                Dma->InterruptCtrlReg.ForceIRQ 
-                || (Dma->InterruptCtrlReg.IRQMasterEnable && Dma->InterruptCtrlReg.IRQChanelFlags);
-#endif 
+            DMA_UpdateMasterIRQFlag(Dma);
         } break;
         default:
         {
@@ -132,6 +186,7 @@ void DMA_Write32(DMA *Dma, u32 Offset, u32 Data)
         } break;
         case 8: /* Chanel Ctrl Regs */
         {
+            Bool8 WasBusy = (Dma->BusyChanels >> Port) & 1;
             if (Port == DMA_PORT_OTC) /* only bits 24, 28, 30 are R/W */
             {
                 Chanel->Ctrl.Enable = Data >> 24;
@@ -142,7 +197,7 @@ void DMA_Write32(DMA *Dma, u32 Offset, u32 Data)
             {
                 Chanel->Ctrl.RamToDevice = Data;
                 Chanel->Ctrl.Decrement = Data >> 1;
-                Chanel->Ctrl.ChoppingEnable = Data >> 2;
+                Chanel->Ctrl.ChoppingEnable = Data >> 8;
                 Chanel->Ctrl.SyncMode = Data >> 9;
                 Chanel->Ctrl.ChoppingDMAWindow = Data >> 16;
                 Chanel->Ctrl.ChoppingCPUWindow = Data >> 20;
@@ -151,9 +206,24 @@ void DMA_Write32(DMA *Dma, u32 Offset, u32 Data)
                 Chanel->Ctrl.Unknown = Data >> 29;
             }
 
-            if (DMA_IsChanelActive(&Chanel->Ctrl))
+            if (WasBusy)
             {
-                PS1_DoDMATransfer(Dma->Bus, Port);
+                /* stopped before the end, there's no interrupt for that; otherwise it keeps going */
+                if (!Chanel->Ctrl.Enable)
+                {
+                    Dma->BusyChanels &= ~(1u << Port);
+                    DMA_UpdateNextEvent(Dma);
+                }
+            }
+            else if (DMA_IsChanelActive(&Chanel->Ctrl))
+            {
+                if (DMA_IsDeviceReady(Dma, Port))
+                    DMA_StartTransfer(Dma, Port);
+                else Dma->WaitingChanels |= 1u << Port;
+            }
+            else
+            {
+                Dma->WaitingChanels &= ~(1u << Port);
             }
         } break;
         default:
@@ -170,7 +240,8 @@ u32 DMA_GetChanelTransferSize(const DMA_Chanel *Chanel)
     {
     case DMA_SYNCMODE_MANUAL:
     {
-        return Chanel->BlockSize;
+        /* 0 is the max size */
+        return Chanel->BlockSize? Chanel->BlockSize : 0x10000;
     } break;
     case DMA_SYNCMODE_REQUEST:
     {
@@ -185,11 +256,55 @@ u32 DMA_GetChanelTransferSize(const DMA_Chanel *Chanel)
     }
 }
 
-void DMA_SetTransferFinishedState(DMA_Chanel *Chanel)
+void DMA_Update(DMA *Dma, u64 Cycle)
 {
-    Chanel->Ctrl.Enable = 0;
-    Chanel->Ctrl.ManualTrigger = 0;
-    /* TODO: also set interrupt */
+    for (u32 Busy = Dma->BusyChanels; Busy; Busy &= Busy - 1)
+    {
+        DMA_Port Port = LowestSetBit64(Busy);
+        if (Dma->FinishCycle[Port] <= Cycle)
+            DMA_FinishTransfer(Dma, Port);
+    }
+    DMA_UpdateNextEvent(Dma);
+}
+
+void DMA_Request(DMA *Dma, DMA_Port Port)
+{
+    u32 Bit = 1u << Port;
+    if (0 == (Dma->WaitingChanels & Bit) || !DMA_IsDeviceReady(Dma, Port))
+        return;
+    Dma->WaitingChanels &= ~Bit;
+    DMA_StartTransfer(Dma, Port);
+}
+
+u64 DMA_GetTransferCycles(const DMA_Chanel *Chanel, DMA_Port Port, DMA_TransferSize Size)
+{
+    /* rough cost of a word for each device, the slow ones make the DMA wait */
+    static const u8 sCyclesPerWord[] = {
+        [DMA_PORT_MDEC_IN] = 1,
+        [DMA_PORT_MDEC_OUT] = 1,
+        [DMA_PORT_GPU] = 1,
+        [DMA_PORT_CDROM] = 24,
+        [DMA_PORT_SPU] = 4,
+        [DMA_PORT_PIO] = 20,
+        [DMA_PORT_OTC] = 1,
+    };
+    u32 WordCount = Size.WordCount;
+    u64 Cycles = (u64)WordCount * sCyclesPerWord[Port];
+    /* rough cost of following a link: the header's read isn't pipelined with the packet's */
+    Cycles += (u64)Size.NodeCount * DMA_LINKEDLIST_NODE_CYCLES;
+
+    /* 
+     * chopping: the DMA gives the bus back to the CPU for 2^CPUWindow cycles 
+     * after every 2^DMAWindow words (not in linked list mode) 
+     */
+    if (Chanel->Ctrl.ChoppingEnable && DMA_SYNCMODE_LINKEDLIST != Chanel->Ctrl.SyncMode && WordCount)
+    {
+        u32 DMAWindow = 1u << Chanel->Ctrl.ChoppingDMAWindow;
+        u32 CPUWindow = 1u << Chanel->Ctrl.ChoppingCPUWindow;
+        u64 Gaps = (WordCount - 1) / DMAWindow;
+        Cycles += Gaps * CPUWindow;
+    }
+    return Cycles;
 }
 
 
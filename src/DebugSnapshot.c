@@ -0,0 +1,160 @@
+
+#include <string.h> /* memcpy, memset */
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Display.h"
+#include "TripleBuffer.h"
+#include "DebugSnapshot.h"
+
+
+
+Bool8 DebugSnapshot_Init(DebugSnapshot_Buffer *Buf, const u8 *Bios)
+{
+    *Buf = (DebugSnapshot_Buffer) {
+        .Bios = Bios,
+    };
+    TripleBuffer_InitExchange(&Buf->Exchange);
+    for (uint i = 0; i < STATIC_ARRAY_SIZE(Buf->Slots); i++)
+    {
+        DebugSnapshot *Slot = &Buf->Slots[i];
+        Slot->Ram = calloc(1, PS1_RAM_SIZE);
+        Slot->Vram = calloc(1, GPU_VRAM_SIZE);
+        if (NULL == Slot->Ram || NULL == Slot->Vram)
+        {
+            DebugSnapshot_Destroy(Buf);
+            return false;
+        }
+    }
+
+    /* nothing was copied yet, and the reader has nothing to compare the first snapshot with */
+    memset(Buf->StaleRamPages, 0xFF, sizeof Buf->StaleRamPages);
+    memset(Buf->StaleVramTiles, 0xFF, sizeof Buf->StaleVramTiles);
+    memset(Buf->UnpublishedRamPages, 0xFF, sizeof Buf->UnpublishedRamPages);
+    memset(Buf->UnpublishedVramTiles, 0xFF, sizeof Buf->UnpublishedVramTiles);
+    return true;
+}
+
+void DebugSnapshot_Destroy(DebugSnapshot_Buffer *Buf)
+{
+    for (uint i = 0; i < STATIC_ARRAY_SIZE(Buf->Slots); i++)
+    {
+        free(Buf->Slots[i].Ram);
+        free(Buf->Slots[i].Vram);
+    }
+    *Buf = (DebugSnapshot_Buffer) { 0 };
+}
+
+
+/* copies the stale pages and tiles of a slot, returns the number of bytes copied */
+static u64 DebugSnapshot_CopyStale(DebugSnapshot *Slot, const PS1 *Ps1, u64 *StaleRamPages, u64 *StaleVramTiles)
+{
+    u64 Bytes = 0;
+    for (uint i = 0; i < PS1_RAM_PAGE_COUNT / 64; i++)
+    {
+        for (u64 Pages = StaleRamPages[i]; Pages; Pages &= Pages - 1)
+        {
+            uint Page = i*64 + LowestSetBit64(Pages);
+            memcpy(Slot->Ram + Page*PS1_RAM_PAGE_SIZE, Ps1->Ram + Page*PS1_RAM_PAGE_SIZE, PS1_RAM_PAGE_SIZE);
+            Bytes += PS1_RAM_PAGE_SIZE;
+        }
+        StaleRamPages[i] = 0;
+    }
+
+    for (uint Row = 0; Row < GPU_DIRTY_TILE_ROWS; Row++)
+    {
+        u64 Columns = StaleVramTiles[Row];
+        StaleVramTiles[Row] = 0;
+        while (Columns)
+        {
+            /* one run of consecutive tiles at a time */
+            uint First = LowestSetBit64(Columns);
+            u64 Run = Columns >> First;
+            uint Count = ~Run? LowestSetBit64(~Run) : 64 - First;
+            Columns &= Count + First >= 64? 0 : ~(u64)0 << (First + Count);
+
+            uint X = First * GPU_DIRTY_TILE_SIZE;
+            uint Width = Count * GPU_DIRTY_TILE_SIZE;
+            for (uint y = Row * GPU_DIRTY_TILE_SIZE; y < (Row + 1) * GPU_DIRTY_TILE_SIZE; y++)
+            {
+                memcpy(&Slot->Vram[y*GPU_VRAM_WIDTH + X], &Ps1->Gpu.Vram[y*GPU_VRAM_WIDTH + X], Width*sizeof(u16));
+            }
+            Bytes += (u64)Width * GPU_DIRTY_TILE_SIZE * sizeof(u16);
+        }
+    }
+    return Bytes;
+}
+
+void DebugSnapshot_Update(DebugSnapshot_Buffer *Buf, PS1 *Ps1, u64 Frame)
+{
+    /* every slot misses this frame's writes */
+    for (uint i = 0; i < PS1_RAM_PAGE_COUNT / 64; i++)
+    {
+        u64 Pages = Ps1->RamDirtyPages[i];
+        Ps1->RamDirtyPages[i] = 0;
+        for (uint s = 0; s < STATIC_ARRAY_SIZE(Buf->Slots); s++)
+            Buf->StaleRamPages[s][i] |= Pages;
+        Buf->UnpublishedRamPages[i] |= Pages;
+    }
+    for (uint Row = 0; Row < GPU_DIRTY_TILE_ROWS; Row++)
+    {
+        u64 Columns = Ps1->Gpu.DirtyTiles[Row];
+        for (uint s = 0; s < STATIC_ARRAY_SIZE(Buf->Slots); s++)
+            Buf->StaleVramTiles[s][Row] |= Columns;
+        Buf->UnpublishedVramTiles[Row] |= Columns;
+    }
+
+    /*
+     * the reader hasn't taken the last snapshot yet, it gets that one and the changes go into the next;
+     * so the viewers cost the emulation nothing more than the bits above when they fall behind
+     */
+    if (TripleBuffer_IsPending(&Buf->Exchange))
+    {
+        Buf->Skipped++;
+        return;
+    }
+
+    uint Back = Buf->Exchange.Back;
+    DebugSnapshot *Slot = &Buf->Slots[Back];
+    Buf->BytesCopied += DebugSnapshot_CopyStale(Slot, Ps1, Buf->StaleRamPages[Back], Buf->StaleVramTiles[Back]);
+
+    /* the reader has the last published snapshot, so the changes since then are the ones since its previous one */
+    memcpy(Slot->ChangedRamPages, Buf->UnpublishedRamPages, sizeof Slot->ChangedRamPages);
+    memcpy(Slot->ChangedVramTiles, Buf->UnpublishedVramTiles, sizeof Slot->ChangedVramTiles);
+    memset(Buf->UnpublishedRamPages, 0, sizeof Buf->UnpublishedRamPages);
+    memset(Buf->UnpublishedVramTiles, 0, sizeof Buf->UnpublishedVramTiles);
+    Slot->Frame = Frame;
+
+    const CPU *Cpu = &Ps1->Cpu;
+    Slot->PC = Cpu->NextInstructionPC;
+    memcpy(Slot->R, Cpu->R, sizeof Slot->R);
+    Slot->Hi = Cpu->Hi;
+    Slot->Lo = Cpu->Lo;
+    Slot->SR = Cpu->SR;
+    Slot->Cause = Cpu->Cause;
+    Slot->EPC = Cpu->EPC;
+
+    const GPU *Gpu = &Ps1->Gpu;
+    uint Width, Height;
+    Display_GetResolution(Gpu, &Width, &Height);
+    Slot->GpuStatus = Gpu->Status;
+    Slot->Clut = Gpu->LastClut;
+    Slot->DisplayX = Gpu->DisplayVRAMStartX;
+    Slot->DisplayY = Gpu->DisplayVRAMStartY;
+    Slot->DisplayWidth = Gpu->Status.DisplayRGB24? (Width*3 + 1) / 2 : Width;
+    Slot->DisplayHeight = Height;
+    Slot->DrawLeft = Gpu->DrawingAreaLeft;
+    Slot->DrawTop = Gpu->DrawingAreaTop;
+    Slot->DrawRight = Gpu->DrawingAreaRight;
+    Slot->DrawBottom = Gpu->DrawingAreaBottom;
+
+    TripleBuffer_Publish(&Buf->Exchange);
+    Buf->Published++;
+}
+
+const DebugSnapshot *DebugSnapshot_Read(DebugSnapshot_Buffer *Buf, Bool8 *OutIsNew)
+{
+    *OutIsNew = TripleBuffer_Take(&Buf->Exchange);
+    return &Buf->Slots[Buf->Exchange.Front];
+}
+
@@ -0,0 +1,639 @@
+#include <string.h> /* memcpy, memcmp, strcmp */
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Disassembler.h"
+#include "Display.h"
+#include "DebugSnapshot.h"
+#include "Debugger.h"
+
+#include "raylib.h"
+
+
+#define DEBUGGER_FONT_FILE "resources/CascadiaMono.ttf"
+#define DEBUGGER_FONT_SIZE 16
+#define DEBUGGER_LINE_HEIGHT 18
+#define DEBUGGER_HEADER_HEIGHT 24
+#define DEBUGGER_PANEL_HEIGHT (DEBUGGER_MAX_LINES * DEBUGGER_LINE_HEIGHT)
+
+#define DEBUGGER_MEMORY_WIDTH 740
+#define DEBUGGER_CODE_WIDTH 600
+#define DEBUGGER_REGISTERS_WIDTH 180
+#define DEBUGGER_VRAM_LEGEND_HEIGHT 40
+
+#define DEBUGGER_BYTES_PER_LINE 16
+#define DEBUGGER_MEMORY_LINE_COUNT (PS1_RAM_SIZE / DEBUGGER_BYTES_PER_LINE)
+#define DEBUGGER_PC_LINE 12     /* where the PC goes when the code view follows it */
+
+/* frame rate of the main window, every window's EndDrawing waits for its share of the frame */
+#define DEBUGGER_FPS 60
+
+#define DEBUGGER_KEY_PAGE_UP    (1u << 0)
+#define DEBUGGER_KEY_PAGE_DOWN  (1u << 1)
+#define DEBUGGER_KEY_FOLLOW_PC  (1u << 2)
+
+#define DEBUGGER_BACKGROUND (Color) { 24, 24, 24, 255 }
+#define DEBUGGER_TEXT LIGHTGRAY
+#define DEBUGGER_TEXT_CHANGED YELLOW
+#define DEBUGGER_TEXT_PC GREEN
+#define DEBUGGER_TEXT_UNMAPPED DARKGRAY
+
+
+
+static Bool8 Debugger_OpenWindow(Debugger_Window *Window, int Width, int Height, const char *Title)
+{
+    Window->Id = InitWindowPro(Width, Height, Title, 0);
+    if (Window->Id < 0)
+        return false;
+
+    /* raylib falls back to its default font when the file isn't there */
+    Window->Font = LoadFontEx(DEBUGGER_FONT_FILE, DEBUGGER_FONT_SIZE, NULL, 0);
+    return true;
+}
+
+/* the window's context must be active */
+static void Debugger_CloseWindow(Debugger_Window *Window)
+{
+    UnloadFont(Window->Font);
+    CloseWindow();
+    Window->Id = -1;
+}
+
+static uint Debugger_OpenWindowCount(const Debugger *Dbg)
+{
+    return (Dbg->VramWindow.Id >= 0) + (Dbg->MemoryWindow.Id >= 0) + (Dbg->CodeWindow.Id >= 0);
+}
+
+static void Debugger_UpdateFrameRate(const Debugger *Dbg)
+{
+    /* the frame time is shared by all windows, so they'd each run at a fraction of it otherwise */
+    SetTargetFPS(DEBUGGER_FPS * (1 + Debugger_OpenWindowCount(Dbg)));
+}
+
+
+
+/*
+ * text panels: the lines are drawn into a render texture when they change,
+ * the window then only draws the texture every frame
+ */
+
+static void Debugger_PanelInit(Debugger_TextPanel *Panel, uint Width, uint LineCount)
+{
+    *Panel = (Debugger_TextPanel) {
+        .Width = Width,
+        .LineCount = MIN(LineCount, DEBUGGER_MAX_LINES),
+    };
+    Panel->Target = LoadRenderTexture((int)Width, DEBUGGER_PANEL_HEIGHT);
+    Panel->HasTarget = true;
+    BeginTextureMode(Panel->Target);
+        ClearBackground(DEBUGGER_BACKGROUND);
+    EndTextureMode();
+}
+
+static void Debugger_PanelDestroy(Debugger_TextPanel *Panel)
+{
+    if (Panel->HasTarget)
+        UnloadRenderTexture(Panel->Target);
+    Panel->HasTarget = false;
+}
+
+static void Debugger_PanelSetLine(Debugger_TextPanel *Panel, uint Line, const char *Text, Color TextColor)
+{
+    ASSERT(Line < Panel->LineCount);
+    Bool8 SameText = 0 == strcmp(Panel->Lines[Line], Text);
+    if (SameText && 0 == memcmp(&Panel->Colors[Line], &TextColor, sizeof TextColor))
+        return;
+
+    if (!SameText)
+        snprintf(Panel->Lines[Line], DEBUGGER_LINE_SIZE, "%s", Text);
+    Panel->Colors[Line] = TextColor;
+    Panel->DirtyLines |= (u64)1 << Line;
+}
+
+/* draws the lines that changed, returns how many */
+static uint Debugger_PanelFlush(Debugger_TextPanel *Panel, const Font *Font)
+{
+    if (0 == Panel->DirtyLines)
+        return 0;
+
+    uint Count = 0;
+    BeginTextureMode(Panel->Target);
+    for (u64 Lines = Panel->DirtyLines; Lines; Lines &= Lines - 1)
+    {
+        uint Line = LowestSetBit64(Lines);
+        float y = (float)(Line * DEBUGGER_LINE_HEIGHT);
+        DrawRectangle(0, (int)y, (int)Panel->Width, DEBUGGER_LINE_HEIGHT, DEBUGGER_BACKGROUND);
+        DrawTextEx(*Font, Panel->Lines[Line], (Vector2) { 4, y + 1 }, DEBUGGER_FONT_SIZE, 0, Panel->Colors[Line]);
+        Count++;
+    }
+    EndTextureMode();
+    Panel->DirtyLines = 0;
+    return Count;
+}
+
+static void Debugger_PanelDraw(const Debugger_TextPanel *Panel, int x, int y)
+{
+    /* render textures are upside down */
+    Rectangle Src = { 0, 0, (float)Panel->Width, -(float)DEBUGGER_PANEL_HEIGHT };
+    DrawTextureRec(Panel->Target.texture, Src, (Vector2) { (float)x, (float)y }, WHITE);
+}
+
+static void Debugger_DrawHeader(const Debugger_Window *Window, const char *Text)
+{
+    DrawTextEx(Window->Font, Text, (Vector2) { 4, 4 }, DEBUGGER_FONT_SIZE, 0, WHITE);
+}
+
+
+
+/* VRAM */
+
+static void Debugger_RefreshVram(Debugger *Dbg, const DebugSnapshot *Snap)
+{
+    uint Tiles = 0;
+    for (uint Row = 0; Row < GPU_DIRTY_TILE_ROWS; Row++)
+    {
+        u64 Columns = Snap->ChangedVramTiles[Row];
+        while (Columns)
+        {
+            /* one run of consecutive tiles at a time, converted to RGBA and uploaded together */
+            uint First = LowestSetBit64(Columns);
+            u64 Run = Columns >> First;
+            uint Count = ~Run? LowestSetBit64(~Run) : 64 - First;
+            Columns &= Count + First >= 64? 0 : ~(u64)0 << (First + Count);
+
+            uint X = First * GPU_DIRTY_TILE_SIZE;
+            uint Width = Count * GPU_DIRTY_TILE_SIZE;
+            uint Y = Row * GPU_DIRTY_TILE_SIZE;
+            for (uint y = 0; y < GPU_DIRTY_TILE_SIZE; y++)
+            {
+                Display_ConvertRow15(&Dbg->VramRows[y*Width], &Snap->Vram[(Y + y)*GPU_VRAM_WIDTH + X], Width);
+            }
+            Rectangle Rect = { (float)X, (float)Y, (float)Width, GPU_DIRTY_TILE_SIZE };
+            UpdateTextureRec(Dbg->VramTexture, Rect, Dbg->VramRows);
+            Tiles += Count;
+        }
+    }
+    Dbg->TilesUploaded = Tiles;
+}
+
+/* outline of a rectangle of VRAM, split where it wraps around */
+static void Debugger_DrawVramRect(uint X, uint Y, uint Width, uint Height, Color OutlineColor)
+{
+    X %= GPU_VRAM_WIDTH;
+    Y %= GPU_VRAM_HEIGHT;
+    uint FirstWidth = MIN(Width, GPU_VRAM_WIDTH - X);
+    uint FirstHeight = MIN(Height, GPU_VRAM_HEIGHT - Y);
+    DrawRectangleLines((int)X, (int)Y, (int)FirstWidth, (int)FirstHeight, OutlineColor);
+    if (Width > FirstWidth)
+        DrawRectangleLines(0, (int)Y, (int)(Width - FirstWidth), (int)FirstHeight, OutlineColor);
+    if (Height > FirstHeight)
+        DrawRectangleLines((int)X, 0, (int)FirstWidth, (int)(Height - FirstHeight), OutlineColor);
+}
+
+static void Debugger_DrawVramWindow(Debugger *Dbg, const DebugSnapshot *Snap)
+{
+    BeginDrawing();
+    ClearBackground(DEBUGGER_BACKGROUND);
+    DrawTexture(Dbg->VramTexture, 0, 0, WHITE);
+    if (!Dbg->HasSnapshot)
+    {
+        EndDrawing();
+        return;
+    }
+
+    /* TextureDepth: 0=4 bit, 1=8 bit, 2=15 bit; a texture page is 256 texels wide */
+    static const uint sPageWidth[4] = { 64, 128, 256, 256 };
+    static const uint sDepthBits[4] = { 4, 8, 15, 15 };
+    uint Depth = Snap->GpuStatus.TextureDepth;
+    uint PageX = Snap->GpuStatus.TexturePageX * 64;
+    uint PageY = Snap->GpuStatus.TexturePageY * 256;
+    uint ClutX = (Snap->Clut & 0x3F) * 16;
+    uint ClutY = (Snap->Clut >> 6) & 0x1FF;
+
+    Debugger_DrawVramRect(Snap->DisplayX, Snap->DisplayY, Snap->DisplayWidth, Snap->DisplayHeight, GREEN);
+    if (Snap->DrawRight >= Snap->DrawLeft && Snap->DrawBottom >= Snap->DrawTop)
+    {
+        Debugger_DrawVramRect(Snap->DrawLeft, Snap->DrawTop,
+            Snap->DrawRight - Snap->DrawLeft + 1, Snap->DrawBottom - Snap->DrawTop + 1, SKYBLUE
+        );
+    }
+    Debugger_DrawVramRect(PageX, PageY, sPageWidth[Depth], 256, ORANGE);
+    if (Depth < 2)
+    {
+        /* 1 line tall, grown so it can be seen */
+        Debugger_DrawVramRect(ClutX, ClutY > 0? ClutY - 1 : 0, 0 == Depth? 16 : 256, 3, MAGENTA);
+    }
+
+    char Text[256];
+    snprintf(Text, sizeof Text,
+        "frame %llu   display %u,%u %ux%u   draw area %u,%u..%u,%u   "
+        "texpage %u,%u %u bit   CLUT %u,%u   %u tiles updated",
+        (unsigned long long)Snap->Frame,
+        Snap->DisplayX, Snap->DisplayY, Snap->DisplayWidth, Snap->DisplayHeight,
+        Snap->DrawLeft, Snap->DrawTop, Snap->DrawRight, Snap->DrawBottom,
+        PageX, PageY, sDepthBits[Depth], ClutX, ClutY, Dbg->TilesUploaded
+    );
+    const Font *Font = &Dbg->VramWindow.Font;
+    DrawTextEx(*Font, Text, (Vector2) { 4, GPU_VRAM_HEIGHT + 2 }, DEBUGGER_FONT_SIZE, 0, WHITE);
+    DrawTextEx(*Font, "display", (Vector2) { 4, GPU_VRAM_HEIGHT + 20 }, DEBUGGER_FONT_SIZE, 0, GREEN);
+    DrawTextEx(*Font, "draw area", (Vector2) { 84, GPU_VRAM_HEIGHT + 20 }, DEBUGGER_FONT_SIZE, 0, SKYBLUE);
+    DrawTextEx(*Font, "texture page", (Vector2) { 184, GPU_VRAM_HEIGHT + 20 }, DEBUGGER_FONT_SIZE, 0, ORANGE);
+    DrawTextEx(*Font, "CLUT", (Vector2) { 314, GPU_VRAM_HEIGHT + 20 }, DEBUGGER_FONT_SIZE, 0, MAGENTA);
+    EndDrawing();
+}
+
+
+
+/* RAM hex view */
+
+static void Debugger_FormatMemoryLine(const DebugSnapshot *Snap, uint Line, char *Out, uint OutSize)
+{
+    const u8 *Bytes = Snap->Ram + Line * DEBUGGER_BYTES_PER_LINE;
+    int Length = snprintf(Out, OutSize, "%08X ", 0x80000000 + Line * DEBUGGER_BYTES_PER_LINE);
+    for (uint i = 0; i < DEBUGGER_BYTES_PER_LINE && Length > 0 && (uint)Length < OutSize; i++)
+    {
+        Length += snprintf(Out + Length, OutSize - Length, "%s%02X", i % 8? " " : "  ", Bytes[i]);
+    }
+    if (Length <= 0 || (uint)Length + DEBUGGER_BYTES_PER_LINE + 3 > OutSize)
+        return;
+
+    Out[Length++] = ' ';
+    Out[Length++] = ' ';
+    for (uint i = 0; i < DEBUGGER_BYTES_PER_LINE; i++)
+    {
+        Out[Length++] = IN_RANGE(0x20, Bytes[i], 0x7E)? (char)Bytes[i] : '.';
+    }
+    Out[Length] = '\0';
+}
+
+static void Debugger_RefreshMemory(Debugger *Dbg, const DebugSnapshot *Snap, Bool8 IsNew)
+{
+    Debugger_TextPanel *Panel = &Dbg->Memory;
+    Bool8 Scrolled = Dbg->MemoryScrolled;
+    Dbg->MemoryScrolled = false;
+    if (!IsNew && !Scrolled)
+        return;
+
+    for (uint i = 0; i < Panel->LineCount; i++)
+    {
+        uint Line = Dbg->MemoryTopLine + i;
+        uint Page = Line * DEBUGGER_BYTES_PER_LINE / PS1_RAM_PAGE_SIZE;
+        Bool8 PageChanged = IsNew && (Snap->ChangedRamPages[Page / 64] >> (Page % 64) & 1);
+        if (!Scrolled && !PageChanged)
+        {
+            /* unchanged since the last snapshot, stops being highlighted */
+            Debugger_PanelSetLine(Panel, i, Panel->Lines[i], DEBUGGER_TEXT);
+            continue;
+        }
+
+        char Text[DEBUGGER_LINE_SIZE];
+        Debugger_FormatMemoryLine(Snap, Line, Text, sizeof Text);
+        /* the page was written, highlight the lines that really differ */
+        Color TextColor = !Scrolled && 0 != strcmp(Text, Panel->Lines[i])? DEBUGGER_TEXT_CHANGED : DEBUGGER_TEXT;
+        Debugger_PanelSetLine(Panel, i, Text, TextColor);
+    }
+}
+
+static void Debugger_ScrollMemory(Debugger *Dbg, int Lines)
+{
+    int Top = (int)Dbg->MemoryTopLine + Lines;
+    int Bottom = DEBUGGER_MEMORY_LINE_COUNT - (int)Dbg->Memory.LineCount;
+    Top = MIN(MAX(Top, 0), Bottom);
+    if ((uint)Top != Dbg->MemoryTopLine)
+    {
+        Dbg->MemoryTopLine = (uint)Top;
+        Dbg->MemoryScrolled = true;
+    }
+}
+
+static void Debugger_DrawMemoryWindow(Debugger *Dbg, const DebugSnapshot *Snap, Bool8 IsNew)
+{
+    if (IsWindowFocused())
+    {
+        int Page = (int)Dbg->Memory.LineCount;
+        Debugger_ScrollMemory(Dbg, (int)(-Dbg->Wheel * 4));
+        if (Dbg->KeysPressed & DEBUGGER_KEY_PAGE_UP)
+            Debugger_ScrollMemory(Dbg, -Page);
+        if (Dbg->KeysPressed & DEBUGGER_KEY_PAGE_DOWN)
+            Debugger_ScrollMemory(Dbg, Page);
+        Dbg->Wheel = 0;
+        Dbg->WheelUsed = true;
+    }
+    if (Dbg->HasSnapshot)
+    {
+        Debugger_RefreshMemory(Dbg, Snap, IsNew);
+        Dbg->LinesRedrawn += Debugger_PanelFlush(&Dbg->Memory, &Dbg->MemoryWindow.Font);
+    }
+
+    char Header[128];
+    snprintf(Header, sizeof Header, "RAM   frame %llu   %u lines redrawn   wheel, page up/down: scroll",
+        (unsigned long long)Snap->Frame, Dbg->LinesRedrawn
+    );
+    BeginDrawing();
+        ClearBackground(DEBUGGER_BACKGROUND);
+        Debugger_DrawHeader(&Dbg->MemoryWindow, Header);
+        Debugger_PanelDraw(&Dbg->Memory, 0, DEBUGGER_HEADER_HEIGHT);
+    EndDrawing();
+}
+
+
+
+/* disassembly and registers */
+
+/* a word of RAM or BIOS, false for anything else */
+static Bool8 Debugger_ReadCode(const Debugger *Dbg, const DebugSnapshot *Snap, u32 Addr, u32 *OutWord)
+{
+    u32 Physical = Addr & 0x1FFFFFFF;
+    if (Physical < 4*PS1_RAM_SIZE) /* mirrored over the first 8mb */
+    {
+        memcpy(OutWord, Snap->Ram + Physical % PS1_RAM_SIZE, sizeof *OutWord);
+        return true;
+    }
+    if (IN_RANGE(0x1FC00000, Physical, 0x1FC00000 + PS1_BIOS_SIZE - 4))
+    {
+        memcpy(OutWord, Dbg->Snapshots.Bios + (Physical - 0x1FC00000), sizeof *OutWord);
+        return true;
+    }
+    return false;
+}
+
+static Bool8 Debugger_CodeChanged(const DebugSnapshot *Snap, u32 Addr)
+{
+    u32 Physical = Addr & 0x1FFFFFFF;
+    if (Physical >= 4*PS1_RAM_SIZE)
+        return false; /* BIOS can't be written */
+    uint Page = Physical % PS1_RAM_SIZE / PS1_RAM_PAGE_SIZE;
+    return Snap->ChangedRamPages[Page / 64] >> (Page % 64) & 1;
+}
+
+static void Debugger_RefreshCode(Debugger *Dbg, const DebugSnapshot *Snap, Bool8 IsNew)
+{
+    Debugger_TextPanel *Panel = &Dbg->Code;
+    u32 PC = Snap->PC;
+    u32 OldTop = Dbg->CodeTop;
+    u32 OldPC = Dbg->LastPC;
+    Bool8 Scrolled = Dbg->CodeScrolled;
+    Dbg->CodeScrolled = false;
+    if (Dbg->FollowPC && (PC - Dbg->CodeTop) / 4 >= Panel->LineCount - 4)
+        Dbg->CodeTop = PC - DEBUGGER_PC_LINE*4;
+    Dbg->LastPC = PC;
+    if (!IsNew && !Scrolled)
+        return;
+
+    Bool8 Moved = Scrolled || Dbg->CodeTop != OldTop;
+    for (uint i = 0; i < Panel->LineCount; i++)
+    {
+        u32 Addr = Dbg->CodeTop + i*4;
+        if (!Moved && Addr != PC && Addr != OldPC && !(IsNew && Debugger_CodeChanged(Snap, Addr)))
+            continue;
+
+        char Text[DEBUGGER_LINE_SIZE];
+        u32 Instruction;
+        Color TextColor = DEBUGGER_TEXT;
+        if (!Debugger_ReadCode(Dbg, Snap, Addr, &Instruction))
+        {
+            snprintf(Text, sizeof Text, "  %08X  ????????", Addr);
+            TextColor = DEBUGGER_TEXT_UNMAPPED;
+        }
+        else
+        {
+            char Mnemonic[64];
+            Disassemble(Instruction, Addr, DISASM_BEAUTIFUL_REGNAME | DISASM_IMM16_AS_HEX, Mnemonic, sizeof Mnemonic);
+            snprintf(Text, sizeof Text, "%c %08X  %08X  %s", Addr == PC? '>' : ' ', Addr, Instruction, Mnemonic);
+            if (Addr == PC)
+                TextColor = DEBUGGER_TEXT_PC;
+        }
+        Debugger_PanelSetLine(Panel, i, Text, TextColor);
+    }
+}
+
+static void Debugger_RefreshRegisters(Debugger *Dbg, const DebugSnapshot *Snap)
+{
+    Debugger_TextPanel *Panel = &Dbg->Registers;
+    const char *Names[DEBUGGER_MAX_LINES];
+    u32 Values[DEBUGGER_MAX_LINES];
+    uint Count = 0;
+
+    Names[Count] = "pc"; Values[Count++] = Snap->PC;
+    for (uint i = 0; i < 32; i++)
+    {
+        Names[Count] = sBeautifulRegisterName[i];
+        Values[Count++] = Snap->R[i];
+    }
+    Names[Count] = "hi"; Values[Count++] = Snap->Hi;
+    Names[Count] = "lo"; Values[Count++] = Snap->Lo;
+    Names[Count] = "sr"; Values[Count++] = Snap->SR;
+    Names[Count] = "cause"; Values[Count++] = Snap->Cause;
+    Names[Count] = "epc"; Values[Count++] = Snap->EPC;
+    ASSERT(Count <= Panel->LineCount);
+
+    for (uint i = 0; i < Count; i++)
+    {
+        char Text[DEBUGGER_LINE_SIZE];
+        snprintf(Text, sizeof Text, "%-5s %08X", Names[i], Values[i]);
+        Color TextColor = Panel->Lines[i][0] && 0 != strcmp(Text, Panel->Lines[i])? DEBUGGER_TEXT_CHANGED : DEBUGGER_TEXT;
+        Debugger_PanelSetLine(Panel, i, Text, TextColor);
+    }
+}
+
+static void Debugger_DrawCodeWindow(Debugger *Dbg, const DebugSnapshot *Snap, Bool8 IsNew)
+{
+    if (IsWindowFocused())
+    {
+        int Lines = (int)(-Dbg->Wheel * 4);
+        if (Dbg->KeysPressed & DEBUGGER_KEY_PAGE_UP)
+            Lines -= (int)Dbg->Code.LineCount;
+        if (Dbg->KeysPressed & DEBUGGER_KEY_PAGE_DOWN)
+            Lines += (int)Dbg->Code.LineCount;
+        if (Lines)
+        {
+            Dbg->CodeTop += (u32)Lines * 4;
+            Dbg->CodeScrolled = true;
+            Dbg->FollowPC = false;
+        }
+        if (Dbg->KeysPressed & DEBUGGER_KEY_FOLLOW_PC)
+        {
+            Dbg->FollowPC = true;
+            Dbg->CodeTop = Snap->PC - DEBUGGER_PC_LINE*4;
+            Dbg->CodeScrolled = true;
+        }
+        Dbg->Wheel = 0;
+        Dbg->WheelUsed = true;
+    }
+    if (Dbg->HasSnapshot)
+    {
+        Debugger_RefreshCode(Dbg, Snap, IsNew);
+        if (IsNew)
+            Debugger_RefreshRegisters(Dbg, Snap);
+        Dbg->LinesRedrawn += Debugger_PanelFlush(&Dbg->Code, &Dbg->CodeWindow.Font);
+        Dbg->LinesRedrawn += Debugger_PanelFlush(&Dbg->Registers, &Dbg->CodeWindow.Font);
+    }
+
+    char Header[128];
+    snprintf(Header, sizeof Header, "code   frame %llu   %u lines redrawn   %s",
+        (unsigned long long)Snap->Frame, Dbg->LinesRedrawn, Dbg->FollowPC? "following PC" : "space: follow PC"
+    );
+    BeginDrawing();
+        ClearBackground(DEBUGGER_BACKGROUND);
+        Debugger_DrawHeader(&Dbg->CodeWindow, Header);
+        Debugger_PanelDraw(&Dbg->Code, 0, DEBUGGER_HEADER_HEIGHT);
+        Debugger_PanelDraw(&Dbg->Registers, DEBUGGER_CODE_WIDTH, DEBUGGER_HEADER_HEIGHT);
+    EndDrawing();
+}
+
+
+
+/* input */
+
+static void Debugger_GatherInput(Debugger *Dbg)
+{
+    /*
+     * key presses and the wheel only last until the next poll, which is in the next window's EndDrawing,
+     * so keys are edge detected on their held state and the wheel is summed up after every poll
+     */
+    Dbg->Wheel += GetMouseWheelMove();
+}
+
+static void Debugger_SampleKeys(Debugger *Dbg)
+{
+    static const int sKeys[] = { KEY_PAGE_UP, KEY_PAGE_DOWN, KEY_SPACE };
+    u32 Down = 0;
+    for (uint i = 0; i < STATIC_ARRAY_SIZE(sKeys); i++)
+    {
+        if (IsKeyDown(sKeys[i]))
+            Down |= 1u << i;
+    }
+    Dbg->KeysPressed = Down & ~Dbg->KeysDown;
+    Dbg->KeysDown = Down;
+}
+
+
+
+Bool8 Debugger_Init(Debugger *Dbg, const u8 *Bios)
+{
+    memset(Dbg, 0, sizeof *Dbg);
+    Dbg->VramWindow.Id = -1;
+    Dbg->MemoryWindow.Id = -1;
+    Dbg->CodeWindow.Id = -1;
+    Dbg->FollowPC = true;
+    if (!DebugSnapshot_Init(&Dbg->Snapshots, Bios))
+        return false;
+
+    /* every window has its own GL context, its textures are created while it's the current one */
+    if (!Debugger_OpenWindow(&Dbg->VramWindow, GPU_VRAM_WIDTH, GPU_VRAM_HEIGHT + DEBUGGER_VRAM_LEGEND_HEIGHT, "VRAM"))
+        goto Fail;
+    Image Blank = GenImageColor(GPU_VRAM_WIDTH, GPU_VRAM_HEIGHT, BLACK);
+    Dbg->VramTexture = LoadTextureFromImage(Blank);
+    UnloadImage(Blank);
+
+    if (!Debugger_OpenWindow(&Dbg->MemoryWindow,
+        DEBUGGER_MEMORY_WIDTH, DEBUGGER_HEADER_HEIGHT + DEBUGGER_PANEL_HEIGHT, "RAM"))
+        goto Fail;
+    Debugger_PanelInit(&Dbg->Memory, DEBUGGER_MEMORY_WIDTH, DEBUGGER_MAX_LINES);
+
+    if (!Debugger_OpenWindow(&Dbg->CodeWindow,
+        DEBUGGER_CODE_WIDTH + DEBUGGER_REGISTERS_WIDTH, DEBUGGER_HEADER_HEIGHT + DEBUGGER_PANEL_HEIGHT, "Code"))
+        goto Fail;
+    Debugger_PanelInit(&Dbg->Code, DEBUGGER_CODE_WIDTH, DEBUGGER_MAX_LINES);
+    Debugger_PanelInit(&Dbg->Registers, DEBUGGER_REGISTERS_WIDTH, DEBUGGER_MAX_LINES);
+
+    Debugger_UpdateFrameRate(Dbg);
+    return true;
+
+Fail:
+    Debugger_Destroy(Dbg);
+    return false;
+}
+
+void Debugger_Destroy(Debugger *Dbg)
+{
+    if (Dbg->VramWindow.Id >= 0)
+    {
+        SetActiveWindowContext(Dbg->VramWindow.Id);
+        UnloadTexture(Dbg->VramTexture);
+        Debugger_CloseWindow(&Dbg->VramWindow);
+    }
+    if (Dbg->MemoryWindow.Id >= 0)
+    {
+        SetActiveWindowContext(Dbg->MemoryWindow.Id);
+        Debugger_PanelDestroy(&Dbg->Memory);
+        Debugger_CloseWindow(&Dbg->MemoryWindow);
+    }
+    if (Dbg->CodeWindow.Id >= 0)
+    {
+        SetActiveWindowContext(Dbg->CodeWindow.Id);
+        Debugger_PanelDestroy(&Dbg->Code);
+        Debugger_PanelDestroy(&Dbg->Registers);
+        Debugger_CloseWindow(&Dbg->CodeWindow);
+    }
+    DebugSnapshot_Destroy(&Dbg->Snapshots);
+}
+
+void Debugger_Present(Debugger *Dbg)
+{
+    if (0 == Debugger_OpenWindowCount(Dbg))
+        return;
+
+    /* the same snapshot for all windows */
+    Bool8 IsNew;
+    const DebugSnapshot *Snap = DebugSnapshot_Read(&Dbg->Snapshots, &IsNew);
+    Dbg->HasSnapshot |= IsNew;
+    Dbg->LinesRedrawn = IsNew? 0 : Dbg->LinesRedrawn;
+    Debugger_GatherInput(Dbg);
+    Debugger_SampleKeys(Dbg);
+    Dbg->WheelUsed = false;
+
+    uint WasOpen = Debugger_OpenWindowCount(Dbg);
+    if (Dbg->VramWindow.Id >= 0)
+    {
+        SetActiveWindowContext(Dbg->VramWindow.Id);
+        if (WindowShouldClose())
+        {
+            UnloadTexture(Dbg->VramTexture);
+            Debugger_CloseWindow(&Dbg->VramWindow);
+        }
+        else
+        {
+            if (IsNew)
+                Debugger_RefreshVram(Dbg, Snap);
+            Debugger_DrawVramWindow(Dbg, Snap);
+            Debugger_GatherInput(Dbg);
+        }
+    }
+    if (Dbg->MemoryWindow.Id >= 0)
+    {
+        SetActiveWindowContext(Dbg->MemoryWindow.Id);
+        if (WindowShouldClose())
+        {
+            Debugger_PanelDestroy(&Dbg->Memory);
+            Debugger_CloseWindow(&Dbg->MemoryWindow);
+        }
+        else
+        {
+            Debugger_DrawMemoryWindow(Dbg, Snap, IsNew);
+            Debugger_GatherInput(Dbg);
+        }
+    }
+    if (Dbg->CodeWindow.Id >= 0)
+    {
+        SetActiveWindowContext(Dbg->CodeWindow.Id);
+        if (WindowShouldClose())
+        {
+            Debugger_PanelDestroy(&Dbg->Code);
+            Debugger_PanelDestroy(&Dbg->Registers);
+            Debugger_CloseWindow(&Dbg->CodeWindow);
+        }
+        else
+        {
+            Debugger_DrawCodeWindow(Dbg, Snap, IsNew);
+            Debugger_GatherInput(Dbg);
+        }
+    }
+
+    /* none of the scrolling windows has the focus, the wheel was for another window */
+    if (!Dbg->WheelUsed)
+        Dbg->Wheel = 0;
+    if (WasOpen != Debugger_OpenWindowCount(Dbg))
+        Debugger_UpdateFrameRate(Dbg);
+}
+
@@ -0,0 +1,615 @@
+
+#include <stdio.h>  /* fopen */
+#include <string.h> /* memcpy, strncmp */
+#include <ctype.h>  /* toupper, isspace */
+
+#include "Common.h"
+#include "Platform.h"
+#include "Disc.h"
+
+/* 
+ * inflating packed images, the raylib library has the implementation already unless it's left out;
+ * one of its (static) functions is unused and would warn 
+ */
+#if defined(__GNUC__)
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wunused-function"
+#endif /* __GNUC__ */
+#ifdef PS1_NO_FRONTEND
+#  define SINFL_IMPLEMENTATION
+#endif /* PS1_NO_FRONTEND */
+#include "external/sinfl.h"
+#if defined(__GNUC__)
+#  pragma GCC diagnostic pop
+#endif /* __GNUC__ */
+
+
+#define DISC_MAX_CUE_SIZE (64 * KB)
+#define DISC_MAX_PATH 1024
+
+
+
+static Bool8 Disc_HasExtension(const char *Path, const char *Extension)
+{
+    size_t PathLength = strlen(Path);
+    size_t ExtensionLength = strlen(Extension);
+    if (PathLength < ExtensionLength)
+        return false;
+
+    const char *End = Path + PathLength - ExtensionLength;
+    for (size_t i = 0; i < ExtensionLength; i++)
+    {
+        if (toupper((unsigned char)End[i]) != toupper((unsigned char)Extension[i]))
+            return false;
+    }
+    return true;
+}
+
+/* mm:ss:ff to a sector count */
+static Bool8 Disc_ParseMSF(const char *Text, u32 *OutSectors)
+{
+    uint Minute, Second, Frame;
+    if (3 != sscanf(Text, "%u:%u:%u", &Minute, &Second, &Frame) || Second >= 60 || Frame >= 75)
+        return false;
+    *OutSectors = (Minute*60 + Second)*75 + Frame;
+    return true;
+}
+
+static Bool8 Disc_AddFile(Disc *Disc, const char *Path)
+{
+    if (Disc->FileCount == DISC_MAX_TRACKS)
+    {
+        LOG("Disc: too many files\n");
+        return false;
+    }
+
+    Platform_MappedFile *File = &Disc->Files[Disc->FileCount];
+    if (!Platform_MapFile(File, Path))
+    {
+        LOG("Disc: unable to open '%s'\n", Path);
+        return false;
+    }
+    if (File->Size % DISC_SECTOR_SIZE)
+        LOG("Disc: '%s' is not a whole number of %d byte sectors, the last one is ignored\n", Path, DISC_SECTOR_SIZE);
+    Disc->FileCount++;
+    return true;
+}
+
+static u32 Disc_FileSectors(const Disc *Disc, uint File)
+{
+    return (u32)(Disc->Files[File].Size / DISC_SECTOR_SIZE);
+}
+
+/*
+ * FILE, TRACK, PREGAP and INDEX 00/01 are all that's needed to lay the tracks out, the rest is ignored.
+ * Positions in a cue sheet are relative to the start of the current FILE,
+ * which follows the previous file on the disc; PREGAP sectors aren't in any file.
+ */
+static Bool8 Disc_ParseCue(Disc *Disc, const char *CuePath)
+{
+    FILE *F = fopen(CuePath, "rb");
+    if (NULL == F)
+    {
+        LOG("Disc: unable to open '%s'\n", CuePath);
+        return false;
+    }
+    char *Cue = malloc(DISC_MAX_CUE_SIZE + 1);
+    ASSERT(Cue != NULL);
+    size_t CueSize = fread(Cue, 1, DISC_MAX_CUE_SIZE, F);
+    fclose(F);
+    Cue[CueSize] = '\0';
+
+    /* file names are relative to the cue sheet */
+    char Path[DISC_MAX_PATH];
+    size_t DirectoryLength = 0;
+    for (size_t i = 0; CuePath[i]; i++)
+    {
+        if ('/' == CuePath[i] || '\\' == CuePath[i])
+            DirectoryLength = i + 1;
+    }
+    DirectoryLength = MIN(DirectoryLength, sizeof Path - 1);
+
+    Bool8 Ok = true;
+    u32 FileBase = 0;       /* LBA of the current file's first sector */
+    u32 Pregaps = 0;        /* PREGAP sectors so far */
+    Disc_Track *Track = NULL;
+    Bool8 HasIndex0 = false;
+    for (char *Line = strtok(Cue, "\r\n"); Line && Ok; Line = strtok(NULL, "\r\n"))
+    {
+        while (isspace((unsigned char)*Line))
+            Line++;
+
+        if (0 == strncmp(Line, "FILE ", 5))
+        {
+            /* FILE "name" BINARY, the quotes are optional when the name has no spaces */
+            char *Name = Line + 5;
+            char *NameEnd;
+            while (isspace((unsigned char)*Name))
+                Name++;
+            if ('"' == *Name)
+                NameEnd = strchr(++Name, '"');
+            else NameEnd = strpbrk(Name, " \t");
+            if (NULL == NameEnd || NULL == strstr(NameEnd, "BINARY"))
+            {
+                LOG("Disc: unsupported FILE line in '%s': %s\n", CuePath, Line);
+                Ok = false;
+                break;
+            }
+            *NameEnd = '\0';
+
+            if (Disc->FileCount)
+                FileBase += Disc_FileSectors(Disc, Disc->FileCount - 1);
+            snprintf(Path, sizeof Path, "%.*s%s", (int)DirectoryLength, CuePath, Name);
+            Ok = Disc_AddFile(Disc, Path);
+        }
+        else if (0 == strncmp(Line, "TRACK ", 6))
+        {
+            uint Number;
+            char Type[32];
+            if (2 != sscanf(Line + 6, "%u %31s", &Number, Type) || 0 == Disc->FileCount)
+            {
+                LOG("Disc: invalid TRACK line in '%s': %s\n", CuePath, Line);
+                Ok = false;
+                break;
+            }
+            Bool8 Audio = 0 == strcmp(Type, "AUDIO");
+            if (!Audio && !strstr(Type, "/2352"))
+            {
+                LOG("Disc: track %u of '%s' is %s, only raw 2352 byte sectors are supported\n", Number, CuePath, Type);
+                Ok = false;
+                break;
+            }
+            if (Disc->TrackCount == DISC_MAX_TRACKS)
+            {
+                Ok = false;
+                break;
+            }
+
+            Track = &Disc->Tracks[Disc->TrackCount++];
+            *Track = (Disc_Track) {
+                .Number = Number,
+                .Audio = Audio,
+                .File = Disc->FileCount - 1,
+                .Start = ~(u32)0,
+            };
+            HasIndex0 = false;
+        }
+        else if (0 == strncmp(Line, "PREGAP ", 7) && Track)
+        {
+            u32 Sectors = 0;
+            if (!Disc_ParseMSF(Line + 7, &Sectors))
+            {
+                LOG("Disc: invalid PREGAP line in '%s': %s\n", CuePath, Line);
+                Ok = false;
+                break;
+            }
+            Pregaps += Sectors;
+        }
+        else if (0 == strncmp(Line, "INDEX ", 6) && Track)
+        {
+            uint Index = 0;
+            char Time[16];
+            u32 Position = 0;
+            if (2 != sscanf(Line + 6, "%u %15s", &Index, Time) || !Disc_ParseMSF(Time, &Position))
+            {
+                LOG("Disc: invalid INDEX line in '%s': %s\n", CuePath, Line);
+                Ok = false;
+                break;
+            }
+            if (0 == Index)
+            {
+                Track->DataStart = FileBase + Pregaps + Position;
+                Track->FileSector = Position;
+                HasIndex0 = true;
+            }
+            else if (1 == Index)
+            {
+                Track->Start = FileBase + Pregaps + Position;
+                if (!HasIndex0)
+                {
+                    Track->DataStart = Track->Start;
+                    Track->FileSector = Position;
+                }
+            }
+        }
+    }
+    free(Cue);
+
+    if (Ok && 0 == Disc->TrackCount)
+    {
+        LOG("Disc: no track in '%s'\n", CuePath);
+        Ok = false;
+    }
+    /* each track's data runs up to the next track in the same file, or the end of the file */
+    for (uint i = 0; i < Disc->TrackCount && Ok; i++)
+    {
+        Disc_Track *Current = &Disc->Tracks[i];
+        if (~(u32)0 == Current->Start)
+        {
+            LOG("Disc: track %u of '%s' has no INDEX 01\n", Current->Number, CuePath);
+            Ok = false;
+            break;
+        }
+
+        u32 End = Disc_FileSectors(Disc, Current->File);
+        if (i + 1 < Disc->TrackCount && Disc->Tracks[i + 1].File == Current->File)
+            End = Disc->Tracks[i + 1].FileSector;
+        Current->SectorCount = End > Current->FileSector? End - Current->FileSector : 0;
+    }
+    return Ok;
+}
+
+/* same as a cue sheet with a single MODE2/2352 track */
+static Bool8 Disc_OpenBin(Disc *Disc, const char *Path)
+{
+    if (!Disc_AddFile(Disc, Path))
+        return false;
+    Disc->Tracks[0] = (Disc_Track) {
+        .Number = 1,
+        .SectorCount = Disc_FileSectors(Disc, 0),
+    };
+    Disc->TrackCount = 1;
+    return true;
+}
+
+static u32 Disc_HunkChecksum(const Disc *Disc, u32 Hunk)
+{
+    u32 Checksum;
+    memcpy(&Checksum, Disc->HunkChecksums + Hunk*sizeof(u32), sizeof Checksum);
+    return Checksum;
+}
+
+static u64 Disc_HunkOffset(const Disc *Disc, u32 Hunk)
+{
+    u64 Offset;
+    memcpy(&Offset, Disc->HunkOffsets + Hunk*sizeof(u64), sizeof Offset);
+    return Offset;
+}
+
+static Bool8 Disc_OpenPacked(Disc *Disc, const char *Path)
+{
+    const Platform_MappedFile *File = &Disc->Files[0];
+    if (!Platform_MapFile(&Disc->Files[0], Path))
+    {
+        LOG("Disc: unable to open '%s'\n", Path);
+        return false;
+    }
+    Disc->FileCount = 1;
+    Disc_PackHeader Header;
+    if (File->Size < sizeof Header)
+    {
+        LOG("Disc: '%s' is too small to be a packed image\n", Path);
+        return false;
+    }
+    memcpy(&Header, File->Data, sizeof Header);
+    if (0 != memcmp(Header.Magic, DISC_PACK_MAGIC, sizeof Header.Magic) || DISC_PACK_VERSION != Header.Version)
+    {
+        LOG("Disc: '%s' is not a packed image, or from another version of PackDisc\n", Path);
+        return false;
+    }
+    u32 HunkCount = (Header.SectorCount + Header.HunkSectors - 1) / MAX(Header.HunkSectors, 1);
+    u64 TracksOffset = sizeof Header;
+    u64 OffsetsOffset = TracksOffset + (u64)Header.TrackCount*sizeof(Disc_PackTrack);
+    u64 ChecksumsOffset = OffsetsOffset + ((u64)HunkCount + 1)*sizeof(u64);
+    u64 HunksOffset = ChecksumsOffset + (u64)HunkCount*sizeof(u32);
+    if (!IN_RANGE(1, Header.HunkSectors, DISC_PACK_MAX_HUNK_SECTORS)
+    || !IN_RANGE(1, Header.TrackCount, DISC_MAX_TRACKS)
+    || HunkCount != Header.HunkCount
+    || HunksOffset > File->Size)
+    {
+        LOG("Disc: the header of '%s' is corrupted\n", Path);
+        return false;
+    }
+
+    Disc->Packed = true;
+    Disc->SectorCount = Header.SectorCount;     /* what the hunks hold, Disc_Open goes by the tracks */
+    Disc->HunkSectors = Header.HunkSectors;
+    Disc->HunkCount = HunkCount;
+    Disc->HunkOffsets = File->Data + OffsetsOffset;
+    Disc->HunkChecksums = File->Data + ChecksumsOffset;
+    for (u32 i = 0; i < HunkCount; i++)
+    {
+        u64 Start = Disc_HunkOffset(Disc, i);
+        u64 End = Disc_HunkOffset(Disc, i + 1);
+        if (Start < HunksOffset || Start > End || End > File->Size)
+        {
+            LOG("Disc: the hunk index of '%s' is corrupted\n", Path);
+            return false;
+        }
+    }
+    /* the offsets only go up, so this is past every hunk: the inflater reads a little ahead */
+    if (Disc_HunkOffset(Disc, HunkCount) + DISC_PACK_PADDING > File->Size)
+    {
+        LOG("Disc: '%s' is truncated\n", Path);
+        return false;
+    }
+
+    /* the whole disc is one run of sectors, gaps included */
+    Disc->TrackCount = Header.TrackCount;
+    for (uint i = 0; i < Header.TrackCount; i++)
+    {
+        Disc_PackTrack Packed;
+        memcpy(&Packed, File->Data + TracksOffset + i*sizeof Packed, sizeof Packed);
+        /* every track is in the hunks, in order */
+        const Disc_Track *Previous = i? &Disc->Tracks[i - 1] : NULL;
+        if (Packed.Start > Header.SectorCount || Packed.DataStart > Header.SectorCount
+        || (Previous && (Packed.Start < Previous->Start || Packed.DataStart < Previous->DataStart)))
+        {
+            LOG("Disc: the track list of '%s' is corrupted\n", Path);
+            return false;
+        }
+        Disc->Tracks[i] = (Disc_Track) {
+            .Number = Packed.Number,
+            .Audio = 0 != Packed.Audio,
+            .Start = Packed.Start,
+            .DataStart = Packed.DataStart,
+            .FileSector = Packed.DataStart,
+        };
+    }
+    for (uint i = 0; i < Header.TrackCount; i++)
+    {
+        Disc_Track *Track = &Disc->Tracks[i];
+        u32 End = i + 1 < Header.TrackCount? Disc->Tracks[i + 1].DataStart : Header.SectorCount;
+        Track->SectorCount = End > Track->DataStart? End - Track->DataStart : 0;
+    }
+
+    for (uint i = 0; i < DISC_HUNK_CACHE_COUNT; i++)
+    {
+        Disc->Hunks[i] = (Disc_Hunk) {
+            .Data = malloc(Header.HunkSectors*DISC_SECTOR_SIZE),
+        };
+        ASSERT(Disc->Hunks[i].Data != NULL);
+    }
+    return true;
+}
+
+/* the hunk with Index, inflated, from the cache or in place of the least recently used one */
+static const u8 *Disc_LoadHunk(Disc *Disc, u32 Index)
+{
+    Disc_Hunk *Hunk = &Disc->Hunks[0];
+    for (uint i = 0; i < DISC_HUNK_CACHE_COUNT; i++)
+    {
+        Disc_Hunk *Slot = &Disc->Hunks[i];
+        if (Slot->Valid && Slot->Index == Index)
+        {
+            Slot->LastUse = ++Disc->HunkClock;
+            Disc->HunkHits++;
+            return Slot->Data;
+        }
+        if (!Slot->Valid || (Hunk->Valid && Slot->LastUse < Hunk->LastUse))
+            Hunk = Slot;
+    }
+
+    if (Index >= Disc->HunkCount)
+    {
+        memset(Hunk->Data, 0, Disc->HunkSectors*DISC_SECTOR_SIZE);
+        Hunk->Valid = false;
+        return Hunk->Data;
+    }
+    u64 Start = Disc_HunkOffset(Disc, Index);
+    u64 End = Disc_HunkOffset(Disc, Index + 1);
+    const u8 *Compressed = Disc->Files[0].Data + Start;
+    int Size = (int)MIN(Disc->HunkSectors, Disc->SectorCount - Index*Disc->HunkSectors) * DISC_SECTOR_SIZE;
+    if (Disc_Checksum(Compressed, End - Start) != Disc_HunkChecksum(Disc, Index))
+    {
+        LOG("Disc: hunk %u is corrupted, its sectors read as zeros\n", Index);
+        memset(Hunk->Data, 0, Size);
+    }
+    else if (End - Start == (u64)Size) /* stored */
+    {
+        memcpy(Hunk->Data, Compressed, Size);
+    }
+    else if (sinflate(Hunk->Data, Size, Compressed, (int)(End - Start)) != Size)
+    {
+        LOG("Disc: hunk %u is corrupted, its sectors read as zeros\n", Index);
+        memset(Hunk->Data, 0, Size);
+    }
+    Hunk->Index = Index;
+    Hunk->Valid = true;
+    Hunk->LastUse = ++Disc->HunkClock;
+    Disc->HunksInflated++;
+    return Hunk->Data;
+}
+
+static void Disc_FreeFiles(Disc *Disc)
+{
+    for (uint i = 0; i < Disc->FileCount; i++)
+        Platform_UnmapFile(&Disc->Files[i]);
+    for (uint i = 0; i < DISC_HUNK_CACHE_COUNT; i++)
+        free(Disc->Hunks[i].Data);
+}
+
+void Disc_LoadSector(Disc *Disc, u32 LBA, u8 Out[DISC_SECTOR_SIZE])
+{
+    if (Disc->Packed)
+    {
+        if (LBA < Disc->SectorCount)
+        {
+            const u8 *Hunk = Disc_LoadHunk(Disc, LBA / Disc->HunkSectors);
+            memcpy(Out, Hunk + (LBA % Disc->HunkSectors)*DISC_SECTOR_SIZE, DISC_SECTOR_SIZE);
+        }
+        else memset(Out, 0, DISC_SECTOR_SIZE);
+        return;
+    }
+
+    /* the pages of the mapping are faulted in here */
+    const Disc_Track *Track = Disc_FindTrack(Disc, LBA);
+    if (Track && LBA - Track->DataStart < Track->SectorCount)
+    {
+        u64 FileSector = Track->FileSector + (LBA - Track->DataStart);
+        memcpy(Out, Disc->Files[Track->File].Data + FileSector*DISC_SECTOR_SIZE, DISC_SECTOR_SIZE);
+    }
+    else memset(Out, 0, DISC_SECTOR_SIZE);
+}
+
+static void Disc_ReadAheadThread(void *UserData)
+{
+    Disc *Disc = UserData;
+    u8 Sector[DISC_SECTOR_SIZE];
+
+    Platform_MutexLock(&Disc->Lock);
+    while (!Disc->Quit)
+    {
+        /* the first sector of the window that isn't cached yet */
+        u32 End = MIN(Disc->ReadAhead + DISC_READ_AHEAD_SECTORS, Disc->SectorCount);
+        u32 LBA = Disc->ReadAhead;
+        while (LBA < End && Disc->Cache[LBA % DISC_CACHE_SECTORS].Valid && Disc->Cache[LBA % DISC_CACHE_SECTORS].LBA == LBA)
+            LBA++;
+        if (LBA >= End)
+        {
+            Platform_CondVarWait(&Disc->Wake, &Disc->Lock);
+            continue;
+        }
+
+        Platform_MutexUnlock(&Disc->Lock);
+        Disc_LoadSector(Disc, LBA, Sector);
+        Platform_MutexLock(&Disc->Lock);
+
+        /* the window may have moved while the lock was released, don't evict a sector of the new one */
+        if (LBA - Disc->ReadAhead < DISC_READ_AHEAD_SECTORS)
+        {
+            Disc_CacheSlot *Slot = &Disc->Cache[LBA % DISC_CACHE_SECTORS];
+            memcpy(Slot->Data, Sector, DISC_SECTOR_SIZE);
+            Slot->LBA = LBA;
+            Slot->Valid = true;
+        }
+    }
+    Platform_MutexUnlock(&Disc->Lock);
+}
+
+/* the license string's last word: "Sony Computer Entertainment Amer  ica", "Euro pe" or "Inc." */
+static void Disc_DetectRegion(Disc *Disc)
+{
+    u8 Sector[DISC_SECTOR_SIZE];
+    Disc_LoadSector(Disc, 4, Sector);
+    const char *Region = "SCEA";
+    for (uint i = 24; i + 4 <= 24 + 2048; i++)
+    {
+        if (0 == memcmp(Sector + i, "Euro", 4))
+        {
+            Region = "SCEE";
+            break;
+        }
+        if (0 == memcmp(Sector + i, "Inc.", 4))
+        {
+            Region = "SCEI";
+            break;
+        }
+    }
+    memcpy(Disc->Region, Region, sizeof Disc->Region);
+}
+
+
+
+Bool8 Disc_Open(Disc *Disc, const char *Path)
+{
+    *Disc = (struct Disc) { 0 };
+    Bool8 Ok = Disc_HasExtension(Path, ".cue")? Disc_ParseCue(Disc, Path)
+        : Disc_HasExtension(Path, ".cdz")? Disc_OpenPacked(Disc, Path)
+        : Disc_OpenBin(Disc, Path);
+    if (!Ok)
+    {
+        Disc_FreeFiles(Disc);
+        return false;
+    }
+
+    const Disc_Track *Last = &Disc->Tracks[Disc->TrackCount - 1];
+    u32 End = Last->DataStart + Last->SectorCount;
+    Disc->SectorCount = Disc->Packed? MIN(End, Disc->SectorCount) : End;
+    Disc_DetectRegion(Disc);
+
+    Platform_MutexInit(&Disc->Lock);
+    Platform_CondVarInit(&Disc->Wake);
+    if (!Platform_ThreadCreate(&Disc->Thread, Disc_ReadAheadThread, Disc))
+    {
+        LOG("Disc: unable to start the read-ahead thread\n");
+        Platform_CondVarDestroy(&Disc->Wake);
+        Platform_MutexDestroy(&Disc->Lock);
+        Disc_FreeFiles(Disc);
+        return false;
+    }
+    return true;
+}
+
+void Disc_Close(Disc *Disc)
+{
+    Platform_MutexLock(&Disc->Lock);
+    Disc->Quit = true;
+    Platform_CondVarSignal(&Disc->Wake);
+    Platform_MutexUnlock(&Disc->Lock);
+    Platform_ThreadJoin(&Disc->Thread);
+
+    Platform_CondVarDestroy(&Disc->Wake);
+    Platform_MutexDestroy(&Disc->Lock);
+    Disc_FreeFiles(Disc);
+}
+
+Disc_SectorStatus Disc_ReadSector(Disc *Disc, u32 LBA, u8 Out[DISC_SECTOR_SIZE])
+{
+    if (LBA >= Disc->SectorCount)
+        return DISC_SECTOR_OUT_OF_RANGE;
+
+    Disc_SectorStatus Status = DISC_SECTOR_PENDING;
+    Platform_MutexLock(&Disc->Lock);
+    const Disc_CacheSlot *Slot = &Disc->Cache[LBA % DISC_CACHE_SECTORS];
+    if (Slot->Valid && Slot->LBA == LBA)
+    {
+        memcpy(Out, Slot->Data, DISC_SECTOR_SIZE);
+        Status = DISC_SECTOR_READY;
+        LBA++; /* the window moves on */
+    }
+    if (Disc->ReadAhead != LBA)
+    {
+        Disc->ReadAhead = LBA;
+        Platform_CondVarSignal(&Disc->Wake);
+    }
+    Platform_MutexUnlock(&Disc->Lock);
+
+    if (DISC_SECTOR_READY == Status)
+        Disc->Hits++;
+    else Disc->Misses++;
+    return Status;
+}
+
+void Disc_Prefetch(Disc *Disc, u32 LBA)
+{
+    Platform_MutexLock(&Disc->Lock);
+    if (Disc->ReadAhead != LBA)
+    {
+        Disc->ReadAhead = LBA;
+        Platform_CondVarSignal(&Disc->Wake);
+    }
+    Platform_MutexUnlock(&Disc->Lock);
+}
+
+u32 Disc_Checksum(const u8 *Data, u64 Size)
+{
+    /* 5552 bytes at most between the modulos, the sums can't overflow 32 bits before that */
+    u32 A = 1, B = 0;
+    while (Size)
+    {
+        u64 Count = MIN(Size, 5552);
+        for (u64 i = 0; i < Count; i++)
+        {
+            A += Data[i];
+            B += A;
+        }
+        A %= 65521;
+        B %= 65521;
+        Data += Count;
+        Size -= Count;
+    }
+    return B << 16 | A;
+}
+
+const Disc_Track *Disc_FindTrack(const Disc *Disc, u32 LBA)
+{
+    if (LBA >= Disc->SectorCount)
+        return NULL;
+
+    const Disc_Track *Found = NULL;
+    for (uint i = 0; i < Disc->TrackCount && Disc->Tracks[i].DataStart <= LBA; i++)
+        Found = &Disc->Tracks[i];
+    return Found;
+}
+
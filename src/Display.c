@@ -0,0 +1,250 @@
+#include <string.h> /* memcpy */
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Rasterizer.h"
+#include "Display.h"
+
+
+
+void Display_GetResolution(const GPU *Gpu, uint *OutWidth, uint *OutHeight)
+{
+    /* HorizontalResolution: xx1: 368; 000: 256; 010: 320; 100: 512; 110: 640 */
+    static const u16 sWidthLUT[4] = { 256, 320, 512, 640 };
+    uint HorRes = Gpu->Status.HorizontalResolution;
+    uint Width = (HorRes & 1)? 368 : sWidthLUT[(HorRes >> 1) & 3];
+
+    /* number of lines comes from the vertical display range */
+    uint Height = 240;
+    if (Gpu->DisplayLineEnd > Gpu->DisplayLineStart)
+    {
+        Height = MIN(Gpu->DisplayLineEnd - Gpu->DisplayLineStart, DISPLAY_MAX_HEIGHT / 2);
+    }
+    if (Gpu->Status.VerticalResolution && Gpu->Status.InterlaceEnable)
+    {
+        Height *= 2;
+    }
+
+    *OutWidth = Width;
+    *OutHeight = Height;
+}
+
+
+void Display_ConvertRow15(u32 *Dst, const u16 *Src, uint Count)
+{
+    uint i = 0;
+#ifdef HAS_SSE2
+    const __m128i Comp5Mask = _mm_set1_epi16(0x1F);
+    const __m128i Alpha = _mm_set1_epi16((i16)0xFF00);
+    for (; i + 8 <= Count; i += 8)
+    {
+        /* XBBBBBGGGGGRRRRR to 8 bit components in 16 bit lanes, low bits are replicated from the high bits */
+        __m128i Pixels = _mm_loadu_si128((const __m128i *)(Src + i));
+        __m128i R = _mm_and_si128(Pixels, Comp5Mask);
+        __m128i G = _mm_and_si128(_mm_srli_epi16(Pixels, 5), Comp5Mask);
+        __m128i B = _mm_and_si128(_mm_srli_epi16(Pixels, 10), Comp5Mask);
+        R = _mm_or_si128(_mm_slli_epi16(R, 3), _mm_srli_epi16(R, 2));
+        G = _mm_or_si128(_mm_slli_epi16(G, 3), _mm_srli_epi16(G, 2));
+        B = _mm_or_si128(_mm_slli_epi16(B, 3), _mm_srli_epi16(B, 2));
+
+        /* interleave the RG and BA halfwords into RGBA words */
+        __m128i RG = _mm_or_si128(R, _mm_slli_epi16(G, 8));
+        __m128i BA = _mm_or_si128(B, Alpha);
+        _mm_storeu_si128((__m128i *)(Dst + i + 0), _mm_unpacklo_epi16(RG, BA));
+        _mm_storeu_si128((__m128i *)(Dst + i + 4), _mm_unpackhi_epi16(RG, BA));
+    }
+#endif /* HAS_SSE2 */
+    for (; i < Count; i++)
+    {
+        u32 R = (Src[i] >> 0) & 0x1F;
+        u32 G = (Src[i] >> 5) & 0x1F;
+        u32 B = (Src[i] >> 10) & 0x1F;
+        Dst[i] = DISPLAY_RGBA(R << 3 | R >> 2, G << 3 | G >> 2, B << 3 | B >> 2);
+    }
+}
+
+void Display_ConvertRow24(u32 *Dst, const u8 *Src, uint Count)
+{
+    uint i = 0;
+#ifdef HAS_SSE2
+    const __m128i ColorMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i Alpha = _mm_set1_epi32((i32)0xFF000000);
+    for (; i + 4 <= Count; i += 4)
+    {
+        /* 4 pixels are in 12 bytes, shift each one down to the bottom of a lane and gather the low words */
+        __m128i Bytes = _mm_loadu_si128((const __m128i *)(Src + i*3));
+        __m128i P01 = _mm_unpacklo_epi32(Bytes, _mm_srli_si128(Bytes, 3));
+        __m128i P23 = _mm_unpacklo_epi32(_mm_srli_si128(Bytes, 6), _mm_srli_si128(Bytes, 9));
+        __m128i Pixels = _mm_unpacklo_epi64(P01, P23);
+        _mm_storeu_si128((__m128i *)(Dst + i), _mm_or_si128(_mm_and_si128(Pixels, ColorMask), Alpha));
+    }
+#endif /* HAS_SSE2 */
+    for (; i < Count; i++)
+    {
+        Dst[i] = DISPLAY_RGBA(Src[i*3 + 0], Src[i*3 + 1], Src[i*3 + 2]);
+    }
+}
+
+
+/* Vram is Scale times the size of VRAM (Scale is always 1 in 24 bit mode), Width is in its pixels */
+static void Display_ConvertVramRow(const GPU *Gpu, const u16 *Vram, uint Scale, u32 *Dst, u32 VramY, uint Width)
+{
+    uint VramWidth = GPU_VRAM_WIDTH * Scale;
+    const u16 *VramRow = &Vram[VramY*VramWidth];
+    u32 StartX = Gpu->DisplayVRAMStartX * Scale;
+
+    if (Gpu->Status.DisplayDisable)
+    {
+        for (uint x = 0; x < Width; x++)
+            Dst[x] = DISPLAY_RGBA(0, 0, 0);
+    }
+    else if (Gpu->Status.DisplayRGB24)
+    {
+        /* gather the row first, it can wrap around and the converter reads a few bytes past the end */
+        u16 Row[(DISPLAY_MAX_WIDTH*3)/2 + 8];
+        uint HalfwordCount = (Width*3 + 1) / 2;
+        uint FirstRun = MIN(HalfwordCount, GPU_VRAM_WIDTH - StartX);
+        memcpy(Row, VramRow + StartX, FirstRun*sizeof(u16));
+        memcpy(Row + FirstRun, VramRow, (HalfwordCount - FirstRun)*sizeof(u16));
+        memset(Row + HalfwordCount, 0, 8*sizeof(u16));
+        Display_ConvertRow24(Dst, (const u8 *)Row, Width);
+    }
+    else
+    {
+        uint FirstRun = MIN(Width, VramWidth - StartX);
+        Display_ConvertRow15(Dst, VramRow + StartX, FirstRun);
+        Display_ConvertRow15(Dst + FirstRun, VramRow, Width - FirstRun);
+    }
+}
+
+void Display_Output(Display_State *State, GPU *Gpu, const Display_Sink *Sink)
+{
+    uint Width, Height, Pitch;
+    Display_GetResolution(Gpu, &Width, &Height);
+
+    /* 24 bit images are uploaded, never drawn, so they're only in native VRAM */
+    uint Scale = 1;
+    const u16 *Vram = Gpu->Vram;
+    if (Gpu->Upscaler && !Gpu->Status.DisplayRGB24)
+    {
+        Vram = Raster_GetUpscaledVram(Gpu, &Scale);
+        Width *= Scale;
+        Height *= Scale;
+    }
+    u32 *Pixels = Sink->BeginFrame(Sink->Context, Width, Height, &Pitch);
+    if (NULL == Pixels)
+    {
+        /* the sink's buffer can't be trusted anymore */
+        State->Pixels = NULL;
+        return;
+    }
+
+    Bool8 Rgb24 = Gpu->Status.DisplayRGB24;
+    Bool8 Disabled = Gpu->Status.DisplayDisable;
+    Bool8 FullFrame = Pixels != State->Pixels
+        || Width != State->Width || Height != State->Height || Pitch != State->Pitch
+        || Gpu->DisplayVRAMStartX != State->VramX || Gpu->DisplayVRAMStartY != State->VramY
+        || Scale != State->Scale || Rgb24 != State->Rgb24 || Disabled != State->Disabled;
+
+    /* halfwords of VRAM that one displayed row spans */
+    uint RowHalfwords = Rgb24? (Width*3 + 1) / 2 : Width / Scale;
+    u64 Columns = GPU_DirtyColumnMask(Gpu->DisplayVRAMStartX, RowHalfwords);
+
+    uint DirtyRowStart = Height, DirtyRowEnd = 0;
+    for (uint y = 0; y < Height; y++)
+    {
+        u32 VramY = (Gpu->DisplayVRAMStartY + y / Scale) % GPU_VRAM_HEIGHT;
+        if (!FullFrame && !(Gpu->DirtyTiles[VramY / GPU_DIRTY_TILE_SIZE] & Columns))
+        {
+            State->RowsSkipped++;
+            continue;
+        }
+
+        Display_ConvertVramRow(Gpu, Vram, Scale, Pixels + (iSize)y*Pitch, VramY*Scale + y % Scale, Width);
+        DirtyRowStart = MIN(DirtyRowStart, y);
+        DirtyRowEnd = y + 1;
+        State->RowsConverted++;
+    }
+    memset(Gpu->DirtyTiles, 0, sizeof Gpu->DirtyTiles);
+    if (DirtyRowStart > DirtyRowEnd)
+        DirtyRowStart = DirtyRowEnd = 0;
+
+    State->Pixels = Pixels;
+    State->Width = Width;
+    State->Height = Height;
+    State->Pitch = Pitch;
+    State->VramX = Gpu->DisplayVRAMStartX;
+    State->VramY = Gpu->DisplayVRAMStartY;
+    State->Scale = Scale;
+    State->Rgb24 = Rgb24;
+    State->Disabled = Disabled;
+    State->FrameCount++;
+
+    Display_Frame Frame = {
+        .Pixels = Pixels,
+        .Width = Width,
+        .Height = Height,
+        .Pitch = Pitch,
+        .DirtyRowStart = DirtyRowStart,
+        .DirtyRowEnd = DirtyRowEnd,
+        .Pal = Gpu->Status.VideoMode,
+    };
+    Sink->EndFrame(Sink->Context, &Frame);
+}
+
+double Display_SkippedFraction(const Display_State *State)
+{
+    u64 Total = State->RowsConverted + State->RowsSkipped;
+    return 0 == Total? 0 : (double)State->RowsSkipped / (double)Total;
+}
+
+
+
+
+u32 *Display_GrowFrameBuffer(u32 **Pixels, uint *Capacity, uint Width, uint Height)
+{
+    if (Width*Height > *Capacity)
+    {
+        /* a new buffer, so the display converts the whole frame */
+        free(*Pixels);
+        *Capacity = Width*Height;
+        *Pixels = malloc(*Capacity * sizeof(u32));
+        if (NULL == *Pixels)
+            *Capacity = 0;
+    }
+    return *Pixels;
+}
+
+static u32 *Display_MemorySinkBeginFrame(void *Context, uint Width, uint Height, uint *OutPitch)
+{
+    Display_MemorySink *Sink = Context;
+    if (NULL == Display_GrowFrameBuffer(&Sink->Pixels, &Sink->Capacity, Width, Height))
+        return NULL;
+    Sink->Width = Width;
+    Sink->Height = Height;
+    *OutPitch = Width;
+    return Sink->Pixels;
+}
+
+static void Display_MemorySinkEndFrame(void *Context, const Display_Frame *Frame)
+{
+    (void)Frame;
+    Display_MemorySink *Sink = Context;
+    Sink->FrameCount++;
+}
+
+Display_Sink Display_MemorySinkInterface(Display_MemorySink *Sink)
+{
+    return (Display_Sink) {
+        .Context = Sink,
+        .BeginFrame = Display_MemorySinkBeginFrame,
+        .EndFrame = Display_MemorySinkEndFrame,
+    };
+}
+
+void Display_MemorySinkDestroy(Display_MemorySink *Sink)
+{
+    free(Sink->Pixels);
+    *Sink = (Display_MemorySink) { 0 };
+}
+
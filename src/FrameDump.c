@@ -0,0 +1,414 @@
+
+#include <string.h> /* memcpy, memset */
+
+#include "Common.h"
+#include "Display.h"
+#include "Platform.h"
+#include "FrameDump.h"
+
+#ifdef _WIN32
+#  include <io.h>    /* _setmode, _fileno */
+#  include <fcntl.h> /* _O_BINARY */
+#endif /* _WIN32 */
+
+/* only PNG writing is used, the rest of the (static) functions would warn as unused */
+#if defined(__GNUC__)
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wunused-function"
+#endif /* __GNUC__ */
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_STATIC
+#include "external/stb_image_write.h"
+#if defined(__GNUC__)
+#  pragma GCC diagnostic pop
+#endif /* __GNUC__ */
+
+
+
+/*
+ * Full range BT.601, 8 bit fixed point:
+ * Y =  0.299 R + 0.587 G + 0.114 B
+ * U = -0.169 R - 0.331 G + 0.500 B + 128
+ * V =  0.500 R - 0.419 G - 0.081 B + 128
+ */
+#define YUV_YR 77
+#define YUV_YG 150
+#define YUV_YB 29
+#define YUV_UR -43
+#define YUV_UG -85
+#define YUV_UB 128
+#define YUV_VR 128
+#define YUV_VG -107
+#define YUV_VB -21
+
+FORCE_INLINE u8 FrameDump_ClampU8(i32 x)
+{
+    return x < 0? 0 : x > 0xFF? 0xFF : (u8)x;
+}
+
+/* converts the 2x2 block at the top left of Row0 */
+FORCE_INLINE void FrameDump_ConvertBlock(u8 *Y0, u8 *Y1, u8 *U, u8 *V, const u32 *Row0, const u32 *Row1)
+{
+    const u32 Px[4] = { Row0[0], Row0[1], Row1[0], Row1[1] };
+    u8 *Ys[4] = { &Y0[0], &Y0[1], &Y1[0], &Y1[1] };
+    i32 SumR = 0, SumG = 0, SumB = 0;
+    for (uint i = 0; i < 4; i++)
+    {
+        i32 R = (Px[i] >> 0) & 0xFF;
+        i32 G = (Px[i] >> 8) & 0xFF;
+        i32 B = (Px[i] >> 16) & 0xFF;
+        *Ys[i] = (u8)((YUV_YR*R + YUV_YG*G + YUV_YB*B + 128) >> 8);
+        SumR += R;
+        SumG += G;
+        SumB += B;
+    }
+
+    i32 R = (SumR + 2) >> 2;
+    i32 G = (SumG + 2) >> 2;
+    i32 B = (SumB + 2) >> 2;
+    *U = FrameDump_ClampU8(((YUV_UR*R + YUV_UG*G + YUV_UB*B + 128) >> 8) + 128);
+    *V = FrameDump_ClampU8(((YUV_VR*R + YUV_VG*G + YUV_VB*B + 128) >> 8) + 128);
+}
+
+#ifdef HAS_SSE2
+/* 8 RGBA pixels to 8 bit components in 16 bit lanes */
+FORCE_INLINE void FrameDump_Unpack8(const u32 *Src, __m128i *R, __m128i *G, __m128i *B)
+{
+    const __m128i ByteMask = _mm_set1_epi32(0xFF);
+    __m128i Lo = _mm_loadu_si128((const __m128i *)(Src + 0));
+    __m128i Hi = _mm_loadu_si128((const __m128i *)(Src + 4));
+    *R = _mm_packs_epi32(_mm_and_si128(Lo, ByteMask), _mm_and_si128(Hi, ByteMask));
+    *G = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(Lo, 8), ByteMask), _mm_and_si128(_mm_srli_epi32(Hi, 8), ByteMask));
+    *B = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(Lo, 16), ByteMask), _mm_and_si128(_mm_srli_epi32(Hi, 16), ByteMask));
+}
+
+FORCE_INLINE __m128i FrameDump_Luma8(__m128i R, __m128i G, __m128i B)
+{
+    /* the weights add up to 256, so the sum fits in an unsigned 16 bit lane */
+    __m128i Sum = _mm_add_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(R, _mm_set1_epi16(YUV_YR)), _mm_mullo_epi16(G, _mm_set1_epi16(YUV_YG))),
+        _mm_add_epi16(_mm_mullo_epi16(B, _mm_set1_epi16(YUV_YB)), _mm_set1_epi16(128))
+    );
+    return _mm_srli_epi16(Sum, 8);
+}
+
+/* sums horizontal pairs of the two rows and averages them, 4 results in 32 bit lanes */
+FORCE_INLINE __m128i FrameDump_Average2x2(__m128i Row0, __m128i Row1)
+{
+    __m128i Sum = _mm_madd_epi16(_mm_add_epi16(Row0, Row1), _mm_set1_epi16(1));
+    return _mm_srli_epi32(_mm_add_epi32(Sum, _mm_set1_epi32(2)), 2);
+}
+
+#define PAIR16(lo, hi) _mm_set1_epi32((i32)((u32)(u16)(hi) << 16 | (u16)(lo)))
+#endif /* HAS_SSE2 */
+
+void FrameDump_ConvertYUV420(u8 *Y, u8 *U, u8 *V, const u32 *Src, uint Pitch, uint Width, uint Height)
+{
+    ASSERT(0 == (Width & 1) && 0 == (Height & 1));
+    uint ChromaWidth = Width / 2;
+    for (uint y = 0; y < Height; y += 2)
+    {
+        const u32 *Row0 = Src + (iSize)y*Pitch;
+        const u32 *Row1 = Row0 + Pitch;
+        u8 *Y0 = Y + (iSize)y*Width;
+        u8 *Y1 = Y0 + Width;
+        u8 *URow = U + (iSize)(y / 2)*ChromaWidth;
+        u8 *VRow = V + (iSize)(y / 2)*ChromaWidth;
+
+        uint x = 0;
+#ifdef HAS_SSE2
+        for (; x + 8 <= Width; x += 8)
+        {
+            __m128i R0, G0, B0, R1, G1, B1;
+            FrameDump_Unpack8(Row0 + x, &R0, &G0, &B0);
+            FrameDump_Unpack8(Row1 + x, &R1, &G1, &B1);
+
+            __m128i Luma = _mm_packus_epi16(FrameDump_Luma8(R0, G0, B0), FrameDump_Luma8(R1, G1, B1));
+            _mm_storel_epi64((__m128i *)(Y0 + x), Luma);
+            _mm_storel_epi64((__m128i *)(Y1 + x), _mm_srli_si128(Luma, 8));
+
+            /* (R, G) and (B, 1) pairs, so that each madd does two terms of the dot product */
+            __m128i Zero = _mm_setzero_si128();
+            __m128i R = _mm_packs_epi32(FrameDump_Average2x2(R0, R1), Zero);
+            __m128i G = _mm_packs_epi32(FrameDump_Average2x2(G0, G1), Zero);
+            __m128i B = _mm_packs_epi32(FrameDump_Average2x2(B0, B1), Zero);
+            __m128i RG = _mm_unpacklo_epi16(R, G);
+            __m128i B1s = _mm_unpacklo_epi16(B, _mm_set1_epi16(1));
+            __m128i Bias = _mm_set1_epi32(128);
+
+            __m128i Cb = _mm_add_epi32(_mm_madd_epi16(RG, PAIR16(YUV_UR, YUV_UG)), _mm_madd_epi16(B1s, PAIR16(YUV_UB, 128)));
+            __m128i Cr = _mm_add_epi32(_mm_madd_epi16(RG, PAIR16(YUV_VR, YUV_VG)), _mm_madd_epi16(B1s, PAIR16(YUV_VB, 128)));
+            Cb = _mm_add_epi32(_mm_srai_epi32(Cb, 8), Bias);
+            Cr = _mm_add_epi32(_mm_srai_epi32(Cr, 8), Bias);
+
+            /* bytes 0..3 are U, 4..7 are V */
+            __m128i Chroma = _mm_packus_epi16(_mm_packs_epi32(Cb, Cr), Zero);
+            u32 Packed = (u32)_mm_cvtsi128_si32(Chroma);
+            memcpy(URow + x/2, &Packed, sizeof Packed);
+            Packed = (u32)_mm_cvtsi128_si32(_mm_srli_si128(Chroma, 4));
+            memcpy(VRow + x/2, &Packed, sizeof Packed);
+        }
+#endif /* HAS_SSE2 */
+        for (; x < Width; x += 2)
+        {
+            FrameDump_ConvertBlock(Y0 + x, Y1 + x, URow + x/2, VRow + x/2, Row0 + x, Row1 + x);
+        }
+    }
+}
+
+
+
+
+static void FrameDump_WriteSnapshot(const FrameDump_Frame *Frame)
+{
+    char FileName[64];
+    snprintf(FileName, sizeof FileName, "snapshot_%06llu.png", (unsigned long long)Frame->Number);
+    if (!stbi_write_png(FileName, (int)Frame->Width, (int)Frame->Height, 4, Frame->Pixels, (int)(Frame->Width*sizeof(u32))))
+    {
+        LOG("Unable to write %s\n", FileName);
+    }
+}
+
+static void FrameDump_CloseVideo(FrameDump *Dump)
+{
+    if (NULL == Dump->VideoFile)
+        return;
+    if (stdout == Dump->VideoFile)
+        fflush(stdout);
+    else fclose(Dump->VideoFile);
+    Dump->VideoFile = NULL;
+}
+
+/* returns false when the video had to be closed */
+static Bool8 FrameDump_WriteVideoFrame(FrameDump *Dump, const FrameDump_Frame *Frame)
+{
+    if (NULL == Dump->Yuv)
+    {
+        /* 4:2:0 needs even dimensions, odd ones get padded */
+        Dump->VideoWidth = (Frame->Width + 1) & ~1u;
+        Dump->VideoHeight = (Frame->Height + 1) & ~1u;
+        Dump->Yuv = malloc(Dump->VideoWidth * Dump->VideoHeight * 3 / 2);
+        Dump->Scratch = malloc(Dump->VideoWidth * Dump->VideoHeight * sizeof(u32));
+        if (NULL == Dump->Yuv || NULL == Dump->Scratch)
+        {
+            LOG("Out of memory for the video dump\n");
+            FrameDump_CloseVideo(Dump);
+            return false;
+        }
+        fprintf(Dump->VideoFile, "YUV4MPEG2 W%u H%u F%s Ip A1:1 C420jpeg\n",
+            Dump->VideoWidth, Dump->VideoHeight, Frame->Pal? "50:1" : "60000:1001"
+        );
+    }
+
+    uint Width = Dump->VideoWidth;
+    uint Height = Dump->VideoHeight;
+    const u32 *Src = Frame->Pixels;
+    if (Frame->Width != Width || Frame->Height != Height)
+    {
+        /* the display mode changed, keep the top left and fill the rest with black */
+        uint CopyWidth = MIN(Width, Frame->Width);
+        uint CopyHeight = MIN(Height, Frame->Height);
+        for (uint y = 0; y < Height; y++)
+        {
+            u32 *Dst = Dump->Scratch + y*Width;
+            uint Copied = y < CopyHeight? CopyWidth : 0;
+            memcpy(Dst, Frame->Pixels + y*Frame->Width, Copied*sizeof(u32));
+            for (uint x = Copied; x < Width; x++)
+                Dst[x] = DISPLAY_RGBA(0, 0, 0);
+        }
+        Src = Dump->Scratch;
+    }
+
+    u8 *Y = Dump->Yuv;
+    u8 *U = Y + Width*Height;
+    u8 *V = U + (Width/2)*(Height/2);
+    FrameDump_ConvertYUV420(Y, U, V, Src, Width, Width, Height);
+
+    size_t Size = Width*Height * 3 / 2;
+    if (fputs("FRAME\n", Dump->VideoFile) < 0
+    || fwrite(Dump->Yuv, 1, Size, Dump->VideoFile) != Size)
+    {
+        LOG("Unable to write to the video dump, stopped recording\n");
+        FrameDump_CloseVideo(Dump);
+        return false;
+    }
+    return true;
+}
+
+static void FrameDump_Worker(void *UserData)
+{
+    FrameDump *Dump = UserData;
+    Platform_MutexLock(&Dump->Lock);
+    while (1)
+    {
+        while (0 == Dump->QueueCount && !Dump->Quit)
+            Platform_CondVarWait(&Dump->FrameQueued, &Dump->Lock);
+        if (0 == Dump->QueueCount)
+            break;
+
+        /* the frame stays in the queue while it's being written, so its slot isn't reused */
+        const FrameDump_Frame *Frame = &Dump->Queue[Dump->QueueHead];
+        Bool8 VideoStopped = false;
+        Platform_MutexUnlock(&Dump->Lock);
+        {
+            if (Frame->Snapshot)
+                FrameDump_WriteSnapshot(Frame);
+            if (Dump->VideoFile)
+                VideoStopped = !FrameDump_WriteVideoFrame(Dump, Frame);
+        }
+        Platform_MutexLock(&Dump->Lock);
+
+        Dump->VideoStopped = Dump->VideoStopped || VideoStopped;
+        Dump->QueueHead = (Dump->QueueHead + 1) % FRAMEDUMP_QUEUE_SIZE;
+        Dump->QueueCount--;
+        Platform_CondVarSignal(&Dump->SlotFreed);
+    }
+    Platform_MutexUnlock(&Dump->Lock);
+}
+
+
+
+
+Bool8 FrameDump_Init(FrameDump *Dump, const char *VideoPath)
+{
+    *Dump = (FrameDump) { 0 };
+
+    if (VideoPath && 0 == strcmp(VideoPath, "-"))
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif /* _WIN32 */
+        Dump->VideoFile = stdout;
+    }
+    else if (VideoPath)
+    {
+        Dump->VideoFile = fopen(VideoPath, "wb");
+        if (NULL == Dump->VideoFile)
+        {
+            LOG("Unable to open %s\n", VideoPath);
+            return false;
+        }
+    }
+
+    Dump->RecordVideo = NULL != Dump->VideoFile;
+    Dump->Queue = calloc(FRAMEDUMP_QUEUE_SIZE, sizeof(FrameDump_Frame));
+    if (NULL == Dump->Queue)
+    {
+        FrameDump_CloseVideo(Dump);
+        return false;
+    }
+
+    Platform_MutexInit(&Dump->Lock);
+    Platform_CondVarInit(&Dump->FrameQueued);
+    Platform_CondVarInit(&Dump->SlotFreed);
+    if (!Platform_ThreadCreate(&Dump->Worker, FrameDump_Worker, Dump))
+    {
+        Platform_CondVarDestroy(&Dump->SlotFreed);
+        Platform_CondVarDestroy(&Dump->FrameQueued);
+        Platform_MutexDestroy(&Dump->Lock);
+        free(Dump->Queue);
+        FrameDump_CloseVideo(Dump);
+        return false;
+    }
+    return true;
+}
+
+void FrameDump_Destroy(FrameDump *Dump)
+{
+    Platform_MutexLock(&Dump->Lock);
+    Dump->Quit = true;
+    Platform_CondVarBroadcast(&Dump->FrameQueued);
+    Platform_MutexUnlock(&Dump->Lock);
+    Platform_ThreadJoin(&Dump->Worker);
+
+    Platform_CondVarDestroy(&Dump->SlotFreed);
+    Platform_CondVarDestroy(&Dump->FrameQueued);
+    Platform_MutexDestroy(&Dump->Lock);
+    FrameDump_CloseVideo(Dump);
+    for (uint i = 0; i < FRAMEDUMP_QUEUE_SIZE; i++)
+        free(Dump->Queue[i].Pixels);
+    free(Dump->Queue);
+    free(Dump->Yuv);
+    free(Dump->Scratch);
+    *Dump = (FrameDump) { 0 };
+}
+
+void FrameDump_RequestSnapshot(FrameDump *Dump)
+{
+    Dump->SnapshotRequested = true;
+}
+
+static void FrameDump_Submit(FrameDump *Dump, const u32 *Pixels, uint Width, uint Height, uint Pitch, Bool8 Pal)
+{
+    u64 Number = Dump->FrameCount++;
+    Bool8 Snapshot = Dump->SnapshotRequested;
+    Dump->SnapshotRequested = false;
+    if (!Snapshot && !Dump->RecordVideo)
+        return;
+
+    Platform_MutexLock(&Dump->Lock);
+    if (Dump->VideoStopped)
+        Dump->RecordVideo = false;
+    if (!Snapshot && !Dump->RecordVideo)
+    {
+        Platform_MutexUnlock(&Dump->Lock);
+        return;
+    }
+    /* wait for a free slot rather than dropping frames, a regression run wants all of them */
+    while (FRAMEDUMP_QUEUE_SIZE == Dump->QueueCount)
+        Platform_CondVarWait(&Dump->SlotFreed, &Dump->Lock);
+    FrameDump_Frame *Frame = &Dump->Queue[(Dump->QueueHead + Dump->QueueCount) % FRAMEDUMP_QUEUE_SIZE];
+    Platform_MutexUnlock(&Dump->Lock);
+
+    /* the worker can't see the slot until QueueCount is incremented */
+    if (Width*Height > Frame->Capacity)
+    {
+        free(Frame->Pixels);
+        Frame->Capacity = Width*Height;
+        Frame->Pixels = malloc(Frame->Capacity * sizeof(u32));
+        if (NULL == Frame->Pixels)
+        {
+            LOG("Out of memory, frame %llu was not recorded\n", (unsigned long long)Number);
+            Frame->Capacity = 0;
+            return;
+        }
+    }
+    Frame->Width = Width;
+    Frame->Height = Height;
+    Frame->Number = Number;
+    Frame->Snapshot = Snapshot;
+    Frame->Pal = Pal;
+    for (uint y = 0; y < Height; y++)
+        memcpy(Frame->Pixels + y*Width, Pixels + (iSize)y*Pitch, Width*sizeof(u32));
+
+    Platform_MutexLock(&Dump->Lock);
+    Dump->QueueCount++;
+    Platform_CondVarSignal(&Dump->FrameQueued);
+    Platform_MutexUnlock(&Dump->Lock);
+}
+
+
+static u32 *FrameDump_BeginFrame(void *Context, uint Width, uint Height, uint *OutPitch)
+{
+    FrameDump *Dump = Context;
+    return Dump->Next.BeginFrame(Dump->Next.Context, Width, Height, OutPitch);
+}
+
+static void FrameDump_EndFrame(void *Context, const Display_Frame *Frame)
+{
+    FrameDump *Dump = Context;
+    /* the whole frame is recorded, the rows that didn't change are still in the sink's buffer */
+    FrameDump_Submit(Dump, Frame->Pixels, Frame->Width, Frame->Height, Frame->Pitch, Frame->Pal);
+    Dump->Next.EndFrame(Dump->Next.Context, Frame);
+}
+
+Display_Sink FrameDump_SinkInterface(FrameDump *Dump, const Display_Sink *Next)
+{
+    Dump->Next = *Next;
+    return (Display_Sink) {
+        .Context = Dump,
+        .BeginFrame = FrameDump_BeginFrame,
+        .EndFrame = FrameDump_EndFrame,
+    };
+}
+
@@ -0,0 +1,195 @@
+#include <string.h> /* memcpy */
+
+#include "Common.h"
+#include "Display.h"
+#include "Platform.h"
+#include "TripleBuffer.h"
+#include "Frontend.h"
+
+#include "raylib.h"
+
+
+#define FRONTEND_WINDOW_WIDTH 960
+#define FRONTEND_WINDOW_HEIGHT 720
+
+#define FRONTEND_KEY_SNAPSHOT (1u << 0)
+#define FRONTEND_KEY_OVERLAY (1u << 1)
+#define FRONTEND_KEY_REVERB (1u << 2)
+
+
+/* a blank texture, replaces the current one */
+static void Frontend_CreateTexture(Frontend *Fe, uint Width, uint Height)
+{
+    if (Fe->HasTexture)
+        UnloadTexture(Fe->Texture);
+    Image Blank = GenImageColor((int)Width, (int)Height, BLACK);
+    Fe->Texture = LoadTextureFromImage(Blank);
+    UnloadImage(Blank);
+    Fe->HasTexture = true;
+}
+
+Bool8 Frontend_Init(Frontend *Fe, const char *Title, Bool8 SoftwareGL)
+{
+    *Fe = (Frontend) { 0 };
+    TripleBuffer_Init(&Fe->Frames);
+    if (SoftwareGL)
+    {
+        /* only Mesa looks at these, other drivers ignore them */
+        Platform_SetEnv("LIBGL_ALWAYS_SOFTWARE", "1");
+        Platform_SetEnv("GALLIUM_DRIVER", "llvmpipe");
+    }
+
+    Fe->WindowId = InitWindowPro(FRONTEND_WINDOW_WIDTH, FRONTEND_WINDOW_HEIGHT, Title, 
+        FLAG_WINDOW_RESIZABLE | FLAG_VSYNC_HINT
+    );
+    if (Fe->WindowId < 0 || !IsWindowReady())
+        return false;
+    /* vsync may not be there (software GL, virtual displays), this keeps presentation from spinning */
+    SetTargetFPS(60);
+    Frontend_CreateTexture(Fe, DISPLAY_MAX_WIDTH, DISPLAY_MAX_HEIGHT);
+    return true;
+}
+
+void Frontend_Destroy(Frontend *Fe)
+{
+    if (Fe->WindowId >= 0 && SetActiveWindowContext(Fe->WindowId) >= 0 && IsWindowReady())
+    {
+        if (Fe->HasTexture)
+            UnloadTexture(Fe->Texture);
+        CloseWindow();
+    }
+    TripleBuffer_Destroy(&Fe->Frames);
+    free(Fe->Pixels);
+    Fe->Pixels = NULL;
+    Fe->HasTexture = false;
+}
+
+/* 
+ * raylib polls input at the end of every window's frame, a key press only shows up until the next poll;
+ * with the debugger windows open that can be another window's frame, but the key is still held down in ours 
+ */
+static Bool8 Frontend_KeyPressed(Frontend *Fe, int Key, u32 Bit)
+{
+    Bool8 WasDown = 0 != (Fe->KeysDown & Bit);
+    Bool8 Down = IsKeyDown(Key);
+    Fe->KeysDown = Down? Fe->KeysDown | Bit : Fe->KeysDown & ~Bit;
+    return Down && !WasDown;
+}
+
+Bool8 Frontend_Present(Frontend *Fe)
+{
+    SetActiveWindowContext(Fe->WindowId);
+    if (WindowShouldClose())
+    {
+        Platform_AtomicStore(&Fe->QuitRequested, 1);
+        return false;
+    }
+    if (Frontend_KeyPressed(Fe, KEY_F12, FRONTEND_KEY_SNAPSHOT))
+        Platform_AtomicStore(&Fe->SnapshotRequested, 1);
+    if (Frontend_KeyPressed(Fe, KEY_F3, FRONTEND_KEY_OVERLAY))
+        Platform_AtomicStore(&Fe->ShowOverlay, !Platform_AtomicLoad(&Fe->ShowOverlay));
+    if (Frontend_KeyPressed(Fe, KEY_F4, FRONTEND_KEY_REVERB))
+        Platform_AtomicStore(&Fe->ReverbToggled, 1);
+
+    Bool8 IsNew;
+    const TripleBuffer_Frame *Frame = TripleBuffer_Read(&Fe->Frames, &IsNew);
+    if (IsNew && Frame->Width && Frame->Height)
+    {
+        if (Frame->Width > (uint)Fe->Texture.width || Frame->Height > (uint)Fe->Texture.height)
+        {
+            /* upscaled frames */
+            Frontend_CreateTexture(Fe, 
+                MAX(Frame->Width, (uint)Fe->Texture.width), 
+                MAX(Frame->Height, (uint)Fe->Texture.height)
+            );
+        }
+        /* every frame of the triple buffer is whole, there's no telling which rows changed since the one we have */
+        Rectangle Rect = { 0, 0, (float)Frame->Width, (float)Frame->Height };
+        UpdateTextureRec(Fe->Texture, Rect, Frame->Pixels);
+        Fe->PresentedCount++;
+    }
+
+    /* scale to fit the window, keeping the 4:3 aspect ratio of a TV */
+    float WindowWidth = (float)GetScreenWidth();
+    float WindowHeight = (float)GetScreenHeight();
+    float Scale = MIN(WindowWidth / 4.0f, WindowHeight / 3.0f);
+    Rectangle Dst = {
+        .width = Scale * 4.0f,
+        .height = Scale * 3.0f,
+    };
+    Dst.x = (WindowWidth - Dst.width) / 2;
+    Dst.y = (WindowHeight - Dst.height) / 2;
+    Rectangle Src = { 0, 0, (float)Frame->Width, (float)Frame->Height };
+
+    BeginDrawing();
+        ClearBackground(BLACK);
+        if (Frame->Width && Frame->Height)
+            DrawTexturePro(Fe->Texture, Src, Dst, (Vector2) { 0 }, 0.0f, WHITE);
+        if (Platform_AtomicLoad(&Fe->ShowOverlay) && Frame->Text[0])
+        {
+            Vector2 Size = MeasureTextEx(GetFontDefault(), Frame->Text, 10, 1);
+            DrawRectangle(0, 0, (int)Size.x + 8, (int)Size.y + 8, Fade(BLACK, 0.6f));
+            DrawText(Frame->Text, 4, 4, 10, GREEN);
+        }
+    EndDrawing();
+    return true;
+}
+
+
+Bool8 Frontend_QuitRequested(Frontend *Fe)
+{
+    return 0 != Platform_AtomicLoad(&Fe->QuitRequested);
+}
+
+Bool8 Frontend_SnapshotRequested(Frontend *Fe)
+{
+    return 0 != Platform_AtomicExchange(&Fe->SnapshotRequested, 0);
+}
+
+Bool8 Frontend_ReverbToggleRequested(Frontend *Fe)
+{
+    return 0 != Platform_AtomicExchange(&Fe->ReverbToggled, 0);
+}
+
+Bool8 Frontend_OverlayEnabled(Frontend *Fe)
+{
+    return 0 != Platform_AtomicLoad(&Fe->ShowOverlay);
+}
+
+void Frontend_SetOverlay(Frontend *Fe, const char *Text)
+{
+    snprintf(Fe->Overlay, sizeof Fe->Overlay, "%s", Text);
+}
+
+
+static u32 *Frontend_BeginFrame(void *Context, uint Width, uint Height, uint *OutPitch)
+{
+    Frontend *Fe = Context;
+    /* frames are copied to the triple buffer as-is, so rows must be tightly packed */
+    *OutPitch = Width;
+    return Display_GrowFrameBuffer(&Fe->Pixels, &Fe->Capacity, Width, Height);
+}
+
+static void Frontend_EndFrame(void *Context, const Display_Frame *Frame)
+{
+    Frontend *Fe = Context;
+    TripleBuffer_Frame *Back = TripleBuffer_BeginWrite(&Fe->Frames, Frame->Width, Frame->Height);
+    if (NULL == Back)
+        return;
+
+    /* the display only converted the rows that changed, the rest of the frame is still in Pixels */
+    memcpy(Back->Pixels, Frame->Pixels, (size_t)Frame->Width * Frame->Height * sizeof(u32));
+    if (Frontend_OverlayEnabled(Fe))
+        memcpy(Back->Text, Fe->Overlay, sizeof Back->Text);
+    TripleBuffer_EndWrite(&Fe->Frames);
+}
+
+Display_Sink Frontend_DisplaySinkInterface(Frontend *Fe)
+{
+    return (Display_Sink) {
+        .Context = Fe,
+        .BeginFrame = Frontend_BeginFrame,
+        .EndFrame = Frontend_EndFrame,
+    };
+}
+
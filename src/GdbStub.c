@@ -0,0 +1,715 @@
+
+#include <string.h> /* memcpy, strncmp */
+#include <stdio.h>  /* snprintf */
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Monitor.h"
+#include "Platform.h"
+#include "GdbStub.h"
+
+
+#define GDBSTUB_POLL_MILLISECONDS 10
+#define GDBSTUB_SIGINT 2
+#define GDBSTUB_SIGTRAP 5
+
+typedef enum GdbStub_PacketState
+{
+    GDBSTUB_PACKET_IDLE = 0,
+    GDBSTUB_PACKET_DATA,
+    GDBSTUB_PACKET_CHECKSUM_HIGH,
+    GDBSTUB_PACKET_CHECKSUM_LOW,
+} GdbStub_PacketState;
+
+
+
+/*==================================================================================
+ *
+ *                              Emulation thread
+ *
+ *==================================================================================*/
+
+Bool8 GdbStub_HaltRequested(GdbStub *Stub)
+{
+    return 0 != Platform_AtomicLoad(&Stub->HaltRequested);
+}
+
+Bool8 GdbStub_Halt(GdbStub *Stub)
+{
+    PS1 *Ps1 = Stub->Ps1;
+    Platform_MutexLock(&Stub->Lock);
+    if (Stub->Quit)
+    {
+        Platform_MutexUnlock(&Stub->Lock);
+        return false;
+    }
+
+    /* halted from outside: the debugger just connected, hit ^C, or went away */
+    if (NULL == Ps1->Monitor || MONITOR_RUNNING == Ps1->Monitor->StopReason)
+    {
+        Ps1->Monitor = &Stub->Mon;
+        Stub->Mon.StopReason = MONITOR_STOP_REQUESTED;
+        Stub->Mon.StopPC = Ps1->Cpu.NextInstructionPC;
+    }
+    Stub->Halted = true;
+    Stub->Action = GDBSTUB_NONE;
+    Stub->Halts++;
+    Platform_CondVarBroadcast(&Stub->Changed);
+    while (GDBSTUB_NONE == Stub->Action)
+        Platform_CondVarWait(&Stub->Changed, &Stub->Lock);
+    GdbStub_Action Action = Stub->Action;
+    Platform_MutexUnlock(&Stub->Lock);
+
+    /* the stub thread already set the monitor up for what comes next */
+    return GDBSTUB_KILL != Action;
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Stub thread
+ *
+ *==================================================================================*/
+
+static Bool8 GdbStub_IsHalted(GdbStub *Stub)
+{
+    Platform_MutexLock(&Stub->Lock);
+    Bool8 Halted = Stub->Halted;
+    Platform_MutexUnlock(&Stub->Lock);
+    return Halted;
+}
+
+/* the machine must be halted */
+static void GdbStub_Resume(GdbStub *Stub, GdbStub_Action Action)
+{
+    Monitor *Mon = &Stub->Mon;
+    PS1 *Ps1 = Stub->Ps1;
+    if (GDBSTUB_DETACH == Action)
+    {
+        Monitor_Init(Mon);
+        memset(Ps1->WatchedRamPages, 0, sizeof Ps1->WatchedRamPages);
+        Ps1->Monitor = NULL;
+        Stub->Attached = false;
+    }
+    else
+    {
+        Mon->SingleStep = GDBSTUB_STEP == Action;
+        Mon->SkipBreakpoint = true;
+        Mon->StopReason = MONITOR_RUNNING;
+        Stub->Running = GDBSTUB_KILL != Action;
+    }
+    Stub->Interrupted = false;
+
+    Platform_AtomicStore(&Stub->HaltRequested, 0);
+    Platform_MutexLock(&Stub->Lock);
+    Stub->Halted = false;
+    Stub->Action = Action;
+    Platform_CondVarBroadcast(&Stub->Changed);
+    Platform_MutexUnlock(&Stub->Lock);
+}
+
+
+static const char sHexDigits[] = "0123456789abcdef";
+
+static int GdbStub_HexValue(char Char)
+{
+    if (IN_RANGE('0', Char, '9'))
+        return Char - '0';
+    if (IN_RANGE('a', Char, 'f'))
+        return Char - 'a' + 10;
+    if (IN_RANGE('A', Char, 'F'))
+        return Char - 'A' + 10;
+    return -1;
+}
+
+/* parses hex digits at *Text and moves past them */
+static u32 GdbStub_ParseHex(const char **Text)
+{
+    u32 Value = 0;
+    int Digit;
+    while ((Digit = GdbStub_HexValue(**Text)) >= 0)
+    {
+        Value = Value << 4 | (u32)Digit;
+        (*Text)++;
+    }
+    return Value;
+}
+
+/* registers are sent in the target's byte order */
+static char *GdbStub_PutRegister(char *Out, u32 Value)
+{
+    for (uint i = 0; i < 4; i++, Value >>= 8)
+    {
+        *Out++ = sHexDigits[(Value >> 4) & 0xF];
+        *Out++ = sHexDigits[Value & 0xF];
+    }
+    return Out;
+}
+
+static u32 GdbStub_ParseRegister(const char **Text)
+{
+    u32 Value = 0;
+    for (uint i = 0; i < 4; i++)
+    {
+        int High = GdbStub_HexValue((*Text)[0]);
+        int Low = High < 0? -1 : GdbStub_HexValue((*Text)[1]);
+        if (Low < 0)
+            break;
+        Value |= (u32)(High << 4 | Low) << (i * 8);
+        *Text += 2;
+    }
+    return Value;
+}
+
+/* returns false for the registers the CPU doesn't have */
+static Bool8 GdbStub_ReadRegister(const CPU *Cpu, uint Index, u32 *OutValue)
+{
+    switch (Index)
+    {
+    case 32: *OutValue = Cpu->SR; return true;
+    case 33: *OutValue = Cpu->Lo; return true;
+    case 34: *OutValue = Cpu->Hi; return true;
+    case 35: *OutValue = 0; return true; /* BadVaddr isn't emulated */
+    case 36: *OutValue = Cpu->Cause; return true;
+    case GDBSTUB_REGISTER_PC: *OutValue = Cpu->NextInstructionPC; return true;
+    case GDBSTUB_REGISTER_EPC: *OutValue = Cpu->EPC; return true;
+    }
+    if (Index < 32)
+    {
+        *OutValue = Cpu->R[Index];
+        return true;
+    }
+    return false;
+}
+
+static void GdbStub_WriteRegister(CPU *Cpu, uint Index, u32 Value)
+{
+    switch (Index)
+    {
+    case 32: Cpu->SR = Value; break;
+    case 33: Cpu->Lo = Value; break;
+    case 34: Cpu->Hi = Value; break;
+    case 36: Cpu->Cause = Value; break;
+    case GDBSTUB_REGISTER_EPC: Cpu->EPC = Value; break;
+    case GDBSTUB_REGISTER_PC:
+    {
+        Cpu->NextInstructionPC = Value;
+        Cpu->PC = Value + 4;
+    } break;
+    default:
+    {
+        if (IN_RANGE(1, Index, 31)) /* r0 stays 0 */
+            Cpu->R[Index] = Value;
+    } break;
+    }
+}
+
+
+static void GdbStub_SendRaw(GdbStub *Stub, const char *Data, uint Length)
+{
+    if (!Platform_SocketSend(&Stub->Client, Data, Length))
+        LOG("GDB stub: unable to send to the debugger\n");
+}
+
+static void GdbStub_Reply(GdbStub *Stub, const char *Data)
+{
+    uint Length = 0;
+    u8 Checksum = 0;
+    Stub->Reply[Length++] = '$';
+    for (; *Data && Length < sizeof Stub->Reply - 3; Data++)
+    {
+        Stub->Reply[Length++] = *Data;
+        Checksum += (u8)*Data;
+    }
+    Stub->Reply[Length++] = '#';
+    Stub->Reply[Length++] = sHexDigits[Checksum >> 4];
+    Stub->Reply[Length++] = sHexDigits[Checksum & 0xF];
+    Stub->ReplyLength = Length;
+    GdbStub_SendRaw(Stub, Stub->Reply, Length);
+}
+
+static void GdbStub_ReplyStop(GdbStub *Stub)
+{
+    const Monitor *Mon = &Stub->Mon;
+    char Text[64];
+    if (MONITOR_STOP_WATCHPOINT == Mon->StopReason)
+    {
+        /*
+         * the kind of watchpoint that was set (Z2, Z3 or Z4), not of the access;
+         * gdb matches the address with its watchpoints, those are usually set on KSEG0 addresses
+         */
+        const char *Kind = (MONITOR_WATCH_READ | MONITOR_WATCH_WRITE) == Mon->WatchpointFlags? "awatch"
+            : MONITOR_WATCH_READ == Mon->WatchpointFlags? "rwatch" 
+            : "watch";
+        snprintf(Text, sizeof Text, "T%02x%s:%08x;", GDBSTUB_SIGTRAP, Kind, 0x80000000 | Mon->WatchOffset);
+    }
+    else
+    {
+        snprintf(Text, sizeof Text, "S%02x", Stub->Interrupted? GDBSTUB_SIGINT : GDBSTUB_SIGTRAP);
+    }
+    GdbStub_Reply(Stub, Text);
+}
+
+/* Z and z packets: type,addr,kind */
+static void GdbStub_HandleBreakpoint(GdbStub *Stub, const char *Args, Bool8 Insert)
+{
+    PS1 *Ps1 = Stub->Ps1;
+    Monitor *Mon = &Stub->Mon;
+    u32 Type = GdbStub_ParseHex(&Args);
+    if (',' != *Args++)
+    {
+        GdbStub_Reply(Stub, "E01");
+        return;
+    }
+    u32 Addr = GdbStub_ParseHex(&Args);
+    u32 Size = ',' == *Args++? GdbStub_ParseHex(&Args) : 4;
+
+    /* the monitor works on physical addresses, this matches the bus for RAM and BIOS */
+    u32 PhysicalAddr = Addr & 0x1FFFFFFF;
+    if (Type <= 1) /* software and hardware breakpoints are the same thing here */
+    {
+        Bool8 Ok = Insert
+            ? Monitor_AddBreakpoint(Mon, PhysicalAddr) || Monitor_IsBreakpoint(Mon, PhysicalAddr)
+            : (Monitor_RemoveBreakpoint(Mon, PhysicalAddr), true);
+        GdbStub_Reply(Stub, Ok? "OK" : "E01");
+    }
+    else if (Type <= 4)
+    {
+        static const u32 sFlags[] = {
+            [2] = MONITOR_WATCH_WRITE,
+            [3] = MONITOR_WATCH_READ,
+            [4] = MONITOR_WATCH_READ | MONITOR_WATCH_WRITE,
+        };
+        Bool8 Ok = PhysicalAddr < PS1_RAM_SIZE && Size && Size <= PS1_RAM_SIZE - PhysicalAddr;
+        if (Ok && Insert)
+            Ok = Monitor_AddWatchpoint(Mon, Ps1->WatchedRamPages, PhysicalAddr, Size, sFlags[Type]);
+        else if (Ok)
+            Monitor_RemoveWatchpoint(Mon, Ps1->WatchedRamPages, PhysicalAddr);
+        GdbStub_Reply(Stub, Ok? "OK" : "E01");
+    }
+    else
+    {
+        GdbStub_Reply(Stub, "");
+    }
+}
+
+/* 
+ * gdb's mips layout needs the FPU feature, so it's described with the same register numbers as without the description;
+ * only epc comes after it
+ */
+static const char *GdbStub_TargetXml(void)
+{
+    static char sXml[8192];
+    if (sXml[0])
+        return sXml;
+
+    char *Out = sXml;
+    char *End = sXml + sizeof sXml;
+#define GDBSTUB_XML(...) Out += snprintf(Out, End - Out, __VA_ARGS__)
+    GDBSTUB_XML("<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+        "<target version=\"1.0\"><architecture>mips:3000</architecture>"
+        "<feature name=\"org.gnu.gdb.mips.cpu\">"
+    );
+    for (uint i = 0; i < 32; i++)
+        GDBSTUB_XML("<reg name=\"r%u\" bitsize=\"32\" regnum=\"%u\"/>", i, i);
+    GDBSTUB_XML("<reg name=\"lo\" bitsize=\"32\" regnum=\"33\"/>"
+        "<reg name=\"hi\" bitsize=\"32\" regnum=\"34\"/>"
+        "<reg name=\"pc\" bitsize=\"32\" regnum=\"%u\" type=\"code_ptr\"/></feature>"
+        "<feature name=\"org.gnu.gdb.mips.cp0\">"
+        "<reg name=\"status\" bitsize=\"32\" regnum=\"32\"/>"
+        "<reg name=\"badvaddr\" bitsize=\"32\" regnum=\"35\"/>"
+        "<reg name=\"cause\" bitsize=\"32\" regnum=\"36\"/>"
+        "<reg name=\"epc\" bitsize=\"32\" regnum=\"%u\" type=\"code_ptr\"/></feature>"
+        "<feature name=\"org.gnu.gdb.mips.fpu\">",
+        GDBSTUB_REGISTER_PC, GDBSTUB_REGISTER_EPC
+    );
+    for (uint i = 0; i < 32; i++)
+        GDBSTUB_XML("<reg name=\"f%u\" bitsize=\"32\" type=\"ieee_single\" regnum=\"%u\"/>", i, 38 + i);
+    GDBSTUB_XML("<reg name=\"fcsr\" bitsize=\"32\" group=\"float\" regnum=\"70\"/>"
+        "<reg name=\"fir\" bitsize=\"32\" group=\"float\" regnum=\"71\"/></feature></target>"
+    );
+#undef GDBSTUB_XML
+    ASSERT(Out < End - 1 && "target description doesn't fit");
+    return sXml;
+}
+
+/* qXfer:features:read:annex:offset,length */
+static void GdbStub_HandleFeaturesRead(GdbStub *Stub, const char *Args)
+{
+    static char sOut[GDBSTUB_PACKET_SIZE];
+    if (0 != strncmp(Args, "target.xml:", 11))
+    {
+        GdbStub_Reply(Stub, "E00");
+        return;
+    }
+    Args += 11;
+    u32 Offset = GdbStub_ParseHex(&Args);
+    u32 Length = ',' == *Args++? GdbStub_ParseHex(&Args) : 0;
+    Length = MIN(Length, sizeof sOut - 2);
+
+    /* no character of it needs escaping */
+    const char *Xml = GdbStub_TargetXml();
+    u32 XmlLength = strlen(Xml);
+    u32 Count = Offset < XmlLength? MIN(Length, XmlLength - Offset) : 0;
+    sOut[0] = Offset + Count < XmlLength? 'm' : 'l'; /* more, or the last part */
+    if (Count)
+        memcpy(sOut + 1, Xml + Offset, Count);
+    sOut[1 + Count] = '\0';
+    GdbStub_Reply(Stub, sOut);
+}
+
+/* a whole packet from the debugger, the machine is halted */
+static void GdbStub_HandlePacket(GdbStub *Stub, const char *Packet)
+{
+    PS1 *Ps1 = Stub->Ps1;
+    CPU *Cpu = &Ps1->Cpu;
+    const char *Args = Packet + 1;
+    static char sOut[GDBSTUB_PACKET_SIZE];
+    Stub->PacketCount++;
+
+    switch (Packet[0])
+    {
+    case '?':
+    {
+        GdbStub_ReplyStop(Stub);
+    } break;
+    case 'g':
+    {
+        char *Out = sOut;
+        for (uint i = 0; i < GDBSTUB_REGISTER_COUNT; i++)
+        {
+            u32 Value;
+            if (GdbStub_ReadRegister(Cpu, i, &Value))
+                Out = GdbStub_PutRegister(Out, Value);
+            else Out += snprintf(Out, 9, "xxxxxxxx"); /* unavailable */
+        }
+        *Out = '\0';
+        GdbStub_Reply(Stub, sOut);
+    } break;
+    case 'G':
+    {
+        for (uint i = 0; i < GDBSTUB_REGISTER_COUNT && *Args; i++)
+        {
+            if ('x' == *Args) /* sent back as unavailable */
+            {
+                for (uint k = 0; k < 8 && *Args; k++)
+                    Args++;
+            }
+            else GdbStub_WriteRegister(Cpu, i, GdbStub_ParseRegister(&Args));
+        }
+        GdbStub_Reply(Stub, "OK");
+    } break;
+    case 'p':
+    {
+        u32 Value;
+        if (GdbStub_ReadRegister(Cpu, GdbStub_ParseHex(&Args), &Value))
+            *GdbStub_PutRegister(sOut, Value) = '\0';
+        else snprintf(sOut, sizeof sOut, "xxxxxxxx"); /* unavailable */
+        GdbStub_Reply(Stub, sOut);
+    } break;
+    case 'P':
+    {
+        uint Index = GdbStub_ParseHex(&Args);
+        if ('=' == *Args++)
+            GdbStub_WriteRegister(Cpu, Index, GdbStub_ParseRegister(&Args));
+        GdbStub_Reply(Stub, "OK");
+    } break;
+    case 'm':
+    {
+        u32 Addr = GdbStub_ParseHex(&Args);
+        u32 Length = ',' == *Args++? GdbStub_ParseHex(&Args) : 0;
+        Length = MIN(Length, (sizeof sOut - 1) / 2);
+
+        /* as much as can be read, an error only if nothing can */
+        char *Out = sOut;
+        u32 i = 0;
+        for (u8 Byte; i < Length && PS1_DebugRead(Ps1, Addr + i, &Byte, 1); i++)
+        {
+            *Out++ = sHexDigits[Byte >> 4];
+            *Out++ = sHexDigits[Byte & 0xF];
+        }
+        *Out = '\0';
+        GdbStub_Reply(Stub, i || 0 == Length? sOut : "E01");
+    } break;
+    case 'M':
+    {
+        u32 Addr = GdbStub_ParseHex(&Args);
+        u32 Length = ',' == *Args++? GdbStub_ParseHex(&Args) : 0;
+        Bool8 Ok = ':' == *Args++;
+        for (u32 i = 0; i < Length && Ok; i++, Args += 2)
+        {
+            int High = GdbStub_HexValue(Args[0]);
+            int Low = High < 0? -1 : GdbStub_HexValue(Args[1]);
+            u8 Byte = (u8)(High << 4 | Low);
+            Ok = Low >= 0 && PS1_DebugWrite(Ps1, Addr + i, &Byte, 1);
+        }
+        GdbStub_Reply(Stub, Ok? "OK" : "E01");
+    } break;
+    case 'c':
+    case 's':
+    {
+        if (*Args)
+            GdbStub_WriteRegister(Cpu, GDBSTUB_REGISTER_PC, GdbStub_ParseHex(&Args));
+        GdbStub_Resume(Stub, 's' == Packet[0]? GDBSTUB_STEP : GDBSTUB_CONTINUE);
+        /* the stop reply is sent once it halts again */
+    } break;
+    case 'Z':
+    case 'z':
+    {
+        GdbStub_HandleBreakpoint(Stub, Args, 'Z' == Packet[0]);
+    } break;
+    case 'D':
+    {
+        GdbStub_Reply(Stub, "OK");
+        GdbStub_Resume(Stub, GDBSTUB_DETACH);
+    } break;
+    case 'k':
+    {
+        LOG("GDB stub: killed by the debugger\n");
+        GdbStub_Resume(Stub, GDBSTUB_KILL);
+    } break;
+    case 'H': /* one thread, whichever it asks for */
+    {
+        GdbStub_Reply(Stub, "OK");
+    } break;
+    case 'q':
+    {
+        if (0 == strncmp(Packet, "qSupported", 10))
+        {
+            snprintf(sOut, sizeof sOut, "PacketSize=%x;qXfer:features:read+", GDBSTUB_PACKET_SIZE);
+            GdbStub_Reply(Stub, sOut);
+        }
+        else if (0 == strncmp(Packet, "qXfer:features:read:", 20))
+        {
+            GdbStub_HandleFeaturesRead(Stub, Packet + 20);
+        }
+        else if (0 == strcmp(Packet, "qAttached"))
+        {
+            GdbStub_Reply(Stub, "1");
+        }
+        else if (0 == strcmp(Packet, "qC"))
+        {
+            GdbStub_Reply(Stub, "QC1");
+        }
+        else if (0 == strcmp(Packet, "qfThreadInfo"))
+        {
+            GdbStub_Reply(Stub, "m1");
+        }
+        else if (0 == strcmp(Packet, "qsThreadInfo"))
+        {
+            GdbStub_Reply(Stub, "l");
+        }
+        else
+        {
+            GdbStub_Reply(Stub, "");
+        }
+    } break;
+    default: /* unsupported, gdb falls back to the packets above */
+    {
+        GdbStub_Reply(Stub, "");
+    } break;
+    }
+}
+
+static void GdbStub_ReceiveByte(GdbStub *Stub, char Byte)
+{
+    switch ((GdbStub_PacketState)Stub->PacketState)
+    {
+    case GDBSTUB_PACKET_IDLE:
+    {
+        if ('$' == Byte)
+        {
+            Stub->PacketState = GDBSTUB_PACKET_DATA;
+            Stub->PacketLength = 0;
+        }
+        else if ('-' == Byte && Stub->ReplyLength) /* the last reply was garbled */
+        {
+            GdbStub_SendRaw(Stub, Stub->Reply, Stub->ReplyLength);
+        }
+        /* '+' acknowledges our reply, and ^C only means something while running */
+    } break;
+    case GDBSTUB_PACKET_DATA:
+    {
+        if ('#' == Byte)
+            Stub->PacketState = GDBSTUB_PACKET_CHECKSUM_HIGH;
+        else if (Stub->PacketLength < sizeof Stub->Packet - 1)
+            Stub->Packet[Stub->PacketLength++] = Byte;
+    } break;
+    case GDBSTUB_PACKET_CHECKSUM_HIGH:
+    {
+        Stub->PacketChecksum = GdbStub_HexValue(Byte);
+        Stub->PacketState = GDBSTUB_PACKET_CHECKSUM_LOW;
+    } break;
+    case GDBSTUB_PACKET_CHECKSUM_LOW:
+    {
+        Stub->PacketState = GDBSTUB_PACKET_IDLE;
+        u8 Checksum = 0;
+        for (uint i = 0; i < Stub->PacketLength; i++)
+            Checksum += (u8)Stub->Packet[i];
+        int High = Stub->PacketChecksum;
+        int Low = GdbStub_HexValue(Byte);
+        if (High < 0 || Low < 0 || (High << 4 | Low) != Checksum)
+        {
+            GdbStub_SendRaw(Stub, "-", 1);
+            break;
+        }
+
+        GdbStub_SendRaw(Stub, "+", 1);
+        Stub->Packet[Stub->PacketLength] = '\0';
+        GdbStub_HandlePacket(Stub, Stub->Packet);
+    } break;
+    }
+}
+
+static void GdbStub_Disconnect(GdbStub *Stub)
+{
+    LOG("GDB stub: debugger disconnected\n");
+    Platform_SocketClose(&Stub->Client);
+    Stub->HasClient = false;
+    Stub->Running = false;
+    Stub->PacketState = GDBSTUB_PACKET_IDLE;
+    Stub->ReplyLength = 0;
+    if (Stub->Attached)
+    {
+        /* the breakpoints have to go, which needs the machine halted */
+        Stub->DetachPending = true;
+        Platform_AtomicStore(&Stub->HaltRequested, 1);
+    }
+}
+
+static void GdbStub_Main(void *UserData)
+{
+    GdbStub *Stub = UserData;
+    for (;;)
+    {
+        Platform_MutexLock(&Stub->Lock);
+        Bool8 Quit = Stub->Quit;
+        Platform_MutexUnlock(&Stub->Lock);
+        if (Quit)
+            break;
+
+        Bool8 Halted = GdbStub_IsHalted(Stub);
+        if (Halted && Stub->DetachPending)
+        {
+            Stub->DetachPending = false;
+            GdbStub_Resume(Stub, GDBSTUB_DETACH);
+            continue;
+        }
+
+        if (!Stub->HasClient)
+        {
+            if (!Stub->DetachPending
+            && Platform_SocketWait(&Stub->Listener, GDBSTUB_POLL_MILLISECONDS) > 0
+            && Platform_SocketAccept(&Stub->Listener, &Stub->Client))
+            {
+                LOG("GDB stub: debugger connected\n");
+                Stub->HasClient = true;
+                Stub->Attached = true;
+                Platform_AtomicStore(&Stub->HaltRequested, 1);
+            }
+            else if (Stub->DetachPending)
+            {
+                Platform_Sleep(GDBSTUB_POLL_MILLISECONDS * 1000);
+            }
+            continue;
+        }
+
+        if (Halted && Stub->Running)
+        {
+            Stub->Running = false;
+            GdbStub_ReplyStop(Stub);
+        }
+        else if (!Halted && !Stub->Running && Stub->Attached)
+        {
+            /* just connected, the debugger can't talk to us before emulation halts */
+            Platform_Sleep(1000);
+            continue;
+        }
+
+        int Ready = Platform_SocketWait(&Stub->Client, GDBSTUB_POLL_MILLISECONDS);
+        if (0 == Ready)
+            continue;
+        char Buffer[512];
+        iSize Received = Ready > 0? Platform_SocketRecv(&Stub->Client, Buffer, sizeof Buffer) : -1;
+        if (Received <= 0)
+        {
+            GdbStub_Disconnect(Stub);
+            continue;
+        }
+        for (iSize i = 0; i < Received && Stub->HasClient; i++)
+        {
+            if (!Stub->Attached) /* detached, waiting for the debugger to hang up */
+                continue;
+            if (Stub->Running)
+            {
+                /* all the debugger may send while emulation runs is ^C */
+                if (0x03 == Buffer[i])
+                {
+                    Stub->Interrupted = true;
+                    Platform_AtomicStore(&Stub->HaltRequested, 1);
+                }
+                continue;
+            }
+            GdbStub_ReceiveByte(Stub, Buffer[i]);
+        }
+    }
+
+    if (Stub->HasClient)
+    {
+        /* the debugger waits for the program to stop, it exited instead */
+        if (Stub->Running)
+            GdbStub_Reply(Stub, "W00");
+        Platform_SocketClose(&Stub->Client);
+        Stub->HasClient = false;
+    }
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Start and stop
+ *
+ *==================================================================================*/
+
+Bool8 GdbStub_Start(GdbStub *Stub, PS1 *Ps1, u16 Port)
+{
+    *Stub = (GdbStub) {
+        .Ps1 = Ps1,
+        .Port = Port,
+    };
+    Monitor_Init(&Stub->Mon);
+    if (!Platform_SocketListen(&Stub->Listener, Port))
+        return false;
+
+    Platform_MutexInit(&Stub->Lock);
+    Platform_CondVarInit(&Stub->Changed);
+    if (!Platform_ThreadCreate(&Stub->Thread, GdbStub_Main, Stub))
+    {
+        Platform_CondVarDestroy(&Stub->Changed);
+        Platform_MutexDestroy(&Stub->Lock);
+        Platform_SocketClose(&Stub->Listener);
+        return false;
+    }
+    return true;
+}
+
+void GdbStub_Stop(GdbStub *Stub)
+{
+    Platform_MutexLock(&Stub->Lock);
+    Stub->Quit = true;
+    if (Stub->Halted)
+    {
+        Stub->Halted = false;
+        Stub->Action = GDBSTUB_KILL;
+    }
+    Platform_CondVarBroadcast(&Stub->Changed);
+    Platform_MutexUnlock(&Stub->Lock);
+
+    Platform_ThreadJoin(&Stub->Thread);
+    Platform_SocketClose(&Stub->Listener);
+    Platform_CondVarDestroy(&Stub->Changed);
+    Platform_MutexDestroy(&Stub->Lock);
+}
+
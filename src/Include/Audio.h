@@ -0,0 +1,76 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "Common.h"
+
+
+/*
+ * Sound output: the emulation thread pushes the SPU's frames, a backend consumes them.
+ *     AUDIO_BACKEND_DEVICE     miniaudio's callback pulls them from a lock-free ring on its own thread
+ *     AUDIO_BACKEND_NULL       they're thrown away, for headless runs
+ * Either way they can also be recorded to a WAV file, every frame pushed, so a run that's unthrottled
+ * (or that the device can't keep up with) still records perfect audio.
+ *
+ * Pushing never waits: frames that don't fit in the ring are dropped.
+ * The device's clock doesn't run at exactly the console's rate, and emulation is paced by its own timer,
+ * so the callback resamples to the device's rate with a ratio that follows the ring's fill level (dynamic rate control):
+ * a ring above AUDIO_TARGET_FRAMES is read a little faster, one below it a little slower, by at most AUDIO_MAX_RATE_ADJUST.
+ * The device only starts playing once the ring reached the target, and starts over like that after running dry.
+ *
+ * The device backend needs miniaudio's implementation, which comes with raylib (raudio.c),
+ * so it's only there when the frontend is (see PS1_NO_FRONTEND).
+ */
+#define AUDIO_SAMPLE_RATE 44100     /* of the frames pushed, the SPU's */
+#define AUDIO_RING_FRAMES 8192      /* 0.19s, a power of 2 */
+#define AUDIO_TARGET_FRAMES 2048    /* 46ms, about 3 video frames of audio */
+#define AUDIO_MAX_RATE_ADJUST 0.005 /* 0.5%, less than a tenth of a semitone */
+
+typedef enum Audio_Backend
+{
+    AUDIO_BACKEND_NULL = 0,
+    AUDIO_BACKEND_DEVICE,
+} Audio_Backend;
+
+typedef struct Audio
+{
+    Audio_Backend Backend;
+
+    /* emulation thread to the device's thread: one writer, one reader */
+    i16 Ring[AUDIO_RING_FRAMES][2];
+    volatile u32 WritePos, ReadPos; /* frame counters, wrapping */
+
+    /* emulation thread only */
+    FILE *WavFile;          /* NULL when not recording */
+    u64 FramesPushed;
+    u64 FramesDropped;      /* the ring was full: unthrottled, or the device fell behind */
+
+    /* device thread only, the stats can be read once the device is stopped (Audio_Destroy) */
+    struct Audio_Device *Device;    /* NULL with the null backend */
+    u32 DeviceRate;
+    u64 Phase;              /* 32.32 position between Prev and Next, in input frames */
+    i16 Prev[2], Next[2];
+    double AverageFill;     /* of the ring, smoothed over the callbacks */
+    Bool8 Playing;          /* the ring reached the target since it last ran dry */
+    u64 FramesPlayed;       /* at the device's rate */
+    u64 FramesMissed;       /* input frames the ring didn't have in time */
+    u64 Pulls;
+    double RatioSum;        /* of the rate control's ratio at each pull */
+} Audio;
+
+
+/*
+ * WavPath: records every frame pushed, NULL not to.
+ * A device that can't be opened falls back to the null backend (Audio::Backend tells);
+ * returns false if the WAV file couldn't be created.
+ */
+Bool8 Audio_Init(Audio *Audio, Audio_Backend Backend, const char *WavPath);
+/* stops the device, finishes the WAV file */
+void Audio_Destroy(Audio *Audio);
+/* emulation thread: interleaved stereo frames at AUDIO_SAMPLE_RATE, never blocks */
+void Audio_Push(Audio *Audio, const i16 *Frames, uint FrameCount);
+/* device thread: FrameCount interleaved stereo frames at Audio::DeviceRate, from the ring */
+void Audio_Pull(Audio *Audio, i16 *Frames, uint FrameCount);
+
+
+#endif /* AUDIO_H */
+
@@ -0,0 +1,110 @@
+#ifndef CDROM_H
+#define CDROM_H
+
+#include "Common.h"
+#include "XA.h"
+
+
+/*
+ * The CD-ROM controller (1F801800h..1F801803h): 4 registers banked by the index register,
+ * a parameter FIFO, a response FIFO, a data FIFO (read by the CPU or DMA 3) and 5 interrupt types:
+ *     INT1 a sector is ready, INT2 second response (command done), INT3 first response (acknowledge),
+ *     INT4 end of data, INT5 error.
+ *
+ * Commands answer later, not when they're written: the first response comes after CDROM_ACK_CYCLES,
+ * the second one and the sectors of a read after their own delays, all in GPU.Cycle time (see PS1_ScheduleEvent).
+ * Only one interrupt can be raised at a time, the next one waits until the CPU acknowledges the previous one.
+ *
+ * Sectors come from Disc (see Disc.h) when one is inserted. A sector the read-ahead thread hasn't cached
+ * yet is asked for again a little later, like a drive that's still spinning up.
+ *
+ * With XA-ADPCM on (Setmode bit 6), audio sectors (of the Setfilter file and channel when Setmode bit 3 is set)
+ * don't go to the CPU: they're decoded a sector at a time (see XA.h) into a ring of 44.1 kHz stereo frames
+ * that the audio mixer takes from with CDROM_ReadAudio.
+ */
+#define CDROM_FIFO_SIZE 16
+#define CDROM_SECTOR_SIZE 2352
+#define CDROM_AUDIO_FRAMES 16384   /* 0.37s, a power of 2 */
+
+typedef enum CDROM_Int
+{
+    CDROM_INT_NONE = 0,
+    CDROM_INT1_DATA_READY,
+    CDROM_INT2_COMPLETE,
+    CDROM_INT3_ACKNOWLEDGE,
+    CDROM_INT4_DATA_END,
+    CDROM_INT5_ERROR,
+} CDROM_Int;
+
+/* a response waiting to be raised, Int is CDROM_INT_NONE when there's none */
+typedef struct CDROM_Response
+{
+    u64 Cycle;              /* not before then */
+    CDROM_Int Int;
+    u8 Size;
+    u8 Bytes[CDROM_FIFO_SIZE];
+} CDROM_Response;
+
+typedef struct CDROM
+{
+    PS1 *Bus;
+    struct Disc *Disc;      /* NULL when the drive is empty; set by the owner, survives resets */
+
+    u8 Index;               /* 1F801800h, selects the bank of the other 3 registers */
+    u8 Params[CDROM_FIFO_SIZE];
+    uint ParamCount;
+    u8 Response[CDROM_FIFO_SIZE];
+    uint ResponseSize, ResponseRead;
+    u8 IntEnable;           /* HINTMSK */
+    u8 IntFlags;            /* HINTSTS, the raised interrupt */
+    Bool8 CommandBusy;      /* a command waits for its first response */
+
+    u8 Stat;                /* the status byte most responses start with */
+    u8 Mode;                /* Setmode */
+    u32 SetlocLBA;
+    Bool8 SetlocPending;    /* the next read or seek goes there */
+    u32 Position;           /* LBA of the drive's head */
+    Bool8 Reading;
+    u64 SectorCycle;        /* when the sector at Position is under the head */
+
+    CDROM_Response Ack;     /* INT3 or INT5 of the last command */
+    CDROM_Response Complete;/* INT2 or INT5, the second response of some commands */
+    CDROM_Response DataReady;   /* INT1 of the last sector read, replaced by the next one if it's not raised yet */
+
+    u8 Sector[CDROM_SECTOR_SIZE];   /* the last sector read */
+    u8 Data[CDROM_SECTOR_SIZE];     /* the data FIFO, loaded from Sector when the CPU asks for it (HCHPCTL bit 7) */
+    uint DataSize, DataRead;
+
+    u64 NextEventCycle;     /* the earliest of the pending responses and the next sector, ~0 when idle */
+
+    /* XA-ADPCM */
+    u8 FilterFile, FilterChanel;    /* Setfilter */
+    Bool8 Muted;            /* Mute command */
+    Bool8 AdpcmMuted;       /* ADPCTL bit 0 */
+    u8 PendingVolume[4];    /* CD left to SPU left, left to right, right to right, right to left; 80h is 100% */
+    u8 Volume[4];           /* applied by ADPCTL bit 5 */
+    XA_Decoder Xa;
+    i16 XAFrames[XA_MAX_SECTOR_FRAMES * 2];
+    i16 AudioFrames[CDROM_AUDIO_FRAMES][2];
+    u32 AudioRead, AudioWrite;  /* frame counters, wrapping */
+
+    u64 SectorsRead;
+    u64 SectorWaits;        /* times a sector wasn't cached by the read-ahead thread in time */
+    u64 XASectors;
+    u64 AudioFramesDropped; /* decoded while the ring was full */
+} CDROM;
+
+
+void CDROM_Reset(CDROM *Cdrom, PS1 *Bus);
+u8 CDROM_Read8(CDROM *Cdrom, u32 Offset);
+void CDROM_Write8(CDROM *Cdrom, u32 Offset, u8 Data);
+/* DMA 3: words from the data FIFO, 0 past its end */
+void CDROM_ReadDataBlock(CDROM *Cdrom, u32 *Words, uint WordCount);
+/* raises the responses and reads the sectors that are due by Cycle */
+void CDROM_Update(CDROM *Cdrom, u64 Cycle);
+/* the next FrameCount interleaved stereo frames of XA audio, with the CD volumes applied; silence when there's none */
+void CDROM_ReadAudio(CDROM *Cdrom, i16 *Frames, uint FrameCount);
+
+
+#endif /* CDROM_H */
+
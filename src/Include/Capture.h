@@ -0,0 +1,56 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "Common.h"
+
+
+/*
+ * Recording of the words written to GP0 and GP1, for replaying them without the CPU (see Replay.c).
+ * Recording starts from a GPU reset with VRAM cleared, so the stream alone reproduces every frame.
+ *
+ * File layout, native endian u32 words:
+ *      CAPTURE_MAGIC, CAPTURE_VERSION
+ *      records: Type << 24 | Count, followed by Count words (none for CAPTURE_VBLANK)
+ * Consecutive GP0 writes are merged into one record, commands can be split between records.
+ */
+#define CAPTURE_MAGIC 0x43315350 /* "PS1C" */
+#define CAPTURE_VERSION 1
+#define CAPTURE_MAX_RECORD_WORDS 0xFFFFFF
+#define CAPTURE_BUFFER_WORDS (64 * 1024)
+
+typedef enum Capture_RecordType
+{
+    CAPTURE_GP0 = 0,
+    CAPTURE_GP1,
+    CAPTURE_VBLANK,
+} Capture_RecordType;
+
+#define CAPTURE_RECORD_TYPE(header) ((header) >> 24)
+#define CAPTURE_RECORD_COUNT(header) ((header) & 0xFFFFFF)
+
+typedef struct Capture
+{
+    FILE *File;
+    u32 Buffer[CAPTURE_BUFFER_WORDS];
+    uint BufferCount;
+    uint OpenRecord;        /* index in Buffer of the GP0 record being appended to */
+    Bool8 HasOpenRecord;
+
+    u64 FrameCount;
+    u64 GP0WordCount;
+    u64 GP1WordCount;
+} Capture;
+
+
+/* returns false if the file can't be created */
+Bool8 Capture_Open(Capture *Cap, const char *FileName);
+void Capture_Close(Capture *Cap);
+
+void Capture_GP0(Capture *Cap, const u32 *Data, uint WordCount);
+void Capture_GP1(Capture *Cap, u32 Data);
+/* marks the end of a frame */
+void Capture_VBlank(Capture *Cap);
+
+
+#endif /* CAPTURE_H */
+
@@ -49,6 +49,31 @@ typedef struct StringView
 #define KB 1024
 #define MB (1024*1024)
 
+#if defined(_MSC_VER)
+#  define FORCE_INLINE static __forceinline
+#else
+#  define FORCE_INLINE static inline __attribute__((always_inline))
+#endif /* _MSC_VER */
+
+/* index of the lowest set bit, Value must not be 0 */
+#if defined(_MSC_VER)
+#  include <intrin.h>
+FORCE_INLINE uint LowestSetBit64(u64 Value)
+{
+    unsigned long Index;
+    _BitScanForward64(&Index, Value);
+    return (uint)Index;
+}
+#else
+#  define LowestSetBit64(value) ((uint)__builtin_ctzll(value))
+#endif /* _MSC_VER */
+
+/* SSE2 is baseline on x64, MSVC does not define __SSE2__ so check its own macros too */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define HAS_SSE2 1
+#  include <emmintrin.h>
+#endif /* SSE2 */
+
 
 #define LOG(...) fprintf(stderr, __VA_ARGS__)
 #define TODO(...) do {\
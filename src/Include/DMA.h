@@ -21,11 +21,18 @@ typedef enum
     DMA_SYNCMODE_LINKEDLIST,
 } DMA_SyncMode;
 
+/* 
+ * linked list mode (GPU ordering tables): a list that's still going after this many words 
+ * is corrupt or circular, the transfer is cut there instead of running forever like on hardware 
+ */
+#define DMA_LINKEDLIST_MAX_WORDS (1024 * 1024)
+#define DMA_LINKEDLIST_NODE_CYCLES 8
+
 typedef struct
 {
     unsigned RamToDevice:1;         /* 0 */
     unsigned Decrement:1;           /* 1 */
-    unsigned ChoppingEnable:1;      /* 2 */
+    unsigned ChoppingEnable:1;      /* 8 */
     unsigned SyncMode:2;            /* 9..10: 0=Manual, 1=Request, 2=LinkedList (GPU) */
     unsigned ChoppingDMAWindow:3;   /* 16..18: shift count for num words */
     unsigned ChoppingCPUWindow:3;   /* 20..22: shift count for num cycles */
@@ -54,6 +61,19 @@ typedef struct
     DMA_ChanelCtrl Ctrl;   /* DCHCR */
 } DMA_Chanel;
 
+/* what a transfer went through, for its timing */
+typedef struct
+{
+    u32 WordCount;          /* words moved, linked list headers included */
+    u32 NodeCount;          /* linked list headers */
+} DMA_TransferSize;
+
+/*
+ * Transfers are timed jobs: starting a channel moves the data right away (PS1_DoDMATransfer),
+ * but the channel stays busy (Ctrl.Enable) until the cycle the transfer would end on hardware,
+ * and the CPU keeps running in between. Then DMA_Update finishes it and raises its DICR interrupt flag.
+ * Time is the GPU's cycle counter (GPU.Cycle), which the run loop advances.
+ */
 typedef struct
 {
     DMA_Chanel Chanels[7];
@@ -61,6 +81,11 @@ typedef struct
     u32 PriorityCtrlReg;                /* DPCR */
     DMA_InterruptCtrl InterruptCtrlReg; /* DICR */
 
+    u32 BusyChanels;        /* bit per channel with a transfer in flight */
+    u32 WaitingChanels;     /* bit per channel started in request mode before its device had data (see DMA_Request) */
+    u64 FinishCycle[7];     /* of the channels in BusyChanels */
+    u64 NextEventCycle;     /* the earliest FinishCycle, ~0 when no channel is busy */
+
     PS1 *Bus;
 } DMA;
 
@@ -68,7 +93,15 @@ typedef struct
 void DMA_Reset(DMA *Dma, PS1 *Bus);
 u32 DMA_Read32(DMA *Dma, u32 Offset);
 void DMA_Write32(DMA *Dma, u32 Offset, u32 Data);
+/* the run loop, once Cycle reaches NextEventCycle: finishes the transfers that ended by then */
+void DMA_Update(DMA *Dma, u64 Cycle);
+/* 
+ * a device is ready for Port: starts its transfer if it's waiting for that. 
+ * The MDEC's output and the SPU (until SPUCNT asks for DMA) can be late, a transfer that starts before them waits 
+ */
+void DMA_Request(DMA *Dma, DMA_Port Port);
 u32 DMA_GetChanelTransferSize(const DMA_Chanel *Chanel);
-void DMA_SetTransferFinishedState(DMA_Chanel *Chanel);
+/* cycles a transfer takes, with the channel's chopping windows */
+u64 DMA_GetTransferCycles(const DMA_Chanel *Chanel, DMA_Port Port, DMA_TransferSize Size);
 
 #endif /* DMA_H */
@@ -0,0 +1,75 @@
+#ifndef DEBUG_SNAPSHOT_H
+#define DEBUG_SNAPSHOT_H
+
+#include "Common.h"
+#include "Ps1.h"
+#include "TripleBuffer.h"
+
+
+/*
+ * Copy of the machine state for the debugger windows, taken by the emulation thread at the end of a frame.
+ * Only the RAM pages and VRAM tiles written since a slot was last filled are copied into it,
+ * and the Changed masks tell the viewers which parts differ from the snapshot they had before.
+ */
+typedef struct DebugSnapshot
+{
+    u8 *Ram;                /* PS1_RAM_SIZE bytes */
+    u16 *Vram;              /* GPU_VRAM_WIDTH x GPU_VRAM_HEIGHT halfwords */
+
+    /* written since the previous snapshot the reader got, same layout as PS1.RamDirtyPages and GPU.DirtyTiles */
+    u64 ChangedRamPages[PS1_RAM_PAGE_COUNT / 64];
+    u64 ChangedVramTiles[GPU_DIRTY_TILE_ROWS];
+    u64 Frame;
+
+    u32 PC;                 /* next instruction to execute */
+    u32 R[32];
+    u32 Hi, Lo;
+    u32 SR, Cause, EPC;
+
+    GPUStat GpuStatus;      /* texture page and depth of the last draw mode */
+    u16 Clut;               /* CLUT attribute of the last textured primitive */
+    u16 DisplayX, DisplayY;
+    u16 DisplayWidth, DisplayHeight;    /* in halfwords of VRAM */
+    u16 DrawLeft, DrawTop, DrawRight, DrawBottom;
+} DebugSnapshot;
+
+/*
+ * Lock-free handoff of snapshots from the emulation thread to the presentation thread,
+ * like TripleBuffer but a new snapshot is only taken once the reader picked up the last one:
+ * while the viewers are busy, the emulation thread only merges the dirty bits of each frame.
+ */
+typedef struct DebugSnapshot_Buffer
+{
+    DebugSnapshot Slots[3];
+    TripleBuffer_Exchange Exchange;
+    const u8 *Bios;         /* read only, PS1_BIOS_SIZE bytes */
+
+    /* writer only: what each slot misses of the current state, and what changed since the last publish */
+    u64 StaleRamPages[3][PS1_RAM_PAGE_COUNT / 64];
+    u64 StaleVramTiles[3][GPU_DIRTY_TILE_ROWS];
+    u64 UnpublishedRamPages[PS1_RAM_PAGE_COUNT / 64];
+    u64 UnpublishedVramTiles[GPU_DIRTY_TILE_ROWS];
+
+    u64 Published;          /* writer only */
+    u64 Skipped;            /* writer only, frames that ended while the reader still had the last snapshot */
+    u64 BytesCopied;        /* writer only */
+} DebugSnapshot_Buffer;
+
+
+/* returns false when out of memory, Bios must outlive the buffer */
+Bool8 DebugSnapshot_Init(DebugSnapshot_Buffer *Buf, const u8 *Bios);
+/* see TripleBuffer_Destroy */
+void DebugSnapshot_Destroy(DebugSnapshot_Buffer *Buf);
+
+/*
+ * emulation thread, at the end of every frame before Display_Output (which clears the GPU's dirty tiles);
+ * consumes Ps1->RamDirtyPages
+ */
+void DebugSnapshot_Update(DebugSnapshot_Buffer *Buf, PS1 *Ps1, u64 Frame);
+
+/* reader: like TripleBuffer_Read */
+const DebugSnapshot *DebugSnapshot_Read(DebugSnapshot_Buffer *Buf, Bool8 *OutIsNew);
+
+
+#endif /* DEBUG_SNAPSHOT_H */
+
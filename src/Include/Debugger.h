@@ -0,0 +1,82 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "Common.h"
+#include "DebugSnapshot.h"
+
+#include "raylib.h"
+
+
+/*
+ * Debugger windows next to the emulator's window: VRAM (with the texture page, CLUT, display and drawing areas),
+ * a hex view of RAM and the disassembly around PC with the registers.
+ * They belong to the presentation thread and only ever look at the snapshots in Snapshots,
+ * which the emulation thread fills in without waiting (see DebugSnapshot_Update).
+ * Each window refreshes what changed since the snapshot before: the VRAM tiles that were written are uploaded,
+ * and text is drawn once per line into a render texture, again only when the line changed.
+ */
+#define DEBUGGER_MAX_LINES 40
+#define DEBUGGER_LINE_SIZE 96
+
+typedef struct Debugger_TextPanel
+{
+    RenderTexture2D Target;
+    Bool8 HasTarget;
+    uint Width;
+    uint LineCount;
+    char Lines[DEBUGGER_MAX_LINES][DEBUGGER_LINE_SIZE];
+    Color Colors[DEBUGGER_MAX_LINES];
+    u64 DirtyLines;         /* lines to draw into Target at the next flush */
+} Debugger_TextPanel;
+
+typedef struct Debugger_Window
+{
+    int Id;                 /* raylib window, -1 once closed */
+    Font Font;              /* fonts and textures belong to the window's GL context */
+} Debugger_Window;
+
+typedef struct Debugger
+{
+    DebugSnapshot_Buffer Snapshots;
+    Bool8 HasSnapshot;
+
+    Debugger_Window VramWindow;
+    Texture2D VramTexture;
+    u32 VramRows[GPU_VRAM_WIDTH * GPU_DIRTY_TILE_SIZE];     /* converted tiles on their way to the texture */
+    uint TilesUploaded;     /* by the last refresh */
+
+    Debugger_Window MemoryWindow;
+    Debugger_TextPanel Memory;
+    uint MemoryTopLine;     /* 16 bytes per line */
+    Bool8 MemoryScrolled;
+
+    Debugger_Window CodeWindow;
+    Debugger_TextPanel Code;
+    Debugger_TextPanel Registers;
+    u32 CodeTop;
+    u32 LastPC;
+    Bool8 FollowPC;
+    Bool8 CodeScrolled;
+    uint LinesRedrawn;      /* since the last new snapshot, in all panels */
+
+    /* input, raylib polls it at the end of every window's frame so it's gathered across all of them */
+    float Wheel;
+    Bool8 WheelUsed;        /* by the focused window, during the last Debugger_Present */
+    u32 KeysDown;
+    u32 KeysPressed;
+} Debugger;
+
+
+/*
+ * presentation thread, after the main window was created; Bios must outlive the debugger.
+ * Returns false if the windows could not be created
+ */
+Bool8 Debugger_Init(Debugger *Dbg, const u8 *Bios);
+/* the emulation thread must be done with Dbg->Snapshots */
+void Debugger_Destroy(Debugger *Dbg);
+/* presentation thread, after Frontend_Present: draws every debugger window that is still open */
+void Debugger_Present(Debugger *Dbg);
+
+
+#endif /* DEBUGGER_H */
+
@@ -0,0 +1,154 @@
+#ifndef DISC_H
+#define DISC_H
+
+#include "Common.h"
+#include "Platform.h"
+
+
+/*
+ * CD images for the CD-ROM controller: a CUE sheet and its BIN files, a lone BIN file (one data track),
+ * or a packed image (.cdz, see below).
+ * Only raw 2352 byte sectors are supported (MODE1/2352, MODE2/2352, AUDIO), which is what PS1 rips are.
+ *
+ * The image files are memory mapped, and a read-ahead thread copies the sectors after the last one read
+ * into a small cache, inflating the hunks of a packed image on the way. The emulation thread only ever reads that cache: a sector that isn't there yet
+ * is reported as pending instead of faulting the mapping in, so slow storage delays sectors
+ * (like a real drive would) but never stalls emulation.
+ *
+ * Sectors are addressed by LBA, where LBA 0 is MSF 00:02:00 (the first sector of track 1's data).
+ */
+#define DISC_SECTOR_SIZE 2352
+#define DISC_PREGAP_SECTORS 150         /* MSF 00:02:00 */
+#define DISC_MAX_TRACKS 99
+#define DISC_CACHE_SECTORS 64
+#define DISC_READ_AHEAD_SECTORS 32      /* at most half the cache, so it doesn't evict the sectors being read */
+
+/*
+ * Packed image, made by PackDisc from a BIN/CUE; all little endian:
+ *     Disc_PackHeader
+ *     Disc_PackTrack[TrackCount]
+ *     u64 HunkOffsets[HunkCount + 1]      from the start of the file, hunk i is [HunkOffsets[i], HunkOffsets[i + 1])
+ *     u32 HunkChecksums[HunkCount]        Adler-32 of the hunk as stored, checked before inflating it
+ *     the hunks, then 8 bytes of padding so the inflater can't read past the mapping
+ * Every LBA of the disc (gaps included, as zeros) is in a hunk of HunkSectors raw sectors (the last one may be shorter),
+ * each hunk deflated on its own so any sector is one offset lookup and one hunk away.
+ * A hunk that doesn't shrink is stored as is. The inflater trusts its input, so a hunk that fails
+ * its checksum reads as zeros instead.
+ */
+#define DISC_PACK_MAGIC "PS1DISCZ"
+#define DISC_PACK_VERSION 1
+#define DISC_PACK_DEFAULT_HUNK_SECTORS 16   /* 37632 bytes, just over deflate's 32kb window */
+#define DISC_PACK_MAX_HUNK_SECTORS 256
+#define DISC_PACK_PADDING 8
+#define DISC_HUNK_CACHE_COUNT 8             /* inflated hunks kept by the read-ahead thread */
+
+typedef struct Disc_PackHeader
+{
+    char Magic[8];
+    u32 Version;
+    u32 HunkSectors;
+    u32 SectorCount;
+    u32 TrackCount;
+    u32 HunkCount;
+    u32 Reserved;
+} Disc_PackHeader;
+
+typedef struct Disc_PackTrack
+{
+    u32 Number;
+    u32 Audio;
+    u32 Start;
+    u32 DataStart;
+} Disc_PackTrack;
+
+typedef struct Disc_Hunk
+{
+    u32 Index;
+    Bool8 Valid;
+    u64 LastUse;
+    u8 *Data;               /* HunkSectors raw sectors */
+} Disc_Hunk;
+
+typedef enum Disc_SectorStatus
+{
+    DISC_SECTOR_READY = 0,
+    DISC_SECTOR_PENDING,        /* the read-ahead thread is bringing it in, ask again later */
+    DISC_SECTOR_OUT_OF_RANGE,   /* past the end of the disc */
+} Disc_SectorStatus;
+
+typedef struct Disc_Track
+{
+    uint Number;
+    Bool8 Audio;
+    u32 Start;              /* LBA of INDEX 01 */
+    u32 DataStart;          /* LBA of the track's first sector in its file (INDEX 00 if the file has the pregap) */
+    u32 FileSector;         /* where DataStart is in the file */
+    u32 SectorCount;        /* in the file from DataStart, the LBAs after that up to the next track are a gap */
+    uint File;
+} Disc_Track;
+
+typedef struct Disc_CacheSlot
+{
+    u32 LBA;
+    Bool8 Valid;
+    u8 Data[DISC_SECTOR_SIZE];
+} Disc_CacheSlot;
+
+typedef struct Disc
+{
+    Platform_MappedFile Files[DISC_MAX_TRACKS];
+    uint FileCount;
+    Disc_Track Tracks[DISC_MAX_TRACKS];
+    uint TrackCount;
+    u32 SectorCount;        /* LBA of the lead-out */
+    char Region[5];         /* SCEA, SCEE or SCEI, from the license string of sector 4 */
+
+    /* packed image: Files[0] is the whole image; the hunk cache belongs to the read-ahead thread */
+    Bool8 Packed;
+    u32 HunkSectors;
+    u32 HunkCount;
+    const u8 *HunkOffsets;  /* in the mapping, not aligned */
+    const u8 *HunkChecksums;
+    Disc_Hunk Hunks[DISC_HUNK_CACHE_COUNT];
+    u64 HunkClock;
+    u64 HunksInflated;
+    u64 HunkHits;
+
+    Platform_Thread Thread;
+    Platform_Mutex Lock;
+    Platform_CondVar Wake;
+    /* under Lock */
+    Bool8 Quit;
+    u32 ReadAhead;          /* the read-ahead thread caches the sectors from here on */
+    Disc_CacheSlot Cache[DISC_CACHE_SECTORS];   /* slot LBA % DISC_CACHE_SECTORS */
+
+    /* emulation thread */
+    u64 Hits;
+    u64 Misses;             /* sectors that weren't cached yet when asked for */
+} Disc;
+
+
+/* Path is a .cue, a .bin or a .cdz file, starts the read-ahead thread; returns false (and logs why) if it can't be used */
+Bool8 Disc_Open(Disc *Disc, const char *Path);
+void Disc_Close(Disc *Disc);
+
+/*
+ * copies the raw sector into Out if it's cached, otherwise asks the read-ahead thread for it;
+ * sectors outside of any file (gaps) read as zeros
+ */
+Disc_SectorStatus Disc_ReadSector(Disc *Disc, u32 LBA, u8 Out[DISC_SECTOR_SIZE]);
+/* a seek: the read-ahead thread starts caching from LBA */
+void Disc_Prefetch(Disc *Disc, u32 LBA);
+/*
+ * copies the raw sector straight from the image, waiting on the storage (and inflating a hunk);
+ * for tools, not the emulation thread, and not alongside the read-ahead thread of a packed image
+ */
+void Disc_LoadSector(Disc *Disc, u32 LBA, u8 Out[DISC_SECTOR_SIZE]);
+/* Adler-32, of the hunks of a packed image */
+u32 Disc_Checksum(const u8 *Data, u64 Size);
+/* the track LBA is in, NULL before track 1 or past the lead-out */
+const Disc_Track *Disc_FindTrack(const Disc *Disc, u32 LBA);
+
+
+#endif /* DISC_H */
+
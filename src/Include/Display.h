@@ -0,0 +1,91 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Rasterizer.h"
+
+
+#define DISPLAY_MAX_WIDTH 640
+#define DISPLAY_MAX_HEIGHT 512
+/* frames are Scale times the display resolution when the GPU renders upscaled (see Raster_AttachUpscaler) */
+#define DISPLAY_MAX_SCALE RASTER_MAX_SCALE
+
+/* output pixels are RGBA8888: R is the lowest byte in memory */
+#define DISPLAY_RGBA(r, g, b) ((u32)(r) | (u32)(g) << 8 | (u32)(b) << 16 | (u32)0xFF << 24)
+
+typedef struct Display_Frame
+{
+    u32 *Pixels;            /* the buffer returned by BeginFrame */
+    uint Width, Height, Pitch;
+    /* only rows DirtyRowStart..DirtyRowEnd-1 changed since the previous frame, none if they're equal */
+    uint DirtyRowStart, DirtyRowEnd;
+    Bool8 Pal;              /* the GPU's video mode: 50 Hz, or 59.94 Hz for NTSC */
+} Display_Frame;
+
+/*
+ * Where the displayed frames go.
+ * The sink owns the frame buffer, the display area of VRAM is converted straight into it.
+ * Rows that didn't change are not converted again, 
+ * so the sink must hand out the same buffer with the previous frame still in it.
+ */
+typedef struct Display_Sink
+{
+    void *Context;
+    /* returns the buffer that the frame gets converted to (Height rows of *OutPitch pixels), or NULL to drop the frame */
+    u32 *(*BeginFrame)(void *Context, uint Width, uint Height, uint *OutPitch);
+    void (*EndFrame)(void *Context, const Display_Frame *Frame);
+} Display_Sink;
+
+/* what the sink's buffer currently holds, anything different from this means converting the whole frame */
+typedef struct Display_State
+{
+    u32 *Pixels;
+    uint Width, Height, Pitch;
+    u16 VramX, VramY;
+    uint Scale;
+    Bool8 Rgb24, Disabled;
+
+    /* stats */
+    u64 FrameCount;
+    u64 RowsConverted;
+    u64 RowsSkipped;
+} Display_State;
+
+/* headless sink, keeps the last frame in memory; zero initialize it, the buffer grows with the frames */
+typedef struct Display_MemorySink
+{
+    u32 *Pixels;
+    uint Capacity;              /* in pixels */
+    uint Width, Height;
+    u64 FrameCount;
+} Display_MemorySink;
+
+
+/* size of the displayed picture in pixels, based on the current display mode */
+void Display_GetResolution(const GPU *Gpu, uint *OutWidth, uint *OutHeight);
+/* 
+ * converts the rows of the display area that changed to RGBA8888 and hands the frame to the sink, 
+ * called once per vblank; clears the GPU's dirty tiles.
+ * With an upscaler the frame comes from the shadow VRAM at Scale times the resolution, except in 24 bit mode.
+ * State must be zero initialized before the first frame
+ */
+void Display_Output(Display_State *State, GPU *Gpu, const Display_Sink *Sink);
+/* fraction of the displayed rows that didn't have to be converted, 0..1 */
+double Display_SkippedFraction(const Display_State *State);
+
+/* row converters, Src of Display_ConvertRow24 must be readable for 4 bytes past the last pixel */
+void Display_ConvertRow15(u32 *Dst, const u16 *Src, uint Count);
+void Display_ConvertRow24(u32 *Dst, const u8 *Src, uint Count);
+
+/* 
+ * for sinks: the frame buffer with room for Width x Height tightly packed pixels, grown (and its content lost) if it's too small;
+ * NULL when out of memory
+ */
+u32 *Display_GrowFrameBuffer(u32 **Pixels, uint *Capacity, uint Width, uint Height);
+Display_Sink Display_MemorySinkInterface(Display_MemorySink *Sink);
+void Display_MemorySinkDestroy(Display_MemorySink *Sink);
+
+
+#endif /* DISPLAY_H */
+
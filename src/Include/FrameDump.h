@@ -0,0 +1,73 @@
+#ifndef FRAMEDUMP_H
+#define FRAMEDUMP_H
+
+#include "Common.h"
+#include "Display.h"
+#include "Platform.h"
+
+
+#define FRAMEDUMP_QUEUE_SIZE 4
+
+typedef struct FrameDump_Frame
+{
+    u32 *Pixels;            /* tightly packed, Width pixels per row */
+    uint Capacity;          /* in pixels, grows with the frames */
+    uint Width, Height;
+    u64 Number;
+    Bool8 Snapshot;
+    Bool8 Pal;
+} FrameDump_Frame;
+
+/*
+ * Records the displayed frames as a Y4M stream and/or PNG snapshots.
+ * The emulation thread only copies each frame into a queue,
+ * the conversion and file writes happen on a worker thread.
+ */
+typedef struct FrameDump
+{
+    Display_Sink Next;          /* frames are passed on to this sink too */
+
+    /* worker thread only */
+    FILE *VideoFile;            /* NULL when only taking snapshots */
+    uint VideoWidth, VideoHeight; /* set by the first frame, a Y4M stream can't change its size or frame rate */
+    u8 *Yuv;                    /* Y, U and V planes of one video frame */
+    u32 *Scratch;               /* frames that don't match the video size are padded or cropped here */
+
+    /* shared, guarded by Lock */
+    Platform_Mutex Lock;
+    Platform_CondVar FrameQueued, SlotFreed;
+    FrameDump_Frame *Queue;     /* FRAMEDUMP_QUEUE_SIZE frames */
+    uint QueueHead, QueueCount;
+    Bool8 Quit;
+    Bool8 VideoStopped;         /* the worker closed the video (out of memory or a write error) */
+
+    /* emulation thread only */
+    Platform_Thread Worker;
+    Bool8 RecordVideo;
+    Bool8 SnapshotRequested;
+    u64 FrameCount;
+} FrameDump;
+
+
+/*
+ * VideoPath: Y4M output file, "-" for stdout, NULL to only take snapshots.
+ * The stream runs at the frame rate of the first frame's video mode (Display_Frame::Pal).
+ * Returns false if the file or the worker thread could not be created.
+ */
+Bool8 FrameDump_Init(FrameDump *Dump, const char *VideoPath);
+/* writes out the queued frames and closes the stream */
+void FrameDump_Destroy(FrameDump *Dump);
+/* the next frame is also saved as snapshot_<frame number>.png */
+void FrameDump_RequestSnapshot(FrameDump *Dump);
+/* a sink that records the frame and forwards it to Next */
+Display_Sink FrameDump_SinkInterface(FrameDump *Dump, const Display_Sink *Next);
+
+/*
+ * RGBA8888 to full range BT.601 YUV 4:2:0 (what Y4M C420jpeg expects).
+ * Width and Height must be even, Pitch is in pixels.
+ */
+void FrameDump_ConvertYUV420(u8 *Y, u8 *U, u8 *V, const u32 *Src, uint Pitch, uint Width, uint Height);
+
+
+#endif /* FRAMEDUMP_H */
+
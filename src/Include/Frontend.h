@@ -0,0 +1,60 @@
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+#include "Common.h"
+#include "Display.h"
+#include "TripleBuffer.h"
+
+#include "raylib.h"
+
+
+/*
+ * Interactive raylib window showing the emulator's display output.
+ * The window belongs to the presentation thread (the one that calls Frontend_Init), which keeps calling Frontend_Present.
+ * Emulation runs on its own thread and outputs frames through Frontend_DisplaySinkInterface,
+ * they're handed over through a triple buffer so vsync and window events never hold emulation back.
+ */
+typedef struct Frontend
+{
+    /* presentation thread only */
+    int WindowId;
+    Texture2D Texture;      /* at least DISPLAY_MAX_WIDTH x DISPLAY_MAX_HEIGHT, only the top left of it is used */
+    Bool8 HasTexture;
+    u64 PresentedCount;     /* new frames shown */
+    u32 KeysDown;           /* FRONTEND_KEY_* held at the last Frontend_Present */
+
+    TripleBuffer Frames;
+
+    /* emulation thread only */
+    u32 *Pixels;            /* frame buffer handed to the display stage, keeps the rows that didn't change */
+    uint Capacity;          /* in pixels */
+    char Overlay[TRIPLEBUFFER_TEXT_SIZE];
+
+    /* set by the presentation thread, read by the emulation thread */
+    volatile u32 QuitRequested;
+    volatile u32 SnapshotRequested;
+    volatile u32 ShowOverlay;
+    volatile u32 ReverbToggled;
+} Frontend;
+
+/* SoftwareGL: asks Mesa for its software renderer (llvmpipe), for machines without a GPU */
+Bool8 Frontend_Init(Frontend *Fe, const char *Title, Bool8 SoftwareGL);
+/* the emulation thread must be done with the frontend */
+void Frontend_Destroy(Frontend *Fe);
+/* presentation thread: handles input, draws the latest frame and waits for vsync, returns false once the window is closed */
+Bool8 Frontend_Present(Frontend *Fe);
+
+/* emulation thread, true once the window was closed */
+Bool8 Frontend_QuitRequested(Frontend *Fe);
+/* emulation thread, true when the snapshot key (F12) was pressed since the last call */
+Bool8 Frontend_SnapshotRequested(Frontend *Fe);
+/* emulation thread, true when the reverb key (F4) was pressed since the last call */
+Bool8 Frontend_ReverbToggleRequested(Frontend *Fe);
+/* emulation thread, the overlay (F3) is only drawn while enabled, no need to update it otherwise */
+Bool8 Frontend_OverlayEnabled(Frontend *Fe);
+void Frontend_SetOverlay(Frontend *Fe, const char *Text);
+/* emulation thread */
+Display_Sink Frontend_DisplaySinkInterface(Frontend *Fe);
+
+
+#endif /* FRONTEND_H */
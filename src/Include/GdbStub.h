@@ -0,0 +1,89 @@
+#ifndef GDB_STUB_H
+#define GDB_STUB_H
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Monitor.h"
+#include "Platform.h"
+
+
+/*
+ * GDB remote serial protocol server on 127.0.0.1, for gdb-multiarch (set architecture mips:3000, target remote :port).
+ *
+ * It runs on its own thread and only touches the machine while emulation is halted in GdbStub_Halt:
+ * registers (r0..r31, sr, lo, hi, badvaddr, cause, pc in gdb's mips layout, then epc, which gdb learns of
+ * from the target description, qXfer:features:read), RAM and BIOS through PS1_DebugRead/Write
+ * (so reading memory never has side effects on MMIO), and the breakpoints and watchpoints of its own monitor,
+ * which is attached to PS1.Monitor for as long as a debugger is connected.
+ * Until then, the emulation thread's only cost is looking at HaltRequested before every frame.
+ */
+#define GDBSTUB_PACKET_SIZE 4096
+#define GDBSTUB_REGISTER_COUNT 73   /* 38..71 are the FPU's, always unavailable: the PS1 doesn't have one */
+#define GDBSTUB_REGISTER_PC 37
+#define GDBSTUB_REGISTER_EPC 72
+
+typedef enum GdbStub_Action
+{
+    GDBSTUB_NONE = 0,       /* halted, waiting for the debugger */
+    GDBSTUB_CONTINUE,
+    GDBSTUB_STEP,
+    GDBSTUB_DETACH,
+    GDBSTUB_KILL,           /* the debugger killed the emulator, or it's exiting */
+} GdbStub_Action;
+
+typedef struct GdbStub
+{
+    PS1 *Ps1;
+    Monitor Mon;
+    Platform_Thread Thread;
+    Platform_Socket Listener;
+    u16 Port;
+
+    /* the emulation thread looks at it once per frame, and halts when it's set */
+    volatile u32 HaltRequested;
+
+    Platform_Mutex Lock;
+    Platform_CondVar Changed;
+    /* under Lock */
+    Bool8 Quit;             /* the emulator is exiting, don't halt anymore */
+    Bool8 Halted;           /* the emulation thread waits in GdbStub_Halt, the machine belongs to the stub thread */
+    GdbStub_Action Action;  /* what the emulation thread does once the debugger lets it go */
+
+    /* stub thread */
+    Platform_Socket Client;
+    Bool8 HasClient;
+    Bool8 Attached;         /* Mon is attached to the machine */
+    Bool8 DetachPending;    /* the debugger went away while emulation was running */
+    Bool8 Running;          /* the debugger waits for a stop reply */
+    Bool8 Interrupted;      /* the halt was the debugger's ^C */
+    char Packet[GDBSTUB_PACKET_SIZE];
+    uint PacketLength;
+    uint PacketState;
+    int PacketChecksum;     /* of the high digit, -1 if it isn't hex */
+    char Reply[GDBSTUB_PACKET_SIZE + 4];    /* the last one, sent again if the debugger asks */
+    uint ReplyLength;
+
+    u64 Halts;
+    u64 PacketCount;
+} GdbStub;
+
+
+/* listens on Port and starts the stub thread; returns false if the port can't be used */
+Bool8 GdbStub_Start(GdbStub *Stub, PS1 *Ps1, u16 Port);
+/*
+ * before the emulation thread is joined: lets it go if it's halted (GdbStub_Halt returns false from then on),
+ * tells the debugger the emulator exited and stops the stub thread
+ */
+void GdbStub_Stop(GdbStub *Stub);
+
+/* emulation thread, before every frame: the debugger wants to halt */
+Bool8 GdbStub_HaltRequested(GdbStub *Stub);
+/*
+ * emulation thread, when HaltRequested or when the stub's monitor stopped: waits until the debugger resumes;
+ * returns false if the emulator should exit
+ */
+Bool8 GdbStub_Halt(GdbStub *Stub);
+
+
+#endif /* GDB_STUB_H */
+
@@ -0,0 +1,93 @@
+#ifndef MDEC_H
+#define MDEC_H
+
+#include "Common.h"
+
+
+/*
+ * The MDEC, the motion (JPEG-like) decoder of FMVs (1F801820h..1F801827h):
+ * commands and their parameters go in through MDEC0 (or DMA 0), decoded pixels come out of MDEC0 (or DMA 1).
+ *     command 1: decode macroblocks, the parameters are run length coded blocks of 16 bit words
+ *     command 2: quantization tables, 64 bytes for luminance (Y) and 64 more for color (Cr, Cb) when bit 0 is set
+ *     command 3: IDCT scale table, 64 signed halfwords
+ *
+ * A color macroblock is 6 blocks of 8x8 coefficients (Cr, Cb, Y1..Y4) that become 16x16 pixels of 15 or 24 bits,
+ * a monochrome one a single Y block that becomes 8x8 pixels of 4 or 8 bits.
+ * Each block goes through run length decoding, dequantization, an 8x8 IDCT (SSE2 when there is),
+ * then the color conversion (also SSE2) joins the blocks of a macroblock.
+ *
+ * Macroblocks are only decoded when their pixels are read: a DMA 1 transfer decodes all the macroblocks it covers
+ * in one batch, straight into RAM, and they're independent of each other so the batch is split between ThreadCount threads
+ * (see MDEC_AttachWorkers). Reading MDEC0 decodes one at a time.
+ */
+#define MDEC_MAX_PARAM_WORDS 0x10000
+#define MDEC_MACROBLOCK_MAX_WORDS (16 * 16 * 3 / 4)    /* 24 bit */
+#define MDEC_MAX_THREADS 16
+
+typedef enum MDEC_Depth
+{
+    MDEC_DEPTH_4 = 0,
+    MDEC_DEPTH_8,
+    MDEC_DEPTH_24,
+    MDEC_DEPTH_15,
+} MDEC_Depth;
+
+typedef struct MDEC
+{
+    PS1 *Bus;
+    /* threads that decode the macroblocks of DMA transfers when not NULL (see MDEC_AttachWorkers), survives resets */
+    struct MDEC_Workers *Workers;
+
+    u32 Command;            /* the last command word */
+    u32 ParamWordsLeft;     /* of the last command, 0 when MDEC0 waits for a command */
+    u32 ParamIndex;
+
+    /* decode command */
+    MDEC_Depth Depth;
+    Bool8 Signed;           /* 8 bit color components are signed, unsigned otherwise */
+    Bool8 SetBit15;         /* of 15 bit pixels */
+    u32 Input[MDEC_MAX_PARAM_WORDS];
+    u32 InputCount;         /* words received */
+    u32 InputRead;          /* halfwords decoded */
+    Bool8 InputDone;        /* the decode command has all of its input, what's left is reading the output */
+
+    u8 QuantTable[2][64];   /* luminance, color; in zigzag order */
+    i16 ScaleTable[64];     /* IDCT matrix, [frequency*8 + position] */
+
+    /* the last macroblock decoded, the part of it that wasn't read yet */
+    u32 Macroblock[MDEC_MACROBLOCK_MAX_WORDS];
+    uint MacroblockWords, MacroblockRead;
+
+    Bool8 DataInRequest;    /* control bit 30, DMA 0 */
+    Bool8 DataOutRequest;   /* control bit 29, DMA 1 */
+
+    u64 MacroblocksDecoded;
+    u64 Batches;            /* of macroblocks decoded together by a DMA transfer */
+} MDEC;
+
+
+void MDEC_Reset(MDEC *Mdec, PS1 *Bus);
+/* 1F801820h: command or parameter */
+void MDEC_WriteCommand(MDEC *Mdec, u32 Data);
+/* 1F801824h: control */
+void MDEC_WriteControl(MDEC *Mdec, u32 Data);
+/* 1F801820h: decoded pixels, 0 once there's none */
+u32 MDEC_ReadData(MDEC *Mdec);
+/* 1F801824h */
+u32 MDEC_ReadStatus(MDEC *Mdec);
+/* DMA 0: same as MDEC_WriteCommand on each word */
+void MDEC_WriteBlock(MDEC *Mdec, const u32 *Words, uint WordCount);
+/* DMA 1: same as MDEC_ReadData WordCount times, but the whole macroblocks are decoded in parallel */
+void MDEC_ReadBlock(MDEC *Mdec, u32 *Words, uint WordCount);
+/* a decode command has all of its input: DMA 1 can go (DMA_Request) */
+Bool8 MDEC_IsOutputReady(const MDEC *Mdec);
+
+/* ThreadCount includes the thread that reads the output; sets MDEC::Workers, returns false if no thread could be created */
+Bool8 MDEC_AttachWorkers(MDEC *Mdec, uint ThreadCount);
+void MDEC_DetachWorkers(MDEC *Mdec);
+/* 1 when there are no workers */
+uint MDEC_GetThreadCount(const MDEC *Mdec);
+
+
+#endif /* MDEC_H */
+
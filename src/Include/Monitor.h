@@ -0,0 +1,97 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include "Common.h"
+
+
+/*
+ * Breakpoints and watchpoints of the debug emulator (the console prompt, see PS1_MonitorPrompt).
+ * Attached to PS1.Monitor only while debugging, the emulator runs its plain loop when it's NULL.
+ *
+ * Breakpoints are physical addresses, and a bit per page says whether a page may hold one:
+ * the run loop only looks at that bit when PC moves to another 4kb page,
+ * and only compares PC with the list while it's on a page whose bit is set.
+ * Pages are folded into MONITOR_PAGE_FILTER_BITS bits, two pages sharing a bit only costs a look at the list.
+ *
+ * Watchpoints are ranges of RAM. Their pages are marked in PS1.WatchedRamPages,
+ * which sends accesses to those pages (and only those) off the bus's fast path to Monitor_CheckAccess.
+ */
+#define MONITOR_MAX_BREAKPOINTS 64
+#define MONITOR_MAX_WATCHPOINTS 16
+#define MONITOR_PAGE_SHIFT 12
+#define MONITOR_PAGE_FILTER_BITS 4096
+
+#define MONITOR_WATCH_READ 0x1
+#define MONITOR_WATCH_WRITE 0x2
+
+typedef enum Monitor_StopReason
+{
+    MONITOR_RUNNING = 0,
+    MONITOR_STOP_STEP,          /* single step, or stopped before the first instruction */
+    MONITOR_STOP_BREAKPOINT,    /* before executing the instruction at StopPC */
+    MONITOR_STOP_WATCHPOINT,    /* after the instruction that did the access */
+    MONITOR_STOP_REQUESTED,     /* by the debugger, between frames */
+} Monitor_StopReason;
+
+typedef struct Monitor_Watchpoint
+{
+    u32 Offset;             /* in RAM */
+    u32 Size;               /* in bytes */
+    u32 Flags;              /* MONITOR_WATCH_* */
+} Monitor_Watchpoint;
+
+typedef struct Monitor
+{
+    u32 Breakpoints[MONITOR_MAX_BREAKPOINTS];   /* physical addresses */
+    uint BreakpointCount;
+    u64 BreakpointPages[MONITOR_PAGE_FILTER_BITS / 64];
+
+    Monitor_Watchpoint Watchpoints[MONITOR_MAX_WATCHPOINTS];
+    uint WatchpointCount;
+
+    /* run loop */
+    u32 PCPage;             /* logical page of PC that PCPageHasBreakpoint was looked up for */
+    Bool8 PCPageValid;      /* cleared whenever the breakpoints change */
+    Bool8 PCPageHasBreakpoint;
+    Bool8 SingleStep;
+    Bool8 SkipBreakpoint;   /* resuming from a breakpoint, don't stop on it again before it executed */
+
+    Monitor_StopReason StopReason;
+    u32 StopPC;             /* next instruction to execute */
+    u32 WatchOffset;        /* the access that hit a watchpoint */
+    u32 WatchValue;
+    u32 WatchSize;
+    u32 WatchFlags;
+    u32 WatchpointFlags;    /* of the watchpoint it hit, both for an access watchpoint */
+
+    u64 PageLookups;        /* times PC moved to another page */
+    u64 SlowAccesses;       /* RAM accesses that went through Monitor_CheckAccess */
+} Monitor;
+
+
+/* nothing set, running */
+void Monitor_Init(Monitor *Mon);
+
+/* return false if the list is full or the address is already in it */
+Bool8 Monitor_AddBreakpoint(Monitor *Mon, u32 PhysicalAddr);
+/* returns false if there was no breakpoint at PhysicalAddr */
+Bool8 Monitor_RemoveBreakpoint(Monitor *Mon, u32 PhysicalAddr);
+Bool8 Monitor_PageHasBreakpoint(const Monitor *Mon, u32 PhysicalAddr);
+Bool8 Monitor_IsBreakpoint(const Monitor *Mon, u32 PhysicalAddr);
+
+/*
+ * WatchedPages is PS1.WatchedRamPages, kept in sync with the watchpoints;
+ * Offset + Size must be within RAM. Return false if the list is full or there's no watchpoint at Offset
+ */
+Bool8 Monitor_AddWatchpoint(Monitor *Mon, u64 *WatchedPages, u32 Offset, u32 Size, u32 Flags);
+Bool8 Monitor_RemoveWatchpoint(Monitor *Mon, u64 *WatchedPages, u32 Offset);
+
+/*
+ * the bus, for an access to a watched page; Flags is a single MONITOR_WATCH_* flag.
+ * Stops at the end of the current instruction if the access overlaps a watchpoint
+ */
+void Monitor_CheckAccess(Monitor *Mon, u32 Offset, u32 Size, u32 Flags, u32 Value);
+
+
+#endif /* MONITOR_H */
+
@@ -0,0 +1,93 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include "Common.h"
+
+
+/*
+ * Thin wrappers over the OS threading primitives (Win32 or pthreads), TCP sockets (Winsock or BSD)
+ * and read only file mappings.
+ * The Win32 types are pointer sized (HANDLE, SRWLOCK, CONDITION_VARIABLE),
+ * so they are kept opaque here and windows.h stays out of the headers.
+ */
+#ifdef _WIN32
+typedef struct Platform_Thread { void *Handle; } Platform_Thread;
+typedef struct Platform_Mutex { void *Opaque; } Platform_Mutex;
+typedef struct Platform_CondVar { void *Opaque; } Platform_CondVar;
+typedef struct Platform_Socket { uintptr_t Handle; } Platform_Socket; /* SOCKET */
+#else
+#  include <pthread.h>
+typedef struct Platform_Thread { pthread_t Handle; } Platform_Thread;
+typedef struct Platform_Mutex { pthread_mutex_t Handle; } Platform_Mutex;
+typedef struct Platform_CondVar { pthread_cond_t Handle; } Platform_CondVar;
+typedef struct Platform_Socket { int Handle; } Platform_Socket;
+#endif /* _WIN32 */
+
+typedef void (*Platform_ThreadFn)(void *UserData);
+
+/* a whole file mapped read only, Data stays valid until Platform_UnmapFile */
+typedef struct Platform_MappedFile
+{
+    const u8 *Data;
+    u64 Size;
+} Platform_MappedFile;
+
+
+/* returns false if the thread could not be created */
+Bool8 Platform_ThreadCreate(Platform_Thread *Thread, Platform_ThreadFn Fn, void *UserData);
+void Platform_ThreadJoin(Platform_Thread *Thread);
+
+void Platform_MutexInit(Platform_Mutex *Mutex);
+void Platform_MutexDestroy(Platform_Mutex *Mutex);
+void Platform_MutexLock(Platform_Mutex *Mutex);
+void Platform_MutexUnlock(Platform_Mutex *Mutex);
+
+void Platform_CondVarInit(Platform_CondVar *CondVar);
+void Platform_CondVarDestroy(Platform_CondVar *CondVar);
+/* Mutex must be locked by the caller, spurious wakeups are possible */
+void Platform_CondVarWait(Platform_CondVar *CondVar, Platform_Mutex *Mutex);
+void Platform_CondVarSignal(Platform_CondVar *CondVar);
+void Platform_CondVarBroadcast(Platform_CondVar *CondVar);
+
+/* 32 bit atomics, all of them are full barriers */
+u32 Platform_AtomicLoad(volatile u32 *Value);
+void Platform_AtomicStore(volatile u32 *Value, u32 NewValue);
+/* returns the previous value */
+u32 Platform_AtomicExchange(volatile u32 *Value, u32 NewValue);
+
+/* number of logical processors, at least 1 */
+uint Platform_CpuCount(void);
+/* sleeps for at least the given time, granularity depends on the OS (about 1ms) */
+void Platform_Sleep(u64 Microseconds);
+/* sets an environment variable of this process, for the libraries that read their settings from there */
+void Platform_SetEnv(const char *Name, const char *Value);
+
+/* 
+ * blocking TCP sockets, for local tools to connect to; 
+ * Listen binds to 127.0.0.1 only and returns false if the port can't be used 
+ */
+Bool8 Platform_SocketListen(Platform_Socket *Listener, u16 Port);
+/* returns false if there was no connection to accept */
+Bool8 Platform_SocketAccept(Platform_Socket *Listener, Platform_Socket *OutClient);
+/* waits until Socket has data (or a connection) to read: returns 1 if it has, 0 on timeout and -1 on error */
+int Platform_SocketWait(Platform_Socket *Socket, u32 TimeoutMilliseconds);
+/* returns the bytes received, 0 once the other side closed the connection, -1 on error */
+iSize Platform_SocketRecv(Platform_Socket *Socket, void *Buffer, uint Size);
+/* sends all of Buffer, returns false on error */
+Bool8 Platform_SocketSend(Platform_Socket *Socket, const void *Buffer, uint Size);
+void Platform_SocketClose(Platform_Socket *Socket);
+
+/* 
+ * returns false if the file can't be opened or is empty; 
+ * pages are read from disk when they're first touched, not here 
+ */
+Bool8 Platform_MapFile(Platform_MappedFile *File, const char *Path);
+void Platform_UnmapFile(Platform_MappedFile *File);
+
+/* monotonic high resolution clock */
+u64 Platform_GetTicks(void);
+u64 Platform_TicksPerSecond(void);
+
+
+#endif /* PLATFORM_H */
+
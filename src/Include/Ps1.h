@@ -4,6 +4,9 @@
 #include "Common.h"
 #include "CPU.h"
 #include "DMA.h"
+#include "CDROM.h"
+#include "MDEC.h"
+#include "SPU.h"
 #include <wchar.h>
 
 
@@ -39,10 +42,62 @@ typedef enum GP0Mode
 {
     GP0_COMMAND,
     GP0_LOAD_IMAGE,
+    GP0_POLYLINE,   /* vertices of a polyline until the terminator word */
 } GP0Mode;
 
+#define GPU_VRAM_WIDTH 1024  /* in halfwords */
+#define GPU_VRAM_HEIGHT 512
+#define GPU_VRAM_SIZE (GPU_VRAM_WIDTH * GPU_VRAM_HEIGHT * sizeof(u16))
+#define GPU_DIRTY_TILE_SIZE 16  /* VRAM changes are tracked per 16x16 halfword tile */
+#define GPU_DIRTY_TILE_ROWS (GPU_VRAM_HEIGHT / GPU_DIRTY_TILE_SIZE)
+#define GPU_FIFO_SIZE 16        /* in words */
+
+/* 
+ * Per frame GPU counters. They cost a timer read per command, 
+ * so they're only compiled in for debug builds or when PS1_GPU_STATS is defined 
+ */
+#if defined(DEBUG) && !defined(PS1_GPU_STATS)
+#  define PS1_GPU_STATS
+#endif /* DEBUG */
+
+/* the top 3 bits of a GP0 opcode */
+typedef enum GPU_CommandClass
+{
+    GPU_CLASS_MISC = 0,
+    GPU_CLASS_POLYGON,
+    GPU_CLASS_LINE,
+    GPU_CLASS_RECTANGLE,
+    GPU_CLASS_VRAM_COPY,
+    GPU_CLASS_CPU_TO_VRAM,
+    GPU_CLASS_VRAM_TO_CPU,
+    GPU_CLASS_ENVIRONMENT,
+    GPU_CLASS_COUNT,
+} GPU_CommandClass;
+
+typedef struct GPU_Stats
+{
+    u64 Frame;                          /* frames counted since the GPU struct was zeroed, soft resets keep counting */
+    u32 CommandCount[256];              /* GP0 commands by opcode */
+    u32 GP1Count;
+    u32 Primitives;                     /* polygons (a quad is one), rectangles, line segments, fills and copies */
+    u64 PixelsWritten;
+    u64 PixelsBlended;                  /* by semi-transparent primitives */
+    u64 PixelsTextured;
+    u64 UploadBytes, DownloadBytes;     /* CPU to VRAM, VRAM to CPU */
+    u32 ListPackets, ListWords;         /* walked by linked list DMA, headers included in ListWords */
+    u32 ListsCut;                       /* linked list DMAs stopped on a loop or on DMA_LINKEDLIST_MAX_WORDS */
+    u64 ClassTicks[GPU_CLASS_COUNT];    /* Platform_GetTicks spent on each class of commands, including image data */
+} GPU_Stats;
+
 typedef struct GPU
 {
+    /* 1024x512 halfwords, allocated by the owner of the GPU, soft reset does not clear it */
+    u16 *Vram;
+    /* records every GP0/GP1 write when not NULL, also survives resets */
+    struct Capture *Capture;
+    /* upscaled shadow of VRAM when not NULL (see Raster_AttachUpscaler), survives resets */
+    struct Raster_Upscaler *Upscaler;
+
     /* command buffer is for multi-word commands, longest possible command does not exceed 16 words */
     u32 CommandBuffer[16];
     uint CommandBufferSize;
@@ -74,26 +129,157 @@ typedef struct GPU
     u16 DisplayHorizontalEnd;
     u16 DisplayLineStart;
     u16 DisplayLineEnd;
+
+    /* 
+     * polyline (GP0 48h..4Fh, 58h..5Fh) state: the first segment goes through the command buffer, 
+     * then each new vertex draws one more segment from the previous one 
+     */
+    u32 PolylineCommand;
+    u32 PolylineLastColor;
+    u32 PolylineLastPosition;
+    u32 PolylineColor;          /* color word of the vertex being received, shaded only */
+    Bool8 PolylineHasColor;
+
+    /* 
+     * timing model, all in CPU cycles since power on (resets don't rewind it):
+     * PS1_RunFrame advances Cycle, drawing commands keep the GPU busy until BusyUntil
+     */
+    u64 Cycle;
+    u64 FrameStartCycle;
+    u64 BusyUntil;
+    uint FifoWords;             /* words that arrived while the GPU was busy */
+    uint ReadWordsRemain;       /* GPUREAD words left of a VRAM to CPU transfer (GP0 C0h) */
+
+    /* VRAM to CPU transfer (GP0 C0h) state */
+    u16 ReadX, ReadY;
+    u16 ReadWidth, ReadHeight;
+    u16 ReadCurrentX, ReadCurrentY;
+
+    /* CPU to VRAM transfer (GP0 A0h) state */
+    u16 ImageX, ImageY;
+    u16 ImageWidth, ImageHeight;
+    u16 ImageCurrentX, ImageCurrentY;
+
+    /* CLUT attribute of the last textured primitive, only the debugger looks at it */
+    u16 LastClut;
+
+    /* 
+     * one bit per tile that was written since the display last looked at VRAM, 
+     * bit n of a row is tile column n (1024 / 16 = 64 columns) 
+     */
+    u64 DirtyTiles[GPU_DIRTY_TILE_ROWS];
+
+#ifdef PS1_GPU_STATS
+    GPU_Stats Stats;        /* the frame being drawn */
+    GPU_Stats FrameStats;   /* the last complete frame */
+#endif /* PS1_GPU_STATS */
 } GPU;
 
+void GPU_Reset(GPU *Gpu, PS1 *Bus);
+u32 GPU_ReadGPU(GPU *Gpu);
+/* same as calling GPU_ReadGPU WordCount times, but VRAM rows are copied in bulk */
+void GPU_ReadGPUBlock(GPU *Gpu, u32 *Data, uint WordCount);
+u32 GPU_ReadStatus(GPU *Gpu);
+void GPU_WriteGP0(GPU *Gpu, u32 Data);
+/* same as calling GPU_WriteGP0 on each word, but commands and image data are consumed in bulk */
+void GPU_WriteGP0Block(GPU *Gpu, const u32 *Data, uint WordCount);
+void GPU_WriteGP1(GPU *Gpu, u32 Data);
+/* flags a rectangle of VRAM as modified, wraps around the edges like VRAM addressing does; every VRAM writer must call this */
+void GPU_MarkDirty(GPU *Gpu, uint X, uint Y, uint Width, uint Height);
+/* DirtyTiles bits of the columns that halfwords X..X+Width-1 (wrapping around) fall in */
+u64 GPU_DirtyColumnMask(uint X, uint Width);
+/* starts a video frame at the current cycle, returns its length in CPU cycles (depends on PAL/NTSC) */
+u32 GPU_BeginFrame(GPU *Gpu);
+/* scanline the video output is on, counted from the start of the frame */
+uint GPU_CurrentLine(const GPU *Gpu);
+/* outside of the vertical/horizontal display range (GP1 07h/06h) */
+Bool8 GPU_InVBlank(const GPU *Gpu);
+Bool8 GPU_InHBlank(const GPU *Gpu);
+/* vblank: publishes the counters of the frame that just ended and starts counting the next one */
+void GPU_EndFrame(GPU *Gpu);
+/* counters of the last complete frame, returns false (and zeroes *OutStats) when they're compiled out */
+Bool8 GPU_GetFrameStats(const GPU *Gpu, GPU_Stats *OutStats);
+/* human readable summary of Stats, a few lines */
+void GPU_FormatStats(const GPU_Stats *Stats, char *Buffer, uint BufferSize);
+
 
 
 struct PS1
 {
 #define PS1_BIOS_SIZE (512 * KB)
 #define PS1_RAM_SIZE (2 * MB)
+#define PS1_RAM_PAGE_SIZE (4 * KB) /* RAM writes are tracked per 4kb page */
+#define PS1_RAM_PAGE_COUNT (PS1_RAM_SIZE / PS1_RAM_PAGE_SIZE)
     u8 *Bios;
     u8 *Ram;
     CPU Cpu;
     GPU Gpu;
     DMA Dma;
+    CDROM Cdrom;
+    MDEC Mdec;
+    SPU Spu;
+
+    /* the earliest NextEventCycle of the devices, in Gpu.Cycle time (see PS1_ScheduleEvent) */
+    u64 NextEventCycle;
+
+    /* 
+     * one bit per RAM page written since the debugger last looked at RAM (see DebugSnapshot_Update), 
+     * bit n of word i is page i*64 + n; every RAM writer must call PS1_MarkRamDirty 
+     */
+    u64 RamDirtyPages[PS1_RAM_PAGE_COUNT / 64];
+
+    /* linked list DMA headers already walked by the current transfer, a bit per RAM word */
+    u64 DMAVisitedNodes[PS1_RAM_SIZE / sizeof(u32) / 64];
+
+    /* breakpoints and watchpoints of the debug emulator when not NULL (see Monitor.h) */
+    struct Monitor *Monitor;
+    /* RAM pages with a watchpoint, same layout as RamDirtyPages; the bus takes its slow path for them */
+    u64 WatchedRamPages[PS1_RAM_PAGE_COUNT / 64];
+    u32 FrameCycles;        /* length of the current frame */
+    u32 FrameCyclesLeft;    /* not 0 while the monitor stopped in the middle of a frame */
 };
 
-void PS1_DoDMATransfer(PS1 *, DMA_Port Chanel);
+#define PS1_CPU_CLOCK 33868800 /* Hz */
+/* video clock cycles per scanline converted to CPU cycles, and scanlines per frame */
+#define PS1_NTSC_CYCLES_PER_LINE 2153
+#define PS1_NTSC_LINES_PER_FRAME 263
+#define PS1_PAL_CYCLES_PER_LINE 2168
+#define PS1_PAL_LINES_PER_FRAME 314
+/* video clock cycles per scanline, the unit of the horizontal display range (GP1 06h) */
+#define PS1_NTSC_VIDEO_CLOCKS_PER_LINE 3413
+#define PS1_PAL_VIDEO_CLOCKS_PER_LINE 3406
+
+void PS1_Reset(PS1 *);
+/* 
+ * runs the CPU for one video frame, the caller outputs the frame (Display_Output) afterwards;
+ * returns the length of the frame in CPU cycles.
+ * With a monitor attached, it returns 0 when it stopped before the end of the frame (see Monitor.StopReason),
+ * the next call resumes the frame
+ */
+u32 PS1_RunFrame(PS1 *);
+
+/* 
+ * devices with work due at a later cycle (DMA, CD-ROM, SPU) keep their own NextEventCycle and report it here,
+ * the run loop calls PS1_UpdateEvents once Gpu.Cycle reaches the earliest one
+ */
+#define PS1_ScheduleEvent(ps1_ptr, cycle) do {\
+    u64 c = cycle;\
+    if (c < (ps1_ptr)->NextEventCycle)\
+        (ps1_ptr)->NextEventCycle = c;\
+} while (0)
+void PS1_UpdateEvents(PS1 *);
+
+/* moves the data of the transfer the channel was started for, returns what the DMA went through */
+DMA_TransferSize PS1_DoDMATransfer(PS1 *, DMA_Port Chanel);
+#define PS1_MarkRamDirty(ps1_ptr, addr) \
+    ((ps1_ptr)->RamDirtyPages[(addr) / (PS1_RAM_PAGE_SIZE * 64)] |= (u64)1 << ((addr) / PS1_RAM_PAGE_SIZE % 64))
 #define PS1_Ram_Write32(ps1_ptr, addr, u32val) do {\
     u32 v = u32val;\
     memcpy((ps1_ptr)->Ram + (addr), &v, sizeof(u32));\
+    PS1_MarkRamDirty(ps1_ptr, addr);\
 } while (0) 
+#define PS1_IsRamPageWatched(ps1_ptr, addr) \
+    (((ps1_ptr)->WatchedRamPages[(addr) / (PS1_RAM_PAGE_SIZE * 64)] >> ((addr) / PS1_RAM_PAGE_SIZE % 64)) & 1)
 #define PS1_Ram_Read32(ps1_ptr, addr, out_u32ptr) \
     memcpy(out_u32ptr, (ps1_ptr)->Ram + (addr), sizeof(u32));
 u32 PS1_Read32(PS1 *, u32 Addr);
@@ -102,6 +288,12 @@ u8 PS1_Read8(PS1 *, u32 Addr);
 void PS1_Write32(PS1 *, u32 Addr, u32 Data);
 void PS1_Write16(PS1 *, u32 Addr, u16 Data);
 void PS1_Write8(PS1 *, u32 Addr, u8 Data);
+/* 
+ * for debuggers: RAM and BIOS only, without touching MMIO or triggering watchpoints; 
+ * return false if any of the bytes is elsewhere (or in BIOS, for writes) 
+ */
+Bool8 PS1_DebugRead(PS1 *, u32 Addr, void *OutBuffer, u32 Size);
+Bool8 PS1_DebugWrite(PS1 *, u32 Addr, const void *Buffer, u32 Size);
 
 
 
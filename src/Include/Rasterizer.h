@@ -0,0 +1,121 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include "Common.h"
+#include "Ps1.h"
+
+
+/*
+ * Span source pixels are 0xFFBBGGRR: 24 bit color in the low bits,
+ * per pixel flags in the top byte
+ */
+#define RASTER_PIXEL_BLEND      (1u << 24)  /* semi-transparency applies to this pixel */
+#define RASTER_PIXEL_MASK       (1u << 25)  /* texel bit 15, copied to the mask bit of VRAM */
+#define RASTER_PIXEL_DISCARD    (1u << 26)  /* fully transparent texel (0000h), VRAM is left untouched */
+
+/* 
+ * polygon flags, match bits 0..4 of GP0 20h..3Fh;
+ * lines (GP0 40h..5Fh) only use RASTER_SEMI_TRANSPARENT and RASTER_SHADED
+ */
+#define RASTER_RAW_TEXTURE      (1u << 0)
+#define RASTER_SEMI_TRANSPARENT (1u << 1)
+#define RASTER_TEXTURED         (1u << 2)
+#define RASTER_QUAD             (1u << 3)
+#define RASTER_SHADED           (1u << 4)
+
+typedef enum Raster_BlendMode
+{
+    RASTER_BLEND_OPAQUE = 0,
+    RASTER_BLEND_AVERAGE,       /* B/2 + F/2 */
+    RASTER_BLEND_ADD,           /* B + F */
+    RASTER_BLEND_SUB,           /* B - F */
+    RASTER_BLEND_ADD_QUARTER,   /* B + F/4 */
+    RASTER_BLEND_COUNT,
+} Raster_BlendMode;
+
+/* largest internal resolution multiplier of the upscaled shadow VRAM */
+#define RASTER_MAX_SCALE 4
+
+typedef struct Raster_Vertex
+{
+    i32 X, Y;       /* drawing offset already applied */
+    u32 Color;      /* 0x00BBGGRR */
+    u32 U, V;
+} Raster_Vertex;
+
+/*
+ * Reads Count pixels from Src, applies dithering, blending and the mask bit rules,
+ * then writes the result to Dst (which is VRAM at (X, Y)).
+ * X and Y are only used for the dither pattern.
+ */
+typedef void (*Raster_SpanFn)(u16 *Dst, const u32 *Src, uint Count, uint X, uint Y);
+
+/* returns a kernel specialized for the given mode combination */
+Raster_SpanFn Raster_GetSpanFn(Raster_BlendMode BlendMode, Bool8 Dither, Bool8 SetMask, Bool8 CheckMask);
+
+/* GPUStat.SemiTransparency (0..3) to blend mode */
+Raster_BlendMode Raster_GetBlendMode(uint SemiTransparency);
+
+/* 
+ * All the drawing functions below return the number of pixels they wrote (or skipped because of the mask bit),
+ * which is what the GPU timing model charges for.
+ */
+
+/* Flags: RASTER_* polygon flags; Clut: CLUT attribute of textured polygons */
+u32 Raster_DrawTriangle(GPU *Gpu,
+    const Raster_Vertex *V0, const Raster_Vertex *V1, const Raster_Vertex *V2,
+    u32 Flags, u16 Clut
+);
+
+/* GP0 02h: ignores the drawing area and mask settings, X and Width are rounded to 16 halfwords */
+u32 Raster_FillRect(GPU *Gpu, u32 X, u32 Y, u32 Width, u32 Height, u32 Color);
+/* GP0 80h: VRAM to VRAM copy, overlapping rectangles behave like memmove */
+u32 Raster_CopyRect(GPU *Gpu, u32 SrcX, u32 SrcY, u32 DstX, u32 DstY, u32 Width, u32 Height);
+/* 
+ * GP0 60h..7Fh: axis aligned rectangle at (X, Y) (drawing offset already applied).
+ * Flags: RASTER_RAW_TEXTURE, RASTER_SEMI_TRANSPARENT and RASTER_TEXTURED;
+ * textured ones start at texel (U, V) and honor GPU::TexturedRectangleXFlip/YFlip
+ */
+u32 Raster_DrawRectangle(GPU *Gpu, 
+    i32 X, i32 Y, u32 Width, u32 Height, 
+    u32 Color, u32 U, u32 V, u32 Flags, u16 Clut
+);
+
+/* 
+ * GP0 40h..5Fh: one line segment, both endpoints included (drawing offset already applied).
+ * Flags: RASTER_SEMI_TRANSPARENT and RASTER_SHADED, only shaded lines are dithered
+ */
+u32 Raster_DrawLine(GPU *Gpu, const Raster_Vertex *V0, const Raster_Vertex *V1, u32 Flags);
+
+
+/*
+ * Upscaled rendering: polygons are drawn a second time at Scale times the resolution into a shadow of VRAM,
+ * rectangles and lines too, with their native pixels as Scale x Scale blocks, blended with the shadow and only where they write.
+ * Everything else is written to VRAM and copied over to the shadow (nearest neighbor).
+ * VRAM stays authoritative for textures and GP0 C0h, the shadow only feeds the display.
+ * Shadow polygons are queued and drawn by ThreadCount threads (including the one that flushes),
+ * each one owning interleaved bands of rows
+ */
+typedef struct Raster_Upscaler Raster_Upscaler;
+
+/* Scale: 2..RASTER_MAX_SCALE, sets GPU::Upscaler; returns false if out of memory */
+Bool8 Raster_AttachUpscaler(GPU *Gpu, uint Scale, uint ThreadCount);
+void Raster_DetachUpscaler(GPU *Gpu);
+/* 
+ * draws the queued polygons, then returns the shadow ((GPU_VRAM_WIDTH*Scale) halfwords per row),
+ * or VRAM itself with a scale of 1 when there is no upscaler 
+ */
+const u16 *Raster_GetUpscaledVram(GPU *Gpu, uint *OutScale);
+/* 0 when there is no upscaler */
+uint Raster_GetUpscalerThreadCount(const GPU *Gpu);
+/* 
+ * every VRAM write other than polygons, rectangles and lines goes between these two (both do nothing without an upscaler):
+ * Begin finishes the queued polygons that the write could affect, End copies the rectangle to the shadow;
+ * rectangles and lines only go through Begin
+ */
+void Raster_UpscaleBeginWrite(GPU *Gpu, u32 X, u32 Y, u32 Width, u32 Height);
+void Raster_UpscaleEndWrite(GPU *Gpu, u32 X, u32 Y, u32 Width, u32 Height);
+
+
+#endif /* RASTERIZER_H */
+
@@ -0,0 +1,150 @@
+#ifndef SPU_H
+#define SPU_H
+
+#include "Common.h"
+
+
+/*
+ * The sound processor (1F801C00h..1F801FFFh): 512KB of sound RAM and 24 voices that play ADPCM samples from it,
+ * mixed at 44.1 kHz with the CD's XA audio (see CDROM_ReadAudio).
+ *     1F801C00h + N*10h   voice N: volume left/right, pitch, start address, ADSR, ADSR level, repeat address
+ *     1F801D80h..         main volume, key on/off, pitch modulation, noise and reverb voices, ENDX
+ *     1F801DA0h..         reverb area, IRQ address, transfer address and FIFO, SPUCNT, SPUSTAT, CD volume
+ *     1F801E00h + N*4     voice N's current volume left/right
+ *
+ * An ADPCM block is 16 bytes: shift and filter, loop flags, then 28 4 bit samples.
+ * The pitch counter steps through the decoded samples (4.12 fixed point, 1000h is 44.1 kHz),
+ * its fraction picks the weights of the 4 tap interpolation.
+ * Each voice has an ADSR envelope, and both of its volumes can sweep (bit 15 of the register).
+ *
+ * The voices aren't mixed a sample at a time: SPU_Update mixes blocks of up to SPU_BLOCK_FRAMES frames,
+ * each voice steps through the whole block first (pitch, ADPCM blocks, envelope), then its interpolation,
+ * envelope and volumes are applied to the block with SSE2 when there is.
+ * Register accesses mix the frames that are due first, so they land at the right frame.
+ *
+ * Reverb runs at half the rate, on the voices with reverb on (and the CD when SPUCNT bit 2 is set):
+ * its filters read and write the work area, from the reverb base address to the end of sound RAM, a ring of halfwords
+ * that moves by one every step. It's done a block at a time too, one stage after the other on all of the block's steps
+ * (SSE2 across the steps), unless some of the addresses are less than a block apart, then it goes a step at a time.
+ */
+#define SPU_RAM_SIZE (512 * KB)
+#define SPU_VOICE_COUNT 24
+#define SPU_SAMPLE_RATE 44100
+#define SPU_CYCLES_PER_FRAME 768    /* PS1_CPU_CLOCK / SPU_SAMPLE_RATE */
+#define SPU_BLOCK_FRAMES 32         /* mixed together, 0.73ms */
+#define SPU_OUTPUT_FRAMES 8192      /* 0.19s, a power of 2 */
+#define SPU_ADPCM_SAMPLES 28
+#define SPU_REVERB_TAPS 28          /* addresses the reverb reads or writes every step */
+
+typedef enum SPU_AdsrPhase
+{
+    SPU_ADSR_OFF = 0,
+    SPU_ADSR_ATTACK,
+    SPU_ADSR_DECAY,
+    SPU_ADSR_SUSTAIN,
+    SPU_ADSR_RELEASE,
+} SPU_AdsrPhase;
+
+/* how ADSR phases and volume sweeps change a level, one tick per frame */
+typedef struct SPU_Envelope
+{
+    u32 Counter;            /* the level changes when it reaches 8000h */
+    u32 Increment;
+    i32 Step;
+    u8 Rate;                /* shift << 2 | step, as the registers have them */
+    Bool8 Decreasing;
+    Bool8 Exponential;
+} SPU_Envelope;
+
+typedef struct SPU_Volume
+{
+    u16 Reg;                /* as written */
+    i16 Level;              /* the current volume */
+    SPU_Envelope Sweep;     /* when Reg bit 15 is set */
+} SPU_Volume;
+
+typedef struct SPU_Voice
+{
+    SPU_Volume Volume[2];   /* left, right */
+    u16 Pitch;
+    u16 AdsrLo, AdsrHi;
+    u32 StartAddr, RepeatAddr;  /* in bytes */
+    u32 Addr;               /* of the ADPCM block being played */
+    u32 Counter;            /* pitch counter: the sample in Samples is bits 12 and up, the interpolation phase bits 4..11 */
+    /* the last 3 samples of the previous ADPCM block, then the 28 of the one being played */
+    i16 Samples[3 + SPU_ADPCM_SAMPLES];
+    i16 Old, Older;         /* ADPCM filter history */
+    u8 Flags;               /* of the block being played */
+
+    SPU_AdsrPhase Phase;
+    i16 Level;              /* ADSR */
+    SPU_Envelope Adsr;
+} SPU_Voice;
+
+/* the work area seen as a ring: halfword N of it is at Base + N*2 */
+typedef struct SPU_Reverb
+{
+    u32 Base;               /* in bytes */
+    u32 Size;               /* in halfwords */
+    u32 Pos;                /* the ring's current position */
+    u32 Taps[SPU_REVERB_TAPS];  /* from Pos, in halfwords, less than Size */
+    Bool8 Overlaps;         /* some taps are less than a block apart, the steps can't be done a stage at a time */
+
+    /* 22.05 kHz: the input of 2 frames goes into a step, the output is interpolated between steps */
+    Bool8 OddFrame;
+    i32 HeldInput[2];       /* of the first frame of the step */
+    i16 LastOutput[2];
+} SPU_Reverb;
+
+typedef struct SPU
+{
+    PS1 *Bus;
+
+    u8 Ram[SPU_RAM_SIZE];
+    u16 Regs[0x200];        /* as written, 1F801C00h..1F801FFFh */
+    SPU_Voice Voices[SPU_VOICE_COUNT];
+    SPU_Volume MainVolume[2];
+    u32 Endx;               /* voices that went through the end of their sample */
+    u16 Control;            /* SPUCNT */
+    Bool8 IrqFlag;          /* SPUSTAT bit 6 */
+    u32 TransferAddr;       /* in bytes */
+    u32 CaptureIndex;       /* halfword of the capture buffers written next */
+    i32 NoiseTimer;
+    i16 NoiseLevel;
+    i16 GaussTaps[256][4];  /* interpolation weights by phase, oldest sample first */
+    SPU_Reverb Reverb;
+    Bool8 ReverbDisabled;   /* by the user (see --no-reverb), not by the game; survives resets */
+
+    u64 NextFrameCycle;     /* when the next frame is due, in Gpu.Cycle time */
+    u64 NextEventCycle;
+
+    /* 44.1 kHz stereo, taken by SPU_ReadAudio */
+    i16 Output[SPU_OUTPUT_FRAMES][2];
+    u32 OutputRead, OutputWrite;    /* frame counters, wrapping */
+
+    u64 FramesMixed;
+    u64 VoiceFrames;        /* frames mixed for each voice that was on */
+    u64 OutputFramesDropped;/* mixed while the output ring was full */
+    u64 ReverbBlocks;       /* blocks that went through the reverb */
+    u64 ReverbSerialBlocks; /* of those, done a step at a time */
+    u64 ReverbTicks;        /* Platform_GetTicks spent on them */
+} SPU;
+
+
+void SPU_Reset(SPU *Spu, PS1 *Bus);
+/* Offset from 1F801C00h */
+u16 SPU_Read16(SPU *Spu, u32 Offset);
+void SPU_Write16(SPU *Spu, u32 Offset, u16 Data);
+/* DMA 4: the words go to/come from the transfer address, like the FIFO */
+void SPU_WriteBlock(SPU *Spu, const u32 *Words, uint WordCount);
+void SPU_ReadBlock(SPU *Spu, u32 *Words, uint WordCount);
+/* SPUCNT asks for a DMA transfer in that direction (see DMA_Request) */
+Bool8 SPU_IsDMAReady(const SPU *Spu, Bool8 RamToDevice);
+/* mixes the frames that are due by Cycle */
+void SPU_Update(SPU *Spu, u64 Cycle);
+/* takes at most FrameCount interleaved stereo frames of the output, returns how many there were */
+uint SPU_ReadAudio(SPU *Spu, i16 *Frames, uint FrameCount);
+
+
+#endif /* SPU_H */
+
@@ -0,0 +1,68 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include "Common.h"
+
+
+#define TRIPLEBUFFER_TEXT_SIZE 512
+
+typedef struct TripleBuffer_Frame
+{
+    u32 *Pixels;            /* RGBA8888, tightly packed */
+    uint Capacity;          /* in pixels, grows with the frames */
+    uint Width, Height;
+    u64 Number;
+    char Text[TRIPLEBUFFER_TEXT_SIZE];  /* drawn over the frame when not empty */
+} TripleBuffer_Frame;
+
+/*
+ * Lock-free handoff of 3 slots from one writer thread to one reader thread, by index.
+ * Each side owns one of the slots, the third one is swapped in and out atomically:
+ * the writer never waits for the reader and the reader always gets a complete slot, the latest one.
+ */
+typedef struct TripleBuffer_Exchange
+{
+    /* index of the slot in the middle, with a flag set when the reader hasn't taken it yet */
+    volatile u32 Middle;
+    uint Back;              /* writer only */
+    uint Front;             /* reader only */
+} TripleBuffer_Exchange;
+
+/*
+ * Whole frames through a TripleBuffer_Exchange.
+ * Frames that the reader didn't pick up in time are replaced (dropped).
+ */
+typedef struct TripleBuffer
+{
+    TripleBuffer_Frame Frames[3];
+    TripleBuffer_Exchange Exchange;
+
+    u64 Published;          /* writer only */
+    u64 Dropped;            /* writer only */
+} TripleBuffer;
+
+
+void TripleBuffer_InitExchange(TripleBuffer_Exchange *Ex);
+/* writer: true while the reader hasn't taken the last published slot */
+Bool8 TripleBuffer_IsPending(TripleBuffer_Exchange *Ex);
+/* writer: hands slot Ex->Back over to the reader and gets another one in Ex->Back; returns true if it replaced one the reader never took */
+Bool8 TripleBuffer_Publish(TripleBuffer_Exchange *Ex);
+/* reader: takes the latest slot into Ex->Front if there is a new one, returns true if so */
+Bool8 TripleBuffer_Take(TripleBuffer_Exchange *Ex);
+
+/* the frames start out empty (0x0) */
+void TripleBuffer_Init(TripleBuffer *Tb);
+/* neither thread may be using it anymore */
+void TripleBuffer_Destroy(TripleBuffer *Tb);
+
+/* writer: the frame to fill in, with room for Width x Height pixels; NULL when out of memory */
+TripleBuffer_Frame *TripleBuffer_BeginWrite(TripleBuffer *Tb, uint Width, uint Height);
+/* writer: hands the frame from BeginWrite over to the reader */
+void TripleBuffer_EndWrite(TripleBuffer *Tb);
+
+/* reader: the latest frame, *OutIsNew is false if it's the same one as last time; valid until the next call */
+const TripleBuffer_Frame *TripleBuffer_Read(TripleBuffer *Tb, Bool8 *OutIsNew);
+
+
+#endif /* TRIPLEBUFFER_H */
+
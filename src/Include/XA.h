@@ -0,0 +1,47 @@
+#ifndef XA_H
+#define XA_H
+
+#include "Common.h"
+
+
+/*
+ * XA-ADPCM, the streamed audio of CD-ROM XA (Mode 2 Form 2) sectors: music and FMV sound.
+ * A sector has 18 sound groups of 128 bytes, each a 16 byte header and 28 rows of 4 bytes holding
+ * 8 units of 28 4 bit samples (or 4 units of 8 bit samples); units alternate left/right in stereo.
+ * The subheader's coding info byte has the format: bit 0 stereo, bit 2 18.9 kHz (37.8 kHz otherwise), bit 4 8 bit.
+ *
+ * A sector is decoded in one go: the samples of every unit are expanded and shifted together (SSE2 when there is),
+ * then the ADPCM filter runs through each unit, and the result is resampled to 44.1 kHz stereo
+ * by a 7 phase polyphase filter (44100 / 37800 = 7 / 6, 44100 / 18900 = 7 / 3).
+ */
+#define XA_GROUPS_PER_SECTOR 18
+#define XA_GROUP_SIZE 128
+#define XA_SAMPLES_PER_UNIT 28
+#define XA_MAX_SECTOR_SAMPLES (XA_GROUPS_PER_SECTOR * 8 * XA_SAMPLES_PER_UNIT)  /* 4 bit mono */
+#define XA_OUTPUT_RATE 44100
+#define XA_RESAMPLE_PHASES 7
+#define XA_RESAMPLE_TAPS 16
+/* 44.1 kHz frames out of the longest sector, 4 bit mono at 18.9 kHz */
+#define XA_MAX_SECTOR_FRAMES (XA_MAX_SECTOR_SAMPLES * 7 / 3)
+
+typedef struct XA_Decoder
+{
+    i16 Old[2], Older[2];   /* ADPCM filter history, per channel */
+    /* samples waiting to be resampled, per channel, with the filter's history in front */
+    i16 Input[2][XA_RESAMPLE_TAPS + XA_MAX_SECTOR_SAMPLES];
+    uint InputCount;
+    u32 Position;           /* of the next output frame in Input, in 1/7 samples */
+    u8 Coding;              /* of the last sector, the history restarts when it changes */
+} XA_Decoder;
+
+
+void XA_Reset(XA_Decoder *Xa);
+/*
+ * Sector is a whole raw sector (sync, header, subheader, data); OutFrames gets interleaved 44.1 kHz stereo,
+ * at most XA_MAX_SECTOR_FRAMES frames; returns the frame count
+ */
+uint XA_DecodeSector(XA_Decoder *Xa, const u8 *Sector, i16 *OutFrames);
+
+
+#endif /* XA_H */
+
@@ -0,0 +1,753 @@
+
+#include <string.h> /* memcpy, memset */
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Platform.h"
+#include "MDEC.h"
+
+
+#define MDEC_END_OF_BLOCK 0xFE00
+/* fewer macroblocks than that are decoded by the calling thread alone, waking the workers up costs more */
+#define MDEC_PARALLEL_MIN_MACROBLOCKS 8
+/* the macroblocks of a transfer are handed to the workers in batches of at most that many */
+#define MDEC_BATCH_MACROBLOCKS 256
+
+/* YCbCr to RGB, in 2.14 fixed point */
+#define MDEC_CR_TO_R 22970      /* 1.402 */
+#define MDEC_CB_TO_G -5631      /* -0.3437 */
+#define MDEC_CR_TO_G -11703     /* -0.7143 */
+#define MDEC_CB_TO_B 29032      /* 1.772 */
+
+/* where the nth coefficient of a block's run length code goes in the 8x8 block */
+static const u8 sMDEC_ZigZag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+/* a macroblock to decode: its first halfword in MDEC::Input, and where its pixels go */
+typedef struct MDEC_Job
+{
+    u32 Start;
+    u32 *Out;
+} MDEC_Job;
+
+typedef struct MDEC_Workers MDEC_Workers;
+
+typedef struct MDEC_Worker
+{
+    struct MDEC_Workers *Pool;
+    Platform_Thread Thread;
+    uint Index;
+} MDEC_Worker;
+
+struct MDEC_Workers
+{
+    const MDEC *Mdec;
+    const MDEC_Job *Jobs;
+    uint JobCount;
+
+    /* the thread that reads the output takes jobs 0, n, 2n..., worker i jobs i + 1, n + i + 1... */
+    MDEC_Worker Workers[MDEC_MAX_THREADS];
+    uint WorkerCount;
+    Platform_Mutex Lock;
+    Platform_CondVar WorkReady;
+    Platform_CondVar WorkDone;
+    u64 Generation;
+    uint WorkersBusy;
+    Bool8 Quit;
+};
+
+
+
+/*==================================================================================
+ *
+ *                                  BLOCKS
+ *
+ *==================================================================================*/
+
+FORCE_INLINE u16 MDEC_Halfword(const MDEC *Mdec, u32 Index)
+{
+    return Mdec->Input[Index / 2] >> (Index % 2 * 16);
+}
+
+FORCE_INLINE i32 MDEC_Signed10(u16 Code)
+{
+    return (i32)((u32)Code << 22) >> 22;
+}
+
+/*
+ * moves *Position past the run length code of a block, the padding in front of it included;
+ * returns false (leaving *Position alone) if the input ends before the block does
+ */
+static Bool8 MDEC_SkipBlock(const MDEC *Mdec, u32 *Position)
+{
+    u32 End = Mdec->InputCount * 2;
+    u32 i = *Position;
+    while (i < End && MDEC_END_OF_BLOCK == MDEC_Halfword(Mdec, i))
+        i++;
+    if (i++ >= End) /* the DC coefficient */
+        return false;
+
+    for (uint k = 0; k < 64; )
+    {
+        if (i >= End)
+            return false;
+        k += (MDEC_Halfword(Mdec, i++) >> 10) + 1;
+    }
+    *Position = i;
+    return true;
+}
+
+static Bool8 MDEC_SkipMacroblock(const MDEC *Mdec, u32 *Position)
+{
+    u32 i = *Position;
+    uint Blocks = Mdec->Depth >= MDEC_DEPTH_24? 6 : 1;
+    for (uint Block = 0; Block < Blocks; Block++)
+    {
+        if (!MDEC_SkipBlock(Mdec, &i))
+            return false;
+    }
+    *Position = i;
+    return true;
+}
+
+/*
+ * run length decoding and dequantization of a block that MDEC_SkipBlock found whole,
+ * Coefficients are in 8x8 order (row = vertical frequency)
+ */
+static void MDEC_DecodeCoefficients(const MDEC *Mdec, u32 *Position, const u8 *Quant, i16 Coefficients[64])
+{
+    u32 i = *Position;
+    while (MDEC_END_OF_BLOCK == MDEC_Halfword(Mdec, i))
+        i++;
+    memset(Coefficients, 0, 64 * sizeof(i16));
+
+    /* the DC coefficient has the block's quantization scale, 0 means that its coefficients aren't quantized or zigzagged */
+    u16 Code = MDEC_Halfword(Mdec, i++);
+    i32 QScale = Code >> 10;
+    i32 Value = MDEC_Signed10(Code) * Quant[0];
+    for (uint k = 0; k < 64; )
+    {
+        if (0 == QScale)
+            Value = MDEC_Signed10(Code) * 2;
+        Value = MIN(MAX(Value, -0x400), 0x3FF);
+        Coefficients[QScale? sMDEC_ZigZag[k] : k] = (i16)Value;
+
+        Code = MDEC_Halfword(Mdec, i++);
+        k += (Code >> 10) + 1;
+        if (k < 64)
+            Value = (MDEC_Signed10(Code) * Quant[k] * QScale + 4) >> 3;
+    }
+    *Position = i;
+}
+
+
+/*
+ * The IDCT is 2 passes of Out = In^T * Matrix, where Matrix is the scale table / 8 (row = frequency, column = position),
+ * each one rounded to 16 bits; the result wraps around to 9 bits and is clamped to 8 like the hardware's.
+ * In SSE2, the rows of the transposed block have pairs of coefficients in each 32 bit lane,
+ * so madd against the interleaved rows 2p and 2p + 1 of the matrix adds up 2 frequencies at once, for 4 positions.
+ */
+#ifdef HAS_SSE2
+FORCE_INLINE void MDEC_Transpose(__m128i Rows[8])
+{
+    __m128i A0 = _mm_unpacklo_epi16(Rows[0], Rows[1]), A1 = _mm_unpackhi_epi16(Rows[0], Rows[1]);
+    __m128i A2 = _mm_unpacklo_epi16(Rows[2], Rows[3]), A3 = _mm_unpackhi_epi16(Rows[2], Rows[3]);
+    __m128i A4 = _mm_unpacklo_epi16(Rows[4], Rows[5]), A5 = _mm_unpackhi_epi16(Rows[4], Rows[5]);
+    __m128i A6 = _mm_unpacklo_epi16(Rows[6], Rows[7]), A7 = _mm_unpackhi_epi16(Rows[6], Rows[7]);
+    __m128i B0 = _mm_unpacklo_epi32(A0, A2), B1 = _mm_unpackhi_epi32(A0, A2);
+    __m128i B2 = _mm_unpacklo_epi32(A1, A3), B3 = _mm_unpackhi_epi32(A1, A3);
+    __m128i B4 = _mm_unpacklo_epi32(A4, A6), B5 = _mm_unpackhi_epi32(A4, A6);
+    __m128i B6 = _mm_unpacklo_epi32(A5, A7), B7 = _mm_unpackhi_epi32(A5, A7);
+    Rows[0] = _mm_unpacklo_epi64(B0, B4);
+    Rows[1] = _mm_unpackhi_epi64(B0, B4);
+    Rows[2] = _mm_unpacklo_epi64(B1, B5);
+    Rows[3] = _mm_unpackhi_epi64(B1, B5);
+    Rows[4] = _mm_unpacklo_epi64(B2, B6);
+    Rows[5] = _mm_unpackhi_epi64(B2, B6);
+    Rows[6] = _mm_unpacklo_epi64(B3, B7);
+    Rows[7] = _mm_unpackhi_epi64(B3, B7);
+}
+
+FORCE_INLINE __m128i MDEC_IDCTRow(__m128i Row, const __m128i Lo[4], const __m128i Hi[4])
+{
+    const __m128i Round = _mm_set1_epi32(1 << 12);
+    __m128i Pair0 = _mm_shuffle_epi32(Row, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128i Pair1 = _mm_shuffle_epi32(Row, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128i Pair2 = _mm_shuffle_epi32(Row, _MM_SHUFFLE(2, 2, 2, 2));
+    __m128i Pair3 = _mm_shuffle_epi32(Row, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i SumLo = _mm_add_epi32(
+        _mm_add_epi32(_mm_madd_epi16(Pair0, Lo[0]), _mm_madd_epi16(Pair1, Lo[1])),
+        _mm_add_epi32(_mm_madd_epi16(Pair2, Lo[2]), _mm_madd_epi16(Pair3, Lo[3]))
+    );
+    __m128i SumHi = _mm_add_epi32(
+        _mm_add_epi32(_mm_madd_epi16(Pair0, Hi[0]), _mm_madd_epi16(Pair1, Hi[1])),
+        _mm_add_epi32(_mm_madd_epi16(Pair2, Hi[2]), _mm_madd_epi16(Pair3, Hi[3]))
+    );
+    SumLo = _mm_srai_epi32(_mm_add_epi32(SumLo, Round), 13);
+    SumHi = _mm_srai_epi32(_mm_add_epi32(SumHi, Round), 13);
+    return _mm_packs_epi32(SumLo, SumHi);
+}
+
+static void MDEC_IDCT(const i16 *ScaleTable, const i16 In[64], i16 Out[64])
+{
+    __m128i Lo[4], Hi[4];
+    for (uint p = 0; p < 4; p++)
+    {
+        __m128i Even = _mm_srai_epi16(_mm_loadu_si128((const __m128i *)(ScaleTable + p*16)), 3);
+        __m128i Odd = _mm_srai_epi16(_mm_loadu_si128((const __m128i *)(ScaleTable + p*16 + 8)), 3);
+        Lo[p] = _mm_unpacklo_epi16(Even, Odd);
+        Hi[p] = _mm_unpackhi_epi16(Even, Odd);
+    }
+
+    __m128i Rows[8];
+    for (uint i = 0; i < 8; i++)
+        Rows[i] = _mm_loadu_si128((const __m128i *)(In + i*8));
+    for (uint Pass = 0; Pass < 2; Pass++)
+    {
+        MDEC_Transpose(Rows);
+        for (uint i = 0; i < 8; i++)
+            Rows[i] = MDEC_IDCTRow(Rows[i], Lo, Hi);
+    }
+
+    const __m128i Min = _mm_set1_epi16(-128), Max = _mm_set1_epi16(127);
+    for (uint i = 0; i < 8; i++)
+    {
+        __m128i Row = _mm_srai_epi16(_mm_slli_epi16(Rows[i], 7), 7);
+        Row = _mm_min_epi16(_mm_max_epi16(Row, Min), Max);
+        _mm_storeu_si128((__m128i *)(Out + i*8), Row);
+    }
+}
+#else
+static void MDEC_IDCTPass(const i16 *ScaleTable, const i16 In[64], i16 Out[64])
+{
+    for (uint y = 0; y < 8; y++)
+    {
+        for (uint x = 0; x < 8; x++)
+        {
+            i32 Sum = 0;
+            for (uint z = 0; z < 8; z++)
+                Sum += In[z*8 + y] * (ScaleTable[z*8 + x] >> 3);
+            Sum = (Sum + (1 << 12)) >> 13;
+            Out[y*8 + x] = (i16)MIN(MAX(Sum, -0x8000), 0x7FFF);
+        }
+    }
+}
+
+static void MDEC_IDCT(const i16 *ScaleTable, const i16 In[64], i16 Out[64])
+{
+    i16 Tmp[64];
+    MDEC_IDCTPass(ScaleTable, In, Tmp);
+    MDEC_IDCTPass(ScaleTable, Tmp, Out);
+    for (uint i = 0; i < 64; i++)
+    {
+        i32 Value = (i32)((u32)Out[i] << 23) >> 23;
+        Out[i] = (i16)MIN(MAX(Value, -128), 127);
+    }
+}
+#endif /* HAS_SSE2 */
+
+
+
+/*==================================================================================
+ *
+ *                                  PIXELS
+ *
+ *==================================================================================*/
+
+#ifdef HAS_SSE2
+/* 8 pixels of CbFactor*Cb + CrFactor*Cr, CbCr has the (Cb, Cr) pairs of pixels 0..3 (Lo) and 4..7 (Hi) */
+FORCE_INLINE __m128i MDEC_Chroma(__m128i CbCrLo, __m128i CbCrHi, i16 CbFactor, i16 CrFactor)
+{
+    const __m128i Round = _mm_set1_epi32(1 << 13);
+    __m128i Factors = _mm_set1_epi32((u16)CbFactor | (u32)(u16)CrFactor << 16);
+    __m128i Lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(CbCrLo, Factors), Round), 14);
+    __m128i Hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(CbCrHi, Factors), Round), 14);
+    return _mm_packs_epi32(Lo, Hi);
+}
+#endif /* HAS_SSE2 */
+
+/*
+ * Blocks are Cr, Cb, Y1 (top left), Y2, Y3, Y4 (bottom right), after the IDCT;
+ * Out gets 16x16 pixels, 15 bit (R in bits 0..4) or 24 bit (R, G, B bytes).
+ * Each chroma sample covers 2x2 pixels.
+ */
+static void MDEC_ToRGB(const MDEC *Mdec, const i16 Blocks[6][64], u8 *Out)
+{
+    const i16 *Cr = Blocks[0];
+    const i16 *Cb = Blocks[1];
+    i16 Bias = Mdec->Signed? 0 : 0x80;
+    u16 Bit15 = Mdec->SetBit15? 0x8000 : 0;
+
+    for (uint Row = 0; Row < 16; Row++)
+    {
+        for (uint Half = 0; Half < 2; Half++)
+        {
+            const i16 *Y = Blocks[2 + Row/8*2 + Half] + Row%8*8;
+            const i16 *CrRow = Cr + Row/2*8 + Half*4;
+            const i16 *CbRow = Cb + Row/2*8 + Half*4;
+            uint Pixel = Row*16 + Half*8;
+#ifdef HAS_SSE2
+            __m128i Cr8 = _mm_loadl_epi64((const __m128i *)CrRow);
+            __m128i Cb8 = _mm_loadl_epi64((const __m128i *)CbRow);
+            Cr8 = _mm_unpacklo_epi16(Cr8, Cr8);
+            Cb8 = _mm_unpacklo_epi16(Cb8, Cb8);
+            __m128i CbCrLo = _mm_unpacklo_epi16(Cb8, Cr8);
+            __m128i CbCrHi = _mm_unpackhi_epi16(Cb8, Cr8);
+
+            __m128i Luma = _mm_loadu_si128((const __m128i *)Y);
+            __m128i R = _mm_add_epi16(Luma, MDEC_Chroma(CbCrLo, CbCrHi, 0, MDEC_CR_TO_R));
+            __m128i G = _mm_add_epi16(Luma, MDEC_Chroma(CbCrLo, CbCrHi, MDEC_CB_TO_G, MDEC_CR_TO_G));
+            __m128i B = _mm_add_epi16(Luma, MDEC_Chroma(CbCrLo, CbCrHi, MDEC_CB_TO_B, 0));
+            /* 8 bit components, as bytes in 16 bit lanes */
+            const __m128i Min = _mm_set1_epi16(-128), Max = _mm_set1_epi16(127);
+            const __m128i Biases = _mm_set1_epi16(Bias), Byte = _mm_set1_epi16(0xFF);
+            R = _mm_and_si128(_mm_add_epi16(_mm_min_epi16(_mm_max_epi16(R, Min), Max), Biases), Byte);
+            G = _mm_and_si128(_mm_add_epi16(_mm_min_epi16(_mm_max_epi16(G, Min), Max), Biases), Byte);
+            B = _mm_and_si128(_mm_add_epi16(_mm_min_epi16(_mm_max_epi16(B, Min), Max), Biases), Byte);
+
+            if (MDEC_DEPTH_15 == Mdec->Depth)
+            {
+                __m128i Pixels = _mm_or_si128(
+                    _mm_or_si128(_mm_srli_epi16(R, 3), _mm_slli_epi16(_mm_srli_epi16(G, 3), 5)),
+                    _mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(B, 3), 10), _mm_set1_epi16(Bit15))
+                );
+                _mm_storeu_si128((__m128i *)(Out + Pixel*2), Pixels);
+            }
+            else
+            {
+                /* R G B 0 in each 32 bit lane, then 3 bytes of each */
+                __m128i RG = _mm_or_si128(R, _mm_slli_epi16(G, 8));
+                u32 Rgb[8];
+                _mm_storeu_si128((__m128i *)Rgb, _mm_unpacklo_epi16(RG, B));
+                _mm_storeu_si128((__m128i *)(Rgb + 4), _mm_unpackhi_epi16(RG, B));
+                for (uint i = 0; i < 8; i++)
+                {
+                    Out[(Pixel + i)*3 + 0] = Rgb[i];
+                    Out[(Pixel + i)*3 + 1] = Rgb[i] >> 8;
+                    Out[(Pixel + i)*3 + 2] = Rgb[i] >> 16;
+                }
+            }
+#else
+            for (uint i = 0; i < 8; i++)
+            {
+                i32 CrValue = CrRow[i / 2];
+                i32 CbValue = CbRow[i / 2];
+                i32 R = Y[i] + ((CrValue*MDEC_CR_TO_R + (1 << 13)) >> 14);
+                i32 G = Y[i] + ((CbValue*MDEC_CB_TO_G + CrValue*MDEC_CR_TO_G + (1 << 13)) >> 14);
+                i32 B = Y[i] + ((CbValue*MDEC_CB_TO_B + (1 << 13)) >> 14);
+                R = (MIN(MAX(R, -128), 127) + Bias) & 0xFF;
+                G = (MIN(MAX(G, -128), 127) + Bias) & 0xFF;
+                B = (MIN(MAX(B, -128), 127) + Bias) & 0xFF;
+                if (MDEC_DEPTH_15 == Mdec->Depth)
+                {
+                    u16 Color = (R >> 3) | (G >> 3) << 5 | (B >> 3) << 10 | Bit15;
+                    Out[(Pixel + i)*2 + 0] = Color;
+                    Out[(Pixel + i)*2 + 1] = Color >> 8;
+                }
+                else
+                {
+                    Out[(Pixel + i)*3 + 0] = R;
+                    Out[(Pixel + i)*3 + 1] = G;
+                    Out[(Pixel + i)*3 + 2] = B;
+                }
+            }
+#endif /* HAS_SSE2 */
+        }
+    }
+}
+
+/* a Y block to 8x8 pixels of 8 bits, or 4 bits (the first pixel in the low nibble) */
+static void MDEC_ToMono(const MDEC *Mdec, const i16 Y[64], u8 *Out)
+{
+    u8 Pixels[64];
+    i16 Bias = Mdec->Signed? 0 : 0x80;
+#ifdef HAS_SSE2
+    const __m128i Biases = _mm_set1_epi16(Bias), Byte = _mm_set1_epi16(0xFF);
+    for (uint i = 0; i < 64; i += 16)
+    {
+        __m128i Lo = _mm_and_si128(_mm_add_epi16(_mm_loadu_si128((const __m128i *)(Y + i)), Biases), Byte);
+        __m128i Hi = _mm_and_si128(_mm_add_epi16(_mm_loadu_si128((const __m128i *)(Y + i + 8)), Biases), Byte);
+        _mm_storeu_si128((__m128i *)(Pixels + i), _mm_packus_epi16(Lo, Hi));
+    }
+#else
+    for (uint i = 0; i < 64; i++)
+        Pixels[i] = (Y[i] + Bias) & 0xFF;
+#endif /* HAS_SSE2 */
+
+    if (MDEC_DEPTH_8 == Mdec->Depth)
+    {
+        memcpy(Out, Pixels, sizeof Pixels);
+        return;
+    }
+    for (uint i = 0; i < 64; i += 2)
+        Out[i / 2] = Pixels[i] >> 4 | (Pixels[i + 1] & 0xF0);
+}
+
+static uint MDEC_MacroblockWords(const MDEC *Mdec)
+{
+    static const u8 sWords[] = {
+        [MDEC_DEPTH_4] = 8 * 8 / 8,
+        [MDEC_DEPTH_8] = 8 * 8 / 4,
+        [MDEC_DEPTH_24] = 16 * 16 * 3 / 4,
+        [MDEC_DEPTH_15] = 16 * 16 / 2,
+    };
+    return sWords[Mdec->Depth];
+}
+
+/* only reads the MDEC, macroblocks can be decoded in any order */
+static void MDEC_DecodeMacroblock(const MDEC *Mdec, u32 Position, u32 *Out)
+{
+    i16 Coefficients[64];
+    i16 Blocks[6][64];
+    if (Mdec->Depth < MDEC_DEPTH_24)
+    {
+        MDEC_DecodeCoefficients(Mdec, &Position, Mdec->QuantTable[0], Coefficients);
+        MDEC_IDCT(Mdec->ScaleTable, Coefficients, Blocks[0]);
+        MDEC_ToMono(Mdec, Blocks[0], (u8 *)Out);
+        return;
+    }
+
+    for (uint i = 0; i < 6; i++)
+    {
+        /* Cr and Cb use the color table */
+        MDEC_DecodeCoefficients(Mdec, &Position, Mdec->QuantTable[i < 2], Coefficients);
+        MDEC_IDCT(Mdec->ScaleTable, Coefficients, Blocks[i]);
+    }
+    MDEC_ToRGB(Mdec, (const i16 (*)[64])Blocks, (u8 *)Out);
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  WORKERS
+ *
+ *==================================================================================*/
+
+static void MDEC_RunJobsOf(const MDEC_Workers *Pool, uint Thread)
+{
+    uint ThreadCount = Pool->WorkerCount + 1;
+    for (uint i = Thread; i < Pool->JobCount; i += ThreadCount)
+        MDEC_DecodeMacroblock(Pool->Mdec, Pool->Jobs[i].Start, Pool->Jobs[i].Out);
+}
+
+static void MDEC_WorkerMain(void *UserData)
+{
+    MDEC_Worker *Worker = UserData;
+    MDEC_Workers *Pool = Worker->Pool;
+    u64 Generation = 0;
+    for (;;)
+    {
+        Platform_MutexLock(&Pool->Lock);
+        while (Generation == Pool->Generation && !Pool->Quit)
+            Platform_CondVarWait(&Pool->WorkReady, &Pool->Lock);
+        if (Pool->Quit)
+        {
+            Platform_MutexUnlock(&Pool->Lock);
+            break;
+        }
+        Generation = Pool->Generation;
+        Platform_MutexUnlock(&Pool->Lock);
+
+        MDEC_RunJobsOf(Pool, Worker->Index);
+
+        Platform_MutexLock(&Pool->Lock);
+        if (0 == --Pool->WorkersBusy)
+            Platform_CondVarSignal(&Pool->WorkDone);
+        Platform_MutexUnlock(&Pool->Lock);
+    }
+}
+
+static void MDEC_RunJobs(MDEC *Mdec, const MDEC_Job *Jobs, uint JobCount)
+{
+    MDEC_Workers *Pool = Mdec->Workers;
+    if (NULL == Pool || JobCount < MDEC_PARALLEL_MIN_MACROBLOCKS)
+    {
+        for (uint i = 0; i < JobCount; i++)
+            MDEC_DecodeMacroblock(Mdec, Jobs[i].Start, Jobs[i].Out);
+        return;
+    }
+
+    Platform_MutexLock(&Pool->Lock);
+    Pool->Mdec = Mdec;
+    Pool->Jobs = Jobs;
+    Pool->JobCount = JobCount;
+    Pool->WorkersBusy = Pool->WorkerCount;
+    Pool->Generation++;
+    Platform_CondVarBroadcast(&Pool->WorkReady);
+    Platform_MutexUnlock(&Pool->Lock);
+
+    MDEC_RunJobsOf(Pool, 0);
+
+    Platform_MutexLock(&Pool->Lock);
+    while (Pool->WorkersBusy)
+        Platform_CondVarWait(&Pool->WorkDone, &Pool->Lock);
+    Platform_MutexUnlock(&Pool->Lock);
+    Mdec->Batches++;
+}
+
+/* decodes up to Count macroblocks one after the other in Out, returns how many there were */
+static uint MDEC_DecodeMacroblocks(MDEC *Mdec, u32 *Out, uint Count)
+{
+    uint Words = MDEC_MacroblockWords(Mdec);
+    uint Done = 0;
+    while (Done < Count)
+    {
+        /* finding where each macroblock starts is serial, decoding them is not */
+        MDEC_Job Jobs[MDEC_BATCH_MACROBLOCKS];
+        uint JobCount = 0;
+        while (JobCount < MDEC_BATCH_MACROBLOCKS && Done + JobCount < Count)
+        {
+            u32 Start = Mdec->InputRead;
+            if (!MDEC_SkipMacroblock(Mdec, &Mdec->InputRead))
+                break;
+            Jobs[JobCount] = (MDEC_Job) { .Start = Start, .Out = Out + (Done + JobCount)*Words };
+            JobCount++;
+        }
+        if (0 == JobCount)
+            break;
+
+        MDEC_RunJobs(Mdec, Jobs, JobCount);
+        Done += JobCount;
+    }
+    Mdec->MacroblocksDecoded += Done;
+    return Done;
+}
+
+static Bool8 MDEC_HasMacroblock(const MDEC *Mdec)
+{
+    if (Mdec->MacroblockRead < Mdec->MacroblockWords)
+        return true;
+    u32 Position = Mdec->InputRead;
+    return MDEC_SkipMacroblock(Mdec, &Position);
+}
+
+
+
+void MDEC_Reset(MDEC *Mdec, PS1 *Bus)
+{
+    MDEC_Workers *Workers = Mdec->Workers;
+    u64 MacroblocksDecoded = Mdec->MacroblocksDecoded;
+    u64 Batches = Mdec->Batches;
+    memset(Mdec, 0, sizeof *Mdec);
+    Mdec->Bus = Bus;
+    Mdec->Workers = Workers;
+    Mdec->MacroblocksDecoded = MacroblocksDecoded;
+    Mdec->Batches = Batches;
+}
+
+void MDEC_WriteCommand(MDEC *Mdec, u32 Data)
+{
+    if (0 == Mdec->ParamWordsLeft)
+    {
+        Mdec->Command = Data;
+        Mdec->ParamIndex = 0;
+        switch (Data >> 29)
+        {
+        case 1: /* decode macroblocks */
+        {
+            Mdec->Depth = (Data >> 27) & 3;
+            Mdec->Signed = (Data >> 26) & 1;
+            Mdec->SetBit15 = (Data >> 25) & 1;
+            Mdec->ParamWordsLeft = Data & 0xFFFF;
+            Mdec->InputCount = 0;
+            Mdec->InputRead = 0;
+            Mdec->InputDone = false;
+            Mdec->MacroblockWords = 0;
+            Mdec->MacroblockRead = 0;
+        } break;
+        case 2: /* quantization tables */
+        {
+            Mdec->ParamWordsLeft = Data & 1? 32 : 16;
+        } break;
+        case 3: /* IDCT scale table */
+        {
+            Mdec->ParamWordsLeft = 32;
+        } break;
+        default:
+        {
+            LOG("MDEC: command %08x does nothing\n", Data);
+            Mdec->ParamWordsLeft = Data & 0xFFFF;
+        } break;
+        }
+        return;
+    }
+
+    switch (Mdec->Command >> 29)
+    {
+    case 1:
+    {
+        Mdec->Input[Mdec->InputCount++] = Data;
+        Mdec->InputDone = 1 == Mdec->ParamWordsLeft;
+    } break;
+    case 2:
+    {
+        u8 *Table = &Mdec->QuantTable[0][0] + Mdec->ParamIndex*4;
+        Table[0] = Data;
+        Table[1] = Data >> 8;
+        Table[2] = Data >> 16;
+        Table[3] = Data >> 24;
+    } break;
+    case 3:
+    {
+        Mdec->ScaleTable[Mdec->ParamIndex*2 + 0] = (i16)Data;
+        Mdec->ScaleTable[Mdec->ParamIndex*2 + 1] = (i16)(Data >> 16);
+    } break;
+    }
+    Mdec->ParamIndex++;
+    Mdec->ParamWordsLeft--;
+
+    /* all of the input is there, a DMA 1 transfer that was waiting for it can go */
+    if (MDEC_IsOutputReady(Mdec))
+        DMA_Request(&Mdec->Bus->Dma, DMA_PORT_MDEC_OUT);
+}
+
+void MDEC_WriteControl(MDEC *Mdec, u32 Data)
+{
+    if (Data & 0x80000000) /* aborts the command */
+    {
+        Mdec->Command = 0;
+        Mdec->ParamWordsLeft = 0;
+        Mdec->InputCount = 0;
+        Mdec->InputRead = 0;
+        Mdec->InputDone = false;
+        Mdec->MacroblockWords = 0;
+        Mdec->MacroblockRead = 0;
+    }
+    Mdec->DataInRequest = (Data >> 30) & 1;
+    Mdec->DataOutRequest = (Data >> 29) & 1;
+    if (MDEC_IsOutputReady(Mdec))
+        DMA_Request(&Mdec->Bus->Dma, DMA_PORT_MDEC_OUT);
+}
+
+u32 MDEC_ReadData(MDEC *Mdec)
+{
+    if (Mdec->MacroblockRead == Mdec->MacroblockWords)
+    {
+        Mdec->MacroblockRead = 0;
+        Mdec->MacroblockWords = 0;
+        if (0 == MDEC_DecodeMacroblocks(Mdec, Mdec->Macroblock, 1))
+            return 0;
+        Mdec->MacroblockWords = MDEC_MacroblockWords(Mdec);
+    }
+    return Mdec->Macroblock[Mdec->MacroblockRead++];
+}
+
+u32 MDEC_ReadStatus(MDEC *Mdec)
+{
+    Bool8 OutputEmpty = !MDEC_HasMacroblock(Mdec);
+    Bool8 Busy = Mdec->ParamWordsLeft || !OutputEmpty;
+    /* bits 16..18, the block being decoded, always read 4: blocks aren't decoded one at a time */
+    return (u32)OutputEmpty << 31
+        | (u32)Busy << 29
+        | (u32)(Mdec->DataInRequest && Mdec->ParamWordsLeft) << 28
+        | (u32)(Mdec->DataOutRequest && !OutputEmpty) << 27
+        | ((Mdec->Command >> 25) & 0xF) << 23
+        | 4u << 16
+        | ((Mdec->ParamWordsLeft - 1) & 0xFFFF);
+}
+
+void MDEC_WriteBlock(MDEC *Mdec, const u32 *Words, uint WordCount)
+{
+    uint i = 0;
+    while (i < WordCount)
+    {
+        /* the input of a decode command in bulk */
+        if (1 == Mdec->Command >> 29 && Mdec->ParamWordsLeft > 1)
+        {
+            uint Count = MIN(WordCount - i, Mdec->ParamWordsLeft - 1);
+            memcpy(Mdec->Input + Mdec->InputCount, Words + i, Count*sizeof(u32));
+            Mdec->InputCount += Count;
+            Mdec->ParamIndex += Count;
+            Mdec->ParamWordsLeft -= Count;
+            i += Count;
+            continue;
+        }
+        MDEC_WriteCommand(Mdec, Words[i++]);
+    }
+}
+
+void MDEC_ReadBlock(MDEC *Mdec, u32 *Words, uint WordCount)
+{
+    uint i = 0;
+    while (i < WordCount && Mdec->MacroblockRead < Mdec->MacroblockWords)
+        Words[i++] = Mdec->Macroblock[Mdec->MacroblockRead++];
+
+    uint Size = MDEC_MacroblockWords(Mdec);
+    i += MDEC_DecodeMacroblocks(Mdec, Words + i, (WordCount - i) / Size) * Size;
+
+    /* the start of the next macroblock, or 0 past the end of the output (the DMA would wait for more on hardware) */
+    while (i < WordCount)
+        Words[i++] = MDEC_ReadData(Mdec);
+}
+
+Bool8 MDEC_IsOutputReady(const MDEC *Mdec)
+{
+    return Mdec->DataOutRequest && Mdec->InputDone && MDEC_HasMacroblock(Mdec);
+}
+
+
+Bool8 MDEC_AttachWorkers(MDEC *Mdec, uint ThreadCount)
+{
+    ASSERT(NULL == Mdec->Workers);
+    MDEC_Workers *Pool = calloc(1, sizeof *Pool);
+    if (NULL == Pool)
+        return false;
+
+    Platform_MutexInit(&Pool->Lock);
+    Platform_CondVarInit(&Pool->WorkReady);
+    Platform_CondVarInit(&Pool->WorkDone);
+    /* the thread that reads the output decodes too, so it counts as one */
+    uint WorkerCount = MIN(MAX(ThreadCount, 1) - 1, MDEC_MAX_THREADS);
+    for (uint i = 0; i < WorkerCount; i++)
+    {
+        MDEC_Worker *Worker = &Pool->Workers[i];
+        Worker->Pool = Pool;
+        Worker->Index = i + 1;
+        if (!Platform_ThreadCreate(&Worker->Thread, MDEC_WorkerMain, Worker))
+            break;
+        Pool->WorkerCount++;
+    }
+
+    Mdec->Workers = Pool;
+    if (0 == Pool->WorkerCount)
+    {
+        MDEC_DetachWorkers(Mdec);
+        return false;
+    }
+    return true;
+}
+
+void MDEC_DetachWorkers(MDEC *Mdec)
+{
+    MDEC_Workers *Pool = Mdec->Workers;
+    if (NULL == Pool)
+        return;
+
+    Platform_MutexLock(&Pool->Lock);
+    Pool->Quit = true;
+    Platform_CondVarBroadcast(&Pool->WorkReady);
+    Platform_MutexUnlock(&Pool->Lock);
+    for (uint i = 0; i < Pool->WorkerCount; i++)
+        Platform_ThreadJoin(&Pool->Workers[i].Thread);
+
+    Platform_CondVarDestroy(&Pool->WorkDone);
+    Platform_CondVarDestroy(&Pool->WorkReady);
+    Platform_MutexDestroy(&Pool->Lock);
+    free(Pool);
+    Mdec->Workers = NULL;
+}
+
+uint MDEC_GetThreadCount(const MDEC *Mdec)
+{
+    return Mdec->Workers? Mdec->Workers->WorkerCount + 1 : 1;
+}
+
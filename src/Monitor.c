@@ -0,0 +1,136 @@
+
+#include <string.h> /* memset */
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Monitor.h"
+
+
+#define MONITOR_FILTER_BIT(physical_addr) (((physical_addr) >> MONITOR_PAGE_SHIFT) % MONITOR_PAGE_FILTER_BITS)
+
+
+
+void Monitor_Init(Monitor *Mon)
+{
+    *Mon = (Monitor) { 0 };
+}
+
+
+static void Monitor_RebuildBreakpointPages(Monitor *Mon)
+{
+    memset(Mon->BreakpointPages, 0, sizeof Mon->BreakpointPages);
+    for (uint i = 0; i < Mon->BreakpointCount; i++)
+    {
+        uint Bit = MONITOR_FILTER_BIT(Mon->Breakpoints[i]);
+        Mon->BreakpointPages[Bit / 64] |= (u64)1 << (Bit % 64);
+    }
+    Mon->PCPageValid = false;
+}
+
+Bool8 Monitor_AddBreakpoint(Monitor *Mon, u32 PhysicalAddr)
+{
+    if (Mon->BreakpointCount == MONITOR_MAX_BREAKPOINTS || Monitor_IsBreakpoint(Mon, PhysicalAddr))
+        return false;
+
+    Mon->Breakpoints[Mon->BreakpointCount++] = PhysicalAddr;
+    Monitor_RebuildBreakpointPages(Mon);
+    return true;
+}
+
+Bool8 Monitor_RemoveBreakpoint(Monitor *Mon, u32 PhysicalAddr)
+{
+    for (uint i = 0; i < Mon->BreakpointCount; i++)
+    {
+        if (Mon->Breakpoints[i] == PhysicalAddr)
+        {
+            Mon->Breakpoints[i] = Mon->Breakpoints[--Mon->BreakpointCount];
+            Monitor_RebuildBreakpointPages(Mon);
+            return true;
+        }
+    }
+    return false;
+}
+
+Bool8 Monitor_PageHasBreakpoint(const Monitor *Mon, u32 PhysicalAddr)
+{
+    uint Bit = MONITOR_FILTER_BIT(PhysicalAddr);
+    return (Mon->BreakpointPages[Bit / 64] >> (Bit % 64)) & 1;
+}
+
+Bool8 Monitor_IsBreakpoint(const Monitor *Mon, u32 PhysicalAddr)
+{
+    for (uint i = 0; i < Mon->BreakpointCount; i++)
+    {
+        if (Mon->Breakpoints[i] == PhysicalAddr)
+            return true;
+    }
+    return false;
+}
+
+
+
+static void Monitor_RebuildWatchedPages(const Monitor *Mon, u64 *WatchedPages)
+{
+    memset(WatchedPages, 0, PS1_RAM_PAGE_COUNT / 8);
+    for (uint i = 0; i < Mon->WatchpointCount; i++)
+    {
+        const Monitor_Watchpoint *Watch = &Mon->Watchpoints[i];
+        uint Last = (Watch->Offset + Watch->Size - 1) / PS1_RAM_PAGE_SIZE;
+        for (uint Page = Watch->Offset / PS1_RAM_PAGE_SIZE; Page <= Last; Page++)
+            WatchedPages[Page / 64] |= (u64)1 << (Page % 64);
+    }
+}
+
+Bool8 Monitor_AddWatchpoint(Monitor *Mon, u64 *WatchedPages, u32 Offset, u32 Size, u32 Flags)
+{
+    ASSERT(Size > 0 && Offset < PS1_RAM_SIZE && Size <= PS1_RAM_SIZE - Offset);
+    if (Mon->WatchpointCount == MONITOR_MAX_WATCHPOINTS)
+        return false;
+
+    Mon->Watchpoints[Mon->WatchpointCount++] = (Monitor_Watchpoint) {
+        .Offset = Offset,
+        .Size = Size,
+        .Flags = Flags,
+    };
+    Monitor_RebuildWatchedPages(Mon, WatchedPages);
+    return true;
+}
+
+Bool8 Monitor_RemoveWatchpoint(Monitor *Mon, u64 *WatchedPages, u32 Offset)
+{
+    for (uint i = 0; i < Mon->WatchpointCount; i++)
+    {
+        if (Mon->Watchpoints[i].Offset == Offset)
+        {
+            Mon->Watchpoints[i] = Mon->Watchpoints[--Mon->WatchpointCount];
+            Monitor_RebuildWatchedPages(Mon, WatchedPages);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Monitor_CheckAccess(Monitor *Mon, u32 Offset, u32 Size, u32 Flags, u32 Value)
+{
+    Mon->SlowAccesses++;
+    for (uint i = 0; i < Mon->WatchpointCount; i++)
+    {
+        const Monitor_Watchpoint *Watch = &Mon->Watchpoints[i];
+        if ((Watch->Flags & Flags)
+        && Offset < Watch->Offset + Watch->Size && Watch->Offset < Offset + Size)
+        {
+            /* the first hit of the instruction is the one reported */
+            if (MONITOR_STOP_WATCHPOINT != Mon->StopReason)
+            {
+                Mon->StopReason = MONITOR_STOP_WATCHPOINT;
+                Mon->WatchOffset = Offset;
+                Mon->WatchValue = Value;
+                Mon->WatchSize = Size;
+                Mon->WatchFlags = Flags;
+                Mon->WatchpointFlags = Watch->Flags;
+            }
+            return;
+        }
+    }
+}
+
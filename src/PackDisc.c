@@ -0,0 +1,177 @@
+/*
+ * Packs a BIN/CUE disc image into a .cdz (see Disc.h) that PS1Emu --cd reads directly.
+ * This is a separate executable built from the same sources as Build.c, see build.bat.
+ * Usage: PackDisc <file.cue|file.bin> <file.cdz> [--hunk sectors] [--level 0-8]
+ *
+ * Each hunk of sectors is deflated on its own (sdefl), bigger hunks pack a little better
+ * but every seek then inflates more than it reads.
+ */
+
+#define PS1_NO_MAIN
+#define PS1_NO_FRONTEND
+#include "Build.c"
+
+#include <string.h> /* strcmp, memcpy */
+
+#define SDEFL_IMPLEMENTATION
+#include "external/sdefl.h"
+
+
+static Bool8 PackDisc_Write(Disc *Source, const char *FileName, u32 HunkSectors, int Level)
+{
+    u32 HunkCount = (Source->SectorCount + HunkSectors - 1) / HunkSectors;
+    uint HunkSize = HunkSectors*DISC_SECTOR_SIZE;
+    /* the offsets are only known once the hunks are written, they go in their place at the end */
+    u64 *Offsets = calloc(HunkCount + 1, sizeof(u64));
+    u32 *Checksums = calloc(HunkCount, sizeof(u32));
+    u8 *Raw = malloc(HunkSize);
+    u8 *Compressed = malloc(sdefl_bound(HunkSize));
+    struct sdefl *Deflate = malloc(sizeof *Deflate);
+    FILE *f = NULL;
+    if (NULL == Offsets || NULL == Checksums || NULL == Raw || NULL == Compressed || NULL == Deflate)
+        printf("Out of memory.\n");
+    else if (NULL == (f = fopen(FileName, "wb")))
+        printf("Unable to create %s.\n", FileName);
+    if (NULL == f)
+    {
+        free(Deflate);
+        free(Compressed);
+        free(Raw);
+        free(Checksums);
+        free(Offsets);
+        return false;
+    }
+
+    Disc_PackHeader Header = {
+        .Magic = DISC_PACK_MAGIC,
+        .Version = DISC_PACK_VERSION,
+        .HunkSectors = HunkSectors,
+        .SectorCount = Source->SectorCount,
+        .TrackCount = Source->TrackCount,
+        .HunkCount = HunkCount,
+    };
+    fwrite(&Header, sizeof Header, 1, f);
+    for (uint i = 0; i < Source->TrackCount; i++)
+    {
+        const Disc_Track *Track = &Source->Tracks[i];
+        Disc_PackTrack Packed = {
+            .Number = Track->Number,
+            .Audio = Track->Audio,
+            .Start = Track->Start,
+            .DataStart = Track->DataStart,
+        };
+        fwrite(&Packed, sizeof Packed, 1, f);
+    }
+
+    long OffsetsPosition = ftell(f);
+    fwrite(Offsets, sizeof(u64), Header.HunkCount + 1, f);
+    fwrite(Checksums, sizeof(u32), Header.HunkCount, f);
+
+    u64 Position = OffsetsPosition + (Header.HunkCount + 1)*sizeof(u64) + Header.HunkCount*sizeof(u32);
+    for (u32 Hunk = 0; Hunk < Header.HunkCount; Hunk++)
+    {
+        u32 FirstLBA = Hunk*HunkSectors;
+        u32 Sectors = MIN(HunkSectors, Header.SectorCount - FirstLBA);
+        for (u32 i = 0; i < Sectors; i++)
+            Disc_LoadSector(Source, FirstLBA + i, Raw + i*DISC_SECTOR_SIZE);
+
+        int Size = (int)(Sectors*DISC_SECTOR_SIZE);
+        int CompressedSize = sdeflate(Deflate, Compressed, Raw, Size, Level);
+        const u8 *Stored = Compressed;
+        if (CompressedSize >= Size) /* stored, so the reader can tell by the size */
+        {
+            Stored = Raw;
+            CompressedSize = Size;
+        }
+        fwrite(Stored, 1, CompressedSize, f);
+
+        Checksums[Hunk] = Disc_Checksum(Stored, CompressedSize);
+        Offsets[Hunk] = Position;
+        Position += CompressedSize;
+        if (0 == Hunk % 1024)
+        {
+            printf("\r%u/%u hunks", Hunk, Header.HunkCount);
+            fflush(stdout);
+        }
+    }
+    Offsets[Header.HunkCount] = Position;
+
+    static const u8 sPadding[DISC_PACK_PADDING] = { 0 };
+    fwrite(sPadding, 1, sizeof sPadding, f);
+    fseek(f, OffsetsPosition, SEEK_SET);
+    fwrite(Offsets, sizeof(u64), Header.HunkCount + 1, f);
+    fwrite(Checksums, sizeof(u32), Header.HunkCount, f);
+    Bool8 Ok = 0 == ferror(f);
+    Ok = 0 == fclose(f) && Ok;
+
+    u64 RawSize = (u64)Header.SectorCount*DISC_SECTOR_SIZE;
+    printf("\r%s: %u sectors in %u hunks, %.1f MB -> %.1f MB (%.1f%%)\n",
+        FileName, Header.SectorCount, Header.HunkCount,
+        (double)RawSize / MB, (double)Position / MB, 100.0 * (double)Position / (double)RawSize
+    );
+    free(Deflate);
+    free(Compressed);
+    free(Raw);
+    free(Checksums);
+    free(Offsets);
+    if (!Ok)
+        printf("Unable to write %s.\n", FileName);
+    return Ok;
+}
+
+int main(int argc, char **argv)
+{
+    const char *InputName = NULL;
+    const char *OutputName = NULL;
+    u32 HunkSectors = DISC_PACK_DEFAULT_HUNK_SECTORS;
+    int Level = SDEFL_LVL_DEF;
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--hunk") && i + 1 < argc)
+        {
+            HunkSectors = strtoul(argv[++i], NULL, 0);
+            if (!IN_RANGE(1, HunkSectors, DISC_PACK_MAX_HUNK_SECTORS))
+            {
+                printf("A hunk is 1 to %d sectors.\n", DISC_PACK_MAX_HUNK_SECTORS);
+                return 1;
+            }
+        }
+        else if (0 == strcmp(argv[i], "--level") && i + 1 < argc)
+        {
+            Level = atoi(argv[++i]);
+            if (!IN_RANGE(SDEFL_LVL_MIN, Level, SDEFL_LVL_MAX))
+            {
+                printf("Level must be %d to %d.\n", SDEFL_LVL_MIN, SDEFL_LVL_MAX);
+                return 1;
+            }
+        }
+        else if (NULL == InputName)
+            InputName = argv[i];
+        else OutputName = argv[i];
+    }
+    if (NULL == InputName || NULL == OutputName)
+    {
+        printf("Usage: %s <file.cue|file.bin> <file.cdz> [--hunk sectors] [--level %d-%d]\n",
+            argv[0], SDEFL_LVL_MIN, SDEFL_LVL_MAX
+        );
+        return 1;
+    }
+
+    Disc *Source = malloc(sizeof *Source);
+    ASSERT(Source != NULL);
+    if (!Disc_Open(Source, InputName))
+    {
+        printf("Unable to use %s as a disc image.\n", InputName);
+        return 1;
+    }
+    if (Source->Packed)
+    {
+        printf("%s is packed already.\n", InputName);
+        return 1;
+    }
+
+    Bool8 Ok = PackDisc_Write(Source, OutputName, HunkSectors, Level);
+    Disc_Close(Source);
+    return Ok? 0 : 1;
+}
+
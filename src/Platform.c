@@ -0,0 +1,518 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+/* clock_gettime, nanosleep and setenv with -std=c11, before any system header */
+#  define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "Common.h"
+#include "Platform.h"
+
+#ifdef _WIN32
+/* keep the GDI and USER declarations out, they collide with raylib's names in the unity build */
+#  define WIN32_LEAN_AND_MEAN
+#  define NOGDI
+#  define NOUSER
+#  define NOMINMAX
+#  include <winsock2.h> /* before windows.h */
+#  include <windows.h>
+#  ifdef _MSC_VER
+#    pragma comment(lib, "ws2_32.lib")
+#  endif /* _MSC_VER */
+#else
+#  include <time.h> /* clock_gettime, nanosleep */
+#  include <unistd.h> /* sysconf, close */
+#  include <sys/socket.h>
+#  include <sys/select.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h> /* TCP_NODELAY */
+#  include <arpa/inet.h> /* htons, htonl */
+#  include <fcntl.h> /* open */
+#  include <sys/mman.h> /* mmap */
+#  include <sys/stat.h> /* fstat */
+#  ifndef MSG_NOSIGNAL /* not on every BSD */
+#    define MSG_NOSIGNAL 0
+#  endif /* MSG_NOSIGNAL */
+#endif /* _WIN32 */
+
+
+
+typedef struct Platform_ThreadStart
+{
+    Platform_ThreadFn Fn;
+    void *UserData;
+} Platform_ThreadStart;
+
+
+#ifdef _WIN32
+
+static DWORD WINAPI Platform_ThreadEntry(LPVOID Param)
+{
+    Platform_ThreadStart Start = *(Platform_ThreadStart *)Param;
+    free(Param);
+    Start.Fn(Start.UserData);
+    return 0;
+}
+
+Bool8 Platform_ThreadCreate(Platform_Thread *Thread, Platform_ThreadFn Fn, void *UserData)
+{
+    Platform_ThreadStart *Start = malloc(sizeof *Start);
+    if (NULL == Start)
+        return false;
+    *Start = (Platform_ThreadStart) { Fn, UserData };
+
+    Thread->Handle = CreateThread(NULL, 0, Platform_ThreadEntry, Start, 0, NULL);
+    if (NULL == Thread->Handle)
+    {
+        free(Start);
+        return false;
+    }
+    return true;
+}
+
+void Platform_ThreadJoin(Platform_Thread *Thread)
+{
+    WaitForSingleObject(Thread->Handle, INFINITE);
+    CloseHandle(Thread->Handle);
+    Thread->Handle = NULL;
+}
+
+
+void Platform_MutexInit(Platform_Mutex *Mutex)
+{
+    InitializeSRWLock((PSRWLOCK)&Mutex->Opaque);
+}
+
+void Platform_MutexDestroy(Platform_Mutex *Mutex)
+{
+    /* SRW locks don't need to be destroyed */
+    (void)Mutex;
+}
+
+void Platform_MutexLock(Platform_Mutex *Mutex)
+{
+    AcquireSRWLockExclusive((PSRWLOCK)&Mutex->Opaque);
+}
+
+void Platform_MutexUnlock(Platform_Mutex *Mutex)
+{
+    ReleaseSRWLockExclusive((PSRWLOCK)&Mutex->Opaque);
+}
+
+
+void Platform_CondVarInit(Platform_CondVar *CondVar)
+{
+    InitializeConditionVariable((PCONDITION_VARIABLE)&CondVar->Opaque);
+}
+
+void Platform_CondVarDestroy(Platform_CondVar *CondVar)
+{
+    (void)CondVar;
+}
+
+void Platform_CondVarWait(Platform_CondVar *CondVar, Platform_Mutex *Mutex)
+{
+    SleepConditionVariableSRW((PCONDITION_VARIABLE)&CondVar->Opaque, (PSRWLOCK)&Mutex->Opaque, INFINITE, 0);
+}
+
+void Platform_CondVarSignal(Platform_CondVar *CondVar)
+{
+    WakeConditionVariable((PCONDITION_VARIABLE)&CondVar->Opaque);
+}
+
+void Platform_CondVarBroadcast(Platform_CondVar *CondVar)
+{
+    WakeAllConditionVariable((PCONDITION_VARIABLE)&CondVar->Opaque);
+}
+
+
+u32 Platform_AtomicLoad(volatile u32 *Value)
+{
+    return (u32)InterlockedCompareExchange((volatile LONG *)Value, 0, 0);
+}
+
+void Platform_AtomicStore(volatile u32 *Value, u32 NewValue)
+{
+    InterlockedExchange((volatile LONG *)Value, (LONG)NewValue);
+}
+
+u32 Platform_AtomicExchange(volatile u32 *Value, u32 NewValue)
+{
+    return (u32)InterlockedExchange((volatile LONG *)Value, (LONG)NewValue);
+}
+
+
+uint Platform_CpuCount(void)
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    return MAX(1, (uint)Info.dwNumberOfProcessors);
+}
+
+void Platform_Sleep(u64 Microseconds)
+{
+    Sleep((DWORD)((Microseconds + 999) / 1000));
+}
+
+void Platform_SetEnv(const char *Name, const char *Value)
+{
+    _putenv_s(Name, Value);
+}
+
+u64 Platform_GetTicks(void)
+{
+    LARGE_INTEGER Counter;
+    QueryPerformanceCounter(&Counter);
+    return (u64)Counter.QuadPart;
+}
+
+u64 Platform_TicksPerSecond(void)
+{
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+    return (u64)Frequency.QuadPart;
+}
+
+Bool8 Platform_MapFile(Platform_MappedFile *File, const char *Path)
+{
+    *File = (Platform_MappedFile) { 0 };
+    HANDLE FileHandle = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == FileHandle)
+        return false;
+
+    LARGE_INTEGER Size;
+    HANDLE Mapping = NULL;
+    if (GetFileSizeEx(FileHandle, &Size) && Size.QuadPart > 0)
+        Mapping = CreateFileMappingA(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    /* the view keeps the file open */
+    CloseHandle(FileHandle);
+    if (NULL == Mapping)
+        return false;
+
+    File->Data = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(Mapping);
+    if (NULL == File->Data)
+        return false;
+    File->Size = (u64)Size.QuadPart;
+    return true;
+}
+
+void Platform_UnmapFile(Platform_MappedFile *File)
+{
+    if (File->Data)
+        UnmapViewOfFile(File->Data);
+    *File = (Platform_MappedFile) { 0 };
+}
+
+static Bool8 Platform_SocketStartup(void)
+{
+    static volatile u32 sStarted;
+    if (Platform_AtomicLoad(&sStarted))
+        return true;
+    WSADATA Data;
+    if (0 != WSAStartup(MAKEWORD(2, 2), &Data))
+        return false;
+    Platform_AtomicStore(&sStarted, 1);
+    return true;
+}
+
+Bool8 Platform_SocketListen(Platform_Socket *Listener, u16 Port)
+{
+    if (!Platform_SocketStartup())
+        return false;
+    SOCKET Handle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (INVALID_SOCKET == Handle)
+        return false;
+
+    BOOL Reuse = TRUE;
+    setsockopt(Handle, SOL_SOCKET, SO_REUSEADDR, (const char *)&Reuse, sizeof Reuse);
+    struct sockaddr_in Addr = { 0 };
+    Addr.sin_family = AF_INET;
+    Addr.sin_port = htons(Port);
+    Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (0 != bind(Handle, (struct sockaddr *)&Addr, sizeof Addr) || 0 != listen(Handle, 1))
+    {
+        closesocket(Handle);
+        return false;
+    }
+    Listener->Handle = (uintptr_t)Handle;
+    return true;
+}
+
+Bool8 Platform_SocketAccept(Platform_Socket *Listener, Platform_Socket *OutClient)
+{
+    SOCKET Handle = accept((SOCKET)Listener->Handle, NULL, NULL);
+    if (INVALID_SOCKET == Handle)
+        return false;
+    BOOL NoDelay = TRUE;
+    setsockopt(Handle, IPPROTO_TCP, TCP_NODELAY, (const char *)&NoDelay, sizeof NoDelay);
+    OutClient->Handle = (uintptr_t)Handle;
+    return true;
+}
+
+int Platform_SocketWait(Platform_Socket *Socket, u32 TimeoutMilliseconds)
+{
+    fd_set Readable;
+    FD_ZERO(&Readable);
+    FD_SET((SOCKET)Socket->Handle, &Readable);
+    struct timeval Timeout = { 
+        .tv_sec = (long)(TimeoutMilliseconds / 1000), 
+        .tv_usec = (long)(TimeoutMilliseconds % 1000) * 1000,
+    };
+    int Result = select(0, &Readable, NULL, NULL, &Timeout);
+    return SOCKET_ERROR == Result? -1 : Result > 0;
+}
+
+iSize Platform_SocketRecv(Platform_Socket *Socket, void *Buffer, uint Size)
+{
+    int Result = recv((SOCKET)Socket->Handle, Buffer, (int)Size, 0);
+    return SOCKET_ERROR == Result? -1 : Result;
+}
+
+Bool8 Platform_SocketSend(Platform_Socket *Socket, const void *Buffer, uint Size)
+{
+    const char *Bytes = Buffer;
+    while (Size)
+    {
+        int Sent = send((SOCKET)Socket->Handle, Bytes, (int)Size, 0);
+        if (SOCKET_ERROR == Sent)
+            return false;
+        Bytes += Sent;
+        Size -= (uint)Sent;
+    }
+    return true;
+}
+
+void Platform_SocketClose(Platform_Socket *Socket)
+{
+    closesocket((SOCKET)Socket->Handle);
+    Socket->Handle = (uintptr_t)INVALID_SOCKET;
+}
+
+#else /* pthreads */
+
+static void *Platform_ThreadEntry(void *Param)
+{
+    Platform_ThreadStart Start = *(Platform_ThreadStart *)Param;
+    free(Param);
+    Start.Fn(Start.UserData);
+    return NULL;
+}
+
+Bool8 Platform_ThreadCreate(Platform_Thread *Thread, Platform_ThreadFn Fn, void *UserData)
+{
+    Platform_ThreadStart *Start = malloc(sizeof *Start);
+    if (NULL == Start)
+        return false;
+    *Start = (Platform_ThreadStart) { Fn, UserData };
+
+    if (0 != pthread_create(&Thread->Handle, NULL, Platform_ThreadEntry, Start))
+    {
+        free(Start);
+        return false;
+    }
+    return true;
+}
+
+void Platform_ThreadJoin(Platform_Thread *Thread)
+{
+    pthread_join(Thread->Handle, NULL);
+}
+
+
+void Platform_MutexInit(Platform_Mutex *Mutex)
+{
+    pthread_mutex_init(&Mutex->Handle, NULL);
+}
+
+void Platform_MutexDestroy(Platform_Mutex *Mutex)
+{
+    pthread_mutex_destroy(&Mutex->Handle);
+}
+
+void Platform_MutexLock(Platform_Mutex *Mutex)
+{
+    pthread_mutex_lock(&Mutex->Handle);
+}
+
+void Platform_MutexUnlock(Platform_Mutex *Mutex)
+{
+    pthread_mutex_unlock(&Mutex->Handle);
+}
+
+
+void Platform_CondVarInit(Platform_CondVar *CondVar)
+{
+    pthread_cond_init(&CondVar->Handle, NULL);
+}
+
+void Platform_CondVarDestroy(Platform_CondVar *CondVar)
+{
+    pthread_cond_destroy(&CondVar->Handle);
+}
+
+void Platform_CondVarWait(Platform_CondVar *CondVar, Platform_Mutex *Mutex)
+{
+    pthread_cond_wait(&CondVar->Handle, &Mutex->Handle);
+}
+
+void Platform_CondVarSignal(Platform_CondVar *CondVar)
+{
+    pthread_cond_signal(&CondVar->Handle);
+}
+
+void Platform_CondVarBroadcast(Platform_CondVar *CondVar)
+{
+    pthread_cond_broadcast(&CondVar->Handle);
+}
+
+
+u32 Platform_AtomicLoad(volatile u32 *Value)
+{
+    return __atomic_load_n(Value, __ATOMIC_SEQ_CST);
+}
+
+void Platform_AtomicStore(volatile u32 *Value, u32 NewValue)
+{
+    __atomic_store_n(Value, NewValue, __ATOMIC_SEQ_CST);
+}
+
+u32 Platform_AtomicExchange(volatile u32 *Value, u32 NewValue)
+{
+    return __atomic_exchange_n(Value, NewValue, __ATOMIC_SEQ_CST);
+}
+
+
+uint Platform_CpuCount(void)
+{
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+    return Count > 0? (uint)Count : 1;
+}
+
+void Platform_Sleep(u64 Microseconds)
+{
+    struct timespec Duration = {
+        .tv_sec = (time_t)(Microseconds / 1000000),
+        .tv_nsec = (long)(Microseconds % 1000000) * 1000,
+    };
+    while (0 != nanosleep(&Duration, &Duration)) /* interrupted by a signal, sleep for the rest */
+    {
+    }
+}
+
+void Platform_SetEnv(const char *Name, const char *Value)
+{
+    setenv(Name, Value, 1);
+}
+
+u64 Platform_GetTicks(void)
+{
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (u64)Now.tv_sec * 1000000000ull + (u64)Now.tv_nsec;
+}
+
+u64 Platform_TicksPerSecond(void)
+{
+    return 1000000000ull;
+}
+
+Bool8 Platform_MapFile(Platform_MappedFile *File, const char *Path)
+{
+    *File = (Platform_MappedFile) { 0 };
+    int Fd = open(Path, O_RDONLY);
+    if (Fd < 0)
+        return false;
+
+    struct stat Info;
+    void *Data = MAP_FAILED;
+    if (0 == fstat(Fd, &Info) && Info.st_size > 0)
+        Data = mmap(NULL, (size_t)Info.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+    /* the mapping keeps the file open */
+    close(Fd);
+    if (MAP_FAILED == Data)
+        return false;
+
+    File->Data = Data;
+    File->Size = (u64)Info.st_size;
+    return true;
+}
+
+void Platform_UnmapFile(Platform_MappedFile *File)
+{
+    if (File->Data)
+        munmap((void *)File->Data, (size_t)File->Size);
+    *File = (Platform_MappedFile) { 0 };
+}
+
+Bool8 Platform_SocketListen(Platform_Socket *Listener, u16 Port)
+{
+    int Handle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Handle < 0)
+        return false;
+
+    int Reuse = 1;
+    setsockopt(Handle, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof Reuse);
+    struct sockaddr_in Addr = { 0 };
+    Addr.sin_family = AF_INET;
+    Addr.sin_port = htons(Port);
+    Addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (0 != bind(Handle, (struct sockaddr *)&Addr, sizeof Addr) || 0 != listen(Handle, 1))
+    {
+        close(Handle);
+        return false;
+    }
+    Listener->Handle = Handle;
+    return true;
+}
+
+Bool8 Platform_SocketAccept(Platform_Socket *Listener, Platform_Socket *OutClient)
+{
+    int Handle = accept(Listener->Handle, NULL, NULL);
+    if (Handle < 0)
+        return false;
+    int NoDelay = 1;
+    setsockopt(Handle, IPPROTO_TCP, TCP_NODELAY, &NoDelay, sizeof NoDelay);
+    OutClient->Handle = Handle;
+    return true;
+}
+
+int Platform_SocketWait(Platform_Socket *Socket, u32 TimeoutMilliseconds)
+{
+    fd_set Readable;
+    FD_ZERO(&Readable);
+    FD_SET(Socket->Handle, &Readable);
+    struct timeval Timeout = { 
+        .tv_sec = (time_t)(TimeoutMilliseconds / 1000), 
+        .tv_usec = (long)(TimeoutMilliseconds % 1000) * 1000,
+    };
+    int Result = select(Socket->Handle + 1, &Readable, NULL, NULL, &Timeout);
+    return Result < 0? -1 : Result > 0;
+}
+
+iSize Platform_SocketRecv(Platform_Socket *Socket, void *Buffer, uint Size)
+{
+    ssize_t Result = recv(Socket->Handle, Buffer, Size, 0);
+    return Result < 0? -1 : (iSize)Result;
+}
+
+Bool8 Platform_SocketSend(Platform_Socket *Socket, const void *Buffer, uint Size)
+{
+    const u8 *Bytes = Buffer;
+    while (Size)
+    {
+        ssize_t Sent = send(Socket->Handle, Bytes, Size, MSG_NOSIGNAL);
+        if (Sent < 0)
+            return false;
+        Bytes += Sent;
+        Size -= (uint)Sent;
+    }
+    return true;
+}
+
+void Platform_SocketClose(Platform_Socket *Socket)
+{
+    close(Socket->Handle);
+    Socket->Handle = -1;
+}
+
+#endif /* _WIN32 */
+
@@ -0,0 +1,1450 @@
+#include <string.h> /* memcpy */
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Platform.h"
+#include "Rasterizer.h"
+
+
+/* applied to the 8 bit color components before they get truncated to 5 bits */
+static const i8 sDitherMatrix[4][4] = {
+    { -4,  0, -3,  1 },
+    {  2, -2,  3, -1 },
+    { -3,  1, -4,  0 },
+    {  3, -1,  2, -2 },
+};
+
+typedef struct Raster_Texture
+{
+    u32 PageX, PageY;       /* in halfwords */
+    u32 ClutX, ClutY;
+    u32 Depth;              /* 0 = 4 bit, 1 = 8 bit, 2 = 15 bit */
+    u32 WindowMaskU, WindowMaskV;
+    u32 WindowOffsetU, WindowOffsetV;
+} Raster_Texture;
+
+typedef struct Raster_Edge
+{
+    /* E(x, y) = A*x + B*y + C, inside when E >= 0 */
+    i64 A, B, C;
+} Raster_Edge;
+
+/* everything needed to draw a triangle without looking at the GPU state again */
+typedef struct Raster_Triangle
+{
+    Raster_Vertex V[3];         /* counter clockwise */
+    u32 Flags;
+    Raster_SpanFn SpanFn;
+    Raster_Texture Texture;
+    i32 MinX, MinY, MaxX, MaxY; /* bounding box clipped to the drawing area */
+} Raster_Triangle;
+
+/* inclusive VRAM rectangle that does not wrap around */
+typedef struct Raster_Rect
+{
+    i32 Left, Top, Right, Bottom;
+} Raster_Rect;
+
+/* rows are drawn in bands of this many rows, interleaved between the upscaler's threads */
+#define RASTER_BAND_ROWS 8
+#define RASTER_UPSCALE_QUEUE_SIZE 4096
+#define RASTER_UPSCALE_MAX_THREADS 16
+#define RASTER_MAX_ATTR_STEP (0x100 << 16) /* colors and texture coordinates are 0..FFh, 16.16 */
+
+typedef struct Raster_UpscaleWorker
+{
+    struct Raster_Upscaler *Upscaler;
+    Platform_Thread Thread;
+    uint Band;
+} Raster_UpscaleWorker;
+
+struct Raster_Upscaler
+{
+    u16 *Vram;                  /* the shadow, (GPU_VRAM_WIDTH*Scale) x (GPU_VRAM_HEIGHT*Scale) */
+    uint Scale;
+    uint Pitch;
+
+    /* polygons that were drawn to VRAM but not to the shadow yet */
+    Raster_Triangle *Queue;
+    uint QueueCount;
+    const u16 *TextureVram;
+    /* union of what the queued polygons draw to and read textures from, in VRAM coordinates */
+    Raster_Rect DrawBounds;
+    Raster_Rect TextureBounds;
+    Bool8 HasTextureBounds;
+
+    /* the thread that flushes draws band 0, each worker one of the others */
+    Raster_UpscaleWorker Workers[RASTER_UPSCALE_MAX_THREADS];
+    uint WorkerCount;
+    Platform_Mutex Lock;
+    Platform_CondVar WorkReady;
+    Platform_CondVar WorkDone;
+    u64 Generation;
+    uint WorkersBusy;
+    Bool8 Quit;
+};
+
+static void Raster_UpscalePrepareWrite(Raster_Upscaler *Up, Raster_Rect Rect, Bool8 Polygon);
+static void Raster_UpscaleQueueTriangle(Raster_Upscaler *Up, const GPU *Gpu, const Raster_Triangle *Tri);
+
+
+
+/*==================================================================================
+ *
+ *                              PIXEL PIPELINE
+ *
+ *==================================================================================*/
+
+FORCE_INLINE int Raster_Blend5(int Back, int Front, Raster_BlendMode Mode)
+{
+    switch (Mode)
+    {
+    case RASTER_BLEND_AVERAGE:      return (Back + Front) >> 1;
+    case RASTER_BLEND_ADD:          return MIN(Back + Front, 0x1F);
+    case RASTER_BLEND_SUB:          return MAX(Back - Front, 0);
+    case RASTER_BLEND_ADD_QUARTER:  return MIN(Back + (Front >> 2), 0x1F);
+    default:
+    case RASTER_BLEND_OPAQUE:       return Front;
+    }
+}
+
+#ifdef HAS_SSE2
+FORCE_INLINE __m128i Raster_Blend5Epi16(__m128i Back, __m128i Front, Raster_BlendMode Mode)
+{
+    const __m128i Max5 = _mm_set1_epi16(0x1F);
+    switch (Mode)
+    {
+    case RASTER_BLEND_AVERAGE:      return _mm_srli_epi16(_mm_add_epi16(Back, Front), 1);
+    case RASTER_BLEND_ADD:          return _mm_min_epi16(_mm_add_epi16(Back, Front), Max5);
+    case RASTER_BLEND_SUB:          return _mm_max_epi16(_mm_sub_epi16(Back, Front), _mm_setzero_si128());
+    case RASTER_BLEND_ADD_QUARTER:  return _mm_min_epi16(_mm_add_epi16(Back, _mm_srli_epi16(Front, 2)), Max5);
+    default:
+    case RASTER_BLEND_OPAQUE:       return Front;
+    }
+}
+
+/* Mask ? A : B */
+FORCE_INLINE __m128i Raster_Select(__m128i Mask, __m128i A, __m128i B)
+{
+    return _mm_or_si128(_mm_and_si128(Mask, A), _mm_andnot_si128(Mask, B));
+}
+#endif /* HAS_SSE2 */
+
+FORCE_INLINE void Raster_ShadeSpan(
+    u16 *Dst, const u32 *Src, uint Count, uint X, uint Y,
+    const Raster_BlendMode Blend, const Bool8 Dither, const Bool8 SetMask, const Bool8 CheckMask)
+{
+    const i8 *DitherRow = sDitherMatrix[Y & 3];
+    uint i = 0;
+
+#ifdef HAS_SSE2
+    const __m128i ByteMask = _mm_set1_epi32(0xFF);
+    const __m128i Comp5Mask = _mm_set1_epi16(0x1F);
+    const __m128i Max8 = _mm_set1_epi16(0xFF);
+    const __m128i Zero = _mm_setzero_si128();
+    const __m128i BlendFlag = _mm_set1_epi16(RASTER_PIXEL_BLEND >> 24);
+    const __m128i MaskFlag = _mm_set1_epi16(RASTER_PIXEL_MASK >> 24);
+    const __m128i DiscardFlag = _mm_set1_epi16(RASTER_PIXEL_DISCARD >> 24);
+    /* the dither pattern repeats every 4 pixels, so it's the same for every group of 8 */
+    const __m128i DitherOffset = _mm_setr_epi16(
+        DitherRow[(X + 0) & 3], DitherRow[(X + 1) & 3], DitherRow[(X + 2) & 3], DitherRow[(X + 3) & 3],
+        DitherRow[(X + 0) & 3], DitherRow[(X + 1) & 3], DitherRow[(X + 2) & 3], DitherRow[(X + 3) & 3]
+    );
+
+    for (; i + 8 <= Count; i += 8)
+    {
+        __m128i Lo = _mm_loadu_si128((const __m128i *)(Src + i));
+        __m128i Hi = _mm_loadu_si128((const __m128i *)(Src + i + 4));
+
+        /* unpack 0xFFBBGGRR into 16 bit lanes */
+        __m128i R = _mm_packs_epi32(_mm_and_si128(Lo, ByteMask), _mm_and_si128(Hi, ByteMask));
+        __m128i G = _mm_packs_epi32(
+            _mm_and_si128(_mm_srli_epi32(Lo, 8), ByteMask),
+            _mm_and_si128(_mm_srli_epi32(Hi, 8), ByteMask)
+        );
+        __m128i B = _mm_packs_epi32(
+            _mm_and_si128(_mm_srli_epi32(Lo, 16), ByteMask),
+            _mm_and_si128(_mm_srli_epi32(Hi, 16), ByteMask)
+        );
+        __m128i Flags = _mm_packs_epi32(_mm_srli_epi32(Lo, 24), _mm_srli_epi32(Hi, 24));
+
+        if (Dither)
+        {
+            R = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(R, DitherOffset), Zero), Max8);
+            G = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(G, DitherOffset), Zero), Max8);
+            B = _mm_min_epi16(_mm_max_epi16(_mm_add_epi16(B, DitherOffset), Zero), Max8);
+        }
+        R = _mm_srli_epi16(R, 3);
+        G = _mm_srli_epi16(G, 3);
+        B = _mm_srli_epi16(B, 3);
+
+        __m128i Old = _mm_loadu_si128((const __m128i *)(Dst + i));
+        if (Blend != RASTER_BLEND_OPAQUE)
+        {
+            __m128i BackR = _mm_and_si128(Old, Comp5Mask);
+            __m128i BackG = _mm_and_si128(_mm_srli_epi16(Old, 5), Comp5Mask);
+            __m128i BackB = _mm_and_si128(_mm_srli_epi16(Old, 10), Comp5Mask);
+            __m128i Blended = _mm_cmpeq_epi16(_mm_and_si128(Flags, BlendFlag), BlendFlag);
+            R = Raster_Select(Blended, Raster_Blend5Epi16(BackR, R, Blend), R);
+            G = Raster_Select(Blended, Raster_Blend5Epi16(BackG, G, Blend), G);
+            B = Raster_Select(Blended, Raster_Blend5Epi16(BackB, B, Blend), B);
+        }
+
+        __m128i New = _mm_or_si128(R, _mm_or_si128(_mm_slli_epi16(G, 5), _mm_slli_epi16(B, 10)));
+        if (SetMask)
+            New = _mm_or_si128(New, _mm_set1_epi16((i16)0x8000));
+        else /* texel mask bit (bit 1 of flags) to bit 15 */
+            New = _mm_or_si128(New, _mm_slli_epi16(_mm_and_si128(Flags, MaskFlag), 14));
+
+        __m128i Keep = _mm_cmpeq_epi16(_mm_and_si128(Flags, DiscardFlag), DiscardFlag);
+        if (CheckMask)
+            Keep = _mm_or_si128(Keep, _mm_srai_epi16(Old, 15));
+
+        _mm_storeu_si128((__m128i *)(Dst + i), Raster_Select(Keep, Old, New));
+    }
+#endif /* HAS_SSE2 */
+
+    for (; i < Count; i++)
+    {
+        u32 Pixel = Src[i];
+        u16 Old = Dst[i];
+        int R = (Pixel >> 0) & 0xFF;
+        int G = (Pixel >> 8) & 0xFF;
+        int B = (Pixel >> 16) & 0xFF;
+        if (Dither)
+        {
+            int Offset = DitherRow[(X + i) & 3];
+            R = MIN(MAX(R + Offset, 0), 0xFF);
+            G = MIN(MAX(G + Offset, 0), 0xFF);
+            B = MIN(MAX(B + Offset, 0), 0xFF);
+        }
+        R >>= 3;
+        G >>= 3;
+        B >>= 3;
+
+        if (Blend != RASTER_BLEND_OPAQUE && (Pixel & RASTER_PIXEL_BLEND))
+        {
+            R = Raster_Blend5((Old >> 0) & 0x1F, R, Blend);
+            G = Raster_Blend5((Old >> 5) & 0x1F, G, Blend);
+            B = Raster_Blend5((Old >> 10) & 0x1F, B, Blend);
+        }
+
+        u16 New = R | G << 5 | B << 10;
+        if (SetMask || (Pixel & RASTER_PIXEL_MASK))
+            New |= 0x8000;
+
+        Bool8 Keep = (Pixel & RASTER_PIXEL_DISCARD) || (CheckMask && (Old & 0x8000));
+        Dst[i] = Keep? Old : New;
+    }
+}
+
+
+#define RASTER_SPAN_FN(b, d, s, c) Raster_Span_##b##_##d##s##c
+#define RASTER_DEFINE_SPAN_FN(b, d, s, c) \
+    static void RASTER_SPAN_FN(b, d, s, c)(u16 *Dst, const u32 *Src, uint Count, uint X, uint Y) {\
+        Raster_ShadeSpan(Dst, Src, Count, X, Y, b, d, s, c);\
+    }
+#define RASTER_DEFINE_SPAN_FNS(b) \
+    RASTER_DEFINE_SPAN_FN(b, 0, 0, 0) RASTER_DEFINE_SPAN_FN(b, 0, 0, 1)\
+    RASTER_DEFINE_SPAN_FN(b, 0, 1, 0) RASTER_DEFINE_SPAN_FN(b, 0, 1, 1)\
+    RASTER_DEFINE_SPAN_FN(b, 1, 0, 0) RASTER_DEFINE_SPAN_FN(b, 1, 0, 1)\
+    RASTER_DEFINE_SPAN_FN(b, 1, 1, 0) RASTER_DEFINE_SPAN_FN(b, 1, 1, 1)
+#define RASTER_SPAN_FNS(b) \
+    RASTER_SPAN_FN(b, 0, 0, 0), RASTER_SPAN_FN(b, 0, 0, 1),\
+    RASTER_SPAN_FN(b, 0, 1, 0), RASTER_SPAN_FN(b, 0, 1, 1),\
+    RASTER_SPAN_FN(b, 1, 0, 0), RASTER_SPAN_FN(b, 1, 0, 1),\
+    RASTER_SPAN_FN(b, 1, 1, 0), RASTER_SPAN_FN(b, 1, 1, 1)
+
+RASTER_DEFINE_SPAN_FNS(RASTER_BLEND_OPAQUE)
+RASTER_DEFINE_SPAN_FNS(RASTER_BLEND_AVERAGE)
+RASTER_DEFINE_SPAN_FNS(RASTER_BLEND_ADD)
+RASTER_DEFINE_SPAN_FNS(RASTER_BLEND_SUB)
+RASTER_DEFINE_SPAN_FNS(RASTER_BLEND_ADD_QUARTER)
+
+/* [Blend][Dither][SetMask][CheckMask] */
+static const Raster_SpanFn sSpanFnTable[RASTER_BLEND_COUNT * 8] = {
+    RASTER_SPAN_FNS(RASTER_BLEND_OPAQUE),
+    RASTER_SPAN_FNS(RASTER_BLEND_AVERAGE),
+    RASTER_SPAN_FNS(RASTER_BLEND_ADD),
+    RASTER_SPAN_FNS(RASTER_BLEND_SUB),
+    RASTER_SPAN_FNS(RASTER_BLEND_ADD_QUARTER),
+};
+
+Raster_SpanFn Raster_GetSpanFn(Raster_BlendMode BlendMode, Bool8 Dither, Bool8 SetMask, Bool8 CheckMask)
+{
+    ASSERT(BlendMode < RASTER_BLEND_COUNT);
+    uint Index = (uint)BlendMode*8
+        | (uint)(Dither != 0) << 2
+        | (uint)(SetMask != 0) << 1
+        | (uint)(CheckMask != 0);
+    return sSpanFnTable[Index];
+}
+
+Raster_BlendMode Raster_GetBlendMode(uint SemiTransparency)
+{
+    return RASTER_BLEND_AVERAGE + (SemiTransparency & 3);
+}
+
+
+
+
+/*==================================================================================
+ *
+ *                              POLYGON RASTERIZER
+ *
+ *==================================================================================*/
+
+static i64 Raster_FloorDiv(i64 Num, i64 Den)
+{
+    ASSERT(Den > 0);
+    i64 Quot = Num / Den;
+    if ((Num % Den) != 0 && Num < 0)
+        Quot--;
+    return Quot;
+}
+
+static Raster_Edge Raster_SetupEdge(const Raster_Vertex *A, const Raster_Vertex *B)
+{
+    Raster_Edge Edge = {
+        .A = (i64)A->Y - B->Y,
+        .B = (i64)B->X - A->X,
+        .C = (i64)(B->Y - A->Y)*A->X - (i64)(B->X - A->X)*A->Y,
+    };
+
+    /* top-left fill rule: pixels exactly on a bottom or right edge are not drawn */
+    Bool8 IsTopLeft = Edge.A > 0 || (Edge.A == 0 && Edge.B > 0);
+    if (!IsTopLeft)
+        Edge.C -= 1;
+    return Edge;
+}
+
+/* narrows [*XStart, *XEnd] to where the edge function is >= 0 on row Y */
+static void Raster_ClipSpanToEdge(const Raster_Edge *Edge, i32 Y, i32 *XStart, i32 *XEnd)
+{
+    i64 RowC = Edge->B*Y + Edge->C;
+    if (Edge->A > 0)
+    {
+        i64 Min = -Raster_FloorDiv(RowC, Edge->A); /* ceil(-RowC / A) */
+        if (Min > *XStart)
+            *XStart = Min > *XEnd? *XEnd + 1 : (i32)Min;
+    }
+    else if (Edge->A < 0)
+    {
+        i64 Max = Raster_FloorDiv(RowC, -Edge->A);
+        if (Max < *XEnd)
+            *XEnd = Max < *XStart? *XStart - 1 : (i32)Max;
+    }
+    else if (RowC < 0)
+    {
+        *XEnd = *XStart - 1;
+    }
+}
+
+/* 
+ * 16.16 fixed point gradient of an attribute over the triangle;
+ * slivers with a tiny area can have gradients of millions per pixel, they only fit in 64 bits
+ */
+static void Raster_SetupGradient(
+    const Raster_Vertex *V0, const Raster_Vertex *V1, const Raster_Vertex *V2, i64 Area,
+    i32 A0, i32 A1, i32 A2,
+    i64 *OutDx, i64 *OutDy)
+{
+    i64 Dx1 = V1->X - V0->X, Dy1 = V1->Y - V0->Y;
+    i64 Dx2 = V2->X - V0->X, Dy2 = V2->Y - V0->Y;
+    i64 Da1 = A1 - A0, Da2 = A2 - A0;
+    *OutDx = ((Da1*Dy2 - Da2*Dy1) * 65536) / Area;
+    *OutDy = ((Da2*Dx1 - Da1*Dx2) * 65536) / Area;
+}
+
+FORCE_INLINE u16 Raster_FetchTexel(const u16 *Vram, const Raster_Texture *Texture, u32 U, u32 V)
+{
+    U = (U & Texture->WindowMaskU) | Texture->WindowOffsetU;
+    V = (V & Texture->WindowMaskV) | Texture->WindowOffsetV;
+    u32 Row = ((Texture->PageY + V) % GPU_VRAM_HEIGHT) * GPU_VRAM_WIDTH;
+    switch (Texture->Depth)
+    {
+    case 0: /* 4 bit CLUT */
+    {
+        u16 Word = Vram[Row + (Texture->PageX + U/4) % GPU_VRAM_WIDTH];
+        u32 Index = (Word >> (U & 3)*4) & 0xF;
+        return Vram[Texture->ClutY*GPU_VRAM_WIDTH + (Texture->ClutX + Index) % GPU_VRAM_WIDTH];
+    } break;
+    case 1: /* 8 bit CLUT */
+    {
+        u16 Word = Vram[Row + (Texture->PageX + U/2) % GPU_VRAM_WIDTH];
+        u32 Index = (Word >> (U & 1)*8) & 0xFF;
+        return Vram[Texture->ClutY*GPU_VRAM_WIDTH + (Texture->ClutX + Index) % GPU_VRAM_WIDTH];
+    } break;
+    default: /* 15 bit direct */
+    {
+        return Vram[Row + (Texture->PageX + U) % GPU_VRAM_WIDTH];
+    } break;
+    }
+}
+
+/* texture page and window come from GPUStat and GP0 E2h */
+static Raster_Texture Raster_SetupTexture(const GPU *Gpu, u16 Clut)
+{
+    return (Raster_Texture) {
+        .PageX = (u32)Gpu->Status.TexturePageX * 64,
+        .PageY = (u32)Gpu->Status.TexturePageY * 256,
+        .ClutX = (Clut & 0x3F) * 16,
+        .ClutY = (Clut >> 6) & 0x1FF,
+        .Depth = Gpu->Status.TextureDepth,
+        .WindowMaskU = ~((u32)Gpu->TextureWindowMaskX * 8) & 0xFF,
+        .WindowMaskV = ~((u32)Gpu->TextureWindowMaskY * 8) & 0xFF,
+        .WindowOffsetU = (u32)(Gpu->TextureWindowOffsetX & Gpu->TextureWindowMaskX) * 8,
+        .WindowOffsetV = (u32)(Gpu->TextureWindowOffsetY & Gpu->TextureWindowMaskY) * 8,
+    };
+}
+
+/* texel and 24 bit color to span pixel */
+FORCE_INLINE u32 Raster_ShadeTexel(u16 Texel, u32 R, u32 G, u32 B, Bool8 Raw, Bool8 SemiTransparent)
+{
+    if (0 == Texel)
+        return RASTER_PIXEL_DISCARD;
+
+    u32 TexR = (Texel << 3) & 0xF8;
+    u32 TexG = (Texel >> 2) & 0xF8;
+    u32 TexB = (Texel >> 7) & 0xF8;
+    if (!Raw) /* texture blending: 80h is brightness 1.0 */
+    {
+        TexR = MIN((TexR * R) >> 7, 0xFF);
+        TexG = MIN((TexG * G) >> 7, 0xFF);
+        TexB = MIN((TexB * B) >> 7, 0xFF);
+    }
+
+    u32 Pixel = TexR | TexG << 8 | TexB << 16;
+    if (Texel & 0x8000)
+    {
+        Pixel |= RASTER_PIXEL_MASK;
+        if (SemiTransparent)
+            Pixel |= RASTER_PIXEL_BLEND;
+    }
+    return Pixel;
+}
+
+/* returns false if nothing would be drawn */
+static Bool8 Raster_SetupTriangle(Raster_Triangle *Tri, const GPU *Gpu,
+    const Raster_Vertex *V0, const Raster_Vertex *V1, const Raster_Vertex *V2,
+    u32 Flags, u16 Clut)
+{
+    i64 Area = (i64)(V1->X - V0->X)*(V2->Y - V0->Y) - (i64)(V1->Y - V0->Y)*(V2->X - V0->X);
+    if (0 == Area)
+        return false;
+    if (Area < 0) /* make it counter clockwise so that the inside is where all edges are positive */
+    {
+        const Raster_Vertex *Tmp = V1;
+        V1 = V2;
+        V2 = Tmp;
+    }
+
+    i32 MinX = MIN(V0->X, MIN(V1->X, V2->X));
+    i32 MaxX = MAX(V0->X, MAX(V1->X, V2->X));
+    i32 MinY = MIN(V0->Y, MIN(V1->Y, V2->Y));
+    i32 MaxY = MAX(V0->Y, MAX(V1->Y, V2->Y));
+    if (MaxX - MinX >= GPU_VRAM_WIDTH || MaxY - MinY >= GPU_VRAM_HEIGHT) /* the GPU skips these */
+        return false;
+
+    MinX = MAX(MinX, (i32)Gpu->DrawingAreaLeft);
+    MaxX = MIN(MaxX, (i32)Gpu->DrawingAreaRight);
+    MinY = MAX(MinY, (i32)Gpu->DrawingAreaTop);
+    MaxY = MIN(MaxY, (i32)Gpu->DrawingAreaBottom);
+    MaxX = MIN(MaxX, GPU_VRAM_WIDTH - 1);
+    MaxY = MIN(MaxY, GPU_VRAM_HEIGHT - 1);
+    if (MinX > MaxX || MinY > MaxY)
+        return false;
+
+    Bool8 Shaded = (Flags & RASTER_SHADED) != 0;
+    Bool8 Textured = (Flags & RASTER_TEXTURED) != 0;
+    Bool8 Raw = Textured && (Flags & RASTER_RAW_TEXTURE);
+    Bool8 SemiTransparent = (Flags & RASTER_SEMI_TRANSPARENT) != 0;
+    *Tri = (Raster_Triangle) {
+        .V = { *V0, *V1, *V2 },
+        .Flags = Flags,
+        .SpanFn = Raster_GetSpanFn(
+            SemiTransparent? Raster_GetBlendMode(Gpu->Status.SemiTransparency) : RASTER_BLEND_OPAQUE,
+            Gpu->Status.DitherEnable && (Shaded || (Textured && !Raw)),
+            Gpu->Status.SetMaskBitOnDraw,
+            Gpu->Status.PreserveMaskedPixel
+        ),
+        .MinX = MinX, .MinY = MinY, 
+        .MaxX = MaxX, .MaxY = MaxY,
+    };
+    if (Textured)
+        Tri->Texture = Raster_SetupTexture(Gpu, Clut);
+    return true;
+}
+
+/* 
+ * Draws Tri at Scale times the resolution into Dst (Pitch halfwords per row), texels are read from Vram.
+ * Only the rows of every BandCount'th band of RASTER_BAND_ROWS rows, starting at Band, are drawn.
+ * Returns the number of pixels drawn
+ */
+static u32 Raster_RasterizeTriangle(const Raster_Triangle *Tri, const u16 *Vram,
+    u16 *Dst, uint Pitch, i32 Scale, uint Band, uint BandCount)
+{
+    Raster_Vertex Scaled[3];
+    for (uint i = 0; i < 3; i++)
+    {
+        Scaled[i] = Tri->V[i];
+        Scaled[i].X *= Scale;
+        Scaled[i].Y *= Scale;
+    }
+    const Raster_Vertex *V0 = &Scaled[0], *V1 = &Scaled[1], *V2 = &Scaled[2];
+    i64 Area = (i64)(V1->X - V0->X)*(V2->Y - V0->Y) - (i64)(V1->Y - V0->Y)*(V2->X - V0->X);
+    i32 MinX = Tri->MinX*Scale;
+    i32 MinY = Tri->MinY*Scale;
+    i32 MaxX = (Tri->MaxX + 1)*Scale - 1;
+    i32 MaxY = (Tri->MaxY + 1)*Scale - 1;
+
+    Raster_Edge Edges[3] = {
+        Raster_SetupEdge(V0, V1),
+        Raster_SetupEdge(V1, V2),
+        Raster_SetupEdge(V2, V0),
+    };
+
+    u32 Flags = Tri->Flags;
+    Bool8 Shaded = (Flags & RASTER_SHADED) != 0;
+    Bool8 Textured = (Flags & RASTER_TEXTURED) != 0;
+    Bool8 Raw = Textured && (Flags & RASTER_RAW_TEXTURE);
+    Bool8 SemiTransparent = (Flags & RASTER_SEMI_TRANSPARENT) != 0;
+    Raster_SpanFn SpanFn = Tri->SpanFn;
+
+    /* attribute gradients, 16.16 fixed point */
+    enum { ATTR_R, ATTR_G, ATTR_B, ATTR_U, ATTR_V, ATTR_COUNT };
+    i32 Attr0[ATTR_COUNT] = {
+        (V0->Color >> 0) & 0xFF, (V0->Color >> 8) & 0xFF, (V0->Color >> 16) & 0xFF,
+        V0->U, V0->V
+    };
+    i64 Dx[ATTR_COUNT] = { 0 }, Dy[ATTR_COUNT] = { 0 };
+    if (Shaded)
+    {
+        for (uint i = ATTR_R; i <= ATTR_B; i++)
+        {
+            uint Shift = i*8;
+            Raster_SetupGradient(V0, V1, V2, Area,
+                Attr0[i], (V1->Color >> Shift) & 0xFF, (V2->Color >> Shift) & 0xFF,
+                &Dx[i], &Dy[i]
+            );
+        }
+    }
+    if (Textured)
+    {
+        Raster_SetupGradient(V0, V1, V2, Area, V0->U, V1->U, V2->U, &Dx[ATTR_U], &Dy[ATTR_U]);
+        Raster_SetupGradient(V0, V1, V2, Area, V0->V, V1->V, V2->V, &Dx[ATTR_V], &Dy[ATTR_V]);
+    }
+    /* 
+     * the values inside the triangle stay between the vertices' (0..FFh), so does a span:
+     * a step of more than that is on a span of a single pixel, where it's never taken
+     */
+    i32 Step[ATTR_COUNT];
+    for (uint i = 0; i < ATTR_COUNT; i++)
+        Step[i] = (i32)MIN(MAX(Dx[i], -RASTER_MAX_ATTR_STEP), RASTER_MAX_ATTR_STEP);
+    const Raster_Texture *Texture = &Tri->Texture;
+
+    u32 FlatColor = V0->Color & 0xFFFFFF;
+    if (SemiTransparent && !Textured)
+        FlatColor |= RASTER_PIXEL_BLEND;
+
+    u32 Span[GPU_VRAM_WIDTH * RASTER_MAX_SCALE];
+    u32 PixelCount = 0;
+    for (i32 Y = MinY; Y <= MaxY; Y++)
+    {
+        if (BandCount > 1 && (uint)(Y / RASTER_BAND_ROWS) % BandCount != Band)
+            continue;
+
+        i32 XStart = MinX, XEnd = MaxX;
+        Raster_ClipSpanToEdge(&Edges[0], Y, &XStart, &XEnd);
+        Raster_ClipSpanToEdge(&Edges[1], Y, &XStart, &XEnd);
+        Raster_ClipSpanToEdge(&Edges[2], Y, &XStart, &XEnd);
+        if (XStart > XEnd)
+            continue;
+
+        uint Count = XEnd - XStart + 1;
+        PixelCount += Count;
+        if (!Shaded && !Textured)
+        {
+            for (uint i = 0; i < Count; i++)
+                Span[i] = FlatColor;
+        }
+        else
+        {
+            /* attributes at the start of the span, rounded; only off the range by the gradients' rounding */
+            i32 Value[ATTR_COUNT];
+            for (uint i = 0; i < ATTR_COUNT; i++)
+            {
+                i64 Start = ((i64)Attr0[i] << 16)
+                    + Dx[i]*(XStart - V0->X)
+                    + Dy[i]*(Y - V0->Y)
+                    + 0x8000;
+                Value[i] = (i32)MIN(MAX(Start, -RASTER_MAX_ATTR_STEP), 2*RASTER_MAX_ATTR_STEP);
+            }
+
+            if (!Textured)
+            {
+                for (uint i = 0; i < Count; i++)
+                {
+                    u32 R = MIN(MAX(Value[ATTR_R] >> 16, 0), 0xFF);
+                    u32 G = MIN(MAX(Value[ATTR_G] >> 16, 0), 0xFF);
+                    u32 B = MIN(MAX(Value[ATTR_B] >> 16, 0), 0xFF);
+                    Span[i] = R | G << 8 | B << 16 | (FlatColor & RASTER_PIXEL_BLEND);
+                    Value[ATTR_R] += Step[ATTR_R];
+                    Value[ATTR_G] += Step[ATTR_G];
+                    Value[ATTR_B] += Step[ATTR_B];
+                }
+            }
+            else
+            {
+                for (uint i = 0; i < Count; i++)
+                {
+                    u32 R = MIN(MAX(Value[ATTR_R] >> 16, 0), 0xFF);
+                    u32 G = MIN(MAX(Value[ATTR_G] >> 16, 0), 0xFF);
+                    u32 B = MIN(MAX(Value[ATTR_B] >> 16, 0), 0xFF);
+                    u16 Texel = Raster_FetchTexel(Vram, Texture,
+                        (u32)(Value[ATTR_U] >> 16) & 0xFF,
+                        (u32)(Value[ATTR_V] >> 16) & 0xFF
+                    );
+                    Span[i] = Raster_ShadeTexel(Texel, R, G, B, Raw, SemiTransparent);
+                    for (uint k = 0; k < ATTR_COUNT; k++)
+                        Value[k] += Step[k];
+                }
+            }
+        }
+
+        SpanFn(&Dst[Y*Pitch + XStart], Span, Count, XStart, Y);
+    }
+    return PixelCount;
+}
+
+u32 Raster_DrawTriangle(GPU *Gpu,
+    const Raster_Vertex *V0, const Raster_Vertex *V1, const Raster_Vertex *V2,
+    u32 Flags, u16 Clut)
+{
+    Raster_Triangle Tri;
+    if (!Raster_SetupTriangle(&Tri, Gpu, V0, V1, V2, Flags, Clut))
+        return 0;
+
+    /* queued polygons that sample textures from where this one draws have to be drawn first */
+    if (Gpu->Upscaler)
+        Raster_UpscalePrepareWrite(Gpu->Upscaler, (Raster_Rect) { Tri.MinX, Tri.MinY, Tri.MaxX, Tri.MaxY }, true);
+
+    GPU_MarkDirty(Gpu, Tri.MinX, Tri.MinY, Tri.MaxX - Tri.MinX + 1, Tri.MaxY - Tri.MinY + 1);
+    u32 PixelCount = Raster_RasterizeTriangle(&Tri, Gpu->Vram, Gpu->Vram, GPU_VRAM_WIDTH, 1, 0, 1);
+    if (Gpu->Upscaler)
+        Raster_UpscaleQueueTriangle(Gpu->Upscaler, Gpu, &Tri);
+    return PixelCount;
+}
+
+
+
+
+/*==================================================================================
+ *
+ *                              RECTANGLES AND BLITS
+ *
+ *==================================================================================*/
+
+FORCE_INLINE u16 Raster_To15(u32 Color)
+{
+    return ((Color >> 3) & 0x1F) | ((Color >> 11) & 0x1F) << 5 | ((Color >> 19) & 0x1F) << 10;
+}
+
+static void Raster_Fill16(u16 *Dst, u16 Value, uint Count)
+{
+    uint i = 0;
+#ifdef HAS_SSE2
+    const __m128i Values = _mm_set1_epi16((i16)Value);
+    for (; i + 8 <= Count; i += 8)
+        _mm_storeu_si128((__m128i *)(Dst + i), Values);
+#endif /* HAS_SSE2 */
+    for (; i < Count; i++)
+        Dst[i] = Value;
+}
+
+u32 Raster_FillRect(GPU *Gpu, u32 X, u32 Y, u32 Width, u32 Height, u32 Color)
+{
+    /* X and width are in units of 16 pixels, and width 3F1h..3FFh rounds up to the whole VRAM */
+    X &= 0x3F0;
+    Y &= 0x1FF;
+    Width = ((Width & 0x3FF) + 0xF) & ~0xFu;
+    Height &= 0x1FF;
+    if (0 == Width || 0 == Height)
+        return 0;
+
+    Raster_UpscaleBeginWrite(Gpu, X, Y, Width, Height);
+    u16 Pixel = Raster_To15(Color);
+    uint FirstRun = MIN(Width, GPU_VRAM_WIDTH - X);
+    for (u32 i = 0; i < Height; i++)
+    {
+        u16 *Row = &Gpu->Vram[((Y + i) % GPU_VRAM_HEIGHT)*GPU_VRAM_WIDTH];
+        Raster_Fill16(Row + X, Pixel, FirstRun);
+        Raster_Fill16(Row, Pixel, Width - FirstRun);
+    }
+    GPU_MarkDirty(Gpu, X, Y, Width, Height);
+    Raster_UpscaleEndWrite(Gpu, X, Y, Width, Height);
+    return Width * Height;
+}
+
+u32 Raster_CopyRect(GPU *Gpu, u32 SrcX, u32 SrcY, u32 DstX, u32 DstY, u32 Width, u32 Height)
+{
+    SrcX &= 0x3FF;
+    SrcY &= 0x1FF;
+    DstX &= 0x3FF;
+    DstY &= 0x1FF;
+    Width = ((Width - 1) & 0x3FF) + 1;
+    Height = ((Height - 1) & 0x1FF) + 1;
+
+    Bool8 SetMask = Gpu->Status.SetMaskBitOnDraw;
+    Bool8 CheckMask = Gpu->Status.PreserveMaskedPixel;
+    u16 MaskBit = SetMask? 0x8000 : 0;
+    Raster_UpscaleBeginWrite(Gpu, DstX, DstY, Width, Height);
+
+    /* go bottom up when moving down, so overlapping rows are read before they get overwritten */
+    Bool8 BottomUp = DstY > SrcY;
+    uint SrcFirstRun = MIN(Width, GPU_VRAM_WIDTH - SrcX);
+    uint DstFirstRun = MIN(Width, GPU_VRAM_WIDTH - DstX);
+    for (u32 i = 0; i < Height; i++)
+    {
+        u32 Offset = BottomUp? Height - 1 - i : i;
+        const u16 *SrcRow = &Gpu->Vram[((SrcY + Offset) % GPU_VRAM_HEIGHT)*GPU_VRAM_WIDTH];
+        u16 *DstRow = &Gpu->Vram[((DstY + Offset) % GPU_VRAM_HEIGHT)*GPU_VRAM_WIDTH];
+
+        /* the row goes through a buffer, which also takes care of overlap within the row */
+        u16 Row[GPU_VRAM_WIDTH];
+        memcpy(Row, SrcRow + SrcX, SrcFirstRun*sizeof(u16));
+        memcpy(Row + SrcFirstRun, SrcRow, (Width - SrcFirstRun)*sizeof(u16));
+
+        if (!SetMask && !CheckMask)
+        {
+            memcpy(DstRow + DstX, Row, DstFirstRun*sizeof(u16));
+            memcpy(DstRow, Row + DstFirstRun, (Width - DstFirstRun)*sizeof(u16));
+        }
+        else
+        {
+            for (u32 x = 0; x < Width; x++)
+            {
+                u16 *Dst = &DstRow[(DstX + x) % GPU_VRAM_WIDTH];
+                if (!(CheckMask && (*Dst & 0x8000)))
+                    *Dst = Row[x] | MaskBit;
+            }
+        }
+    }
+    GPU_MarkDirty(Gpu, DstX, DstY, Width, Height);
+    Raster_UpscaleEndWrite(Gpu, DstX, DstY, Width, Height);
+    return Width * Height;
+}
+
+/* Count texels of one row, U steps by StepU (1 or -1); Depth is a constant at every call site */
+FORCE_INLINE void Raster_FetchTexelRow(
+    u16 *Out, const u16 *Vram, const Raster_Texture *Texture, 
+    u32 U, u32 StepU, u32 V, uint Count, const u32 Depth)
+{
+    V = (V & Texture->WindowMaskV) | Texture->WindowOffsetV;
+    const u16 *Row = &Vram[((Texture->PageY + V) % GPU_VRAM_HEIGHT) * GPU_VRAM_WIDTH];
+    const u16 *Clut = &Vram[Texture->ClutY * GPU_VRAM_WIDTH];
+    for (uint i = 0; i < Count; i++, U += StepU)
+    {
+        u32 TexU = (U & Texture->WindowMaskU) | Texture->WindowOffsetU;
+        if (0 == Depth)
+        {
+            u32 Index = (Row[(Texture->PageX + TexU/4) % GPU_VRAM_WIDTH] >> (TexU & 3)*4) & 0xF;
+            Out[i] = Clut[(Texture->ClutX + Index) % GPU_VRAM_WIDTH];
+        }
+        else if (1 == Depth)
+        {
+            u32 Index = (Row[(Texture->PageX + TexU/2) % GPU_VRAM_WIDTH] >> (TexU & 1)*8) & 0xFF;
+            Out[i] = Clut[(Texture->ClutX + Index) % GPU_VRAM_WIDTH];
+        }
+        else
+        {
+            Out[i] = Row[(Texture->PageX + TexU) % GPU_VRAM_WIDTH];
+        }
+    }
+}
+
+/* 
+ * the Count texels of a row starting at U are a run of one VRAM row (and the CLUT one of another):
+ * no texture window, U doesn't wrap around at FFh, and neither the page nor the CLUT wrap around at VRAM's right edge
+ */
+static Bool8 Raster_IsTexelRowContiguous(const Raster_Texture *Texture, u32 U, u32 StepU, uint Count)
+{
+    if (0xFF != Texture->WindowMaskU || 0 != Texture->WindowOffsetU)
+        return false;
+    u32 First = U & 0xFF;
+    u32 Last = First + StepU*(Count - 1);
+    if (Last > 0xFF) /* past FFh, or below 0 */
+        return false;
+
+    u32 LastWord = MAX(First, Last);
+    u32 ClutSize = 0;
+    switch (Texture->Depth)
+    {
+    case 0: LastWord /= 4; ClutSize = 16; break;
+    case 1: LastWord /= 2; ClutSize = 256; break;
+    }
+    return Texture->PageX + LastWord < GPU_VRAM_WIDTH && Texture->ClutX + ClutSize <= GPU_VRAM_WIDTH;
+}
+
+/* Raster_FetchTexelRow without the window and the wrapping, see Raster_IsTexelRowContiguous */
+FORCE_INLINE void Raster_FetchContiguousTexelRow(
+    u16 *Out, const u16 *Vram, const Raster_Texture *Texture, 
+    u32 U, u32 StepU, u32 V, uint Count, const u32 Depth)
+{
+    V = (V & Texture->WindowMaskV) | Texture->WindowOffsetV;
+    const u16 *Row = &Vram[((Texture->PageY + V) % GPU_VRAM_HEIGHT) * GPU_VRAM_WIDTH + Texture->PageX];
+    const u16 *Clut = &Vram[Texture->ClutY * GPU_VRAM_WIDTH + Texture->ClutX];
+    U &= 0xFF;
+    uint i = 0;
+    if (1 == StepU && 0 == Depth)
+    {
+        for (; i < Count && (U & 3); i++, U++)
+            Out[i] = Clut[(Row[U/4] >> (U & 3)*4) & 0xF];
+        /* a VRAM halfword at a time */
+        for (; i + 4 <= Count; i += 4, U += 4)
+        {
+            u16 Word = Row[U/4];
+            Out[i + 0] = Clut[Word & 0xF];
+            Out[i + 1] = Clut[(Word >> 4) & 0xF];
+            Out[i + 2] = Clut[(Word >> 8) & 0xF];
+            Out[i + 3] = Clut[Word >> 12];
+        }
+    }
+    else if (1 == StepU && 1 == Depth)
+    {
+        for (; i < Count && (U & 1); i++, U++)
+            Out[i] = Clut[Row[U/2] >> 8];
+        for (; i + 2 <= Count; i += 2, U += 2)
+        {
+            u16 Word = Row[U/2];
+            Out[i + 0] = Clut[Word & 0xFF];
+            Out[i + 1] = Clut[Word >> 8];
+        }
+    }
+    else if (1 == StepU)
+    {
+        memcpy(Out, Row + U, Count * sizeof *Out);
+        return;
+    }
+    for (; i < Count; i++, U += StepU)
+    {
+        if (0 == Depth)
+            Out[i] = Clut[(Row[U/4] >> (U & 3)*4) & 0xF];
+        else if (1 == Depth)
+            Out[i] = Clut[(Row[U/2] >> (U & 1)*8) & 0xFF];
+        else Out[i] = Row[U];
+    }
+}
+
+/* Raster_ShadeTexel on a row, Raw and SemiTransparent are constants at every call site */
+FORCE_INLINE void Raster_ShadeTexelRow(
+    u32 *Span, const u16 *Texels, uint Count, 
+    u32 R, u32 G, u32 B, const Bool8 Raw, const Bool8 SemiTransparent)
+{
+    for (uint i = 0; i < Count; i++)
+        Span[i] = Raster_ShadeTexel(Texels[i], R, G, B, Raw, SemiTransparent);
+}
+
+/* 
+ * opaque raw texels with the mask bit left alone: they go to VRAM as they are, but for the transparent ones (0000h);
+ * MaskBit is 8000h to set it on every pixel (GP0 E6h)
+ */
+static void Raster_CopyTexelRow(u16 *Dst, const u16 *Texels, uint Count, u16 MaskBit)
+{
+    uint i = 0;
+#ifdef HAS_SSE2
+    __m128i Mask = _mm_set1_epi16((i16)MaskBit);
+    for (; i + 8 <= Count; i += 8)
+    {
+        __m128i Texel = _mm_loadu_si128((const __m128i *)(Texels + i));
+        __m128i Old = _mm_loadu_si128((const __m128i *)(Dst + i));
+        __m128i Transparent = _mm_cmpeq_epi16(Texel, _mm_setzero_si128());
+        _mm_storeu_si128((__m128i *)(Dst + i), Raster_Select(Transparent, Old, _mm_or_si128(Texel, Mask)));
+    }
+#endif /* HAS_SSE2 */
+    for (; i < Count; i++)
+    {
+        if (Texels[i])
+            Dst[i] = Texels[i] | MaskBit;
+    }
+}
+
+/*
+ * Rectangles and lines are drawn to the shadow too, at its resolution: a native pixel becomes a Scale x Scale block
+ * that's blended with the shadow's pixels, and the pixels they don't write (transparent texels, masked pixels,
+ * the rest of a line's bounding box) keep their upscaled polygons. The caller went through Raster_UpscaleBeginWrite
+ */
+static void Raster_UpscaleSpan(Raster_Upscaler *Up, Raster_SpanFn SpanFn, const u32 *Span, uint Count, i32 X, i32 Y)
+{
+    uint Scale = Up->Scale;
+    u32 Scaled[GPU_VRAM_WIDTH * RASTER_MAX_SCALE];
+    for (uint i = 0; i < Count; i++)
+    {
+        for (uint k = 0; k < Scale; k++)
+            Scaled[i*Scale + k] = Span[i];
+    }
+    for (uint k = 0; k < Scale; k++)
+    {
+        uint Row = Y*Scale + k;
+        SpanFn(&Up->Vram[Row*Up->Pitch + X*Scale], Scaled, Count*Scale, X*Scale, Row);
+    }
+}
+
+static void Raster_UpscaleCopyTexelRow(Raster_Upscaler *Up, const u16 *Texels, uint Count, i32 X, i32 Y, u16 MaskBit)
+{
+    uint Scale = Up->Scale;
+    u16 Scaled[GPU_VRAM_WIDTH * RASTER_MAX_SCALE];
+    for (uint i = 0; i < Count; i++)
+    {
+        for (uint k = 0; k < Scale; k++)
+            Scaled[i*Scale + k] = Texels[i];
+    }
+    for (uint k = 0; k < Scale; k++)
+        Raster_CopyTexelRow(&Up->Vram[(Y*Scale + k)*Up->Pitch + X*Scale], Scaled, Count*Scale, MaskBit);
+}
+
+u32 Raster_DrawRectangle(GPU *Gpu, 
+    i32 X, i32 Y, u32 Width, u32 Height, 
+    u32 Color, u32 U, u32 V, u32 Flags, u16 Clut)
+{
+    i32 MinX = MAX(X, (i32)Gpu->DrawingAreaLeft);
+    i32 MinY = MAX(Y, (i32)Gpu->DrawingAreaTop);
+    i32 MaxX = MIN(X + (i32)Width - 1, MIN((i32)Gpu->DrawingAreaRight, GPU_VRAM_WIDTH - 1));
+    i32 MaxY = MIN(Y + (i32)Height - 1, MIN((i32)Gpu->DrawingAreaBottom, GPU_VRAM_HEIGHT - 1));
+    if (MinX > MaxX || MinY > MaxY)
+        return 0;
+
+    Bool8 Textured = (Flags & RASTER_TEXTURED) != 0;
+    Bool8 Raw = Textured && (Flags & RASTER_RAW_TEXTURE);
+    Bool8 SemiTransparent = (Flags & RASTER_SEMI_TRANSPARENT) != 0;
+    Raster_BlendMode BlendMode = SemiTransparent? Raster_GetBlendMode(Gpu->Status.SemiTransparency) : RASTER_BLEND_OPAQUE;
+    Bool8 SetMask = Gpu->Status.SetMaskBitOnDraw;
+    Bool8 CheckMask = Gpu->Status.PreserveMaskedPixel;
+    uint Count = MaxX - MinX + 1;
+    u32 PixelCount = Count * (MaxY - MinY + 1);
+    GPU_MarkDirty(Gpu, MinX, MinY, Count, MaxY - MinY + 1);
+    Raster_UpscaleBeginWrite(Gpu, MinX, MinY, Count, MaxY - MinY + 1);
+
+    /* rectangles are never dithered */
+    Raster_SpanFn SpanFn = Raster_GetSpanFn(BlendMode, false, SetMask, CheckMask);
+    Raster_Upscaler *Up = Gpu->Upscaler;
+    if (!Textured && RASTER_BLEND_OPAQUE == BlendMode && !CheckMask)
+    {
+        /* plain fill */
+        u16 Pixel = Raster_To15(Color) | (SetMask? 0x8000 : 0);
+        for (i32 y = MinY; y <= MaxY; y++)
+            Raster_Fill16(&Gpu->Vram[y*GPU_VRAM_WIDTH + MinX], Pixel, Count);
+        if (Up)
+        {
+            for (i32 y = MinY*Up->Scale; y < (MaxY + 1)*(i32)Up->Scale; y++)
+                Raster_Fill16(&Up->Vram[y*Up->Pitch + MinX*Up->Scale], Pixel, Count*Up->Scale);
+        }
+    }
+    else if (!Textured)
+    {
+        u32 Span[GPU_VRAM_WIDTH];
+        u32 FlatColor = (Color & 0xFFFFFF) | (SemiTransparent? RASTER_PIXEL_BLEND : 0);
+        for (uint i = 0; i < Count; i++)
+            Span[i] = FlatColor;
+        for (i32 y = MinY; y <= MaxY; y++)
+        {
+            SpanFn(&Gpu->Vram[y*GPU_VRAM_WIDTH + MinX], Span, Count, MinX, y);
+            if (Up)
+                Raster_UpscaleSpan(Up, SpanFn, Span, Count, MinX, y);
+        }
+    }
+    else
+    {
+        /* texture coordinates step by one texel per pixel, backwards when flipped */
+        Raster_Texture Texture = Raster_SetupTexture(Gpu, Clut);
+        u32 StepU = Gpu->TexturedRectangleXFlip? (u32)-1 : 1;
+        u32 StepV = Gpu->TexturedRectangleYFlip? (u32)-1 : 1;
+        u32 StartU = U + StepU*(u32)(MinX - X);
+        u32 TexV = V + StepV*(u32)(MinY - Y);
+        u32 R = Color & 0xFF, G = (Color >> 8) & 0xFF, B = (Color >> 16) & 0xFF;
+        /* brightness 80h is 1.0, the texels come out unchanged, like raw ones */
+        Raw = Raw || 0x808080 == (Color & 0xFFFFFF);
+        /* the same for every row: U only depends on the column */
+        Bool8 Contiguous = Raster_IsTexelRowContiguous(&Texture, StartU, StepU, Count);
+        Bool8 Copy = Raw && !SemiTransparent && !CheckMask;
+
+        u32 Span[GPU_VRAM_WIDTH];
+        u16 Texels[GPU_VRAM_WIDTH];
+        for (i32 y = MinY; y <= MaxY; y++, TexV += StepV)
+        {
+            if (Contiguous)
+            {
+                switch (Texture.Depth)
+                {
+                case 0:  Raster_FetchContiguousTexelRow(Texels, Gpu->Vram, &Texture, StartU, StepU, TexV & 0xFF, Count, 0); break;
+                case 1:  Raster_FetchContiguousTexelRow(Texels, Gpu->Vram, &Texture, StartU, StepU, TexV & 0xFF, Count, 1); break;
+                default: Raster_FetchContiguousTexelRow(Texels, Gpu->Vram, &Texture, StartU, StepU, TexV & 0xFF, Count, 2); break;
+                }
+            }
+            else switch (Texture.Depth)
+            {
+            case 0:  Raster_FetchTexelRow(Texels, Gpu->Vram, &Texture, StartU, StepU, TexV & 0xFF, Count, 0); break;
+            case 1:  Raster_FetchTexelRow(Texels, Gpu->Vram, &Texture, StartU, StepU, TexV & 0xFF, Count, 1); break;
+            default: Raster_FetchTexelRow(Texels, Gpu->Vram, &Texture, StartU, StepU, TexV & 0xFF, Count, 2); break;
+            }
+
+            u16 *Dst = &Gpu->Vram[y*GPU_VRAM_WIDTH + MinX];
+            if (Copy)
+            {
+                Raster_CopyTexelRow(Dst, Texels, Count, SetMask? 0x8000 : 0);
+                if (Up)
+                    Raster_UpscaleCopyTexelRow(Up, Texels, Count, MinX, y, SetMask? 0x8000 : 0);
+                continue;
+            }
+            switch (Raw << 1 | SemiTransparent)
+            {
+            case 0: Raster_ShadeTexelRow(Span, Texels, Count, R, G, B, false, false); break;
+            case 1: Raster_ShadeTexelRow(Span, Texels, Count, R, G, B, false, true); break;
+            case 2: Raster_ShadeTexelRow(Span, Texels, Count, R, G, B, true, false); break;
+            case 3: Raster_ShadeTexelRow(Span, Texels, Count, R, G, B, true, true); break;
+            }
+            SpanFn(Dst, Span, Count, MinX, y);
+            if (Up)
+                Raster_UpscaleSpan(Up, SpanFn, Span, Count, MinX, y);
+        }
+    }
+    return PixelCount;
+}
+
+
+
+
+
+/*==================================================================================
+ *
+ *                                      LINES
+ *
+ *==================================================================================*/
+
+/* hands the pixels gathered so far to the span kernel, and to the shadow's */
+FORCE_INLINE void Raster_FlushLineRun(GPU *Gpu, Raster_SpanFn SpanFn, const u32 *Span, uint *RunCount, i32 RunX, i32 RunY)
+{
+    if (*RunCount)
+    {
+        SpanFn(&Gpu->Vram[RunY*GPU_VRAM_WIDTH + RunX], Span, *RunCount, RunX, RunY);
+        if (Gpu->Upscaler)
+            Raster_UpscaleSpan(Gpu->Upscaler, SpanFn, Span, *RunCount, RunX, RunY);
+    }
+    *RunCount = 0;
+}
+
+u32 Raster_DrawLine(GPU *Gpu, const Raster_Vertex *V0, const Raster_Vertex *V1, u32 Flags)
+{
+    i32 Dx = V1->X - V0->X;
+    i32 Dy = V1->Y - V0->Y;
+    if (Dx < 0) /* always walk left to right, x major lines then advance by exactly one pixel per step */
+    {
+        const Raster_Vertex *Tmp = V0;
+        V0 = V1;
+        V1 = Tmp;
+        Dx = -Dx;
+        Dy = -Dy;
+    }
+    i32 AbsDy = Dy < 0? -Dy : Dy;
+    if (Dx >= GPU_VRAM_WIDTH || AbsDy >= GPU_VRAM_HEIGHT) /* the GPU skips these */
+        return 0;
+
+    i32 ClipLeft = Gpu->DrawingAreaLeft;
+    i32 ClipTop = Gpu->DrawingAreaTop;
+    i32 ClipRight = MIN((i32)Gpu->DrawingAreaRight, GPU_VRAM_WIDTH - 1);
+    i32 ClipBottom = MIN((i32)Gpu->DrawingAreaBottom, GPU_VRAM_HEIGHT - 1);
+    i32 MinX = MAX(V0->X, ClipLeft);
+    i32 MaxX = MIN(V1->X, ClipRight);
+    i32 MinY = MAX(MIN(V0->Y, V1->Y), ClipTop);
+    i32 MaxY = MIN(MAX(V0->Y, V1->Y), ClipBottom);
+    if (MinX > MaxX || MinY > MaxY)
+        return 0;
+
+    Bool8 Shaded = (Flags & RASTER_SHADED) != 0;
+    Bool8 SemiTransparent = (Flags & RASTER_SEMI_TRANSPARENT) != 0;
+    Raster_SpanFn SpanFn = Raster_GetSpanFn(
+        SemiTransparent? Raster_GetBlendMode(Gpu->Status.SemiTransparency) : RASTER_BLEND_OPAQUE,
+        Gpu->Status.DitherEnable && Shaded,
+        Gpu->Status.SetMaskBitOnDraw,
+        Gpu->Status.PreserveMaskedPixel
+    );
+    u32 BlendFlag = SemiTransparent? RASTER_PIXEL_BLEND : 0;
+
+    /* 
+     * DDA in 32.32 fixed point, starting from the center of the first pixel.
+     * Lines going up are biased down slightly so that halfway points round towards the start,
+     * that way both endpoints are always hit exactly
+     */
+    i32 Steps = MAX(Dx, AbsDy);
+    i64 StepX = 0, StepY = 0;
+    if (Steps)
+    {
+        StepX = (i64)Dx * ((i64)1 << 32) / Steps;
+        StepY = (i64)Dy * ((i64)1 << 32) / Steps;
+    }
+    i64 X = (i64)V0->X * ((i64)1 << 32) + ((i64)1 << 31);
+    i64 Y = (i64)V0->Y * ((i64)1 << 32) + ((i64)1 << 31);
+    if (StepY < 0)
+        Y -= 1024;
+
+    /* colors in 16.16 fixed point */
+    i32 Color[3], ColorStep[3] = { 0 };
+    for (uint i = 0; i < 3; i++)
+    {
+        i32 Start = (V0->Color >> i*8) & 0xFF;
+        i32 End = (V1->Color >> i*8) & 0xFF;
+        Color[i] = Start * 65536 + 0x8000;
+        if (Shaded && Steps)
+            ColorStep[i] = (End - Start) * 65536 / Steps;
+    }
+    u32 FlatColor = (V0->Color & 0xFFFFFF) | BlendFlag;
+
+    /* consecutive pixels on the same row are drawn as one span */
+    GPU_MarkDirty(Gpu, MinX, MinY, MaxX - MinX + 1, MaxY - MinY + 1);
+    Raster_UpscaleBeginWrite(Gpu, MinX, MinY, MaxX - MinX + 1, MaxY - MinY + 1);
+    u32 Span[GPU_VRAM_WIDTH];
+    uint RunCount = 0;
+    i32 RunX = 0, RunY = 0;
+    u32 PixelCount = 0;
+    for (i32 i = 0; i <= Steps; i++)
+    {
+        i32 PixelX = (i32)(X >> 32);
+        i32 PixelY = (i32)(Y >> 32);
+        u32 Pixel = FlatColor;
+        if (Shaded)
+        {
+            Pixel = (u32)(Color[0] >> 16)
+                | (u32)(Color[1] >> 16) << 8
+                | (u32)(Color[2] >> 16) << 16 
+                | BlendFlag;
+            Color[0] += ColorStep[0];
+            Color[1] += ColorStep[1];
+            Color[2] += ColorStep[2];
+        }
+        X += StepX;
+        Y += StepY;
+
+        if (!IN_RANGE(ClipLeft, PixelX, ClipRight) || !IN_RANGE(ClipTop, PixelY, ClipBottom))
+        {
+            Raster_FlushLineRun(Gpu, SpanFn, Span, &RunCount, RunX, RunY);
+            continue;
+        }
+        if (RunCount && (PixelY != RunY || PixelX != RunX + (i32)RunCount))
+            Raster_FlushLineRun(Gpu, SpanFn, Span, &RunCount, RunX, RunY);
+        if (0 == RunCount)
+        {
+            RunX = PixelX;
+            RunY = PixelY;
+        }
+        Span[RunCount++] = Pixel;
+        PixelCount++;
+    }
+    Raster_FlushLineRun(Gpu, SpanFn, Span, &RunCount, RunX, RunY);
+    return PixelCount;
+}
+
+
+
+
+
+/*==================================================================================
+ *
+ *                              UPSCALED SHADOW VRAM
+ *
+ *==================================================================================*/
+
+/* splits a rectangle that wraps around the edges of VRAM into (up to 4) rectangles that don't */
+static uint Raster_SplitRect(u32 X, u32 Y, u32 Width, u32 Height, Raster_Rect Out[4])
+{
+    X %= GPU_VRAM_WIDTH;
+    Y %= GPU_VRAM_HEIGHT;
+    Width = MIN(Width, GPU_VRAM_WIDTH);
+    Height = MIN(Height, GPU_VRAM_HEIGHT);
+    if (0 == Width || 0 == Height)
+        return 0;
+
+    i32 Columns[2][2] = { { X, MIN(X + Width, GPU_VRAM_WIDTH) - 1 }, { 0, (i32)(X + Width) - GPU_VRAM_WIDTH - 1 } };
+    i32 Rows[2][2] = { { Y, MIN(Y + Height, GPU_VRAM_HEIGHT) - 1 }, { 0, (i32)(Y + Height) - GPU_VRAM_HEIGHT - 1 } };
+    uint Count = 0;
+    for (uint r = 0; r < 2; r++)
+    {
+        for (uint c = 0; c < 2; c++)
+        {
+            if (Rows[r][0] <= Rows[r][1] && Columns[c][0] <= Columns[c][1])
+                Out[Count++] = (Raster_Rect) { Columns[c][0], Rows[r][0], Columns[c][1], Rows[r][1] };
+        }
+    }
+    return Count;
+}
+
+static Bool8 Raster_RectsOverlap(Raster_Rect A, Raster_Rect B)
+{
+    return A.Left <= B.Right && B.Left <= A.Right 
+        && A.Top <= B.Bottom && B.Top <= A.Bottom;
+}
+
+static Raster_Rect Raster_RectUnion(Raster_Rect A, Raster_Rect B)
+{
+    return (Raster_Rect) {
+        MIN(A.Left, B.Left), MIN(A.Top, B.Top),
+        MAX(A.Right, B.Right), MAX(A.Bottom, B.Bottom),
+    };
+}
+
+/* nearest neighbor copy of a VRAM rectangle to the shadow */
+static void Raster_UpscaleCopy(Raster_Upscaler *Up, const u16 *Vram, Raster_Rect Rect)
+{
+    uint Scale = Up->Scale;
+    uint Width = Rect.Right - Rect.Left + 1;
+    for (i32 y = Rect.Top; y <= Rect.Bottom; y++)
+    {
+        const u16 *Src = &Vram[y*GPU_VRAM_WIDTH + Rect.Left];
+        u16 *Row = &Up->Vram[(y*Scale)*Up->Pitch + Rect.Left*Scale];
+        uint x = 0;
+#ifdef HAS_SSE2
+        if (2 == Scale || 4 == Scale)
+        {
+            for (; x + 8 <= Width; x += 8)
+            {
+                __m128i Pixels = _mm_loadu_si128((const __m128i *)(Src + x));
+                __m128i Lo = _mm_unpacklo_epi16(Pixels, Pixels);
+                __m128i Hi = _mm_unpackhi_epi16(Pixels, Pixels);
+                u16 *Dst = Row + x*Scale;
+                if (2 == Scale)
+                {
+                    _mm_storeu_si128((__m128i *)(Dst + 0), Lo);
+                    _mm_storeu_si128((__m128i *)(Dst + 8), Hi);
+                }
+                else
+                {
+                    _mm_storeu_si128((__m128i *)(Dst + 0), _mm_unpacklo_epi32(Lo, Lo));
+                    _mm_storeu_si128((__m128i *)(Dst + 8), _mm_unpackhi_epi32(Lo, Lo));
+                    _mm_storeu_si128((__m128i *)(Dst + 16), _mm_unpacklo_epi32(Hi, Hi));
+                    _mm_storeu_si128((__m128i *)(Dst + 24), _mm_unpackhi_epi32(Hi, Hi));
+                }
+            }
+        }
+#endif /* HAS_SSE2 */
+        for (; x < Width; x++)
+        {
+            for (uint k = 0; k < Scale; k++)
+                Row[x*Scale + k] = Src[x];
+        }
+        for (uint k = 1; k < Scale; k++)
+            memcpy(Row + k*Up->Pitch, Row, Width*Scale*sizeof(u16));
+    }
+}
+
+static void Raster_UpscaleDrawBand(Raster_Upscaler *Up, uint Band)
+{
+    uint BandCount = Up->WorkerCount + 1;
+    for (uint i = 0; i < Up->QueueCount; i++)
+    {
+        Raster_RasterizeTriangle(&Up->Queue[i], Up->TextureVram, 
+            Up->Vram, Up->Pitch, Up->Scale, 
+            Band, BandCount
+        );
+    }
+}
+
+static void Raster_UpscaleWorkerMain(void *UserData)
+{
+    Raster_UpscaleWorker *Worker = UserData;
+    Raster_Upscaler *Up = Worker->Upscaler;
+    u64 Generation = 0;
+    for (;;)
+    {
+        Platform_MutexLock(&Up->Lock);
+        while (Generation == Up->Generation && !Up->Quit)
+            Platform_CondVarWait(&Up->WorkReady, &Up->Lock);
+        if (Up->Quit)
+        {
+            Platform_MutexUnlock(&Up->Lock);
+            break;
+        }
+        Generation = Up->Generation;
+        Platform_MutexUnlock(&Up->Lock);
+
+        Raster_UpscaleDrawBand(Up, Worker->Band);
+
+        Platform_MutexLock(&Up->Lock);
+        if (0 == --Up->WorkersBusy)
+            Platform_CondVarSignal(&Up->WorkDone);
+        Platform_MutexUnlock(&Up->Lock);
+    }
+}
+
+/* draws the queued polygons to the shadow, all threads at once */
+static void Raster_UpscaleFlush(Raster_Upscaler *Up)
+{
+    if (0 == Up->QueueCount)
+        return;
+
+    Platform_MutexLock(&Up->Lock);
+    Up->WorkersBusy = Up->WorkerCount;
+    Up->Generation++;
+    Platform_CondVarBroadcast(&Up->WorkReady);
+    Platform_MutexUnlock(&Up->Lock);
+
+    Raster_UpscaleDrawBand(Up, 0);
+
+    Platform_MutexLock(&Up->Lock);
+    while (Up->WorkersBusy)
+        Platform_CondVarWait(&Up->WorkDone, &Up->Lock);
+    Platform_MutexUnlock(&Up->Lock);
+
+    Up->QueueCount = 0;
+    Up->HasTextureBounds = false;
+}
+
+/* 
+ * Queued polygons read their textures from VRAM when they are flushed, 
+ * so anything written over those textures has to wait for them.
+ * Writes other than polygons also have to come after the polygons under them, since they're copied over the shadow
+ */
+static void Raster_UpscalePrepareWrite(Raster_Upscaler *Up, Raster_Rect Rect, Bool8 Polygon)
+{
+    if (0 == Up->QueueCount)
+        return;
+    if ((Up->HasTextureBounds && Raster_RectsOverlap(Rect, Up->TextureBounds))
+    || (!Polygon && Raster_RectsOverlap(Rect, Up->DrawBounds)))
+    {
+        Raster_UpscaleFlush(Up);
+    }
+}
+
+static void Raster_UpscaleAddTextureBounds(Raster_Upscaler *Up, u32 X, u32 Y, u32 Width, u32 Height)
+{
+    Raster_Rect Rects[4];
+    uint Count = Raster_SplitRect(X, Y, Width, Height, Rects);
+    for (uint i = 0; i < Count; i++)
+    {
+        Up->TextureBounds = Up->HasTextureBounds
+            ? Raster_RectUnion(Up->TextureBounds, Rects[i])
+            : Rects[i];
+        Up->HasTextureBounds = true;
+    }
+}
+
+static void Raster_UpscaleQueueTriangle(Raster_Upscaler *Up, const GPU *Gpu, const Raster_Triangle *Tri)
+{
+    if (RASTER_UPSCALE_QUEUE_SIZE == Up->QueueCount)
+        Raster_UpscaleFlush(Up);
+
+    Raster_Rect Bounds = { Tri->MinX, Tri->MinY, Tri->MaxX, Tri->MaxY };
+    Up->DrawBounds = Up->QueueCount
+        ? Raster_RectUnion(Up->DrawBounds, Bounds)
+        : Bounds;
+    if (Tri->Flags & RASTER_TEXTURED)
+    {
+        /* the whole texture page, and the CLUT if there is one */
+        const Raster_Texture *Texture = &Tri->Texture;
+        uint Depth = MIN(Texture->Depth, 2);
+        Raster_UpscaleAddTextureBounds(Up, Texture->PageX, Texture->PageY, 64 << Depth, 256);
+        if (Depth < 2)
+            Raster_UpscaleAddTextureBounds(Up, Texture->ClutX, Texture->ClutY, 0 == Depth? 16 : 256, 1);
+    }
+    Up->TextureVram = Gpu->Vram;
+    Up->Queue[Up->QueueCount++] = *Tri;
+}
+
+
+Bool8 Raster_AttachUpscaler(GPU *Gpu, uint Scale, uint ThreadCount)
+{
+    ASSERT(NULL == Gpu->Upscaler);
+    ASSERT(IN_RANGE(2, Scale, RASTER_MAX_SCALE));
+    Raster_Upscaler *Up = calloc(1, sizeof *Up);
+    if (NULL == Up)
+        return false;
+    Up->Scale = Scale;
+    Up->Pitch = GPU_VRAM_WIDTH * Scale;
+    Up->Vram = malloc(GPU_VRAM_SIZE * Scale * Scale);
+    Up->Queue = malloc(RASTER_UPSCALE_QUEUE_SIZE * sizeof(Raster_Triangle));
+    if (NULL == Up->Vram || NULL == Up->Queue)
+    {
+        free(Up->Vram);
+        free(Up->Queue);
+        free(Up);
+        return false;
+    }
+
+    Platform_MutexInit(&Up->Lock);
+    Platform_CondVarInit(&Up->WorkReady);
+    Platform_CondVarInit(&Up->WorkDone);
+    /* the flushing thread draws too, so it counts as one */
+    uint WorkerCount = MIN(MAX(ThreadCount, 1) - 1, RASTER_UPSCALE_MAX_THREADS);
+    for (uint i = 0; i < WorkerCount; i++)
+    {
+        Raster_UpscaleWorker *Worker = &Up->Workers[i];
+        Worker->Upscaler = Up;
+        Worker->Band = i + 1;
+        if (!Platform_ThreadCreate(&Worker->Thread, Raster_UpscaleWorkerMain, Worker))
+            break;
+        Up->WorkerCount++;
+    }
+
+    Gpu->Upscaler = Up;
+    Raster_UpscaleCopy(Up, Gpu->Vram, (Raster_Rect) { 0, 0, GPU_VRAM_WIDTH - 1, GPU_VRAM_HEIGHT - 1 });
+    return true;
+}
+
+void Raster_DetachUpscaler(GPU *Gpu)
+{
+    Raster_Upscaler *Up = Gpu->Upscaler;
+    if (NULL == Up)
+        return;
+
+    Platform_MutexLock(&Up->Lock);
+    Up->Quit = true;
+    Platform_CondVarBroadcast(&Up->WorkReady);
+    Platform_MutexUnlock(&Up->Lock);
+    for (uint i = 0; i < Up->WorkerCount; i++)
+        Platform_ThreadJoin(&Up->Workers[i].Thread);
+
+    Platform_CondVarDestroy(&Up->WorkDone);
+    Platform_CondVarDestroy(&Up->WorkReady);
+    Platform_MutexDestroy(&Up->Lock);
+    free(Up->Vram);
+    free(Up->Queue);
+    free(Up);
+    Gpu->Upscaler = NULL;
+}
+
+const u16 *Raster_GetUpscaledVram(GPU *Gpu, uint *OutScale)
+{
+    Raster_Upscaler *Up = Gpu->Upscaler;
+    if (NULL == Up)
+    {
+        *OutScale = 1;
+        return Gpu->Vram;
+    }
+    Raster_UpscaleFlush(Up);
+    *OutScale = Up->Scale;
+    return Up->Vram;
+}
+
+uint Raster_GetUpscalerThreadCount(const GPU *Gpu)
+{
+    return Gpu->Upscaler? Gpu->Upscaler->WorkerCount + 1 : 0;
+}
+
+void Raster_UpscaleBeginWrite(GPU *Gpu, u32 X, u32 Y, u32 Width, u32 Height)
+{
+    if (NULL == Gpu->Upscaler)
+        return;
+    Raster_Rect Rects[4];
+    uint Count = Raster_SplitRect(X, Y, Width, Height, Rects);
+    for (uint i = 0; i < Count; i++)
+        Raster_UpscalePrepareWrite(Gpu->Upscaler, Rects[i], false);
+}
+
+void Raster_UpscaleEndWrite(GPU *Gpu, u32 X, u32 Y, u32 Width, u32 Height)
+{
+    if (NULL == Gpu->Upscaler)
+        return;
+    Raster_Rect Rects[4];
+    uint Count = Raster_SplitRect(X, Y, Width, Height, Rects);
+    for (uint i = 0; i < Count; i++)
+        Raster_UpscaleCopy(Gpu->Upscaler, Gpu->Vram, Rects[i]);
+}
+
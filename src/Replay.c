@@ -0,0 +1,276 @@
+
+/*
+ * Replays a GPU capture (PS1Emu --capture-gpu) without the CPU, as fast as possible.
+ * This is a separate executable built from the same sources as Build.c, see build.bat.
+ * Usage: Replay <capture file> [--passes count] [--scale 1|2|4]
+ *
+ * The timed passes feed whole records through GPU_WriteGP0Block and report frames/s,
+ * with --scale the upscaled VRAM is also brought up to date at every vblank, like the display does,
+ * then one profiling pass times every GP0 command separately and reports time per opcode.
+ */
+
+#define PS1_NO_MAIN
+#define PS1_NO_FRONTEND
+#include "Build.c"
+
+#include <string.h> /* strcmp, memset */
+
+
+typedef struct Replay_OpcodeStats
+{
+    u64 Count;
+    u64 Ticks;
+} Replay_OpcodeStats;
+
+typedef struct Replay
+{
+    const u32 *Words;
+    uint WordCount;
+    GPU Gpu;
+
+    Replay_OpcodeStats GP0[256];
+    Replay_OpcodeStats GP1;
+    u64 FrameCount;
+} Replay;
+
+
+static const char *Replay_OpcodeName(u8 Opcode)
+{
+    switch (Opcode)
+    {
+    case 0x00: return "nop";
+    case 0x01: return "clear texture cache";
+    case 0x02: return "fill rectangle";
+    case 0xE1: return "draw mode";
+    case 0xE2: return "texture window";
+    case 0xE3: return "drawing area top left";
+    case 0xE4: return "drawing area bottom right";
+    case 0xE5: return "drawing offset";
+    case 0xE6: return "mask bits";
+    }
+    static const char *sGroupNames[8] = {
+        "misc", "polygon", "line", "rectangle", "VRAM to VRAM copy", "CPU to VRAM", "VRAM to CPU", "environment",
+    };
+    return sGroupNames[Opcode >> 5];
+}
+
+static Bool8 Replay_Load(Replay *Rp, const char *FileName)
+{
+    FILE *f = fopen(FileName, "rb");
+    if (NULL == f)
+    {
+        printf("Unable to open %s.\n", FileName);
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    iSize FileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    u32 *Words = malloc(FileSize);
+    Bool8 Ok = NULL != Words
+        && FileSize >= 2*(iSize)sizeof(u32)
+        && fread(Words, 1, FileSize, f) == (size_t)FileSize;
+    fclose(f);
+
+    if (!Ok || CAPTURE_MAGIC != Words[0] || CAPTURE_VERSION != Words[1])
+    {
+        printf("%s is not a GPU capture (version %d).\n", FileName, CAPTURE_VERSION);
+        free(Words);
+        return false;
+    }
+    Rp->Words = Words + 2;
+    Rp->WordCount = FileSize / sizeof(u32) - 2;
+    return true;
+}
+
+static void Replay_ResetGpu(Replay *Rp)
+{
+    /* the capture starts from a GPU reset with VRAM cleared */
+    Raster_UpscaleBeginWrite(&Rp->Gpu, 0, 0, GPU_VRAM_WIDTH, GPU_VRAM_HEIGHT);
+    memset(Rp->Gpu.Vram, 0, GPU_VRAM_SIZE);
+    Raster_UpscaleEndWrite(&Rp->Gpu, 0, 0, GPU_VRAM_WIDTH, GPU_VRAM_HEIGHT);
+    GPU_Reset(&Rp->Gpu, NULL);
+}
+
+/* the GPU is between commands */
+static Bool8 Replay_GpuIdle(const GPU *Gpu)
+{
+    return GP0_COMMAND == Gpu->GP0Mode && 0 == Gpu->CommandWordsRemain;
+}
+
+static void Replay_Run(Replay *Rp, Bool8 Profile)
+{
+    Replay_ResetGpu(Rp);
+    GPU *Gpu = &Rp->Gpu;
+    const u32 *Words = Rp->Words;
+    uint Index = 0;
+    u8 CurrentOpcode = 0; /* command that was still receiving words at the end of the previous record */
+    Rp->FrameCount = 0;
+
+    while (Index < Rp->WordCount)
+    {
+        u32 Header = Words[Index++];
+        u32 Count = CAPTURE_RECORD_COUNT(Header);
+        if (Index + Count > Rp->WordCount)
+        {
+            printf("Capture is truncated.\n");
+            break;
+        }
+
+        const u32 *Data = &Words[Index];
+        Index += Count;
+        switch (CAPTURE_RECORD_TYPE(Header))
+        {
+        case CAPTURE_GP0:
+        {
+            if (!Profile)
+            {
+                GPU_WriteGP0Block(Gpu, Data, Count);
+                break;
+            }
+
+            /* one command (and its image data) at a time */
+            uint i = 0;
+            while (i < Count)
+            {
+                u64 Start = Platform_GetTicks();
+                Bool8 NewCommand = Replay_GpuIdle(Gpu);
+                if (NewCommand)
+                {
+                    CurrentOpcode = Data[i] >> 24;
+                    GPU_WriteGP0(Gpu, Data[i++]);
+                }
+                while (!Replay_GpuIdle(Gpu) && i < Count)
+                {
+                    uint Chunk = MIN(Gpu->CommandWordsRemain, Count - i);
+                    GPU_WriteGP0Block(Gpu, &Data[i], Chunk);
+                    i += Chunk;
+                }
+                Replay_OpcodeStats *Stats = &Rp->GP0[CurrentOpcode];
+                Stats->Ticks += Platform_GetTicks() - Start;
+                Stats->Count += NewCommand;
+            }
+        } break;
+        case CAPTURE_GP1:
+        {
+            u64 Start = Profile? Platform_GetTicks() : 0;
+            for (u32 i = 0; i < Count; i++)
+                GPU_WriteGP1(Gpu, Data[i]);
+            if (Profile)
+            {
+                Rp->GP1.Ticks += Platform_GetTicks() - Start;
+                Rp->GP1.Count += Count;
+            }
+        } break;
+        case CAPTURE_VBLANK:
+        {
+            if (Gpu->Upscaler)
+            {
+                uint Scale;
+                Raster_GetUpscaledVram(Gpu, &Scale);
+            }
+            GPU_EndFrame(Gpu);
+            Rp->FrameCount++;
+        } break;
+        default:
+        {
+            printf("Unknown record %08x at word %u.\n", Header, Index - Count - 1);
+            Index = Rp->WordCount;
+        } break;
+        }
+    }
+}
+
+static void Replay_PrintStats(const char *Name, const Replay_OpcodeStats *Stats, double TicksPerSecond)
+{
+    double Ms = (double)Stats->Ticks * 1000.0 / TicksPerSecond;
+    printf("    %-30s %10llu %12.3f ms %10.1f ns/cmd\n",
+        Name, (unsigned long long)Stats->Count, Ms,
+        Stats->Count? Ms * 1e6 / (double)Stats->Count : 0.0
+    );
+}
+
+int main(int argc, char **argv)
+{
+    const char *FileName = NULL;
+    uint PassCount = 5;
+    uint Scale = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--passes") && i + 1 < argc)
+        {
+            int Count = atoi(argv[++i]);
+            PassCount = (uint)MAX(1, Count);
+        }
+        else if (0 == strcmp(argv[i], "--scale") && i + 1 < argc)
+        {
+            Scale = strtoul(argv[++i], NULL, 0);
+            if (1 != Scale && 2 != Scale && 4 != Scale)
+            {
+                printf("Scale must be 1, 2 or 4.\n");
+                return 1;
+            }
+        }
+        else FileName = argv[i];
+    }
+    if (NULL == FileName)
+    {
+        printf("Usage: %s <capture file> [--passes count] [--scale 1|2|4]\n", argv[0]);
+        return 1;
+    }
+
+    Replay *Rp = calloc(1, sizeof *Rp);
+    ASSERT(Rp != NULL);
+    Rp->Gpu.Vram = malloc(GPU_VRAM_SIZE);
+    ASSERT(Rp->Gpu.Vram != NULL);
+    if (!Replay_Load(Rp, FileName))
+        return 1;
+    if (Scale > 1 && !Raster_AttachUpscaler(&Rp->Gpu, Scale, Platform_CpuCount()))
+    {
+        printf("Not enough memory to render at %ux.\n", Scale);
+        return 1;
+    }
+
+    double TicksPerSecond = (double)Platform_TicksPerSecond();
+    double BestSeconds = 0;
+    for (uint Pass = 0; Pass < PassCount; Pass++)
+    {
+        u64 Start = Platform_GetTicks();
+        Replay_Run(Rp, false);
+        double Seconds = (double)(Platform_GetTicks() - Start) / TicksPerSecond;
+        if (0 == Pass || Seconds < BestSeconds)
+            BestSeconds = Seconds;
+    }
+    printf("%s: %llu frames, %u words, %ux on %u threads\n", 
+        FileName, (unsigned long long)Rp->FrameCount, Rp->WordCount, 
+        Scale, MAX(1, Raster_GetUpscalerThreadCount(&Rp->Gpu))
+    );
+    printf("    best of %u passes: %.3f ms, %.1f frames/s\n",
+        PassCount, BestSeconds * 1000.0, (double)Rp->FrameCount / BestSeconds
+    );
+
+    GPU_Stats Stats;
+    if (GPU_GetFrameStats(&Rp->Gpu, &Stats))
+    {
+        char Text[512];
+        GPU_FormatStats(&Stats, Text, sizeof Text);
+        printf("last frame:\n%s\n", Text);
+    }
+
+    /* the per command timings include the timer overhead, so they're a separate pass */
+    Replay_Run(Rp, true);
+    printf("per command (profiling pass):\n");
+    printf("    %-30s %10s %15s %17s\n", "GP0 opcode", "count", "total", "average");
+    for (uint Opcode = 0; Opcode < 256; Opcode++)
+    {
+        if (0 == Rp->GP0[Opcode].Count && 0 == Rp->GP0[Opcode].Ticks)
+            continue;
+        char Name[64];
+        snprintf(Name, sizeof Name, "%02X %s", Opcode, Replay_OpcodeName((u8)Opcode));
+        Replay_PrintStats(Name, &Rp->GP0[Opcode], TicksPerSecond);
+    }
+    Replay_PrintStats("GP1", &Rp->GP1, TicksPerSecond);
+    Raster_DetachUpscaler(&Rp->Gpu);
+    return 0;
+}
+
@@ -0,0 +1,1265 @@
+#include <string.h> /* memcpy, memset */
+
+#include "Common.h"
+#include "Ps1.h"
+#include "Platform.h"
+#include "CDROM.h"
+#include "SPU.h"
+
+
+/* register offsets from 1F801C00h */
+#define SPU_REG_VOICE_LEVEL 0x0C        /* of each voice, 10h apart */
+#define SPU_REG_MAIN_VOLUME 0x180
+#define SPU_REG_REVERB_VOLUME 0x184     /* output, left and right */
+#define SPU_REG_KEY_ON 0x188
+#define SPU_REG_KEY_OFF 0x18C
+#define SPU_REG_PITCH_MOD 0x190
+#define SPU_REG_NOISE_ON 0x194
+#define SPU_REG_REVERB_ON 0x198
+#define SPU_REG_ENDX 0x19C
+#define SPU_REG_REVERB_BASE 0x1A2
+#define SPU_REG_IRQ_ADDR 0x1A4
+#define SPU_REG_TRANSFER_ADDR 0x1A6
+#define SPU_REG_FIFO 0x1A8
+#define SPU_REG_CONTROL 0x1AA
+#define SPU_REG_STATUS 0x1AE
+#define SPU_REG_CD_VOLUME 0x1B0
+#define SPU_REG_CURRENT_MAIN_VOLUME 0x1B8
+#define SPU_REG_REVERB_CONFIG 0x1C0     /* 32 registers, see SPU_ReverbReg */
+#define SPU_REG_CURRENT_VOLUMES 0x200   /* left and right of each voice, 4 apart */
+
+/* SPUCNT */
+#define SPU_CTRL_ENABLE 0x8000
+#define SPU_CTRL_UNMUTE 0x4000
+#define SPU_CTRL_REVERB 0x0080          /* the reverb writes to its work area */
+#define SPU_CTRL_IRQ_ENABLE 0x0040
+#define SPU_CTRL_CD_REVERB 0x0004
+#define SPU_CTRL_CD_AUDIO 0x0001
+#define SPU_TRANSFER_MODE(control) (((control) >> 4) & 3)
+#define SPU_TRANSFER_DMA_WRITE 2
+#define SPU_TRANSFER_DMA_READ 3
+
+/* ADPCM block flags */
+#define SPU_FLAG_LOOP_END 0x01
+#define SPU_FLAG_LOOP_REPEAT 0x02
+#define SPU_FLAG_LOOP_START 0x04
+
+/*
+ * the first 4KB of sound RAM get what's being mixed, halfwords that wrap around in each of 4 buffers:
+ * CD left, CD right, voice 1, voice 3
+ */
+#define SPU_CAPTURE_HALFWORDS 0x200
+
+/* a register pair of 1 bit per voice, voices 0..15 in the first one */
+#define SPU_VOICE_BITS(spu_ptr, offset) \
+    ((u32)(spu_ptr)->Regs[(offset) / 2] | (u32)(spu_ptr)->Regs[(offset) / 2 + 1] << 16)
+
+/* 
+ * the reverb registers from 1F801DC0h, named as in psx-spx: 
+ * d is a distance and m an address in the work area, both in 8 bytes from the current position; v is a volume
+ */
+typedef enum SPU_ReverbReg
+{
+    SPU_REVERB_DAPF1 = 0, SPU_REVERB_DAPF2,
+    SPU_REVERB_VIIR,
+    SPU_REVERB_VCOMB1, SPU_REVERB_VCOMB2, SPU_REVERB_VCOMB3, SPU_REVERB_VCOMB4,
+    SPU_REVERB_VWALL,
+    SPU_REVERB_VAPF1, SPU_REVERB_VAPF2,
+    SPU_REVERB_MLSAME, SPU_REVERB_MRSAME,
+    SPU_REVERB_MLCOMB1, SPU_REVERB_MRCOMB1, SPU_REVERB_MLCOMB2, SPU_REVERB_MRCOMB2,
+    SPU_REVERB_DLSAME, SPU_REVERB_DRSAME,
+    SPU_REVERB_MLDIFF, SPU_REVERB_MRDIFF,
+    SPU_REVERB_MLCOMB3, SPU_REVERB_MRCOMB3, SPU_REVERB_MLCOMB4, SPU_REVERB_MRCOMB4,
+    SPU_REVERB_DLDIFF, SPU_REVERB_DRDIFF,
+    SPU_REVERB_MLAPF1, SPU_REVERB_MRAPF1, SPU_REVERB_MLAPF2, SPU_REVERB_MRAPF2,
+    SPU_REVERB_VLIN, SPU_REVERB_VRIN,
+} SPU_ReverbReg;
+
+/* where each step of the reverb reads and writes (SPU_Reverb::Taps), the writes first */
+typedef enum SPU_ReverbTap
+{
+    SPU_TAP_IIR = 0,        /* 4: the outputs of the IIR filters, mLSAME, mRSAME, mLDIFF, mRDIFF */
+    SPU_TAP_APF = 4,        /* 4: what goes into the all pass filters' delays, mLAPF1, mRAPF1, mLAPF2, mRAPF2 */
+    SPU_TAP_WRITE_COUNT = 8,
+    SPU_TAP_IIR_PREV = 8,   /* 4: the IIR filters' previous outputs, a halfword before theirs */
+    SPU_TAP_IIR_WALL = 12,  /* 4: their inputs from the work area, dLSAME, dRSAME, dRDIFF, dLDIFF */
+    SPU_TAP_COMB = 16,      /* 8: mLCOMB1..4, mRCOMB1..4 */
+    SPU_TAP_APF_DELAYED = 24,   /* 4: the all pass filters' delays, mLAPF1 - dAPF1 and so on */
+} SPU_ReverbTap;
+
+#define SPU_REVERB_STEPS (SPU_BLOCK_FRAMES / 2)
+
+/* ADPCM prediction filters, in 1/64 */
+static const i8 sSPU_FilterPos[5] = { 0, 60, 115, 98, 122 };
+static const i8 sSPU_FilterNeg[5] = { 0, 0, -52, -55, -60 };
+
+/* the address register of each SPU_ReverbTap */
+static const u8 sSPU_ReverbTapRegs[SPU_REVERB_TAPS] = {
+    SPU_REVERB_MLSAME, SPU_REVERB_MRSAME, SPU_REVERB_MLDIFF, SPU_REVERB_MRDIFF,
+    SPU_REVERB_MLAPF1, SPU_REVERB_MRAPF1, SPU_REVERB_MLAPF2, SPU_REVERB_MRAPF2,
+    SPU_REVERB_MLSAME, SPU_REVERB_MRSAME, SPU_REVERB_MLDIFF, SPU_REVERB_MRDIFF,
+    SPU_REVERB_DLSAME, SPU_REVERB_DRSAME, SPU_REVERB_DRDIFF, SPU_REVERB_DLDIFF,
+    SPU_REVERB_MLCOMB1, SPU_REVERB_MLCOMB2, SPU_REVERB_MLCOMB3, SPU_REVERB_MLCOMB4,
+    SPU_REVERB_MRCOMB1, SPU_REVERB_MRCOMB2, SPU_REVERB_MRCOMB3, SPU_REVERB_MRCOMB4,
+    SPU_REVERB_MLAPF1, SPU_REVERB_MRAPF1, SPU_REVERB_MLAPF2, SPU_REVERB_MRAPF2,
+};
+
+
+/* a voice through a block of frames, filled by SPU_StepVoice a frame at a time for the SIMD part */
+typedef struct SPU_VoiceBlock
+{
+    i16 Taps[SPU_BLOCK_FRAMES][4];  /* the 4 samples up to each frame's position, oldest first */
+    u8 Phase[SPU_BLOCK_FRAMES];     /* of the interpolation */
+    i32 Gain[SPU_BLOCK_FRAMES];     /* ADSR level */
+    i32 Volume[2][SPU_BLOCK_FRAMES];
+    i32 Out[SPU_BLOCK_FRAMES];      /* interpolated, times the ADSR level */
+} SPU_VoiceBlock;
+
+
+static i16 SPU_Clamp16(i32 Value)
+{
+    return (i16)MIN(MAX(Value, -0x8000), 0x7FFF);
+}
+
+/*
+ * The hardware's interpolation table is Gaussian shaped, this is the cubic B-spline instead:
+ * the polynomial approximation of a Gaussian, about as wide as the hardware's.
+ * Frame positions are between the 2nd and 3rd taps; each phase sums to 8000h, 1.0 in 1.15 fixed point.
+ */
+static void SPU_BuildGaussTaps(i16 Taps[256][4])
+{
+    for (i64 t = 0; t < 256; t++)
+    {
+        /* in 1/(6 * 256^3) */
+        i64 Weights[4] = {
+            (256 - t)*(256 - t)*(256 - t),
+            3*t*t*t - 6*256*t*t + 4*256*256*256,
+            -3*t*t*t + 3*256*t*t + 3*256*256*t + 256*256*256,
+            t*t*t,
+        };
+        i32 Sum = 0;
+        for (uint k = 0; k < 4; k++)
+        {
+            Taps[t][k] = (i16)((Weights[k] + 1536) / 3072);
+            Sum += Taps[t][k];
+        }
+        Taps[t][1] += (i16)(0x8000 - Sum); /* rounding */
+    }
+}
+
+/* the IRQ goes off when the SPU touches the IRQ address, Size bytes from Addr (wrapping around) */
+static void SPU_CheckIrq(SPU *Spu, u32 Addr, u32 Size)
+{
+    u32 IrqAddr = (u32)Spu->Regs[SPU_REG_IRQ_ADDR / 2] * 8;
+    if ((Spu->Control & SPU_CTRL_IRQ_ENABLE) && ((IrqAddr - Addr) & (SPU_RAM_SIZE - 1)) < Size)
+    {
+        Spu->IrqFlag = true;
+        /* TODO: this is interrupt 9 (I_STAT bit 9), there's no interrupt controller yet */
+    }
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Envelopes
+ *
+ *==================================================================================*/
+
+/*
+ * Rate is shift << 2 | step: the level moves by a step of 7 - step (or -8 + step when decreasing),
+ * shifted up when shift < 11, or it moves less often when shift > 11
+ */
+static void SPU_SetEnvelope(SPU_Envelope *Env, uint Rate, Bool8 Decreasing, Bool8 Exponential)
+{
+    i32 Step = 7 - (i32)(Rate & 3);
+    if (Decreasing)
+        Step = ~Step;
+    Env->Counter = 0;
+    Env->Increment = 0x8000;
+    if (Rate < 44)
+        Step *= 1 << (11 - (Rate >> 2));
+    else if (Rate >= 48)
+        Env->Increment >>= (Rate >> 2) - 11;
+    Env->Step = Step;
+    Env->Rate = (u8)Rate;
+    Env->Decreasing = Decreasing;
+    Env->Exponential = Exponential;
+}
+
+/* one frame, returns the new level (0..7FFFh) */
+static i32 SPU_TickEnvelope(SPU_Envelope *Env, i32 Level)
+{
+    i32 Step = Env->Step;
+    u32 Increment = Env->Increment;
+    if (Env->Exponential)
+    {
+        /* decreasing goes in proportion to the level, increasing slows down past 6000h */
+        if (Env->Decreasing)
+        {
+            Step = (Step * Level) >> 15;
+        }
+        else if (Level >= 0x6000)
+        {
+            if (Env->Rate < 40)
+            {
+                Step >>= 2;
+            }
+            else if (Env->Rate >= 44)
+            {
+                Increment >>= 2;
+            }
+            else
+            {
+                Step >>= 1;
+                Increment >>= 1;
+            }
+        }
+    }
+
+    Env->Counter += Increment;
+    if (Env->Counter < 0x8000)
+        return Level;
+    Env->Counter = 0;
+    return MIN(MAX(Level + Step, 0), 0x7FFF);
+}
+
+/* bit 15 set: a sweep (bit 14 exponential, 13 decreasing, 12 negative, 0..6 rate); otherwise a fixed volume / 2 */
+static void SPU_SetVolume(SPU_Volume *Volume, u16 Data)
+{
+    Volume->Reg = Data;
+    if (Data & 0x8000)
+        SPU_SetEnvelope(&Volume->Sweep, Data & 0x7F, 0 != (Data & 0x2000), 0 != (Data & 0x4000));
+    else Volume->Level = (i16)(Data << 1);
+}
+
+static void SPU_TickVolume(SPU_Volume *Volume)
+{
+    if (!(Volume->Reg & 0x8000))
+        return;
+
+    /* the sweep moves the magnitude, the phase bit gives the sign */
+    i32 Magnitude = MIN(Volume->Level < 0? -Volume->Level : Volume->Level, 0x7FFF);
+    Magnitude = SPU_TickEnvelope(&Volume->Sweep, Magnitude);
+    Volume->Level = (i16)(Volume->Reg & 0x1000? -Magnitude : Magnitude);
+}
+
+static void SPU_SetAdsrPhase(SPU_Voice *Voice, SPU_AdsrPhase Phase)
+{
+    u16 Lo = Voice->AdsrLo, Hi = Voice->AdsrHi;
+    Voice->Phase = Phase;
+    switch (Phase)
+    {
+    case SPU_ADSR_ATTACK:   SPU_SetEnvelope(&Voice->Adsr, Lo >> 8 & 0x7F, false, Lo >> 15); break;
+    case SPU_ADSR_DECAY:    SPU_SetEnvelope(&Voice->Adsr, (Lo >> 4 & 0xF) << 2, true, true); break;
+    case SPU_ADSR_SUSTAIN:  SPU_SetEnvelope(&Voice->Adsr, Hi >> 6 & 0x7F, Hi >> 14 & 1, Hi >> 15); break;
+    case SPU_ADSR_RELEASE:  SPU_SetEnvelope(&Voice->Adsr, (Hi & 0x1F) << 2, true, Hi >> 5 & 1); break;
+    case SPU_ADSR_OFF: break;
+    }
+}
+
+static void SPU_TickAdsr(SPU_Voice *Voice)
+{
+    Voice->Level = (i16)SPU_TickEnvelope(&Voice->Adsr, Voice->Level);
+    switch (Voice->Phase)
+    {
+    case SPU_ADSR_ATTACK:
+    {
+        if (Voice->Level >= 0x7FFF)
+            SPU_SetAdsrPhase(Voice, SPU_ADSR_DECAY);
+    } break;
+    case SPU_ADSR_DECAY:
+    {
+        i32 SustainLevel = MIN(((Voice->AdsrLo & 0xF) + 1) * 0x800, 0x7FFF);
+        if (Voice->Level <= SustainLevel)
+            SPU_SetAdsrPhase(Voice, SPU_ADSR_SUSTAIN);
+    } break;
+    case SPU_ADSR_RELEASE:
+    {
+        if (0 == Voice->Level)
+            Voice->Phase = SPU_ADSR_OFF;
+    } break;
+    case SPU_ADSR_SUSTAIN: /* until key off */
+    case SPU_ADSR_OFF: break;
+    }
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Voices
+ *
+ *==================================================================================*/
+
+/* the ADPCM block at Voice->Addr goes into Samples, after the last 3 samples of the previous one */
+static void SPU_DecodeBlock(SPU *Spu, SPU_Voice *Voice)
+{
+    const u8 *Block = Spu->Ram + Voice->Addr;
+    uint Shift = Block[0] & 0xF;
+    uint Filter = MIN(Block[0] >> 4 & 7, 4);
+    if (Shift > 12) /* reserved, behaves like 9 */
+        Shift = 9;
+    Voice->Flags = Block[1];
+    if (Voice->Flags & SPU_FLAG_LOOP_START)
+        Voice->RepeatAddr = Voice->Addr;
+    SPU_CheckIrq(Spu, Voice->Addr, 16);
+
+    i16 Raw[32];
+#ifdef HAS_SSE2
+    /* 
+     * every byte in 2 lanes with its nibbles at the top, low one first (see XA_ExpandGroup), 
+     * then the rest of the lane is cleared and the nibble shifted down 
+     */
+    u8 Data[16] = { 0 };
+    memcpy(Data, Block + 2, SPU_ADPCM_SAMPLES / 2);
+    const __m128i NibbleToTop = _mm_setr_epi16(4096, 1, 4096, 1, 4096, 1, 4096, 1);
+    const __m128i TopNibble = _mm_set1_epi16((i16)0xF000);
+    __m128i ShiftCount = _mm_cvtsi32_si128((int)Shift);
+    __m128i Bytes = _mm_loadu_si128((const __m128i *)Data);
+    __m128i DoubledLo = _mm_unpacklo_epi8(Bytes, Bytes);
+    __m128i DoubledHi = _mm_unpackhi_epi8(Bytes, Bytes);
+    __m128i Nibbles[4] = {
+        _mm_unpacklo_epi16(DoubledLo, DoubledLo), _mm_unpackhi_epi16(DoubledLo, DoubledLo),
+        _mm_unpacklo_epi16(DoubledHi, DoubledHi), _mm_unpackhi_epi16(DoubledHi, DoubledHi),
+    };
+    for (uint i = 0; i < 4; i++)
+    {
+        __m128i Samples = _mm_and_si128(_mm_mullo_epi16(Nibbles[i], NibbleToTop), TopNibble);
+        _mm_storeu_si128((__m128i *)(Raw + i*8), _mm_sra_epi16(Samples, ShiftCount));
+    }
+#else
+    for (uint i = 0; i < SPU_ADPCM_SAMPLES; i++)
+    {
+        i16 Nibble = (i16)(((Block[2 + i/2] >> (i & 1? 4 : 0)) & 0xF) << 12);
+        Raw[i] = Nibble >> Shift;
+    }
+#endif /* HAS_SSE2 */
+
+    i32 K0 = sSPU_FilterPos[Filter];
+    i32 K1 = sSPU_FilterNeg[Filter];
+    i32 Old = Voice->Old;
+    i32 Older = Voice->Older;
+    memcpy(Voice->Samples, Voice->Samples + SPU_ADPCM_SAMPLES, 3*sizeof(i16));
+    for (uint i = 0; i < SPU_ADPCM_SAMPLES; i++)
+    {
+        i32 Sample = SPU_Clamp16(Raw[i] + ((Old*K0 + Older*K1 + 32) >> 6));
+        Voice->Samples[3 + i] = (i16)Sample;
+        Older = Old;
+        Old = Sample;
+    }
+    Voice->Old = (i16)Old;
+    Voice->Older = (i16)Older;
+}
+
+/* the voice is done with its ADPCM block */
+static void SPU_NextBlock(SPU *Spu, uint Index)
+{
+    SPU_Voice *Voice = &Spu->Voices[Index];
+    if (Voice->Flags & SPU_FLAG_LOOP_END)
+    {
+        Spu->Endx |= 1u << Index;
+        Voice->Addr = Voice->RepeatAddr;
+        if (!(Voice->Flags & SPU_FLAG_LOOP_REPEAT))
+        {
+            Voice->Phase = SPU_ADSR_OFF;
+            Voice->Level = 0;
+        }
+    }
+    else
+    {
+        Voice->Addr = (Voice->Addr + 16) & (SPU_RAM_SIZE - 1);
+    }
+    SPU_DecodeBlock(Spu, Voice);
+}
+
+static void SPU_KeyOn(SPU *Spu, uint Index)
+{
+    SPU_Voice *Voice = &Spu->Voices[Index];
+    Voice->Addr = Voice->StartAddr;
+    Voice->Counter = 0;
+    Voice->Old = 0;
+    Voice->Older = 0;
+    memset(Voice->Samples, 0, sizeof Voice->Samples);
+    Voice->Level = 0;
+    SPU_SetAdsrPhase(Voice, SPU_ADSR_ATTACK);
+    Spu->Endx &= ~(1u << Index);
+    SPU_DecodeBlock(Spu, Voice);
+}
+
+static void SPU_KeyOff(SPU *Spu, uint Index)
+{
+    SPU_Voice *Voice = &Spu->Voices[Index];
+    if (SPU_ADSR_OFF != Voice->Phase)
+        SPU_SetAdsrPhase(Voice, SPU_ADSR_RELEASE);
+}
+
+static i16 SPU_TickNoise(SPU *Spu)
+{
+    uint Step = 4 + (Spu->Control >> 8 & 3);
+    uint Shift = Spu->Control >> 10 & 0xF;
+    Spu->NoiseTimer -= (i32)Step;
+    if (Spu->NoiseTimer < 0)
+    {
+        u16 Level = (u16)Spu->NoiseLevel;
+        uint Parity = (Level >> 15 ^ Level >> 12 ^ Level >> 11 ^ Level >> 10 ^ 1) & 1;
+        Spu->NoiseLevel = (i16)(Level << 1 | Parity);
+        Spu->NoiseTimer += 0x20000 >> Shift;
+        if (Spu->NoiseTimer < 0)
+            Spu->NoiseTimer += 0x20000 >> Shift;
+    }
+    return Spu->NoiseLevel;
+}
+
+/*
+ * The serial part of a voice's block: pitch, ADPCM blocks, ADSR and volume sweeps, a frame at a time.
+ * Modulator is the previous voice's output with pitch modulation on, NULL otherwise;
+ * Noise replaces the samples of noise voices, NULL otherwise.
+ */
+static void SPU_StepVoice(SPU *Spu, uint Index, uint FrameCount, const i32 *Modulator, const i16 *Noise, SPU_VoiceBlock *Block)
+{
+    SPU_Voice *Voice = &Spu->Voices[Index];
+    for (uint i = 0; i < FrameCount; i++)
+    {
+        if (Noise)
+        {
+            /* the taps sum to 1.0 */
+            for (uint k = 0; k < 4; k++)
+                Block->Taps[i][k] = Noise[i];
+        }
+        else memcpy(Block->Taps[i], Voice->Samples + (Voice->Counter >> 12), sizeof Block->Taps[i]);
+        Block->Phase[i] = (u8)(Voice->Counter >> 4);
+        Block->Gain[i] = Voice->Level;
+        Block->Volume[0][i] = Voice->Volume[0].Level;
+        Block->Volume[1][i] = Voice->Volume[1].Level;
+
+        u32 Step = Voice->Pitch;
+        if (Modulator) /* 8000h + the modulator is the factor, 8000h is 1.0; pitches past 7FFFh are taken as signed */
+            Step = (u32)(((i32)(i16)Step * (Modulator[i] + 0x8000)) >> 15) & 0xFFFF;
+        Voice->Counter += MIN(Step, 0x4000);
+        if (Voice->Counter >= SPU_ADPCM_SAMPLES << 12) /* at most 4 samples per frame */
+        {
+            Voice->Counter -= SPU_ADPCM_SAMPLES << 12;
+            SPU_NextBlock(Spu, Index);
+        }
+
+        if (SPU_ADSR_OFF != Voice->Phase)
+            SPU_TickAdsr(Voice);
+        SPU_TickVolume(&Voice->Volume[0]);
+        SPU_TickVolume(&Voice->Volume[1]);
+    }
+}
+
+/* the 4 taps of each frame through the weights of its phase, times the ADSR level */
+static void SPU_Interpolate(const SPU *Spu, SPU_VoiceBlock *Block, uint FrameCount)
+{
+    uint i = 0;
+#ifdef HAS_SSE2
+    const __m128i Low16 = _mm_set1_epi32(0xFFFF);
+    for (; i + 4 <= FrameCount; i += 4)
+    {
+        /* 2 frames per register, madd adds their taps in pairs, then the pairs of each frame are added */
+        __m128i Taps01 = _mm_loadu_si128((const __m128i *)Block->Taps[i]);
+        __m128i Taps23 = _mm_loadu_si128((const __m128i *)Block->Taps[i + 2]);
+        __m128i Weights01 = _mm_unpacklo_epi64(
+            _mm_loadl_epi64((const __m128i *)Spu->GaussTaps[Block->Phase[i + 0]]),
+            _mm_loadl_epi64((const __m128i *)Spu->GaussTaps[Block->Phase[i + 1]])
+        );
+        __m128i Weights23 = _mm_unpacklo_epi64(
+            _mm_loadl_epi64((const __m128i *)Spu->GaussTaps[Block->Phase[i + 2]]),
+            _mm_loadl_epi64((const __m128i *)Spu->GaussTaps[Block->Phase[i + 3]])
+        );
+        __m128 Pairs01 = _mm_castsi128_ps(_mm_madd_epi16(Taps01, Weights01));
+        __m128 Pairs23 = _mm_castsi128_ps(_mm_madd_epi16(Taps23, Weights23));
+        __m128i Even = _mm_castps_si128(_mm_shuffle_ps(Pairs01, Pairs23, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i Odd = _mm_castps_si128(_mm_shuffle_ps(Pairs01, Pairs23, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i Sample = _mm_srai_epi32(_mm_add_epi32(Even, Odd), 15);
+
+        /* the sample fits in 16 bits and the level's top half is 0: madd is a 32 bit multiply */
+        __m128i Gain = _mm_loadu_si128((const __m128i *)(Block->Gain + i));
+        __m128i Out = _mm_srai_epi32(_mm_madd_epi16(_mm_and_si128(Sample, Low16), Gain), 15);
+        _mm_storeu_si128((__m128i *)(Block->Out + i), Out);
+    }
+#endif /* HAS_SSE2 */
+    for (; i < FrameCount; i++)
+    {
+        const i16 *Taps = Block->Taps[i];
+        const i16 *Weights = Spu->GaussTaps[Block->Phase[i]];
+        i32 Sample = (Taps[0]*Weights[0] + Taps[1]*Weights[1] + Taps[2]*Weights[2] + Taps[3]*Weights[3]) >> 15;
+        Block->Out[i] = (Sample * Block->Gain[i]) >> 15;
+    }
+}
+
+/* the voice's output through its volumes, added to the mix */
+static void SPU_Accumulate(const SPU_VoiceBlock *Block, uint FrameCount, i32 Mix[2][SPU_BLOCK_FRAMES])
+{
+    for (uint Side = 0; Side < 2; Side++)
+    {
+        const i32 *Volume = Block->Volume[Side];
+        i32 *Out = Mix[Side];
+        uint i = 0;
+#ifdef HAS_SSE2
+        const __m128i Low16 = _mm_set1_epi32(0xFFFF);
+        for (; i + 4 <= FrameCount; i += 4)
+        {
+            /* with the sample's top half cleared, madd is sample * volume even for a negative volume */
+            __m128i Sample = _mm_and_si128(_mm_loadu_si128((const __m128i *)(Block->Out + i)), Low16);
+            __m128i Product = _mm_madd_epi16(Sample, _mm_loadu_si128((const __m128i *)(Volume + i)));
+            __m128i Sum = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(Out + i)), _mm_srai_epi32(Product, 15));
+            _mm_storeu_si128((__m128i *)(Out + i), Sum);
+        }
+#endif /* HAS_SSE2 */
+        for (; i < FrameCount; i++)
+            Out[i] += (Block->Out[i] * Volume[i]) >> 15;
+    }
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Reverb
+ *
+ *==================================================================================*/
+
+/*
+ * A step, with L and R for each side:
+ *     IIR:         [mLSAME] = (Lin + [dLSAME]*vWALL - [mLSAME - 1])*vIIR + [mLSAME - 1]
+ *                  and the same for mRSAME (Rin, dRSAME), mLDIFF (Lin, dRDIFF), mRDIFF (Rin, dLDIFF)
+ *     comb:        L = [mLCOMB1]*vCOMB1 + [mLCOMB2]*vCOMB2 + [mLCOMB3]*vCOMB3 + [mLCOMB4]*vCOMB4
+ *     all pass:    L -= [mLAPF1 - dAPF1]*vAPF1, [mLAPF1] = L, L = L*vAPF1 + [mLAPF1 - dAPF1]; then the same with APF2
+ *     output:      L*vLOUT
+ * the work area isn't written unless SPUCNT bit 7 is set, the output still comes from what's in it.
+ * Products are (a * b) >> 15, results are clamped to 16 bits where they're stored (and in the same places
+ * by the SIMD code: packs), so the step at a time and the stage at a time ways agree to the bit.
+ */
+
+/* the taps' offsets in the ring, and whether they're far enough apart to do a block a stage at a time */
+static void SPU_ConfigureReverb(SPU *Spu)
+{
+    SPU_Reverb *Reverb = &Spu->Reverb;
+    const u16 *Regs = Spu->Regs + SPU_REG_REVERB_CONFIG / 2;
+    Reverb->Base = (u32)Spu->Regs[SPU_REG_REVERB_BASE / 2] * 8;
+    Reverb->Size = (SPU_RAM_SIZE - Reverb->Base) / 2;
+    Reverb->Pos %= Reverb->Size;
+    for (uint t = 0; t < SPU_REVERB_TAPS; t++)
+    {
+        i64 Offset = (i64)Regs[sSPU_ReverbTapRegs[t]] * 4;
+        if (IN_RANGE(SPU_TAP_IIR_PREV, t, SPU_TAP_IIR_PREV + 3))
+            Offset -= 1;
+        else if (t >= SPU_TAP_APF_DELAYED)
+            Offset -= (i64)Regs[SPU_REVERB_DAPF1 + (t - SPU_TAP_APF_DELAYED) / 2] * 4;
+        Reverb->Taps[t] = (u32)((Offset % Reverb->Size + Reverb->Size) % Reverb->Size);
+    }
+
+    /*
+     * A block a stage at a time reads everything first and writes everything last, so a step reading what an earlier step
+     * of the block wrote (or what its own step wrote, to be safe) would get the old value; reading ahead of a write is fine,
+     * the presets do that a lot, 4 halfwords ahead. The IIR filters' own previous outputs are kept by their stage.
+     * Writes must stay a block apart from each other for the last one to win.
+     */
+    Reverb->Overlaps = false;
+    for (uint w = 0; w < SPU_TAP_WRITE_COUNT; w++)
+    {
+        for (uint t = 0; t < SPU_REVERB_TAPS; t++)
+        {
+            if (t == w || t == SPU_TAP_IIR_PREV + w)
+                continue;
+            u32 Ahead = (Reverb->Taps[t] + Reverb->Size - Reverb->Taps[w]) % Reverb->Size;
+            u32 Behind = Reverb->Size - Ahead;
+            if (0 == Ahead || Behind < SPU_REVERB_STEPS || (t < SPU_TAP_WRITE_COUNT && Ahead < SPU_REVERB_STEPS))
+                Reverb->Overlaps = true;
+        }
+    }
+}
+
+static u8 *SPU_ReverbAddr(SPU *Spu, u32 Tap, uint Step)
+{
+    const SPU_Reverb *Reverb = &Spu->Reverb;
+    return Spu->Ram + Reverb->Base + (Reverb->Pos + Tap + Step) % Reverb->Size * 2;
+}
+
+/* Count halfwords of the ring from Tap, for that many steps */
+static void SPU_ReverbRead(SPU *Spu, u32 Tap, i16 *Halfwords, uint Count)
+{
+    const SPU_Reverb *Reverb = &Spu->Reverb;
+    u32 Index = (Reverb->Pos + Tap) % Reverb->Size;
+    while (Count)
+    {
+        uint Run = MIN(Count, Reverb->Size - Index);
+        memcpy(Halfwords, Spu->Ram + Reverb->Base + Index*2, Run*sizeof(i16));
+        Halfwords += Run;
+        Count -= Run;
+        Index = 0;
+    }
+}
+
+static void SPU_ReverbWrite(SPU *Spu, u32 Tap, const i16 *Halfwords, uint Count)
+{
+    const SPU_Reverb *Reverb = &Spu->Reverb;
+    u32 Index = (Reverb->Pos + Tap) % Reverb->Size;
+    while (Count)
+    {
+        uint Run = MIN(Count, Reverb->Size - Index);
+        memcpy(Spu->Ram + Reverb->Base + Index*2, Halfwords, Run*sizeof(i16));
+        Halfwords += Run;
+        Count -= Run;
+        Index = 0;
+    }
+}
+
+/* the IRQ address checked against everything the block's steps touch, once per tap */
+static void SPU_ReverbCheckIrq(SPU *Spu, uint StepCount, Bool8 Writes)
+{
+    const SPU_Reverb *Reverb = &Spu->Reverb;
+    if (!(Spu->Control & SPU_CTRL_IRQ_ENABLE))
+        return;
+    for (uint t = Writes? 0 : SPU_TAP_COMB; t < SPU_REVERB_TAPS; t++)
+    {
+        u32 Index = (Reverb->Pos + Reverb->Taps[t]) % Reverb->Size;
+        uint Run = MIN(StepCount, Reverb->Size - Index);
+        SPU_CheckIrq(Spu, Reverb->Base + Index*2, Run*2);
+        if (Run < StepCount)
+            SPU_CheckIrq(Spu, Reverb->Base, MIN(StepCount - Run, Reverb->Size)*2);
+    }
+}
+
+static i16 SPU_ReverbVolume(const SPU *Spu, SPU_ReverbReg Reg)
+{
+    return (i16)Spu->Regs[SPU_REG_REVERB_CONFIG / 2 + Reg];
+}
+
+/* one step with every access going through sound RAM, for when the taps are close together; writes are always on */
+static void SPU_ReverbStep(SPU *Spu, uint Step, const i16 Input[2], i16 Output[2])
+{
+    const SPU_Reverb *Reverb = &Spu->Reverb;
+    i32 In[2] = {
+        SPU_Clamp16((Input[0] * SPU_ReverbVolume(Spu, SPU_REVERB_VLIN)) >> 15),
+        SPU_Clamp16((Input[1] * SPU_ReverbVolume(Spu, SPU_REVERB_VRIN)) >> 15),
+    };
+    i32 Wall = SPU_ReverbVolume(Spu, SPU_REVERB_VWALL);
+    i32 Iir = SPU_ReverbVolume(Spu, SPU_REVERB_VIIR);
+    for (uint k = 0; k < 4; k++)
+    {
+        i16 Prev, Reflected;
+        memcpy(&Prev, SPU_ReverbAddr(Spu, Reverb->Taps[SPU_TAP_IIR_PREV + k], Step), sizeof Prev);
+        memcpy(&Reflected, SPU_ReverbAddr(Spu, Reverb->Taps[SPU_TAP_IIR_WALL + k], Step), sizeof Reflected);
+        i32 Diff = SPU_Clamp16(In[k & 1] + ((Reflected * Wall) >> 15) - Prev);
+        i16 Filtered = SPU_Clamp16(((Diff * Iir) >> 15) + Prev);
+        memcpy(SPU_ReverbAddr(Spu, Reverb->Taps[SPU_TAP_IIR + k], Step), &Filtered, sizeof Filtered);
+    }
+
+    i32 Sample[2];
+    for (uint Side = 0; Side < 2; Side++)
+    {
+        i32 Sum = 0;
+        for (uint k = 0; k < 4; k++)
+        {
+            i16 Comb;
+            memcpy(&Comb, SPU_ReverbAddr(Spu, Reverb->Taps[SPU_TAP_COMB + Side*4 + k], Step), sizeof Comb);
+            Sum += (Comb * SPU_ReverbVolume(Spu, SPU_REVERB_VCOMB1 + k)) >> 15;
+        }
+        Sample[Side] = SPU_Clamp16(Sum);
+    }
+    for (uint Stage = 0; Stage < 2; Stage++)
+    {
+        i32 Volume = SPU_ReverbVolume(Spu, SPU_REVERB_VAPF1 + Stage);
+        for (uint Side = 0; Side < 2; Side++)
+        {
+            i16 Delayed;
+            memcpy(&Delayed, SPU_ReverbAddr(Spu, Reverb->Taps[SPU_TAP_APF_DELAYED + Stage*2 + Side], Step), sizeof Delayed);
+            i16 Delay = SPU_Clamp16(Sample[Side] - ((Delayed * Volume) >> 15));
+            memcpy(SPU_ReverbAddr(Spu, Reverb->Taps[SPU_TAP_APF + Stage*2 + Side], Step), &Delay, sizeof Delay);
+            Sample[Side] = SPU_Clamp16(((Delay * Volume) >> 15) + Delayed);
+        }
+    }
+    for (uint Side = 0; Side < 2; Side++)
+        Output[Side] = SPU_Clamp16((Sample[Side] * (i16)Spu->Regs[SPU_REG_REVERB_VOLUME / 2 + Side]) >> 15);
+}
+
+#ifdef HAS_SSE2
+/* (A * B) >> 15 of 8 halfwords, the first 4 in *Lo and the other 4 in *Hi */
+static void SPU_MulHalfwords(__m128i A, __m128i B, __m128i *Lo, __m128i *Hi)
+{
+    __m128i ProductLo = _mm_mullo_epi16(A, B);
+    __m128i ProductHi = _mm_mulhi_epi16(A, B);
+    *Lo = _mm_srai_epi32(_mm_unpacklo_epi16(ProductLo, ProductHi), 15);
+    *Hi = _mm_srai_epi32(_mm_unpackhi_epi16(ProductLo, ProductHi), 15);
+}
+#endif /* HAS_SSE2 */
+
+static void SPU_ReverbScale(const i16 *Samples, i16 Volume, i16 *Out, uint Count)
+{
+    uint i = 0;
+#ifdef HAS_SSE2
+    for (; i + 8 <= Count; i += 8)
+    {
+        __m128i Lo, Hi;
+        SPU_MulHalfwords(_mm_loadu_si128((const __m128i *)(Samples + i)), _mm_set1_epi16(Volume), &Lo, &Hi);
+        _mm_storeu_si128((__m128i *)(Out + i), _mm_packs_epi32(Lo, Hi));
+    }
+#endif /* HAS_SSE2 */
+    for (; i < Count; i++)
+        Out[i] = SPU_Clamp16((Samples[i] * Volume) >> 15);
+}
+
+/*
+ * The 4 IIR filters of the whole block: each is a recurrence, so it goes a step at a time, one filter per SSE lane.
+ * Prev is what each filter wrote last, Out gets what they write.
+ */
+static void SPU_ReverbIir(const SPU *Spu, i16 In[2][SPU_REVERB_STEPS], i16 Reflected[4][SPU_REVERB_STEPS], const i16 Prev[4],
+    i16 Out[4][SPU_REVERB_STEPS], uint Count)
+{
+    i16 Wall = SPU_ReverbVolume(Spu, SPU_REVERB_VWALL);
+    i16 Iir = SPU_ReverbVolume(Spu, SPU_REVERB_VIIR);
+#ifdef HAS_SSE2
+    /* a volume in the low half of each lane and 0 in the top one, madd with a sample the same way is a 16x16 multiply */
+    const __m128i WallVolume = _mm_set1_epi32((u16)Wall);
+    const __m128i IirVolume = _mm_set1_epi32((u16)Iir);
+    const __m128i Zero = _mm_setzero_si128();
+    __m128i Last = _mm_setr_epi32(Prev[0], Prev[1], Prev[2], Prev[3]);
+    for (uint i = 0; i < Count; i++)
+    {
+        __m128i Input = _mm_setr_epi32(In[0][i], In[1][i], In[0][i], In[1][i]);
+        __m128i Wet = _mm_setr_epi32((u16)Reflected[0][i], (u16)Reflected[1][i], (u16)Reflected[2][i], (u16)Reflected[3][i]);
+        __m128i Sum = _mm_add_epi32(Input, _mm_srai_epi32(_mm_madd_epi16(Wet, WallVolume), 15));
+        __m128i Diff = _mm_unpacklo_epi16(_mm_packs_epi32(_mm_sub_epi32(Sum, Last), Zero), Zero);
+        __m128i Filtered = _mm_add_epi32(_mm_srai_epi32(_mm_madd_epi16(Diff, IirVolume), 15), Last);
+        Filtered = _mm_packs_epi32(Filtered, Filtered);
+        Last = _mm_srai_epi32(_mm_unpacklo_epi16(Filtered, Filtered), 16);
+
+        i16 Lanes[8];
+        _mm_storeu_si128((__m128i *)Lanes, Filtered);
+        for (uint k = 0; k < 4; k++)
+            Out[k][i] = Lanes[k];
+    }
+#else
+    i32 Last[4] = { Prev[0], Prev[1], Prev[2], Prev[3] };
+    for (uint i = 0; i < Count; i++)
+    {
+        for (uint k = 0; k < 4; k++)
+        {
+            i32 Diff = SPU_Clamp16(In[k & 1][i] + ((Reflected[k][i] * Wall) >> 15) - Last[k]);
+            Last[k] = SPU_Clamp16(((Diff * Iir) >> 15) + Last[k]);
+            Out[k][i] = (i16)Last[k];
+        }
+    }
+#endif /* HAS_SSE2 */
+}
+
+/* the comb filter of one side: 4 taps through their volumes */
+static void SPU_ReverbComb(const SPU *Spu, i16 Taps[4][SPU_REVERB_STEPS], i16 *Out, uint Count)
+{
+    i16 Volumes[4];
+    for (uint k = 0; k < 4; k++)
+        Volumes[k] = SPU_ReverbVolume(Spu, SPU_REVERB_VCOMB1 + k);
+
+    uint i = 0;
+#ifdef HAS_SSE2
+    for (; i + 8 <= Count; i += 8)
+    {
+        __m128i SumLo = _mm_setzero_si128();
+        __m128i SumHi = _mm_setzero_si128();
+        for (uint k = 0; k < 4; k++)
+        {
+            __m128i Lo, Hi;
+            SPU_MulHalfwords(_mm_loadu_si128((const __m128i *)(Taps[k] + i)), _mm_set1_epi16(Volumes[k]), &Lo, &Hi);
+            SumLo = _mm_add_epi32(SumLo, Lo);
+            SumHi = _mm_add_epi32(SumHi, Hi);
+        }
+        _mm_storeu_si128((__m128i *)(Out + i), _mm_packs_epi32(SumLo, SumHi));
+    }
+#endif /* HAS_SSE2 */
+    for (; i < Count; i++)
+    {
+        i32 Sum = 0;
+        for (uint k = 0; k < 4; k++)
+            Sum += (Taps[k][i] * Volumes[k]) >> 15;
+        Out[i] = SPU_Clamp16(Sum);
+    }
+}
+
+/* Samples through an all pass filter: Delayed is what comes out of its delay, Delay gets what goes in */
+static void SPU_ReverbAllPass(i16 *Samples, const i16 *Delayed, i16 Volume, i16 *Delay, uint Count)
+{
+    uint i = 0;
+#ifdef HAS_SSE2
+    const __m128i Volumes = _mm_set1_epi16(Volume);
+    for (; i + 8 <= Count; i += 8)
+    {
+        __m128i Old = _mm_loadu_si128((const __m128i *)(Delayed + i));
+        __m128i Sample = _mm_loadu_si128((const __m128i *)(Samples + i));
+        __m128i OldLo = _mm_srai_epi32(_mm_unpacklo_epi16(Old, Old), 16);
+        __m128i OldHi = _mm_srai_epi32(_mm_unpackhi_epi16(Old, Old), 16);
+        __m128i Lo, Hi;
+        SPU_MulHalfwords(Old, Volumes, &Lo, &Hi);
+        __m128i In = _mm_packs_epi32(
+            _mm_sub_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(Sample, Sample), 16), Lo),
+            _mm_sub_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(Sample, Sample), 16), Hi)
+        );
+        _mm_storeu_si128((__m128i *)(Delay + i), In);
+        SPU_MulHalfwords(In, Volumes, &Lo, &Hi);
+        _mm_storeu_si128((__m128i *)(Samples + i), _mm_packs_epi32(_mm_add_epi32(Lo, OldLo), _mm_add_epi32(Hi, OldHi)));
+    }
+#endif /* HAS_SSE2 */
+    for (; i < Count; i++)
+    {
+        i16 In = SPU_Clamp16(Samples[i] - ((Delayed[i] * Volume) >> 15));
+        Delay[i] = In;
+        Samples[i] = SPU_Clamp16(((In * Volume) >> 15) + Delayed[i]);
+    }
+}
+
+/* the block's steps a stage at a time: everything they read is read first and everything they write is written last */
+static void SPU_ReverbStages(SPU *Spu, i16 Input[2][SPU_REVERB_STEPS], i16 Output[2][SPU_REVERB_STEPS], uint StepCount, Bool8 Writes)
+{
+    const SPU_Reverb *Reverb = &Spu->Reverb;
+    i16 Taps[SPU_REVERB_TAPS][SPU_REVERB_STEPS];
+    for (uint t = Writes? SPU_TAP_IIR_WALL : SPU_TAP_COMB; t < SPU_REVERB_TAPS; t++)
+        SPU_ReverbRead(Spu, Reverb->Taps[t], Taps[t], StepCount);
+
+    if (Writes) /* the IIR filters only go to the work area */
+    {
+        i16 In[2][SPU_REVERB_STEPS];
+        i16 Prev[4];
+        SPU_ReverbScale(Input[0], SPU_ReverbVolume(Spu, SPU_REVERB_VLIN), In[0], StepCount);
+        SPU_ReverbScale(Input[1], SPU_ReverbVolume(Spu, SPU_REVERB_VRIN), In[1], StepCount);
+        for (uint k = 0; k < 4; k++)
+            SPU_ReverbRead(Spu, Reverb->Taps[SPU_TAP_IIR_PREV + k], &Prev[k], 1);
+        SPU_ReverbIir(Spu, In, Taps + SPU_TAP_IIR_WALL, Prev, Taps + SPU_TAP_IIR, StepCount);
+    }
+
+    SPU_ReverbComb(Spu, Taps + SPU_TAP_COMB, Output[0], StepCount);
+    SPU_ReverbComb(Spu, Taps + SPU_TAP_COMB + 4, Output[1], StepCount);
+    for (uint Stage = 0; Stage < 2; Stage++)
+    {
+        for (uint Side = 0; Side < 2; Side++)
+        {
+            uint Filter = Stage*2 + Side;
+            SPU_ReverbAllPass(Output[Side], Taps[SPU_TAP_APF_DELAYED + Filter], SPU_ReverbVolume(Spu, SPU_REVERB_VAPF1 + Stage),
+                Taps[SPU_TAP_APF + Filter], StepCount
+            );
+        }
+    }
+    for (uint Side = 0; Side < 2; Side++)
+        SPU_ReverbScale(Output[Side], (i16)Spu->Regs[SPU_REG_REVERB_VOLUME / 2 + Side], Output[Side], StepCount);
+
+    if (Writes)
+    {
+        for (uint t = 0; t < SPU_TAP_WRITE_COUNT; t++)
+            SPU_ReverbWrite(Spu, Reverb->Taps[t], Taps[t], StepCount);
+    }
+}
+
+/*
+ * Input goes into the reverb, Output gets what comes out of it, a frame each.
+ * A step takes the average of 2 frames, the frames get the steps' output interpolated, one frame late.
+ */
+static void SPU_ReverbBlock(SPU *Spu, i32 Input[2][SPU_BLOCK_FRAMES], i16 Output[2][SPU_BLOCK_FRAMES], uint FrameCount)
+{
+    SPU_Reverb *Reverb = &Spu->Reverb;
+    Bool8 Writes = 0 != (Spu->Control & SPU_CTRL_REVERB);
+    if (Spu->ReverbDisabled
+    || (!Writes && 0 == Spu->Regs[SPU_REG_REVERB_VOLUME / 2] && 0 == Spu->Regs[SPU_REG_REVERB_VOLUME / 2 + 1]))
+    {
+        memset(Output, 0, 2*sizeof Output[0]);
+        return;
+    }
+    u64 Start = Platform_GetTicks();
+
+    i16 StepInput[2][SPU_REVERB_STEPS];
+    i16 StepOutput[2][SPU_REVERB_STEPS];
+    uint StepCount = 0;
+    Bool8 FirstOdd = Reverb->OddFrame;
+    for (uint i = 0; i < FrameCount; i++)
+    {
+        for (uint Side = 0; Side < 2; Side++)
+        {
+            if (Reverb->OddFrame)
+                StepInput[Side][StepCount] = SPU_Clamp16((Reverb->HeldInput[Side] + Input[Side][i]) >> 1);
+            else Reverb->HeldInput[Side] = Input[Side][i];
+        }
+        StepCount += Reverb->OddFrame;
+        Reverb->OddFrame = !Reverb->OddFrame;
+    }
+
+    SPU_ReverbCheckIrq(Spu, StepCount, Writes);
+    if (Writes && Reverb->Overlaps)
+    {
+        for (uint Step = 0; Step < StepCount; Step++)
+        {
+            i16 In[2] = { StepInput[0][Step], StepInput[1][Step] };
+            i16 Out[2];
+            SPU_ReverbStep(Spu, Step, In, Out);
+            StepOutput[0][Step] = Out[0];
+            StepOutput[1][Step] = Out[1];
+        }
+        Spu->ReverbSerialBlocks++;
+    }
+    else SPU_ReverbStages(Spu, StepInput, StepOutput, StepCount, Writes);
+    Reverb->Pos = (Reverb->Pos + StepCount) % Reverb->Size;
+
+    Bool8 Odd = FirstOdd;
+    uint Step = 0;
+    for (uint i = 0; i < FrameCount; i++, Odd = !Odd)
+    {
+        for (uint Side = 0; Side < 2; Side++)
+        {
+            if (Odd)
+            {
+                Output[Side][i] = (i16)((Reverb->LastOutput[Side] + StepOutput[Side][Step]) >> 1);
+                Reverb->LastOutput[Side] = StepOutput[Side][Step];
+            }
+            else Output[Side][i] = Reverb->LastOutput[Side];
+        }
+        Step += Odd;
+    }
+
+    Spu->ReverbBlocks++;
+    Spu->ReverbTicks += Platform_GetTicks() - Start;
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Mixing
+ *
+ *==================================================================================*/
+
+static void SPU_PushOutput(SPU *Spu, const i16 *Frames, uint FrameCount)
+{
+    uint Free = SPU_OUTPUT_FRAMES - (Spu->OutputWrite - Spu->OutputRead);
+    uint Count = MIN(FrameCount, Free);
+    for (uint i = 0; i < Count; i++)
+    {
+        i16 *Frame = Spu->Output[(Spu->OutputWrite + i) % SPU_OUTPUT_FRAMES];
+        Frame[0] = Frames[i*2 + 0];
+        Frame[1] = Frames[i*2 + 1];
+    }
+    Spu->OutputWrite += Count;
+    Spu->OutputFramesDropped += FrameCount - Count;
+}
+
+/* CD left, CD right, voice 1 and voice 3 go to their buffers at the start of sound RAM */
+static void SPU_Capture(SPU *Spu, i16 Capture[4][SPU_BLOCK_FRAMES], uint FrameCount)
+{
+    for (uint i = 0; i < FrameCount; i++)
+    {
+        for (uint Buffer = 0; Buffer < 4; Buffer++)
+        {
+            u32 Addr = (Buffer*SPU_CAPTURE_HALFWORDS + Spu->CaptureIndex) * 2;
+            memcpy(Spu->Ram + Addr, &Capture[Buffer][i], sizeof(i16));
+            SPU_CheckIrq(Spu, Addr, 2);
+        }
+        Spu->CaptureIndex = (Spu->CaptureIndex + 1) % SPU_CAPTURE_HALFWORDS;
+    }
+}
+
+/* FrameCount (up to SPU_BLOCK_FRAMES) frames of every voice and the CD into the output */
+static void SPU_MixBlock(SPU *Spu, uint FrameCount)
+{
+    i32 Mix[2][SPU_BLOCK_FRAMES] = { 0 };
+    i32 ReverbMix[2][SPU_BLOCK_FRAMES] = { 0 };
+    i32 Modulator[SPU_BLOCK_FRAMES] = { 0 };    /* the output of the previous voice */
+    i16 Capture[4][SPU_BLOCK_FRAMES] = { 0 };
+    i16 Noise[SPU_BLOCK_FRAMES];
+    SPU_VoiceBlock Block;
+    for (uint i = 0; i < FrameCount; i++)
+        Noise[i] = SPU_TickNoise(Spu);
+
+    u32 PitchMod = SPU_VOICE_BITS(Spu, SPU_REG_PITCH_MOD) & ~1u; /* voice 0 has no previous voice */
+    u32 NoiseOn = SPU_VOICE_BITS(Spu, SPU_REG_NOISE_ON);
+    u32 ReverbOn = SPU_VOICE_BITS(Spu, SPU_REG_REVERB_ON);
+    Bool8 PreviousOn = false;
+    for (uint v = 0; v < SPU_VOICE_COUNT; v++)
+    {
+        if (SPU_ADSR_OFF == Spu->Voices[v].Phase)
+        {
+            if (PreviousOn)
+                memset(Modulator, 0, sizeof Modulator);
+            PreviousOn = false;
+            continue;
+        }
+
+        SPU_StepVoice(Spu, v, FrameCount,
+            PitchMod >> v & 1? Modulator : NULL,
+            NoiseOn >> v & 1? Noise : NULL,
+            &Block
+        );
+        SPU_Interpolate(Spu, &Block, FrameCount);
+        SPU_Accumulate(&Block, FrameCount, Mix);
+        if (ReverbOn >> v & 1)
+            SPU_Accumulate(&Block, FrameCount, ReverbMix);
+        memcpy(Modulator, Block.Out, FrameCount*sizeof(i32));
+        PreviousOn = true;
+        Spu->VoiceFrames += FrameCount;
+
+        if (1 == v || 3 == v)
+        {
+            for (uint i = 0; i < FrameCount; i++)
+                Capture[2 + v/2][i] = (i16)Block.Out[i];
+        }
+    }
+
+    /* CD audio, already through the CD-ROM's own volumes; the ring drains even when it's not mixed */
+    i16 Cd[SPU_BLOCK_FRAMES * 2];
+    CDROM_ReadAudio(&Spu->Bus->Cdrom, Cd, FrameCount);
+    for (uint Side = 0; Side < 2; Side++)
+    {
+        i32 CdVolume = (i16)Spu->Regs[SPU_REG_CD_VOLUME / 2 + Side];
+        for (uint i = 0; i < FrameCount; i++)
+        {
+            i32 Sample = (Cd[i*2 + Side] * CdVolume) >> 15;
+            Capture[Side][i] = Cd[i*2 + Side];
+            if (Spu->Control & SPU_CTRL_CD_AUDIO)
+                Mix[Side][i] += Sample;
+            if (Spu->Control & SPU_CTRL_CD_REVERB)
+                ReverbMix[Side][i] += Sample;
+        }
+    }
+    SPU_Capture(Spu, Capture, FrameCount);
+
+    i16 Reverb[2][SPU_BLOCK_FRAMES];
+    SPU_ReverbBlock(Spu, ReverbMix, Reverb, FrameCount);
+
+    i16 Out[SPU_BLOCK_FRAMES * 2];
+    Bool8 Audible = (Spu->Control & (SPU_CTRL_ENABLE | SPU_CTRL_UNMUTE)) == (SPU_CTRL_ENABLE | SPU_CTRL_UNMUTE);
+    for (uint i = 0; i < FrameCount; i++)
+    {
+        for (uint Side = 0; Side < 2; Side++)
+        {
+            /* the reverb has its own output volume */
+            i32 Sample = ((SPU_Clamp16(Mix[Side][i]) * Spu->MainVolume[Side].Level) >> 15) + Reverb[Side][i];
+            Out[i*2 + Side] = Audible? SPU_Clamp16(Sample) : 0;
+            SPU_TickVolume(&Spu->MainVolume[Side]);
+        }
+    }
+    SPU_PushOutput(Spu, Out, FrameCount);
+    Spu->FramesMixed += FrameCount;
+}
+
+
+
+/*==================================================================================
+ *
+ *                                  Registers
+ *
+ *==================================================================================*/
+
+static void SPU_WriteRam(SPU *Spu, const void *Data, u32 Size)
+{
+    const u8 *Bytes = Data;
+    SPU_CheckIrq(Spu, Spu->TransferAddr, Size);
+    while (Size)
+    {
+        u32 Count = MIN(Size, SPU_RAM_SIZE - Spu->TransferAddr);
+        memcpy(Spu->Ram + Spu->TransferAddr, Bytes, Count);
+        Spu->TransferAddr = (Spu->TransferAddr + Count) & (SPU_RAM_SIZE - 1);
+        Bytes += Count;
+        Size -= Count;
+    }
+}
+
+static void SPU_ReadRam(SPU *Spu, void *Data, u32 Size)
+{
+    u8 *Bytes = Data;
+    SPU_CheckIrq(Spu, Spu->TransferAddr, Size);
+    while (Size)
+    {
+        u32 Count = MIN(Size, SPU_RAM_SIZE - Spu->TransferAddr);
+        memcpy(Bytes, Spu->Ram + Spu->TransferAddr, Count);
+        Spu->TransferAddr = (Spu->TransferAddr + Count) & (SPU_RAM_SIZE - 1);
+        Bytes += Count;
+        Size -= Count;
+    }
+}
+
+static void SPU_WriteVoice(SPU *Spu, uint Index, u32 Reg, u16 Data)
+{
+    SPU_Voice *Voice = &Spu->Voices[Index];
+    switch (Reg)
+    {
+    case 0x0: SPU_SetVolume(&Voice->Volume[0], Data); break;
+    case 0x2: SPU_SetVolume(&Voice->Volume[1], Data); break;
+    case 0x4: Voice->Pitch = Data; break;
+    case 0x6: Voice->StartAddr = (u32)Data * 8; break;
+    case 0x8: Voice->AdsrLo = Data; break;
+    case 0xA: Voice->AdsrHi = Data; break;
+    case SPU_REG_VOICE_LEVEL: Voice->Level = (i16)Data; break;
+    case 0xE: Voice->RepeatAddr = (u32)Data * 8; break;
+    }
+}
+
+
+
+void SPU_Reset(SPU *Spu, PS1 *Bus)
+{
+    u64 FramesMixed = Spu->FramesMixed;
+    u64 VoiceFrames = Spu->VoiceFrames;
+    u64 OutputFramesDropped = Spu->OutputFramesDropped;
+    u64 ReverbBlocks = Spu->ReverbBlocks;
+    u64 ReverbSerialBlocks = Spu->ReverbSerialBlocks;
+    u64 ReverbTicks = Spu->ReverbTicks;
+    Bool8 ReverbDisabled = Spu->ReverbDisabled;
+    memset(Spu, 0, sizeof *Spu); /* too big for a compound literal */
+    Spu->Bus = Bus;
+    Spu->FramesMixed = FramesMixed;
+    Spu->VoiceFrames = VoiceFrames;
+    Spu->OutputFramesDropped = OutputFramesDropped;
+    Spu->ReverbBlocks = ReverbBlocks;
+    Spu->ReverbSerialBlocks = ReverbSerialBlocks;
+    Spu->ReverbTicks = ReverbTicks;
+    Spu->ReverbDisabled = ReverbDisabled;
+    SPU_BuildGaussTaps(Spu->GaussTaps);
+    SPU_ConfigureReverb(Spu);
+
+    Spu->NextFrameCycle = Bus->Gpu.Cycle + SPU_CYCLES_PER_FRAME;
+    Spu->NextEventCycle = Spu->NextFrameCycle + (SPU_BLOCK_FRAMES - 1)*SPU_CYCLES_PER_FRAME;
+    PS1_ScheduleEvent(Bus, Spu->NextEventCycle);
+}
+
+u16 SPU_Read16(SPU *Spu, u32 Offset)
+{
+    SPU_Update(Spu, Spu->Bus->Gpu.Cycle);
+    if (Offset < SPU_VOICE_COUNT*0x10 && SPU_REG_VOICE_LEVEL == (Offset & 0xF))
+        return (u16)Spu->Voices[Offset / 0x10].Level;
+    if (IN_RANGE(SPU_REG_CURRENT_VOLUMES, Offset, SPU_REG_CURRENT_VOLUMES + SPU_VOICE_COUNT*4 - 1))
+    {
+        u32 Index = (Offset - SPU_REG_CURRENT_VOLUMES) / 4;
+        return (u16)Spu->Voices[Index].Volume[Offset / 2 & 1].Level;
+    }
+
+    switch (Offset)
+    {
+    case SPU_REG_ENDX:      return (u16)Spu->Endx;
+    case SPU_REG_ENDX + 2:  return (u16)(Spu->Endx >> 16);
+    case SPU_REG_CONTROL:   return Spu->Control;
+    case SPU_REG_STATUS:
+    {
+        u16 Status = (Spu->Control & 0x3F) | (u16)Spu->IrqFlag << 6;
+        switch (SPU_TRANSFER_MODE(Spu->Control))
+        {
+        case SPU_TRANSFER_DMA_WRITE: Status |= 0x0080 | 0x0100; break;
+        case SPU_TRANSFER_DMA_READ: Status |= 0x0080 | 0x0200; break;
+        }
+        if (Spu->CaptureIndex >= SPU_CAPTURE_HALFWORDS / 2) /* writing the second half of the capture buffers */
+            Status |= 0x0800;
+        return Status;
+    } break;
+    case SPU_REG_CURRENT_MAIN_VOLUME:       return (u16)Spu->MainVolume[0].Level;
+    case SPU_REG_CURRENT_MAIN_VOLUME + 2:   return (u16)Spu->MainVolume[1].Level;
+    }
+    return Spu->Regs[Offset / 2];
+}
+
+void SPU_Write16(SPU *Spu, u32 Offset, u16 Data)
+{
+    SPU_Update(Spu, Spu->Bus->Gpu.Cycle);
+    Spu->Regs[Offset / 2] = Data;
+    if (Offset < SPU_VOICE_COUNT*0x10)
+    {
+        SPU_WriteVoice(Spu, Offset / 0x10, Offset & 0xF, Data);
+        return;
+    }
+    if (IN_RANGE(SPU_REG_REVERB_CONFIG, Offset, SPU_REG_REVERB_CONFIG + 0x3F))
+    {
+        SPU_ConfigureReverb(Spu);
+        return;
+    }
+
+    switch (Offset)
+    {
+    case SPU_REG_MAIN_VOLUME:
+    case SPU_REG_MAIN_VOLUME + 2:
+    {
+        SPU_SetVolume(&Spu->MainVolume[Offset / 2 & 1], Data);
+    } break;
+    case SPU_REG_KEY_ON:
+    case SPU_REG_KEY_ON + 2:
+    case SPU_REG_KEY_OFF:
+    case SPU_REG_KEY_OFF + 2:
+    {
+        uint First = Offset & 2? 16 : 0;
+        Bool8 On = Offset < SPU_REG_KEY_OFF;
+        for (uint i = 0; i < 16 && First + i < SPU_VOICE_COUNT; i++)
+        {
+            if (!(Data >> i & 1))
+                continue;
+            if (On)
+                SPU_KeyOn(Spu, First + i);
+            else SPU_KeyOff(Spu, First + i);
+        }
+    } break;
+    case SPU_REG_REVERB_BASE:
+    {
+        /* the ring starts over from the new base */
+        Spu->Reverb.Pos = 0;
+        SPU_ConfigureReverb(Spu);
+    } break;
+    case SPU_REG_TRANSFER_ADDR:
+    {
+        Spu->TransferAddr = (u32)Data * 8;
+    } break;
+    case SPU_REG_FIFO:
+    {
+        /* straight to sound RAM, the FIFO itself isn't there */
+        SPU_WriteRam(Spu, &Data, sizeof Data);
+    } break;
+    case SPU_REG_CONTROL:
+    {
+        Spu->Control = Data;
+        if (!(Data & SPU_CTRL_IRQ_ENABLE)) /* acknowledges the IRQ */
+            Spu->IrqFlag = false;
+        if (SPU_TRANSFER_MODE(Data) >= SPU_TRANSFER_DMA_WRITE)
+            DMA_Request(&Spu->Bus->Dma, DMA_PORT_SPU);
+    } break;
+    }
+}
+
+void SPU_WriteBlock(SPU *Spu, const u32 *Words, uint WordCount)
+{
+    SPU_WriteRam(Spu, Words, WordCount*sizeof(u32));
+}
+
+void SPU_ReadBlock(SPU *Spu, u32 *Words, uint WordCount)
+{
+    SPU_ReadRam(Spu, Words, WordCount*sizeof(u32));
+}
+
+Bool8 SPU_IsDMAReady(const SPU *Spu, Bool8 RamToDevice)
+{
+    return SPU_TRANSFER_MODE(Spu->Control) == (RamToDevice? SPU_TRANSFER_DMA_WRITE : SPU_TRANSFER_DMA_READ);
+}
+
+void SPU_Update(SPU *Spu, u64 Cycle)
+{
+    if (Cycle >= Spu->NextFrameCycle)
+    {
+        u64 FrameCount = (Cycle - Spu->NextFrameCycle) / SPU_CYCLES_PER_FRAME + 1;
+        Spu->NextFrameCycle += FrameCount*SPU_CYCLES_PER_FRAME;
+        while (FrameCount)
+        {
+            uint Count = (uint)MIN(FrameCount, SPU_BLOCK_FRAMES);
+            SPU_MixBlock(Spu, Count);
+            FrameCount -= Count;
+        }
+    }
+    /* a whole block at a time when nothing else makes it mix sooner */
+    Spu->NextEventCycle = Spu->NextFrameCycle + (SPU_BLOCK_FRAMES - 1)*SPU_CYCLES_PER_FRAME;
+    PS1_ScheduleEvent(Spu->Bus, Spu->NextEventCycle);
+}
+
+uint SPU_ReadAudio(SPU *Spu, i16 *Frames, uint FrameCount)
+{
+    uint Count = MIN(FrameCount, Spu->OutputWrite - Spu->OutputRead);
+    for (uint i = 0; i < Count; i++)
+    {
+        const i16 *Frame = Spu->Output[(Spu->OutputRead + i) % SPU_OUTPUT_FRAMES];
+        Frames[i*2 + 0] = Frame[0];
+        Frames[i*2 + 1] = Frame[1];
+    }
+    Spu->OutputRead += Count;
+    return Count;
+}
+
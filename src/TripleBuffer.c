@@ -0,0 +1,93 @@
+
+#include "Common.h"
+#include "Platform.h"
+#include "TripleBuffer.h"
+
+
+#define TRIPLEBUFFER_FRESH 0x4
+#define TRIPLEBUFFER_INDEX(middle) ((middle) & 0x3)
+
+
+
+void TripleBuffer_InitExchange(TripleBuffer_Exchange *Ex)
+{
+    *Ex = (TripleBuffer_Exchange) {
+        .Front = 0,
+        .Middle = 1,
+        .Back = 2,
+    };
+}
+
+Bool8 TripleBuffer_IsPending(TripleBuffer_Exchange *Ex)
+{
+    return 0 != (Platform_AtomicLoad(&Ex->Middle) & TRIPLEBUFFER_FRESH);
+}
+
+Bool8 TripleBuffer_Publish(TripleBuffer_Exchange *Ex)
+{
+    /* the exchange is a full barrier, the slot's content is visible before its index is */
+    u32 Previous = Platform_AtomicExchange(&Ex->Middle, Ex->Back | TRIPLEBUFFER_FRESH);
+    Ex->Back = TRIPLEBUFFER_INDEX(Previous);
+    return 0 != (Previous & TRIPLEBUFFER_FRESH);
+}
+
+Bool8 TripleBuffer_Take(TripleBuffer_Exchange *Ex)
+{
+    if (!TripleBuffer_IsPending(Ex))
+        return false;
+    /* only the writer sets the flag, so the slot swapped in is still the fresh one (or a newer one) */
+    u32 Previous = Platform_AtomicExchange(&Ex->Middle, Ex->Front);
+    Ex->Front = TRIPLEBUFFER_INDEX(Previous);
+    return true;
+}
+
+
+
+void TripleBuffer_Init(TripleBuffer *Tb)
+{
+    *Tb = (TripleBuffer) { 0 };
+    TripleBuffer_InitExchange(&Tb->Exchange);
+}
+
+void TripleBuffer_Destroy(TripleBuffer *Tb)
+{
+    for (uint i = 0; i < STATIC_ARRAY_SIZE(Tb->Frames); i++)
+        free(Tb->Frames[i].Pixels);
+    *Tb = (TripleBuffer) { 0 };
+}
+
+TripleBuffer_Frame *TripleBuffer_BeginWrite(TripleBuffer *Tb, uint Width, uint Height)
+{
+    /* the back frame belongs to the writer, the reader can't see it being resized */
+    TripleBuffer_Frame *Frame = &Tb->Frames[Tb->Exchange.Back];
+    if (Width*Height > Frame->Capacity)
+    {
+        free(Frame->Pixels);
+        Frame->Capacity = Width*Height;
+        Frame->Pixels = malloc(Frame->Capacity * sizeof(u32));
+        if (NULL == Frame->Pixels)
+        {
+            Frame->Capacity = 0;
+            return NULL;
+        }
+    }
+    Frame->Width = Width;
+    Frame->Height = Height;
+    Frame->Number = Tb->Published;
+    Frame->Text[0] = '\0';
+    return Frame;
+}
+
+void TripleBuffer_EndWrite(TripleBuffer *Tb)
+{
+    if (TripleBuffer_Publish(&Tb->Exchange))
+        Tb->Dropped++;
+    Tb->Published++;
+}
+
+const TripleBuffer_Frame *TripleBuffer_Read(TripleBuffer *Tb, Bool8 *OutIsNew)
+{
+    *OutIsNew = TripleBuffer_Take(&Tb->Exchange);
+    return &Tb->Frames[Tb->Exchange.Front];
+}
+
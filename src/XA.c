@@ -0,0 +1,196 @@
+
+#include <string.h> /* memmove, memset */
+
+#include "Common.h"
+#include "XA.h"
+
+
+/*
+ * Windowed sinc (Blackman, cutoff at 0.45 of the input rate) for output positions i/7 between input samples,
+ * each phase sums to 1.0 in 2.14 fixed point. Tap 7 + i/7 is where the output sample lands.
+ */
+static const i16 sXA_Resample[XA_RESAMPLE_PHASES][XA_RESAMPLE_TAPS] = {
+    { 9, -55, 180, -422, 780, -1186, 1513, 14746, 1513, -1186, 780, -422, 180, -55, 9, 0 },
+    { 8, -47, 143, -296, 445, -403, -376, 14327, 3821, -1933, 1045, -496, 190, -52, 8, 0 },
+    { 5, -34, 92, -151, 105, 291, -1730, 13126, 6370, -2499, 1171, -492, 163, -36, 3, 0 },
+    { 3, -20, 40, -14, -186, 808, -2506, 11262, 8932, -2733, 1103, -390, 95, -4, -7, 1 },
+    { 1, -7, -4, 95, -390, 1103, -2733, 8932, 11262, -2506, 808, -186, -14, 40, -20, 3 },
+    { 0, 3, -36, 163, -492, 1171, -2499, 6370, 13126, -1730, 291, 105, -151, 92, -34, 5 },
+    { 0, 8, -52, 190, -496, 1045, -1933, 3821, 14327, -376, -403, 445, -296, 143, -47, 8 },
+};
+
+/* ADPCM prediction filters, in 1/64 */
+static const i8 sXA_FilterPos[4] = { 0, 60, 115, 98 };
+static const i8 sXA_FilterNeg[4] = { 0, 0, -52, -55 };
+
+
+static i16 XA_Clamp16(i32 Value)
+{
+    return (i16)MIN(MAX(Value, -0x8000), 0x7FFF);
+}
+
+/*
+ * The 28 rows of a sound group as samples before the filter, Raw[Row*Units + Unit].
+ * Shifting right by the unit's shift is a multiply here: (n << 12) >> Shift == n * (1 << (12 - Shift)),
+ * which SSE2 can do per lane.
+ */
+static void XA_ExpandGroup(const u8 *Group, Bool8 EightBit, i16 *Raw)
+{
+    uint Units = EightBit? 4 : 8;
+    uint Bits = EightBit? 8 : 4;
+    i16 Scale[8];
+    for (uint Unit = 0; Unit < 8; Unit++)
+    {
+        uint Shift = Group[4 + Unit % Units] & 0xF;
+        if (Shift > 12) /* reserved, behaves like 9 */
+            Shift = 9;
+        /* 8 bit samples can't be shifted down further than that this way, those shifts don't make sense anyway */
+        Shift = MIN(Shift, 16 - Bits);
+        Scale[Unit] = (i16)(1 << (16 - Bits - Shift));
+    }
+    const u8 *Rows = Group + 16;
+
+#ifdef HAS_SSE2
+    __m128i Scales = _mm_loadu_si128((const __m128i *)Scale);
+    if (EightBit)
+    {
+        /* 2 rows of 4 units at a time */
+        for (uint Row = 0; Row < XA_SAMPLES_PER_UNIT; Row += 2)
+        {
+            __m128i Bytes = _mm_loadl_epi64((const __m128i *)(Rows + Row*4));
+            __m128i Samples = _mm_srai_epi16(_mm_unpacklo_epi8(_mm_setzero_si128(), Bytes), 8);
+            _mm_storeu_si128((__m128i *)(Raw + Row*4), _mm_mullo_epi16(Samples, Scales));
+        }
+        return;
+    }
+
+    /*
+     * 2 rows of 8 units at a time: each byte goes in 2 lanes as b | b << 8,
+     * the even lane keeps its low nibble by moving it to the top (* 4096), the odd one has its high nibble there already
+     */
+    const __m128i NibbleToTop = _mm_setr_epi16(4096, 1, 4096, 1, 4096, 1, 4096, 1);
+    for (uint Row = 0; Row < XA_SAMPLES_PER_UNIT; Row += 2)
+    {
+        __m128i Bytes = _mm_loadl_epi64((const __m128i *)(Rows + Row*4));
+        __m128i Doubled = _mm_unpacklo_epi8(Bytes, Bytes);
+        __m128i Row0 = _mm_unpacklo_epi16(Doubled, Doubled);
+        __m128i Row1 = _mm_unpackhi_epi16(Doubled, Doubled);
+        Row0 = _mm_srai_epi16(_mm_mullo_epi16(Row0, NibbleToTop), 12);
+        Row1 = _mm_srai_epi16(_mm_mullo_epi16(Row1, NibbleToTop), 12);
+        _mm_storeu_si128((__m128i *)(Raw + Row*8), _mm_mullo_epi16(Row0, Scales));
+        _mm_storeu_si128((__m128i *)(Raw + Row*8 + 8), _mm_mullo_epi16(Row1, Scales));
+    }
+#else
+    for (uint Row = 0; Row < XA_SAMPLES_PER_UNIT; Row++)
+    {
+        for (uint Unit = 0; Unit < Units; Unit++)
+        {
+            i32 Sample = EightBit
+                ? (i8)Rows[Row*4 + Unit]
+                : (i8)(Rows[Row*4 + Unit/2] << (Unit & 1? 0 : 4)) >> 4;
+            Raw[Row*Units + Unit] = (i16)(Sample * Scale[Unit]);
+        }
+    }
+#endif /* HAS_SSE2 */
+}
+
+/* the ADPCM filter through every unit of a group, appends to the channels' input */
+static void XA_FilterGroup(XA_Decoder *Xa, const u8 *Group, const i16 *Raw, uint Units, Bool8 Stereo)
+{
+    for (uint Unit = 0; Unit < Units; Unit++)
+    {
+        uint Chanel = Stereo? Unit & 1 : 0;
+        uint Filter = (Group[4 + Unit] >> 4) & 3;
+        i32 K0 = sXA_FilterPos[Filter];
+        i32 K1 = sXA_FilterNeg[Filter];
+        i32 Old = Xa->Old[Chanel];
+        i32 Older = Xa->Older[Chanel];
+        i16 *Out = Stereo
+            ? &Xa->Input[Chanel][Xa->InputCount + (Unit / 2)*XA_SAMPLES_PER_UNIT]
+            : &Xa->Input[0][Xa->InputCount + Unit*XA_SAMPLES_PER_UNIT];
+
+        for (uint Row = 0; Row < XA_SAMPLES_PER_UNIT; Row++)
+        {
+            i32 Sample = XA_Clamp16(Raw[Row*Units + Unit] + ((Old*K0 + Older*K1 + 32) >> 6));
+            Out[Row] = (i16)Sample;
+            Older = Old;
+            Old = Sample;
+        }
+        Xa->Old[Chanel] = (i16)Old;
+        Xa->Older[Chanel] = (i16)Older;
+    }
+    Xa->InputCount += (Stereo? Units / 2 : Units) * XA_SAMPLES_PER_UNIT;
+}
+
+static i16 XA_Interpolate(const i16 *Samples, const i16 *Coefficients)
+{
+#ifdef HAS_SSE2
+    __m128i Lo = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)Samples), _mm_loadu_si128((const __m128i *)Coefficients));
+    __m128i Hi = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(Samples + 8)), _mm_loadu_si128((const __m128i *)(Coefficients + 8)));
+    __m128i Sum = _mm_add_epi32(Lo, Hi);
+    Sum = _mm_add_epi32(Sum, _mm_shuffle_epi32(Sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    Sum = _mm_add_epi32(Sum, _mm_shuffle_epi32(Sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    i32 Total = _mm_cvtsi128_si32(Sum);
+#else
+    i32 Total = 0;
+    for (uint i = 0; i < XA_RESAMPLE_TAPS; i++)
+        Total += Samples[i] * Coefficients[i];
+#endif /* HAS_SSE2 */
+    return XA_Clamp16((Total + (1 << 13)) >> 14);
+}
+
+
+
+void XA_Reset(XA_Decoder *Xa)
+{
+    /* half the filter's length of silence, the latency of the resampler */
+    memset(Xa, 0, sizeof *Xa);
+    Xa->InputCount = XA_RESAMPLE_TAPS / 2;
+}
+
+uint XA_DecodeSector(XA_Decoder *Xa, const u8 *Sector, i16 *OutFrames)
+{
+    u8 Coding = Sector[19];
+    if (Coding != Xa->Coding)
+    {
+        XA_Reset(Xa);
+        Xa->Coding = Coding;
+    }
+    Bool8 Stereo = Coding & 0x01;
+    Bool8 HalfRate = 0 != (Coding & 0x04);
+    Bool8 EightBit = 0 != (Coding & 0x10);
+    uint Units = EightBit? 4 : 8;
+
+    i16 Raw[XA_SAMPLES_PER_UNIT * 8];
+    for (uint i = 0; i < XA_GROUPS_PER_SECTOR; i++)
+    {
+        const u8 *Group = Sector + 24 + i*XA_GROUP_SIZE;
+        XA_ExpandGroup(Group, EightBit, Raw);
+        XA_FilterGroup(Xa, Group, Raw, Units, Stereo);
+    }
+
+    /* every output frame moves 6/7 of a 37.8 kHz sample, or 3/7 of an 18.9 kHz one */
+    u32 Step = HalfRate? 3 : 6;
+    uint FrameCount = 0;
+    while (Xa->Position / XA_RESAMPLE_PHASES + XA_RESAMPLE_TAPS <= Xa->InputCount)
+    {
+        uint Index = Xa->Position / XA_RESAMPLE_PHASES;
+        const i16 *Coefficients = sXA_Resample[Xa->Position % XA_RESAMPLE_PHASES];
+        i16 Left = XA_Interpolate(Xa->Input[0] + Index, Coefficients);
+        i16 Right = Stereo? XA_Interpolate(Xa->Input[1] + Index, Coefficients) : Left;
+        OutFrames[FrameCount*2 + 0] = Left;
+        OutFrames[FrameCount*2 + 1] = Right;
+        FrameCount++;
+        Xa->Position += Step;
+    }
+    ASSERT(FrameCount <= XA_MAX_SECTOR_FRAMES);
+
+    /* keep what the next sector's first frames still need */
+    uint Consumed = Xa->Position / XA_RESAMPLE_PHASES;
+    for (uint Chanel = 0; Chanel < (Stereo? 2u : 1u); Chanel++)
+        memmove(Xa->Input[Chanel], Xa->Input[Chanel] + Consumed, (Xa->InputCount - Consumed)*sizeof(i16));
+    Xa->InputCount -= Consumed;
+    Xa->Position -= Consumed*XA_RESAMPLE_PHASES;
+    return FrameCount;
+}
+
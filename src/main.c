@@ -4,6 +4,13 @@
 #include "Common.h"
 #include "CPU.h"
 #include "Ps1.h"
+#include "Rasterizer.h"
+#include "Display.h"
+#include "FrameDump.h"
+#include "Capture.h"
+#ifndef PS1_NO_FRONTEND
+#  include "Frontend.h"
+#endif /* PS1_NO_FRONTEND */
 
 
 static void GP1_ResetCommandBuffer(GPU *Gpu);
@@ -11,6 +18,15 @@ static void GP1_ResetCommandBuffer(GPU *Gpu);
 void GPU_Reset(GPU *Gpu, PS1 *Bus)
 {
     *Gpu = (GPU) {
+        .Vram = Gpu->Vram,
+        .Capture = Gpu->Capture,
+        .Upscaler = Gpu->Upscaler,
+        .Cycle = Gpu->Cycle,
+        .FrameStartCycle = Gpu->FrameStartCycle,
+#ifdef PS1_GPU_STATS
+        .Stats = Gpu->Stats,
+        .FrameStats = Gpu->FrameStats,
+#endif /* PS1_GPU_STATS */
         .Bus = Bus,
         .GP0Mode = GP0_COMMAND,
 
@@ -37,14 +53,284 @@ void GPU_Reset(GPU *Gpu, PS1 *Bus)
         .DisplayLineEnd = 0x100,
     };
 
+    /* the display has not seen any of VRAM yet */
+    memset(Gpu->DirtyTiles, 0xFF, sizeof Gpu->DirtyTiles);
     GP1_ResetCommandBuffer(Gpu);
     /* TODO: clear GPU cache */
 }
 
+u64 GPU_DirtyColumnMask(uint X, uint Width)
+{
+    if (0 == Width)
+        return 0;
+    uint FirstColumn = (X % GPU_VRAM_WIDTH) / GPU_DIRTY_TILE_SIZE;
+    uint ColumnCount = ((X % GPU_VRAM_WIDTH) + Width - 1) / GPU_DIRTY_TILE_SIZE - FirstColumn + 1;
+    if (ColumnCount >= 64)
+        return ~(u64)0;
+
+    /* rotate, the columns past 63 wrap around to 0 */
+    u64 Mask = ((u64)1 << ColumnCount) - 1;
+    return (Mask << FirstColumn) | (FirstColumn? Mask >> (64 - FirstColumn) : 0);
+}
+
+void GPU_MarkDirty(GPU *Gpu, uint X, uint Y, uint Width, uint Height)
+{
+    if (0 == Width || 0 == Height)
+        return;
+
+    /* tile rows covered, counted before wrapping around */
+    uint FirstRow = (Y % GPU_VRAM_HEIGHT) / GPU_DIRTY_TILE_SIZE;
+    uint RowCount = ((Y % GPU_VRAM_HEIGHT) + Height - 1) / GPU_DIRTY_TILE_SIZE - FirstRow + 1;
+    RowCount = MIN(RowCount, GPU_DIRTY_TILE_ROWS);
+
+    u64 Columns = GPU_DirtyColumnMask(X, Width);
+    for (uint i = 0; i < RowCount; i++)
+    {
+        Gpu->DirtyTiles[(FirstRow + i) % GPU_DIRTY_TILE_ROWS] |= Columns;
+    }
+}
+
+
+
+
+static u32 GPU_CyclesPerLine(const GPU *Gpu)
+{
+    return Gpu->Status.VideoMode /* PAL */
+        ? PS1_PAL_CYCLES_PER_LINE 
+        : PS1_NTSC_CYCLES_PER_LINE;
+}
+
+static u32 GPU_LinesPerFrame(const GPU *Gpu)
+{
+    return Gpu->Status.VideoMode /* PAL */
+        ? PS1_PAL_LINES_PER_FRAME 
+        : PS1_NTSC_LINES_PER_FRAME;
+}
+
+u32 GPU_BeginFrame(GPU *Gpu)
+{
+    Gpu->FrameStartCycle = Gpu->Cycle;
+    /* bit 13 alternates between fields when interlaced, always set otherwise */
+    Gpu->Status.Field = Gpu->Status.InterlaceEnable? !Gpu->Status.Field : 1;
+    return GPU_CyclesPerLine(Gpu) * GPU_LinesPerFrame(Gpu);
+}
+
+uint GPU_CurrentLine(const GPU *Gpu)
+{
+    u64 Line = (Gpu->Cycle - Gpu->FrameStartCycle) / GPU_CyclesPerLine(Gpu);
+    return (uint)MIN(Line, GPU_LinesPerFrame(Gpu) - 1);
+}
+
+Bool8 GPU_InVBlank(const GPU *Gpu)
+{
+    uint Line = GPU_CurrentLine(Gpu);
+    return Line < Gpu->DisplayLineStart || Line >= Gpu->DisplayLineEnd;
+}
+
+Bool8 GPU_InHBlank(const GPU *Gpu)
+{
+    u32 CyclesPerLine = GPU_CyclesPerLine(Gpu);
+    u32 VideoClocksPerLine = Gpu->Status.VideoMode
+        ? PS1_PAL_VIDEO_CLOCKS_PER_LINE 
+        : PS1_NTSC_VIDEO_CLOCKS_PER_LINE;
+    u32 VideoClock = (u32)((Gpu->Cycle - Gpu->FrameStartCycle) % CyclesPerLine) * VideoClocksPerLine / CyclesPerLine;
+    return VideoClock < Gpu->DisplayHorizontalStart || VideoClock >= Gpu->DisplayHorizontalEnd;
+}
+
+void GPU_EndFrame(GPU *Gpu)
+{
+#ifdef PS1_GPU_STATS
+    Gpu->FrameStats = Gpu->Stats;
+    Gpu->Stats = (GPU_Stats) { .Frame = Gpu->FrameStats.Frame + 1 };
+#else
+    (void)Gpu;
+#endif /* PS1_GPU_STATS */
+}
+
+Bool8 GPU_GetFrameStats(const GPU *Gpu, GPU_Stats *OutStats)
+{
+#ifdef PS1_GPU_STATS
+    *OutStats = Gpu->FrameStats;
+    return true;
+#else
+    (void)Gpu;
+    *OutStats = (GPU_Stats) { 0 };
+    return false;
+#endif /* PS1_GPU_STATS */
+}
+
+void GPU_FormatStats(const GPU_Stats *Stats, char *Buffer, uint BufferSize)
+{
+    static const char *sClassNames[GPU_CLASS_COUNT] = {
+        "misc", "polygon", "line", "rect", "copy", "upload", "download", "env",
+    };
+    u32 CommandCount = 0;
+    /* most used opcodes */
+    u8 Top[4] = { 0 };
+    u32 TopCount[4] = { 0 };
+    for (uint Opcode = 0; Opcode < 256; Opcode++)
+    {
+        u32 Count = Stats->CommandCount[Opcode];
+        CommandCount += Count;
+        for (uint i = 0; i < STATIC_ARRAY_SIZE(Top); i++)
+        {
+            if (Count > TopCount[i])
+            {
+                uint Moved = STATIC_ARRAY_SIZE(Top) - i - 1;
+                memmove(&Top[i + 1], &Top[i], Moved*sizeof Top[0]);
+                memmove(&TopCount[i + 1], &TopCount[i], Moved*sizeof TopCount[0]);
+                Top[i] = (u8)Opcode;
+                TopCount[i] = Count;
+                break;
+            }
+        }
+    }
+
+    uint Length = snprintf(Buffer, BufferSize,
+        "GPU frame %llu: %u GP0 commands, %u GP1, %u primitives\n"
+        "pixels: %llu written, %llu blended, %llu textured\n"
+        "VRAM: %llu KB uploaded, %llu KB downloaded\n"
+        "linked list DMA: %u packets, %u words, %u cut\n"
+        "time (us):",
+        (unsigned long long)Stats->Frame, CommandCount, Stats->GP1Count, Stats->Primitives,
+        (unsigned long long)Stats->PixelsWritten, (unsigned long long)Stats->PixelsBlended,
+        (unsigned long long)Stats->PixelsTextured,
+        (unsigned long long)Stats->UploadBytes / KB, (unsigned long long)Stats->DownloadBytes / KB,
+        Stats->ListPackets, Stats->ListWords, Stats->ListsCut
+    );
+    double MicrosecondsPerTick = 1e6 / (double)Platform_TicksPerSecond();
+    for (uint i = 0; i < GPU_CLASS_COUNT && Length < BufferSize; i++)
+    {
+        if (Stats->ClassTicks[i])
+        {
+            Length += snprintf(Buffer + Length, BufferSize - Length, " %s %.0f", 
+                sClassNames[i], (double)Stats->ClassTicks[i] * MicrosecondsPerTick
+            );
+        }
+    }
+    if (Length < BufferSize)
+        Length += snprintf(Buffer + Length, BufferSize - Length, "\ntop opcodes:");
+    for (uint i = 0; i < STATIC_ARRAY_SIZE(Top) && Length < BufferSize; i++)
+    {
+        if (TopCount[i])
+            Length += snprintf(Buffer + Length, BufferSize - Length, " %02X x%u", Top[i], TopCount[i]);
+    }
+}
+
+static Bool8 GPU_IsBusy(const GPU *Gpu)
+{
+    return Gpu->Cycle < Gpu->BusyUntil;
+}
+
+/* words that arrive while the GPU is still drawing wait in the FIFO, which is empty again once it's done */
+static void GPU_QueueWords(GPU *Gpu, uint WordCount)
+{
+    if (GPU_IsBusy(Gpu))
+        Gpu->FifoWords = MIN(Gpu->FifoWords + WordCount, GPU_FIFO_SIZE);
+    else Gpu->FifoWords = 0;
+}
+
+/* 
+ * Drawing cost estimate in GPU clocks (the GPU runs at 11/7 of the CPU clock): 
+ * one clock per pixel, plus one for the texture lookup and one for reading VRAM back (blending, mask check)
+ */
+#define GPU_COMMAND_SETUP_CLOCKS 16
+static u32 GPU_PixelClocks(const GPU *Gpu, u32 Flags)
+{
+    u32 Clocks = 1;
+    if (Flags & RASTER_TEXTURED)
+        Clocks++;
+    if ((Flags & RASTER_SEMI_TRANSPARENT) || Gpu->Status.PreserveMaskedPixel)
+        Clocks++;
+    return Clocks;
+}
+
+/* commands that arrive while the GPU is busy start after the previous one is done */
+static void GPU_AddDrawCost(GPU *Gpu, u64 GpuClocks)
+{
+    u64 Start = MAX(Gpu->Cycle, Gpu->BusyUntil);
+    Gpu->BusyUntil = Start + (GPU_COMMAND_SETUP_CLOCKS + GpuClocks) * 7 / 11;
+}
+
+/* frame counters of a polygon, rectangle, line segment, fill or copy */
+static void GPU_CountPrimitive(GPU *Gpu, u32 Pixels, u32 Flags)
+{
+#ifdef PS1_GPU_STATS
+    GPU_Stats *Stats = &Gpu->Stats;
+    Stats->Primitives++;
+    Stats->PixelsWritten += Pixels;
+    if (Flags & RASTER_SEMI_TRANSPARENT)
+        Stats->PixelsBlended += Pixels;
+    if (Flags & RASTER_TEXTURED)
+        Stats->PixelsTextured += Pixels;
+#else
+    (void)Gpu;
+    (void)Pixels;
+    (void)Flags;
+#endif /* PS1_GPU_STATS */
+}
+
+
+static u16 GPU_ReadImagePixel(GPU *Gpu)
+{
+    if (Gpu->ReadCurrentY >= Gpu->ReadHeight) /* padding halfword of odd sized transfers */
+        return 0;
+
+    u32 X = (Gpu->ReadX + Gpu->ReadCurrentX) % GPU_VRAM_WIDTH;
+    u32 Y = (Gpu->ReadY + Gpu->ReadCurrentY) % GPU_VRAM_HEIGHT;
+    if (++Gpu->ReadCurrentX == Gpu->ReadWidth)
+    {
+        Gpu->ReadCurrentX = 0;
+        Gpu->ReadCurrentY++;
+    }
+    return Gpu->Vram[Y*GPU_VRAM_WIDTH + X];
+}
+
 u32 GPU_ReadGPU(GPU *Gpu)
 {
-    /* TODO: implement this */
-    return 0;
+    if (0 == Gpu->ReadWordsRemain)
+        return 0;
+
+    Gpu->ReadWordsRemain--;
+#ifdef PS1_GPU_STATS
+    Gpu->Stats.DownloadBytes += sizeof(u32);
+#endif /* PS1_GPU_STATS */
+    /* the lower halfword is the first pixel, like uploads */
+    u32 Data = GPU_ReadImagePixel(Gpu);
+    Data |= (u32)GPU_ReadImagePixel(Gpu) << 16;
+    return Data;
+}
+
+void GPU_ReadGPUBlock(GPU *Gpu, u32 *Data, uint WordCount)
+{
+    uint ImageWords = MIN(WordCount, Gpu->ReadWordsRemain);
+    Gpu->ReadWordsRemain -= ImageWords;
+#ifdef PS1_GPU_STATS
+    Gpu->Stats.DownloadBytes += ImageWords * sizeof(u32);
+#endif /* PS1_GPU_STATS */
+
+    /* rows are copied a run at a time, the halfwords are already in word stream order */
+    u8 *Dst = (u8 *)Data;
+    uint HalfwordsLeft = ImageWords*2;
+    while (HalfwordsLeft && Gpu->ReadCurrentY < Gpu->ReadHeight)
+    {
+        u32 X = (Gpu->ReadX + Gpu->ReadCurrentX) % GPU_VRAM_WIDTH;
+        u32 Y = (Gpu->ReadY + Gpu->ReadCurrentY) % GPU_VRAM_HEIGHT;
+        uint Run = MIN((uint)(Gpu->ReadWidth - Gpu->ReadCurrentX), HalfwordsLeft);
+        Run = MIN(Run, GPU_VRAM_WIDTH - X); /* the rectangle wraps around horizontally */
+
+        memcpy(Dst, &Gpu->Vram[Y*GPU_VRAM_WIDTH + X], Run*sizeof(u16));
+        Dst += Run*sizeof(u16);
+        HalfwordsLeft -= Run;
+        Gpu->ReadCurrentX += Run;
+        if (Gpu->ReadCurrentX == Gpu->ReadWidth)
+        {
+            Gpu->ReadCurrentX = 0;
+            Gpu->ReadCurrentY++;
+        }
+    }
+    /* the padding halfword, and whatever is read past the end of the transfer */
+    memset(Dst, 0, (u8 *)(Data + WordCount) - Dst);
 }
 
 u32 GPU_ReadStatus(GPU *Gpu)
@@ -64,26 +350,37 @@ u32 GPU_ReadStatus(GPU *Gpu)
     // Value |= 1 << 14;
     Value |= (u32)Gpu->Status.TextureDisable << 15;
     Value |= (u32)Gpu->Status.HorizontalResolution << 16;
-    //Value |= (u32)Gpu->Status.VerticalResolution << 19;
-    Value |= (u32)0 << 19; /* TODO: hack: use 240 bit vertical res to work around infinite loop in bios */
+    Value |= (u32)Gpu->Status.VerticalResolution << 19;
     Value |= (u32)Gpu->Status.VideoMode << 20;
     Value |= (u32)Gpu->Status.DisplayRGB24 << 21;
     Value |= (u32)Gpu->Status.InterlaceEnable << 22;
     Value |= (u32)Gpu->Status.DisplayDisable << 23;
     Value |= (u32)Gpu->Status.Interrupt << 24;
 
-    /* TODO: this is a hack: pretend that the GPU is always ready for now. */
-    Gpu->Status.ReadyToSend = 1;
-    Gpu->Status.ReadyToReceiveCmdWord = 1;
-    Gpu->Status.ReadyToReceiveDMABlock = 1;
+    Bool8 Busy = GPU_IsBusy(Gpu);
+    if (!Busy)
+        Gpu->FifoWords = 0;
+    Gpu->Status.ReadyToSend = Gpu->ReadWordsRemain > 0;
+    Gpu->Status.ReadyToReceiveCmdWord = !Busy;
+    Gpu->Status.ReadyToReceiveDMABlock = Gpu->FifoWords < GPU_FIFO_SIZE;
     Value |= (u32)Gpu->Status.ReadyToReceiveCmdWord << 26; /* Ready to Receive CMD Word */
     Value |= (u32)Gpu->Status.ReadyToSend << 27; /* Ready to send */
     Value |= (u32)Gpu->Status.ReadyToReceiveDMABlock << 28; /* Ready to receive DMA Block */
 
     Value |= (u32)Gpu->Status.DMADirection << 29;
 
-    /* bit 31 is enabled during odd line in interlaced mode while not being in vblank */
-    Value |= 0 << 31;
+    /* 
+     * bit 31: odd line, or odd field in 480 line interlaced mode, always 0 in vblank.
+     * Software waits for it to flip, so it has to follow the emulated beam
+     */
+    Bool8 Odd = false;
+    if (!GPU_InVBlank(Gpu))
+    {
+        Odd = Gpu->Status.VerticalResolution && Gpu->Status.InterlaceEnable
+            ? Gpu->Status.Field
+            : GPU_CurrentLine(Gpu) & 1;
+    }
+    Value |= (u32)Odd << 31;
 
     /* bit 25 depends on DMA direction (29..30) */
     u32 DMARequest = 0;
@@ -95,7 +392,7 @@ u32 GPU_ReadStatus(GPU *Gpu)
     } break;
     case 1: /* fifo, fifo status (1/0 = empty/full) */
     {
-        DMARequest = 1; /* TODO: hack: set to always empty for now */
+        DMARequest = Gpu->FifoWords < GPU_FIFO_SIZE;
     } break;
     case 2: /* GPU to GP0, copy bit 28 */
     {
@@ -117,95 +414,136 @@ static void GP0_SetDrawingTopLeft(GPU *Gpu);
 static void GP0_SetDrawingBottomRight(GPU *Gpu);
 static void GP0_SetDrawingOffset(GPU *Gpu);
 static void GP0_SetMaskBits(GPU *Gpu);
-static void GP0_RenderQuadMonoOpaque(GPU *Gpu);
 static void GP0_ClearTextureCache(GPU *Gpu);
 static void GP0_LoadRectangle(GPU *Gpu);
 static void GP0_StoreRectangle(GPU *Gpu);
-static void GP0_RenderShadedQuad(GPU *Gpu);
-static void GP0_RenderShadedTri(GPU *Gpu);
-static void GP0_RenderTexturedQuad(GPU *Gpu);
+static void GP0_RenderPolygon(GPU *Gpu);
+static uint GP0_PolygonWordCount(u8 Command);
+static void GP0_RenderRectangle(GPU *Gpu);
+static uint GP0_RectangleWordCount(u8 Command);
+static void GP0_RenderLine(GPU *Gpu);
+static void GP0_WritePolyline(GPU *Gpu, u32 Data);
+static void GP0_FillRectangle(GPU *Gpu);
+static void GP0_CopyRectangle(GPU *Gpu);
+static void GP0_EndLoadImage(GPU *Gpu);
+static void GP0_WriteImageData(GPU *Gpu, u32 Data);
+static void GP0_WriteImageBlock(GPU *Gpu, const u32 *Data, uint WordCount);
 
 static void GP1_SetDisplayMode(GPU *Gpu, u32 Instruction);
 
 
-void GPU_WriteGP0(GPU *Gpu, u32 Data)
+/* sets up the handler and word count of the command starting with Header */
+static void GP0_DecodeCommand(GPU *Gpu, u32 Header)
 {
-    if (0 == Gpu->CommandWordsRemain)
+    Gpu->CommandBufferSize = 0;
+    Gpu->CommandWordsRemain = 1;
+    u8 Command = Header >> 24;
+    switch (Command)
     {
-        Gpu->CommandBufferSize = 0;
-        Gpu->CommandWordsRemain = 1;
-        u8 Command = Data >> 24;
-        switch (Command)
-        {
-        case 0x00: /* nop */ 
-        {
-            Gpu->CommandBufferFn = NULL;
-        } break;
-        case 0x01: /* clear texture cache */
-        {
-            Gpu->CommandBufferFn = GP0_ClearTextureCache;
-        } break;
-        case 0xE1: /* set drawing mode (status reg and misc) */
-        {
-            Gpu->CommandBufferFn = GP0_SetDrawMode;
-        } break;
-        case 0xE2: /* Texture window setting */
-        {
-            Gpu->CommandBufferFn = GP0_SetTextureWindow;
-        } break;
-        case 0xE3: /* set drawing area top left */
-        {
-            Gpu->CommandBufferFn = GP0_SetDrawingTopLeft;
-        } break;
-        case 0xE4: /* set drawing area bottom right */
-        {
-            Gpu->CommandBufferFn = GP0_SetDrawingBottomRight;
-        } break;
-        case 0xE5: /* set drawing offset */
-        {
-            Gpu->CommandBufferFn = GP0_SetDrawingOffset;
-        } break;
-        case 0xE6: /* set mask bits */
-        {
-            Gpu->CommandBufferFn = GP0_SetMaskBits;
-        } break;
+    case 0x00: /* nop */ 
+    {
+        Gpu->CommandBufferFn = NULL;
+    } break;
+    case 0x01: /* clear texture cache */
+    {
+        Gpu->CommandBufferFn = GP0_ClearTextureCache;
+    } break;
+    case 0x02: /* fill rectangle */
+    {
+        Gpu->CommandBufferFn = GP0_FillRectangle;
+        Gpu->CommandWordsRemain += 2;
+    } break;
+    case 0xE1: /* set drawing mode (status reg and misc) */
+    {
+        Gpu->CommandBufferFn = GP0_SetDrawMode;
+    } break;
+    case 0xE2: /* Texture window setting */
+    {
+        Gpu->CommandBufferFn = GP0_SetTextureWindow;
+    } break;
+    case 0xE3: /* set drawing area top left */
+    {
+        Gpu->CommandBufferFn = GP0_SetDrawingTopLeft;
+    } break;
+    case 0xE4: /* set drawing area bottom right */
+    {
+        Gpu->CommandBufferFn = GP0_SetDrawingBottomRight;
+    } break;
+    case 0xE5: /* set drawing offset */
+    {
+        Gpu->CommandBufferFn = GP0_SetDrawingOffset;
+    } break;
+    case 0xE6: /* set mask bits */
+    {
+        Gpu->CommandBufferFn = GP0_SetMaskBits;
+    } break;
 
-        case 0x28: /* render quad mono opaque */
-        {
-            Gpu->CommandBufferFn = GP0_RenderQuadMonoOpaque;
-            Gpu->CommandWordsRemain += 4;
-        } break;
-        case 0x38: /* render shaded quad */
-        {
-            Gpu->CommandBufferFn = GP0_RenderShadedQuad;
-            Gpu->CommandWordsRemain += 7;
-        } break;
-        case 0x30: /* render shaded triangle */
+    case 0xC0: /* store rectangle (GPU to CPU) */
+    {
+        Gpu->CommandBufferFn = GP0_StoreRectangle;
+        Gpu->CommandWordsRemain += 2;
+    } break;
+    case 0xA0: /* load rectangle (CPU to GPU) */
+    {
+        Gpu->CommandBufferFn = GP0_LoadRectangle;
+        Gpu->CommandWordsRemain += 2;
+    } break;
+    default:
+    {
+        if (IN_RANGE(0x20, Command, 0x3F)) /* render polygon */
         {
-            Gpu->CommandBufferFn = GP0_RenderShadedTri;
-            Gpu->CommandWordsRemain += 5;
-        } break;
-        case 0x2C: /* render textured quad */
+            Gpu->CommandBufferFn = GP0_RenderPolygon;
+            Gpu->CommandWordsRemain = GP0_PolygonWordCount(Command);
+        }
+        else if (IN_RANGE(0x40, Command, 0x5F)) /* render line, polylines continue in GP0_POLYLINE mode */
         {
-            Gpu->CommandBufferFn = GP0_RenderTexturedQuad;
-            Gpu->CommandWordsRemain += 6;
-        } break;
-
-        case 0xC0: /* store rectangle (GPU to CPU) */
+            Gpu->CommandBufferFn = GP0_RenderLine;
+            Gpu->CommandWordsRemain = (Command & RASTER_SHADED)? 4 : 3;
+        }
+        else if (IN_RANGE(0x60, Command, 0x7F)) /* render rectangle */
         {
-            Gpu->CommandBufferFn = GP0_StoreRectangle;
-            Gpu->CommandWordsRemain += 2;
-        } break;
-        case 0xA0: /* load rectangle (CPU to GPU) */
+            Gpu->CommandBufferFn = GP0_RenderRectangle;
+            Gpu->CommandWordsRemain = GP0_RectangleWordCount(Command);
+        }
+        else if (IN_RANGE(0x80, Command, 0x9F)) /* copy rectangle (VRAM to VRAM) */
         {
-            Gpu->CommandBufferFn = GP0_LoadRectangle;
-            Gpu->CommandWordsRemain += 2;
-        } break;
-        default:
+            Gpu->CommandBufferFn = GP0_CopyRectangle;
+            Gpu->CommandWordsRemain = 4;
+        }
+        else
         {
-            TODO("Unhandled GP0 opcode: %08x\n", Data);
-        } break;
+            TODO("Unhandled GP0 opcode: %08x\n", Header);
         }
+    } break;
+    }
+}
+
+static void GP0_ExecuteCommand(GPU *Gpu)
+{
+#ifdef DEBUG
+    LOG("[GP0 Cmd]: %08x\n", Gpu->CommandBuffer[0]);
+#endif /* DEBUG */
+#ifdef PS1_GPU_STATS
+    u8 Opcode = Gpu->CommandBuffer[0] >> 24;
+    u64 Start = Platform_GetTicks();
+#endif /* PS1_GPU_STATS */
+    Gpu->CommandBufferFn(Gpu);
+    Gpu->CommandBufferFn = NULL;
+#ifdef PS1_GPU_STATS
+    Gpu->Stats.CommandCount[Opcode]++;
+    Gpu->Stats.ClassTicks[Opcode >> 5] += Platform_GetTicks() - Start;
+#endif /* PS1_GPU_STATS */
+}
+
+void GPU_WriteGP0(GPU *Gpu, u32 Data)
+{
+    if (Gpu->Capture)
+        Capture_GP0(Gpu->Capture, &Data, 1);
+    GPU_QueueWords(Gpu, 1);
+
+    if (0 == Gpu->CommandWordsRemain)
+    {
+        GP0_DecodeCommand(Gpu, Data);
     }
 
     switch (Gpu->GP0Mode)
@@ -220,25 +558,101 @@ void GPU_WriteGP0(GPU *Gpu, u32 Data)
         if (0 == Gpu->CommandWordsRemain 
         && NULL != Gpu->CommandBufferFn)
         {
-            LOG("[GP0 Cmd]: %08x\n", Gpu->CommandBuffer[0]);
-            Gpu->CommandBufferFn(Gpu);
-            Gpu->CommandBufferFn = NULL;
+            GP0_ExecuteCommand(Gpu);
         }
     } break;
     case GP0_LOAD_IMAGE:
     {
+#ifdef PS1_GPU_STATS
+        u64 Start = Platform_GetTicks();
+        GP0_WriteImageData(Gpu, Data);
+        Gpu->Stats.UploadBytes += sizeof(u32);
+        Gpu->Stats.ClassTicks[GPU_CLASS_CPU_TO_VRAM] += Platform_GetTicks() - Start;
+#else
+        GP0_WriteImageData(Gpu, Data);
+#endif /* PS1_GPU_STATS */
         Gpu->CommandWordsRemain--;
         if (0 == Gpu->CommandWordsRemain) /* done transfering, switch back to command mode */
         {
-            Gpu->GP0Mode = GP0_COMMAND;
-            Gpu->CommandBufferSize = 0;
+            GP0_EndLoadImage(Gpu);
         }
     } break;
+    case GP0_POLYLINE:
+    {
+        GP0_WritePolyline(Gpu, Data);
+    } break;
+    }
+}
+
+void GPU_WriteGP0Block(GPU *Gpu, const u32 *Data, uint WordCount)
+{
+    if (Gpu->Capture)
+        Capture_GP0(Gpu->Capture, Data, WordCount);
+    GPU_QueueWords(Gpu, WordCount);
+
+    /* same state machine as GPU_WriteGP0, but consumes as many words as possible per step */
+    while (WordCount)
+    {
+        uint Consumed = 0;
+        switch (Gpu->GP0Mode)
+        {
+        case GP0_COMMAND:
+        {
+            if (0 == Gpu->CommandWordsRemain)
+            {
+                GP0_DecodeCommand(Gpu, Data[0]);
+            }
+
+            Consumed = MIN(WordCount, Gpu->CommandWordsRemain);
+            ASSERT(Gpu->CommandBufferSize + Consumed <= STATIC_ARRAY_SIZE(Gpu->CommandBuffer));
+            memcpy(&Gpu->CommandBuffer[Gpu->CommandBufferSize], Data, Consumed*sizeof(u32));
+            Gpu->CommandBufferSize += Consumed;
+            Gpu->CommandWordsRemain -= Consumed;
+
+            if (0 == Gpu->CommandWordsRemain 
+            && NULL != Gpu->CommandBufferFn)
+            {
+                GP0_ExecuteCommand(Gpu);
+            }
+        } break;
+        case GP0_LOAD_IMAGE:
+        {
+            Consumed = MIN(WordCount, Gpu->CommandWordsRemain);
+#ifdef PS1_GPU_STATS
+            u64 Start = Platform_GetTicks();
+            GP0_WriteImageBlock(Gpu, Data, Consumed);
+            Gpu->Stats.UploadBytes += Consumed*sizeof(u32);
+            Gpu->Stats.ClassTicks[GPU_CLASS_CPU_TO_VRAM] += Platform_GetTicks() - Start;
+#else
+            GP0_WriteImageBlock(Gpu, Data, Consumed);
+#endif /* PS1_GPU_STATS */
+            Gpu->CommandWordsRemain -= Consumed;
+            if (0 == Gpu->CommandWordsRemain) /* done transfering, switch back to command mode */
+            {
+                GP0_EndLoadImage(Gpu);
+            }
+        } break;
+        case GP0_POLYLINE:
+        {
+            /* the length is only known once the terminator shows up */
+            while (Consumed < WordCount && GP0_POLYLINE == Gpu->GP0Mode)
+                GP0_WritePolyline(Gpu, Data[Consumed++]);
+        } break;
+        }
+
+        Data += Consumed;
+        WordCount -= Consumed;
     }
 }
 
 void GPU_WriteGP1(GPU *Gpu, u32 Data)
 {
+    if (Gpu->Capture)
+        Capture_GP1(Gpu->Capture, Data);
+#ifdef PS1_GPU_STATS
+    Gpu->Stats.GP1Count++;
+#endif /* PS1_GPU_STATS */
+
     u8 Command = Data >> 24;
     switch (Command)
     {
@@ -310,7 +724,7 @@ static void GP0_SetDrawingOffset(GPU *Gpu)
 {
     u32 Instruction = Gpu->CommandBuffer[0];
     i16 X = (i16)(Instruction << 5) >> 5; /* bits 0..10 */
-    i16 Y = (i16)(Instruction >> 5) >> 5; /* bits 11..21 */
+    i16 Y = (i16)((Instruction >> 11) << 5) >> 5; /* bits 11..21 */
     Gpu->DrawingOffsetX = X;
     Gpu->DrawingOffsetY = Y;
 }
@@ -342,14 +756,7 @@ static void GP0_SetMaskBits(GPU *Gpu)
 {
     u32 Instruction = Gpu->CommandBuffer[0];
     Gpu->Status.SetMaskBitOnDraw = Instruction & 1;
-    Gpu->Status.PreserveMaskedPixel = Instruction & 2;
-}
-
-static void GP0_RenderQuadMonoOpaque(GPU *Gpu)
-{
-    (void)Gpu;
-    LOG("[Renderer]: Quad Mono Opaque: %d words\n", Gpu->CommandBufferSize);
-    /* TODO: implement */
+    Gpu->Status.PreserveMaskedPixel = (Instruction >> 1) & 1;
 }
 
 static void GP0_ClearTextureCache(GPU *Gpu)
@@ -368,10 +775,20 @@ static void GP0_LoadRectangle(GPU *Gpu)
      * ...: Data (DMA from RAM to GP0 port)
      * size (height*width) is padded to words boundary while counting in halfwords
      */
+    u32 DstParam = Gpu->CommandBuffer[1];
     u32 SizeParam = Gpu->CommandBuffer[2];
+    Gpu->ImageX = DstParam & 0x3FF;
+    Gpu->ImageY = (DstParam >> 16) & 0x1FF;
+    /* a size of 0 means max size */
+    Gpu->ImageWidth = ((SizeParam - 1) & 0x3FF) + 1;
+    Gpu->ImageHeight = (((SizeParam >> 16) - 1) & 0x1FF) + 1;
+    Gpu->ImageCurrentX = 0;
+    Gpu->ImageCurrentY = 0;
+    GPU_MarkDirty(Gpu, Gpu->ImageX, Gpu->ImageY, Gpu->ImageWidth, Gpu->ImageHeight);
+    Raster_UpscaleBeginWrite(Gpu, Gpu->ImageX, Gpu->ImageY, Gpu->ImageWidth, Gpu->ImageHeight);
 
     /* width * height */
-    u32 RectangleSizeHalf = (SizeParam & 0xFFFF) * (SizeParam >> 16); 
+    u32 RectangleSizeHalf = (u32)Gpu->ImageWidth * (u32)Gpu->ImageHeight;
 
     /* round up to even multiple of halfword, divide by 2 (sizeof(word)/sizeof(halfword)) */
     u32 RectangleSizeWord = (RectangleSizeHalf + 1) / 2;
@@ -380,8 +797,75 @@ static void GP0_LoadRectangle(GPU *Gpu)
     Gpu->GP0Mode = GP0_LOAD_IMAGE;
     Gpu->CommandWordsRemain = RectangleSizeWord;
 
-    /* TODO: implement the copy when VRAM is added (using dst param) */
+#ifdef DEBUG
     LOG("Load rectangle size %d words\n", RectangleSizeWord);
+#endif /* DEBUG */
+}
+
+static void GP0_EndLoadImage(GPU *Gpu)
+{
+    Raster_UpscaleEndWrite(Gpu, Gpu->ImageX, Gpu->ImageY, Gpu->ImageWidth, Gpu->ImageHeight);
+    Gpu->GP0Mode = GP0_COMMAND;
+    Gpu->CommandBufferSize = 0;
+}
+
+static void GP0_WriteImagePixel(GPU *Gpu, u16 Pixel)
+{
+    if (Gpu->ImageCurrentY >= Gpu->ImageHeight) /* padding halfword of odd sized transfers */
+        return;
+
+    u32 X = (Gpu->ImageX + Gpu->ImageCurrentX) % GPU_VRAM_WIDTH;
+    u32 Y = (Gpu->ImageY + Gpu->ImageCurrentY) % GPU_VRAM_HEIGHT;
+    u16 *Dst = &Gpu->Vram[Y*GPU_VRAM_WIDTH + X];
+    if (!(Gpu->Status.PreserveMaskedPixel && (*Dst & 0x8000)))
+    {
+        *Dst = Pixel | (Gpu->Status.SetMaskBitOnDraw? 0x8000 : 0);
+    }
+
+    if (++Gpu->ImageCurrentX == Gpu->ImageWidth)
+    {
+        Gpu->ImageCurrentX = 0;
+        Gpu->ImageCurrentY++;
+    }
+}
+
+static void GP0_WriteImageData(GPU *Gpu, u32 Data)
+{
+    /* each word contains 2 pixels, the lower halfword goes first */
+    GP0_WriteImagePixel(Gpu, Data & 0xFFFF);
+    GP0_WriteImagePixel(Gpu, Data >> 16);
+}
+
+static void GP0_WriteImageBlock(GPU *Gpu, const u32 *Data, uint WordCount)
+{
+    if (Gpu->Status.SetMaskBitOnDraw || Gpu->Status.PreserveMaskedPixel)
+    {
+        for (uint i = 0; i < WordCount; i++)
+            GP0_WriteImageData(Gpu, Data[i]);
+        return;
+    }
+
+    /* no mask bit to deal with, pixels are copied row by row, 
+     * the lower halfword is first so the word stream is already in pixel order */
+    const u8 *Src = (const u8 *)Data;
+    uint HalfwordsLeft = WordCount*2;
+    while (HalfwordsLeft && Gpu->ImageCurrentY < Gpu->ImageHeight)
+    {
+        u32 X = (Gpu->ImageX + Gpu->ImageCurrentX) % GPU_VRAM_WIDTH;
+        u32 Y = (Gpu->ImageY + Gpu->ImageCurrentY) % GPU_VRAM_HEIGHT;
+        uint Run = MIN((uint)(Gpu->ImageWidth - Gpu->ImageCurrentX), HalfwordsLeft);
+        Run = MIN(Run, GPU_VRAM_WIDTH - X); /* the rectangle wraps around horizontally */
+
+        memcpy(&Gpu->Vram[Y*GPU_VRAM_WIDTH + X], Src, Run*sizeof(u16));
+        Src += Run*sizeof(u16);
+        HalfwordsLeft -= Run;
+        Gpu->ImageCurrentX += Run;
+        if (Gpu->ImageCurrentX == Gpu->ImageWidth)
+        {
+            Gpu->ImageCurrentX = 0;
+            Gpu->ImageCurrentY++;
+        }
+    }
 }
 
 static void GP0_StoreRectangle(GPU *Gpu)
@@ -394,30 +878,276 @@ static void GP0_StoreRectangle(GPU *Gpu)
      * ...: Data (DMA or GPUREAD to RAM)
      * size (height*width) is padded to words boundary while counting in halfwords
      * */
+    u32 SrcParam = Gpu->CommandBuffer[1];
     u32 SizeParam = Gpu->CommandBuffer[2];
-    u32 RectangleSizeHalf = (SizeParam & 0xFFFF) * (SizeParam >> 16);
+    Gpu->ReadX = SrcParam & 0x3FF;
+    Gpu->ReadY = (SrcParam >> 16) & 0x1FF;
+    /* a size of 0 means max size, like uploads */
+    Gpu->ReadWidth = ((SizeParam - 1) & 0x3FF) + 1;
+    Gpu->ReadHeight = (((SizeParam >> 16) - 1) & 0x1FF) + 1;
+    Gpu->ReadCurrentX = 0;
+    Gpu->ReadCurrentY = 0;
+
+    u32 RectangleSizeHalf = (u32)Gpu->ReadWidth * (u32)Gpu->ReadHeight;
     u32 RectangleSizeWord = (RectangleSizeHalf + 1) / 2;
+    Gpu->ReadWordsRemain = RectangleSizeWord;
 
-    /* TODO: implement copy when implementing VRAM */
+#ifdef DEBUG
     LOG("Store rectangle size %d words\n", RectangleSizeWord);
+#endif /* DEBUG */
 }
 
-static void GP0_RenderShadedQuad(GPU *Gpu)
+static uint GP0_PolygonWordCount(u8 Command)
 {
-    (void)Gpu;
-    LOG("[Renderer]: Draw shaded quad\n");
+    /* 
+     * Command breakdown:
+     * 0: Color + Command
+     * for each vertex: 
+     *      Color (shaded only, not present for the first vertex), 
+     *      Vertex: YYYYXXXX, 
+     *      Texcoord (textured only): first one contains the CLUT, second one contains the texpage 
+     */
+    uint VertexCount = (Command & RASTER_QUAD)? 4 : 3;
+    uint WordsPerVertex = 1 
+        + ((Command & RASTER_TEXTURED) != 0) 
+        + ((Command & RASTER_SHADED) != 0);
+    uint WordCount = 1 + VertexCount*WordsPerVertex;
+    if (Command & RASTER_SHADED)
+        WordCount--;
+    return WordCount;
 }
 
-static void GP0_RenderShadedTri(GPU *Gpu)
+static void GP0_SetTexturePage(GPU *Gpu, u16 TexPage)
 {
-    (void)Gpu;
-    LOG("[Renderer]: Draw shaded triangle\n");
+    /* texpage attribute of textured polygons, same as bits 0..8 and 11 of GP0 E1h */
+    Gpu->Status.TexturePageX = TexPage >> 0;
+    Gpu->Status.TexturePageY = TexPage >> 4;
+    Gpu->Status.SemiTransparency = TexPage >> 5;
+    Gpu->Status.TextureDepth = TexPage >> 7;
+    Gpu->Status.TextureDisable = TexPage >> 11;
 }
 
-static void GP0_RenderTexturedQuad(GPU *Gpu)
+static void GP0_RenderPolygon(GPU *Gpu)
 {
-    (void)Gpu;
-    LOG("[Renderer]: Draw textured quad\n");
+    u32 Flags = (Gpu->CommandBuffer[0] >> 24) & 0x1F;
+    uint VertexCount = (Flags & RASTER_QUAD)? 4 : 3;
+    if (!(Flags & RASTER_TEXTURED))
+        Flags &= ~RASTER_RAW_TEXTURE;
+
+    Raster_Vertex Vertices[4];
+    u16 Clut = 0;
+    u32 Color = Gpu->CommandBuffer[0] & 0xFFFFFF;
+    uint WordIndex = 1;
+    for (uint i = 0; i < VertexCount; i++)
+    {
+        if (i > 0 && (Flags & RASTER_SHADED))
+            Color = Gpu->CommandBuffer[WordIndex++] & 0xFFFFFF;
+
+        /* 11 bit signed coordinates */
+        u32 Position = Gpu->CommandBuffer[WordIndex++];
+        Vertices[i] = (Raster_Vertex) {
+            .X = ((i16)(Position << 5) >> 5) + Gpu->DrawingOffsetX,
+            .Y = ((i16)((Position >> 16) << 5) >> 5) + Gpu->DrawingOffsetY,
+            .Color = Color,
+        };
+
+        if (Flags & RASTER_TEXTURED)
+        {
+            u32 TexCoord = Gpu->CommandBuffer[WordIndex++];
+            Vertices[i].U = TexCoord & 0xFF;
+            Vertices[i].V = (TexCoord >> 8) & 0xFF;
+            if (i == 0)
+                Clut = TexCoord >> 16;
+            else if (i == 1)
+                GP0_SetTexturePage(Gpu, TexCoord >> 16);
+        }
+    }
+    ASSERT(WordIndex == Gpu->CommandBufferSize);
+    if (Flags & RASTER_TEXTURED)
+        Gpu->LastClut = Clut;
+
+    u32 Pixels = Raster_DrawTriangle(Gpu, &Vertices[0], &Vertices[1], &Vertices[2], Flags, Clut);
+    if (Flags & RASTER_QUAD)
+    {
+        Pixels += Raster_DrawTriangle(Gpu, &Vertices[1], &Vertices[2], &Vertices[3], Flags, Clut);
+    }
+    GPU_AddDrawCost(Gpu, (u64)Pixels * GPU_PixelClocks(Gpu, Flags));
+    GPU_CountPrimitive(Gpu, Pixels, Flags);
+}
+
+static uint GP0_RectangleWordCount(u8 Command)
+{
+    /* 
+     * Command breakdown:
+     *      Color + Command
+     *      Vertex: YYYYXXXX
+     *      Texcoord + CLUT (textured only)
+     *      Size: HHHHWWWW (variable size only)
+     */
+    uint WordCount = 2;
+    if (Command & RASTER_TEXTURED)
+        WordCount++;
+    if (0 == ((Command >> 3) & 3))
+        WordCount++;
+    return WordCount;
+}
+
+static void GP0_RenderRectangle(GPU *Gpu)
+{
+    u32 Flags = (Gpu->CommandBuffer[0] >> 24) & (RASTER_RAW_TEXTURE | RASTER_SEMI_TRANSPARENT | RASTER_TEXTURED);
+    u32 Color = Gpu->CommandBuffer[0] & 0xFFFFFF;
+    u32 Position = Gpu->CommandBuffer[1];
+    i32 X = ((i16)(Position << 5) >> 5) + Gpu->DrawingOffsetX;
+    i32 Y = ((i16)((Position >> 16) << 5) >> 5) + Gpu->DrawingOffsetY;
+    if (!(Flags & RASTER_TEXTURED))
+        Flags &= ~RASTER_RAW_TEXTURE;
+
+    uint WordIndex = 2;
+    u32 U = 0, V = 0;
+    u16 Clut = 0;
+    if (Flags & RASTER_TEXTURED)
+    {
+        u32 TexCoord = Gpu->CommandBuffer[WordIndex++];
+        U = TexCoord & 0xFF;
+        V = (TexCoord >> 8) & 0xFF;
+        Clut = TexCoord >> 16;
+        Gpu->LastClut = Clut;
+    }
+
+    u32 Width, Height;
+    switch ((Gpu->CommandBuffer[0] >> 27) & 3)
+    {
+    case 0: /* variable size */
+    {
+        u32 Size = Gpu->CommandBuffer[WordIndex++];
+        Width = Size & 0x3FF;
+        Height = (Size >> 16) & 0x1FF;
+    } break;
+    case 1: Width = 1; Height = 1; break;
+    case 2: Width = 8; Height = 8; break;
+    default:
+    case 3: Width = 16; Height = 16; break;
+    }
+    ASSERT(WordIndex == Gpu->CommandBufferSize);
+
+    u32 Pixels = Raster_DrawRectangle(Gpu, X, Y, Width, Height, Color, U, V, Flags, Clut);
+    GPU_AddDrawCost(Gpu, (u64)Pixels * GPU_PixelClocks(Gpu, Flags));
+    GPU_CountPrimitive(Gpu, Pixels, Flags);
+}
+
+/* Position: YYYYXXXX word of a line vertex */
+static Raster_Vertex GP0_DecodeLineVertex(const GPU *Gpu, u32 Position, u32 Color)
+{
+    /* 11 bit signed coordinates */
+    return (Raster_Vertex) {
+        .X = ((i16)(Position << 5) >> 5) + Gpu->DrawingOffsetX,
+        .Y = ((i16)((Position >> 16) << 5) >> 5) + Gpu->DrawingOffsetY,
+        .Color = Color & 0xFFFFFF,
+    };
+}
+
+static void GP0_DrawLineSegment(GPU *Gpu, u32 Command, u32 Color0, u32 Position0, u32 Color1, u32 Position1)
+{
+    u32 Flags = (Command >> 24) & (RASTER_SEMI_TRANSPARENT | RASTER_SHADED);
+    Raster_Vertex V0 = GP0_DecodeLineVertex(Gpu, Position0, Color0);
+    Raster_Vertex V1 = GP0_DecodeLineVertex(Gpu, Position1, Color1);
+    u32 Pixels = Raster_DrawLine(Gpu, &V0, &V1, Flags);
+    GPU_AddDrawCost(Gpu, (u64)Pixels * GPU_PixelClocks(Gpu, Flags));
+    GPU_CountPrimitive(Gpu, Pixels, Flags);
+}
+
+static void GP0_RenderLine(GPU *Gpu)
+{
+    /* 
+     * Command breakdown:
+     * 0: Color + Command
+     * 1: Vertex: YYYYXXXX
+     *    Color (shaded only)
+     *    Vertex: YYYYXXXX
+     * polylines (bit 3) keep sending [Color,] Vertex until a 5xxx5xxx word
+     */
+    u32 Command = Gpu->CommandBuffer[0];
+    Bool8 Shaded = (Command >> 24) & RASTER_SHADED;
+    u32 Color1 = Shaded? Gpu->CommandBuffer[2] : Command;
+    u32 Position1 = Gpu->CommandBuffer[Shaded? 3 : 2];
+    GP0_DrawLineSegment(Gpu, Command, Command, Gpu->CommandBuffer[1], Color1, Position1);
+
+    if (Command & (0x08 << 24)) /* polyline */
+    {
+        Gpu->PolylineCommand = Command;
+        Gpu->PolylineLastColor = Color1;
+        Gpu->PolylineLastPosition = Position1;
+        Gpu->PolylineHasColor = false;
+        Gpu->GP0Mode = GP0_POLYLINE;
+        Gpu->CommandWordsRemain = 1; /* at least the terminator */
+    }
+}
+
+static void GP0_WritePolyline(GPU *Gpu, u32 Data)
+{
+    Bool8 Shaded = (Gpu->PolylineCommand >> 24) & RASTER_SHADED;
+    Bool8 StartsVertex = !Shaded || !Gpu->PolylineHasColor;
+    if (StartsVertex && 0x50005000 == (Data & 0xF000F000)) /* terminator */
+    {
+        Gpu->GP0Mode = GP0_COMMAND;
+        Gpu->CommandWordsRemain = 0;
+        Gpu->CommandBufferSize = 0;
+        return;
+    }
+    if (Shaded && !Gpu->PolylineHasColor)
+    {
+        Gpu->PolylineColor = Data;
+        Gpu->PolylineHasColor = true;
+        return;
+    }
+
+    u32 Color = Shaded? Gpu->PolylineColor : Gpu->PolylineCommand;
+    GP0_DrawLineSegment(Gpu, Gpu->PolylineCommand, 
+        Gpu->PolylineLastColor, Gpu->PolylineLastPosition, 
+        Color, Data
+    );
+    Gpu->PolylineLastColor = Color;
+    Gpu->PolylineLastPosition = Data;
+    Gpu->PolylineHasColor = false;
+}
+
+static void GP0_FillRectangle(GPU *Gpu)
+{
+    /* 
+     * Command breakdown (3 words)
+     * 0: Color + Command
+     * 1: Top left: YYYYXXXX
+     * 2: Size: HHHHWWWW
+     */
+    u32 Color = Gpu->CommandBuffer[0] & 0xFFFFFF;
+    u32 TopLeft = Gpu->CommandBuffer[1];
+    u32 Size = Gpu->CommandBuffer[2];
+    u32 Pixels = Raster_FillRect(Gpu, TopLeft & 0xFFFF, TopLeft >> 16, Size & 0xFFFF, Size >> 16, Color);
+    /* fills write whole rows without the pixel pipeline, about twice as fast */
+    GPU_AddDrawCost(Gpu, Pixels / 2);
+    GPU_CountPrimitive(Gpu, Pixels, 0);
+}
+
+static void GP0_CopyRectangle(GPU *Gpu)
+{
+    /* 
+     * Command breakdown (4 words)
+     * 0: Command
+     * 1: Src: YYYYXXXX
+     * 2: Dst: YYYYXXXX
+     * 3: Size: HHHHWWWW
+     */
+    u32 Src = Gpu->CommandBuffer[1];
+    u32 Dst = Gpu->CommandBuffer[2];
+    u32 Size = Gpu->CommandBuffer[3];
+    u32 Pixels = Raster_CopyRect(Gpu, 
+        Src & 0xFFFF, Src >> 16, 
+        Dst & 0xFFFF, Dst >> 16, 
+        Size & 0xFFFF, Size >> 16
+    );
+    /* every pixel is read then written */
+    GPU_AddDrawCost(Gpu, (u64)Pixels * 2);
+    GPU_CountPrimitive(Gpu, Pixels, 0);
 }
 
 
@@ -445,10 +1175,12 @@ static void GP1_SetDisplayMode(GPU *Gpu, u32 Instruction)
 
 static void GP1_ResetCommandBuffer(GPU *Gpu)
 {
+    if (GP0_LOAD_IMAGE == Gpu->GP0Mode) /* part of the image made it to VRAM */
+        Raster_UpscaleEndWrite(Gpu, Gpu->ImageX, Gpu->ImageY, Gpu->ImageWidth, Gpu->ImageHeight);
     Gpu->CommandBufferSize = 0;
     Gpu->CommandWordsRemain = 0;
     Gpu->GP0Mode = GP0_COMMAND;
-    /* TODO: clear fifo */
+    Gpu->FifoWords = 0;
 }
 
 
@@ -575,6 +1307,24 @@ static TranslatedAddr InDMARange(u32 PhysicalAddr)
     return Translation;
 }
 
+static TranslatedAddr InCDROMRange(u32 PhysicalAddr)
+{
+    TranslatedAddr Translation = {
+        .Valid = IN_RANGE(0x1F801800, PhysicalAddr, 0x1F801803),
+        .Offset = PhysicalAddr - 0x1F801800,
+    };
+    return Translation;
+}
+
+static TranslatedAddr InMDECRange(u32 PhysicalAddr)
+{
+    TranslatedAddr Translation = {
+        .Valid = IN_RANGE(0x1F801820, PhysicalAddr, 0x1F801827),
+        .Offset = PhysicalAddr - 0x1F801820,
+    };
+    return Translation;
+}
+
 static TranslatedAddr InGPURange(u32 PhysicalAddr)
 {
     TranslatedAddr Translation = {
@@ -586,141 +1336,432 @@ static TranslatedAddr InGPURange(u32 PhysicalAddr)
 
 
 
-static void PS1_DoDMATransferBlock(PS1 *Ps1, DMA_Port Port)
+/*
+ * Block (manual and request sync mode) transfers are split into spans of RAM that don't wrap around,
+ * and each span goes to the device's handler in one call. Words of a span are in RAM order,
+ * lowest address first, whichever way the channel walks RAM: Decrement says the device sees them last to first.
+ * A NULL handler means the device isn't emulated yet.
+ */
+typedef struct PS1_DMASpan
 {
-    static const char *DMADeviceName[] = {
-        "MDECin", "MDECout",
-        "GPU", "CDROM",
-        "SPU", "PIO",
-        "OTC"
-    };
-    DMA_Chanel *Chanel = &Ps1->Dma.Chanels[Port];
-    int Increment = 
-        Chanel->Ctrl.Decrement
-        ? -4 : 4;
-    u32 Addr = Chanel->BaseAddr;
-    u32 WordsLeft = DMA_GetChanelTransferSize(Chanel);
-
-    if (Chanel->Ctrl.RamToDevice)
-    {
-        LOG("[DMA Transfer]: ram to device %d (%s):\n"
-            "    Addr: %08x..%08x\n"
-            "    Incr: %d\n"
-            "    Size: %08x (%d) words\n",
-            Port, DMADeviceName[Port], 
-            Addr, Addr + Increment*WordsLeft,
-            Increment,
-            WordsLeft, WordsLeft
-        );
-        do {
-            u32 CurrentAddr = (Addr % PS1_RAM_SIZE) & ~0x3;
-            u32 Data;
-            PS1_Ram_Read32(Ps1, CurrentAddr, &Data);
-            switch (Port)
-            {
-            case DMA_PORT_GPU:
-            {
-                GPU_WriteGP0(&Ps1->Gpu, Data);
-                //LOG("      | %08x\n", Data);
-            } break;
-            default:
-            {
-                TODO("DMA from ram to device %d (%s)", Port, DMADeviceName[Port]);
-            } break;
-            }
+    u32 *Words;             /* in PS1.Ram */
+    u32 Addr;               /* of Words[0] */
+    u32 Count;
+    Bool8 Decrement;
+    Bool8 Last;             /* the last span of the transfer */
+} PS1_DMASpan;
+typedef void (*PS1_DMASpanFn)(PS1 *Ps1, const PS1_DMASpan *Span);
 
-            Addr += Increment;
-            WordsLeft--;
-        } while (WordsLeft != 0);
+
+static void PS1_DMAGPUFromRam(PS1 *Ps1, const PS1_DMASpan *Span)
+{
+    if (!Span->Decrement)
+    {
+        GPU_WriteGP0Block(&Ps1->Gpu, Span->Words, Span->Count);
+        return;
     }
-    else /* device to ram */
+
+    for (u32 i = Span->Count; i > 0; i--)
+        GPU_WriteGP0(&Ps1->Gpu, Span->Words[i - 1]);
+}
+
+static void PS1_DMAGPUToRam(PS1 *Ps1, const PS1_DMASpan *Span)
+{
+    GPU_ReadGPUBlock(&Ps1->Gpu, Span->Words, Span->Count);
+    if (Span->Decrement) /* the first word read goes to the highest address */
     {
-        LOG("[DMA Transfer]: device %d (%s) to ram:\n"
-            "    Addr: %08x..%08x\n"
-            "    Incr: %d\n"
-            "    Size: %08x (%d) words\n",
-            Port, DMADeviceName[Port], 
-            Addr, Addr + Increment*WordsLeft,
-            Increment,
-            WordsLeft, WordsLeft
-        );
-        do {
-            /* wrap addr to ram size, ignore 2 LSB's */
-            u32 CurrentAddr = (Addr % PS1_RAM_SIZE) & ~0x3;
+        for (u32 i = 0, k = Span->Count - 1; i < k; i++, k--)
+        {
+            u32 Tmp = Span->Words[i];
+            Span->Words[i] = Span->Words[k];
+            Span->Words[k] = Tmp;
+        }
+    }
+}
 
-            u32 SrcWord = 0;
-            switch (Port)
-            {
-            case DMA_PORT_OTC: /* clear linked list */
-            {
-                /* current entry = prev entry */
-                SrcWord = (Addr - 4) % PS1_RAM_SIZE;
-                if (WordsLeft == 1) /* last entry */
-                    SrcWord = 0xFFFFFF;
-            } break;
-            default:
-            {
-                TODO("DMA transfer from device %d (%s) to ram", Port, DMADeviceName[Port]);
-            } break;
-            }
-            PS1_Ram_Write32(Ps1, CurrentAddr, SrcWord);
+static void PS1_DMACDROMToRam(PS1 *Ps1, const PS1_DMASpan *Span)
+{
+    CDROM_ReadDataBlock(&Ps1->Cdrom, Span->Words, Span->Count);
+    if (Span->Decrement)
+    {
+        for (u32 i = 0, k = Span->Count - 1; i < k; i++, k--)
+        {
+            u32 Tmp = Span->Words[i];
+            Span->Words[i] = Span->Words[k];
+            Span->Words[k] = Tmp;
+        }
+    }
+}
+
+static void PS1_DMAMDECFromRam(PS1 *Ps1, const PS1_DMASpan *Span)
+{
+    if (!Span->Decrement)
+    {
+        MDEC_WriteBlock(&Ps1->Mdec, Span->Words, Span->Count);
+        return;
+    }
+
+    for (u32 i = Span->Count; i > 0; i--)
+        MDEC_WriteCommand(&Ps1->Mdec, Span->Words[i - 1]);
+}
+
+static void PS1_DMAMDECToRam(PS1 *Ps1, const PS1_DMASpan *Span)
+{
+    MDEC_ReadBlock(&Ps1->Mdec, Span->Words, Span->Count);
+    if (Span->Decrement)
+    {
+        for (u32 i = 0, k = Span->Count - 1; i < k; i++, k--)
+        {
+            u32 Tmp = Span->Words[i];
+            Span->Words[i] = Span->Words[k];
+            Span->Words[k] = Tmp;
+        }
+    }
+}
+
+static void PS1_DMASPUFromRam(PS1 *Ps1, const PS1_DMASpan *Span)
+{
+    if (!Span->Decrement)
+    {
+        SPU_WriteBlock(&Ps1->Spu, Span->Words, Span->Count);
+        return;
+    }
+
+    for (u32 i = Span->Count; i > 0; i--)
+        SPU_WriteBlock(&Ps1->Spu, &Span->Words[i - 1], 1);
+}
+
+static void PS1_DMASPUToRam(PS1 *Ps1, const PS1_DMASpan *Span)
+{
+    if (!Span->Decrement)
+    {
+        SPU_ReadBlock(&Ps1->Spu, Span->Words, Span->Count);
+        return;
+    }
+
+    for (u32 i = Span->Count; i > 0; i--)
+        SPU_ReadBlock(&Ps1->Spu, &Span->Words[i - 1], 1);
+}
+
+static void PS1_DMAOTCToRam(PS1 *Ps1, const PS1_DMASpan *Span)
+{
+    (void)Ps1;
+    /* 
+     * the ordering table is cleared from its last entry down, 
+     * each entry links to the one below it: the word at A is A - 4 
+     */
+    u32 *Words = Span->Words;
+    u32 Count = Span->Count;
+    u32 Link = Span->Addr - 4;
+    u32 i = 0;
+    if (0 == Span->Addr) /* links back to the top of RAM */
+    {
+        Words[i++] = PS1_RAM_SIZE - 4;
+        Link += 4;
+    }
+
+#ifdef HAS_SSE2
+    __m128i Links = _mm_setr_epi32(Link, Link + 4, Link + 8, Link + 12);
+    const __m128i Step = _mm_set1_epi32(16);
+    for (; i + 4 <= Count; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(Words + i), Links);
+        Links = _mm_add_epi32(Links, Step);
+        Link += 16;
+    }
+#endif /* HAS_SSE2 */
+    for (; i < Count; i++)
+    {
+        Words[i] = Link;
+        Link += 4;
+    }
 
-            Addr += Increment;
-            WordsLeft--;
-        } while (WordsLeft != 0);
+    /* the entry cleared last ends the list */
+    if (Span->Last)
+        Words[Span->Decrement? 0 : Count - 1] = 0xFFFFFF;
+}
+
+static void PS1_MarkRamSpanDirty(PS1 *Ps1, u32 Addr, u32 Size)
+{
+    u32 LastPage = (Addr + Size - 1) / PS1_RAM_PAGE_SIZE;
+    for (u32 Page = Addr / PS1_RAM_PAGE_SIZE; Page <= LastPage; Page++)
+        PS1_MarkRamDirty(Ps1, Page * PS1_RAM_PAGE_SIZE);
+}
+
+static DMA_TransferSize PS1_DoDMATransferBlock(PS1 *Ps1, DMA_Port Port)
+{
+    static const struct {
+        const char *Name;
+        PS1_DMASpanFn FromRam;
+        PS1_DMASpanFn ToRam;
+    } sDevices[] = {
+        [DMA_PORT_MDEC_IN]  = { "MDECin", PS1_DMAMDECFromRam, NULL },
+        [DMA_PORT_MDEC_OUT] = { "MDECout", NULL, PS1_DMAMDECToRam },
+        [DMA_PORT_GPU]      = { "GPU", PS1_DMAGPUFromRam, PS1_DMAGPUToRam },
+        [DMA_PORT_CDROM]    = { "CDROM", NULL, PS1_DMACDROMToRam },
+        [DMA_PORT_SPU]      = { "SPU", PS1_DMASPUFromRam, PS1_DMASPUToRam },
+        [DMA_PORT_PIO]      = { "PIO", NULL, NULL },
+        [DMA_PORT_OTC]      = { "OTC", NULL, PS1_DMAOTCToRam },
+    };
+    DMA_Chanel *Chanel = &Ps1->Dma.Chanels[Port];
+    Bool8 RamToDevice = Chanel->Ctrl.RamToDevice;
+    Bool8 Decrement = Chanel->Ctrl.Decrement;
+    u32 Addr = Chanel->BaseAddr & (PS1_RAM_SIZE - 4); /* wrap addr to ram size, ignore 2 LSB's */
+    u32 WordCount = DMA_GetChanelTransferSize(Chanel);
+    u32 WordsLeft = WordCount;
+
+#ifdef DEBUG
+    LOG("[DMA Transfer]: %s %d (%s):\n"
+        "    Addr: %08x\n"
+        "    Incr: %d\n"
+        "    Size: %08x (%d) words\n",
+        RamToDevice? "ram to device" : "device to ram",
+        Port, sDevices[Port].Name, 
+        Addr,
+        Decrement? -4 : 4,
+        WordsLeft, WordsLeft
+    );
+#endif /* DEBUG */
+    PS1_DMASpanFn Handler = RamToDevice
+        ? sDevices[Port].FromRam 
+        : sDevices[Port].ToRam;
+    if (NULL == Handler)
+    {
+        TODO("DMA transfer %s device %d (%s)", RamToDevice? "from ram to" : "to ram from", Port, sDevices[Port].Name);
     }
 
-    DMA_SetTransferFinishedState(Chanel);
+    while (WordsLeft)
+    {
+        PS1_DMASpan Span = { .Decrement = Decrement };
+        if (Decrement) /* from Addr down to the bottom of RAM at most */
+        {
+            Span.Count = MIN(WordsLeft, Addr / sizeof(u32) + 1);
+            Span.Addr = Addr - (Span.Count - 1)*sizeof(u32);
+            Addr = (Span.Addr - sizeof(u32)) & (PS1_RAM_SIZE - 4);
+        }
+        else /* from Addr up to the top of RAM at most */
+        {
+            Span.Count = MIN(WordsLeft, (PS1_RAM_SIZE - Addr) / sizeof(u32));
+            Span.Addr = Addr;
+            Addr = (Addr + Span.Count*sizeof(u32)) & (PS1_RAM_SIZE - 4);
+        }
+        WordsLeft -= Span.Count;
+        Span.Last = 0 == WordsLeft;
+        Span.Words = (u32 *)(Ps1->Ram + Span.Addr);
+
+        Handler(Ps1, &Span);
+        if (!RamToDevice)
+            PS1_MarkRamSpanDirty(Ps1, Span.Addr, Span.Count*sizeof(u32));
+    }
+    return (DMA_TransferSize) { .WordCount = WordCount };
 }
 
-static void PS1_DoDMATransferLinkedList(PS1 *Ps1, DMA_Port Port)
+/*
+ * GPU ordering tables: each header holds the packet's size in words (bits 24..31) and the next header's address,
+ * the list ends on a header with bit 23 set.
+ * Packets are gathered into a batch so the GPU gets them in few GPU_WriteGP0Block calls instead of one per packet.
+ * A header visited twice means the list loops: the hardware would go on forever, we end the transfer there.
+ */
+#define PS1_DMA_LINKEDLIST_BATCH_WORDS 1024
+
+static DMA_TransferSize PS1_DoDMATransferLinkedList(PS1 *Ps1, DMA_Port Port)
 {
+    DMA_TransferSize Size = { 0 };
     DMA_Chanel *Chanel = &Ps1->Dma.Chanels[Port];
-    ASSERT(Port == DMA_PORT_GPU && "is this ok?");
-    if (Chanel->Ctrl.RamToDevice == 0)
+    if (Port != DMA_PORT_GPU || Chanel->Ctrl.RamToDevice == 0)
     {
-        TODO("Invalid transfer direction for linked list mode: device to ram\n");
+        LOG("[DMA Transfer]: linked-list on port %d %s ignored, only GPU reads from ram are supported\n", 
+            Port, Chanel->Ctrl.RamToDevice? "from ram" : "to ram"
+        );
+        return Size;
     }
 
-    u32 Addr = (Chanel->BaseAddr % PS1_RAM_SIZE) & ~0x3;
+    u32 Addr = Chanel->BaseAddr & (PS1_RAM_SIZE - 4);
+#ifdef DEBUG
     LOG("[DMA Transfer]: linked-list @ %08x\n", Addr);
+#endif /* DEBUG */
+    memset(Ps1->DMAVisitedNodes, 0, sizeof Ps1->DMAVisitedNodes);
+    u32 Batch[PS1_DMA_LINKEDLIST_BATCH_WORDS];
+    uint BatchCount = 0;
+    Bool8 Cut = false;
     while (1)
     {
+        u32 Node = Addr / sizeof(u32);
+        u64 NodeBit = (u64)1 << (Node % 64);
+        if (Ps1->DMAVisitedNodes[Node / 64] & NodeBit)
+        {
+            Cut = true;
+            break;
+        }
+        Ps1->DMAVisitedNodes[Node / 64] |= NodeBit;
+
         u32 Header;
         PS1_Ram_Read32(Ps1, Addr, &Header);
+        uint PacketWords = Header >> 24;
+        Size.NodeCount++;
+        Size.WordCount += 1 + PacketWords;
 
-        uint SizeWords = Header >> 24;
-        for (uint WordCount = SizeWords; WordCount; WordCount--)
+        /* the packet follows the header, in at most 2 pieces if it wraps around */
+        if (BatchCount + PacketWords > PS1_DMA_LINKEDLIST_BATCH_WORDS)
         {
-            Addr = (Addr + sizeof(u32)) % PS1_RAM_SIZE;
-            u32 GPUCommand;
-            PS1_Ram_Read32(Ps1, Addr, &GPUCommand);
-            GPU_WriteGP0(&Ps1->Gpu, GPUCommand);
+            GPU_WriteGP0Block(&Ps1->Gpu, Batch, BatchCount);
+            BatchCount = 0;
         }
+        u32 PacketAddr = (Addr + sizeof(u32)) & (PS1_RAM_SIZE - 4);
+        const u32 *Packet = (const u32 *)(Ps1->Ram + PacketAddr);
+        uint FirstPiece = MIN(PacketWords, (PS1_RAM_SIZE - PacketAddr) / sizeof(u32));
+        for (uint i = 0; i < FirstPiece; i++)
+            Batch[BatchCount++] = Packet[i];
+        for (uint i = FirstPiece; i < PacketWords; i++)
+            Batch[BatchCount++] = ((const u32 *)Ps1->Ram)[i - FirstPiece];
 
         /* last packet, low 24 bits are set to 1, but we only check the msb, 
          * that's how mednafen does the check 
          * (probably how the hardware does it too? Or just optimization?) */
         if (Header & 0x800000)
             break;
+        if (Size.WordCount >= DMA_LINKEDLIST_MAX_WORDS)
+        {
+            Cut = true;
+            break;
+        }
+
+        Addr = Header & (PS1_RAM_SIZE - 4);
+    }
+    GPU_WriteGP0Block(&Ps1->Gpu, Batch, BatchCount);
+
+    if (Cut)
+    {
+        LOG("[DMA Transfer]: linked-list @ %08x cut at %08x after %u words, it loops or is corrupt\n",
+            Chanel->BaseAddr, Addr, Size.WordCount
+        );
+    }
+#ifdef PS1_GPU_STATS
+    Ps1->Gpu.Stats.ListPackets += Size.NodeCount;
+    Ps1->Gpu.Stats.ListWords += Size.WordCount;
+    Ps1->Gpu.Stats.ListsCut += Cut;
+#endif /* PS1_GPU_STATS */
+    return Size;
+}
+
+
+
+void PS1_Reset(PS1 *Ps1)
+{
+    CPU_Reset(&Ps1->Cpu, Ps1);
+    GPU_Reset(&Ps1->Gpu, Ps1);
+    Ps1->NextEventCycle = ~(u64)0;
+    DMA_Reset(&Ps1->Dma, Ps1);
+    CDROM_Reset(&Ps1->Cdrom, Ps1);
+    MDEC_Reset(&Ps1->Mdec, Ps1);
+    SPU_Reset(&Ps1->Spu, Ps1);
+    Ps1->FrameCyclesLeft = 0;
+}
+
+void PS1_UpdateEvents(PS1 *Ps1)
+{
+    u64 Cycle = Ps1->Gpu.Cycle;
+    /* the devices schedule their next event again as they update */
+    Ps1->NextEventCycle = ~(u64)0;
+    if (Ps1->Dma.NextEventCycle <= Cycle)
+        DMA_Update(&Ps1->Dma, Cycle);
+    else PS1_ScheduleEvent(Ps1, Ps1->Dma.NextEventCycle);
+    if (Ps1->Cdrom.NextEventCycle <= Cycle)
+        CDROM_Update(&Ps1->Cdrom, Cycle);
+    else PS1_ScheduleEvent(Ps1, Ps1->Cdrom.NextEventCycle);
+    if (Ps1->Spu.NextEventCycle <= Cycle)
+        SPU_Update(&Ps1->Spu, Cycle);
+    else PS1_ScheduleEvent(Ps1, Ps1->Spu.NextEventCycle);
+}
+
+/* like the loop in PS1_RunFrame, but stops for the monitor; returns the cycles that were run */
+static u32 PS1_RunMonitored(PS1 *Ps1, u32 Cycles)
+{
+    Monitor *Mon = Ps1->Monitor;
+    CPU *Cpu = &Ps1->Cpu;
+
+    /* in locals for the loop, the CPU can't change them behind our back */
+    u32 PCPage = Mon->PCPageValid? Mon->PCPage : ~(u32)0;
+    Bool8 PCPageHasBreakpoint = Mon->PCPageHasBreakpoint;
+    Bool8 SkipBreakpoint = Mon->SkipBreakpoint;
+    Bool8 SingleStep = Mon->SingleStep;
+    u32 i = 0;
+    while (i < Cycles)
+    {
+        /* 
+         * the page bit is only looked up when PC enters another page, 
+         * most of the time the code runs on a page without breakpoints and this is all it costs 
+         */
+        u32 PC = Cpu->NextInstructionPC;
+        if (PC >> MONITOR_PAGE_SHIFT != PCPage)
+        {
+            PCPage = PC >> MONITOR_PAGE_SHIFT;
+            PCPageHasBreakpoint = Monitor_PageHasBreakpoint(Mon, PS1_GetPhysicalAddr(PC));
+            Mon->PageLookups++;
+        }
+        /* while an mfhi/mflo stalls, PC is already past it and the instruction there has yet to be checked */
+        if (!Cpu->HiLoBlocking)
+        {
+            if (PCPageHasBreakpoint && !SkipBreakpoint && Monitor_IsBreakpoint(Mon, PS1_GetPhysicalAddr(PC)))
+            {
+                Mon->StopReason = MONITOR_STOP_BREAKPOINT;
+                break;
+            }
+            SkipBreakpoint = false;
+        }
 
-        Addr = (Header % PS1_RAM_SIZE) & ~0x3;
+        CPU_Clock(Cpu);
+        if (++Ps1->Gpu.Cycle >= Ps1->NextEventCycle)
+            PS1_UpdateEvents(Ps1);
+        i++;
+        if (MONITOR_RUNNING != Mon->StopReason) /* the instruction hit a watchpoint */
+            break;
+        if (SingleStep && !Cpu->HiLoBlocking)
+        {
+            Mon->StopReason = MONITOR_STOP_STEP;
+            break;
+        }
     }
 
-    DMA_SetTransferFinishedState(Chanel);
+    Mon->StopPC = Cpu->NextInstructionPC;
+    Mon->PCPage = PCPage;
+    Mon->PCPageValid = ~(u32)0 != PCPage;
+    Mon->PCPageHasBreakpoint = PCPageHasBreakpoint;
+    Mon->SkipBreakpoint = SkipBreakpoint;
+    return i;
 }
 
-
-
-void PS1_Reset(PS1 *Ps1)
+u32 PS1_RunFrame(PS1 *Ps1)
 {
-    CPU_Reset(&Ps1->Cpu, Ps1);
-    GPU_Reset(&Ps1->Gpu, Ps1);
-    DMA_Reset(&Ps1->Dma, Ps1);
+    if (0 == Ps1->FrameCyclesLeft)
+    {
+        Ps1->FrameCycles = GPU_BeginFrame(&Ps1->Gpu);
+        Ps1->FrameCyclesLeft = Ps1->FrameCycles;
+    }
+
+    if (Ps1->Monitor)
+    {
+        Ps1->FrameCyclesLeft -= PS1_RunMonitored(Ps1, Ps1->FrameCyclesLeft);
+        if (Ps1->FrameCyclesLeft)
+            return 0;
+    }
+    else
+    {
+        u32 Cycles = Ps1->FrameCyclesLeft;
+        for (u32 i = 0; i < Cycles; i++)
+        {
+            CPU_Clock(&Ps1->Cpu);
+            if (++Ps1->Gpu.Cycle >= Ps1->NextEventCycle)
+                PS1_UpdateEvents(Ps1);
+        }
+        Ps1->FrameCyclesLeft = 0;
+    }
+    GPU_EndFrame(&Ps1->Gpu);
+    return Ps1->FrameCycles;
 }
 
 
-void PS1_DoDMATransfer(PS1 *Ps1, DMA_Port Port)
+DMA_TransferSize PS1_DoDMATransfer(PS1 *Ps1, DMA_Port Port)
 {
     DMA_SyncMode SyncMode = Ps1->Dma.Chanels[Port].Ctrl.SyncMode; 
     switch (SyncMode)
@@ -728,17 +1769,18 @@ void PS1_DoDMATransfer(PS1 *Ps1, DMA_Port Port)
     case DMA_SYNCMODE_MANUAL:
     case DMA_SYNCMODE_REQUEST:
     {
-        PS1_DoDMATransferBlock(Ps1, Port);
+        return PS1_DoDMATransferBlock(Ps1, Port);
     } break;
     case DMA_SYNCMODE_LINKEDLIST:
     {
-        PS1_DoDMATransferLinkedList(Ps1, Port);
+        return PS1_DoDMATransferLinkedList(Ps1, Port);
     } break;
     default:
     {
         UNREACHABLE("unknown syncmode: %d", SyncMode);
     } break;
     }
+    return (DMA_TransferSize) { 0 };
 }
 
 
@@ -770,6 +1812,8 @@ u32 PS1_Read32(PS1 *Ps1, u32 LogicalAddr)
         ASSERT(Offset + 4 <= PS1_RAM_SIZE && Offset < Offset + 4);
 
         PS1_Ram_Read32(Ps1, Offset, &Data);
+        if (PS1_IsRamPageWatched(Ps1, Offset))
+            Monitor_CheckAccess(Ps1->Monitor, Offset, 4, MONITOR_WATCH_READ, Data);
         return Data; /* no log */
     }
 
@@ -797,6 +1841,19 @@ u32 PS1_Read32(PS1 *Ps1, u32 LogicalAddr)
         LOG("(DMA): %08x\n", Data);
         return Data;
     }
+    else if ((Translation = InMDECRange(PhysicalAddr)).Valid)
+    {
+        if (Translation.Offset < 4) /* MDEC0, decoded pixels */
+        {
+            Data = MDEC_ReadData(&Ps1->Mdec);
+            LOG("(MDEC data): %08x\n", Data);
+        }
+        else /* MDEC1, status */
+        {
+            Data = MDEC_ReadStatus(&Ps1->Mdec);
+            LOG("(MDEC status): %08x\n", Data);
+        }
+    }
     else if ((Translation = InGPURange(PhysicalAddr)).Valid)
     {
         if (PhysicalAddr == 0x1F801810) /* GPUREAD register, read only */
@@ -814,6 +1871,13 @@ u32 PS1_Read32(PS1 *Ps1, u32 LogicalAddr)
     {
         LOG("(timer): %08x\n", Data);
     }
+    else if ((Translation = InSPURange(PhysicalAddr)).Valid)
+    {
+        /* as 2 halfwords */
+        Data = SPU_Read16(&Ps1->Spu, Translation.Offset);
+        Data |= (u32)SPU_Read16(&Ps1->Spu, Translation.Offset + 2) << 16;
+        LOG("(SPU): %08x\n", Data);
+    }
     else
     {
         TODO("\nRead32 unknown region [%08x]\n", PhysicalAddr);
@@ -838,11 +1902,13 @@ u16 PS1_Read16(PS1 *Ps1, u32 LogicalAddr)
 
         Data = Ps1->Ram[Offset + 0];
         Data |= (u16)Ps1->Ram[Offset + 1] << 8;
+        if (PS1_IsRamPageWatched(Ps1, Offset))
+            Monitor_CheckAccess(Ps1->Monitor, Offset, 2, MONITOR_WATCH_READ, Data);
         return Data; /* no log */
     }
     if ((Translation = InSPURange(PhysicalAddr)).Valid)
     {
-        return Data; /* too much logging from spu */
+        return SPU_Read16(&Ps1->Spu, Translation.Offset); /* too much logging from spu */
     }
 
     LOG("Read16 [%08x] ", LogicalAddr);
@@ -871,6 +1937,8 @@ u8 PS1_Read8(PS1 *Ps1, u32 LogicalAddr)
     else if ((Translation = InRamRange(PhysicalAddr)).Valid)
     {
         Data = Ps1->Ram[Translation.Offset];
+        if (PS1_IsRamPageWatched(Ps1, Translation.Offset))
+            Monitor_CheckAccess(Ps1->Monitor, Translation.Offset, 1, MONITOR_WATCH_READ, Data);
         return Data; /*  too much ram reads */
     }
 
@@ -880,6 +1948,11 @@ u8 PS1_Read8(PS1 *Ps1, u32 LogicalAddr)
         LOG("(Expansion 1)\n");
         Data = 0xFF;
     }
+    else if ((Translation = InCDROMRange(PhysicalAddr)).Valid)
+    {
+        Data = CDROM_Read8(&Ps1->Cdrom, Translation.Offset);
+        LOG("(CD-ROM): %02x\n", Data);
+    }
     else
     {
         LOG("(UNknown region)\n");
@@ -908,6 +1981,8 @@ void PS1_Write32(PS1 *Ps1, u32 LogicalAddr, u32 Data)
         u32 Offset = Translation.Offset;
         ASSERT(Offset + 4 <= PS1_RAM_SIZE && Offset < Offset + 4);
 
+        if (PS1_IsRamPageWatched(Ps1, Offset))
+            Monitor_CheckAccess(Ps1->Monitor, Offset, 4, MONITOR_WATCH_WRITE, Data);
         PS1_Ram_Write32(Ps1, Offset, Data);
         return; /*  ram log is unnecessary since there is going to be a lot of ram write */
     }
@@ -959,6 +2034,19 @@ void PS1_Write32(PS1 *Ps1, u32 LogicalAddr, u32 Data)
         DMA_Write32(&Ps1->Dma, Translation.Offset, Data);
         return;
     }
+    else if ((Translation = InMDECRange(PhysicalAddr)).Valid)
+    {
+        if (Translation.Offset < 4) /* MDEC0, command or parameter */
+        {
+            LOG("(MDEC command): %08x\n", Data);
+            MDEC_WriteCommand(&Ps1->Mdec, Data);
+        }
+        else /* MDEC1, control */
+        {
+            LOG("(MDEC control): %08x\n", Data);
+            MDEC_WriteControl(&Ps1->Mdec, Data);
+        }
+    }
     else if ((Translation = InGPURange(PhysicalAddr)).Valid)
     {
         /* nop */
@@ -973,6 +2061,13 @@ void PS1_Write32(PS1 *Ps1, u32 LogicalAddr, u32 Data)
             GPU_WriteGP1(&Ps1->Gpu, Data);
         }
     }
+    else if ((Translation = InSPURange(PhysicalAddr)).Valid)
+    {
+        /* as 2 halfwords */
+        LOG("(SPU): %08x\n", Data);
+        SPU_Write16(&Ps1->Spu, Translation.Offset, (u16)Data);
+        SPU_Write16(&Ps1->Spu, Translation.Offset + 2, (u16)(Data >> 16));
+    }
     else
     {
         TODO("(unknown) <- %08x", Data);
@@ -993,12 +2088,16 @@ void PS1_Write16(PS1 *Ps1, u32 LogicalAddr, u16 Data)
         u32 Offset = Translation.Offset;
         ASSERT(Offset + 2 > Offset && Offset + 2 <= PS1_RAM_SIZE);
 
+        if (PS1_IsRamPageWatched(Ps1, Offset))
+            Monitor_CheckAccess(Ps1->Monitor, Offset, 2, MONITOR_WATCH_WRITE, Data);
         Ps1->Ram[Offset + 0] = Data;
         Ps1->Ram[Offset + 1] = Data >> 8;
+        PS1_MarkRamDirty(Ps1, Offset);
         return;
     }
     else if ((Translation = InSPURange(PhysicalAddr)).Valid)
     {
+        SPU_Write16(&Ps1->Spu, Translation.Offset, Data);
         return; /* too much logging from spu */
     }
 
@@ -1023,7 +2122,10 @@ void PS1_Write8(PS1 *Ps1, u32 LogicalAddr, u8 Data)
     TranslatedAddr Translation = InRamRange(PhysicalAddr);
     if (Translation.Valid)
     {
+        if (PS1_IsRamPageWatched(Ps1, Translation.Offset))
+            Monitor_CheckAccess(Ps1->Monitor, Translation.Offset, 1, MONITOR_WATCH_WRITE, Data);
         Ps1->Ram[Translation.Offset] = Data;
+        PS1_MarkRamDirty(Ps1, Translation.Offset);
         return; /*  too much ram writes */
     }
 
@@ -1032,6 +2134,11 @@ void PS1_Write8(PS1 *Ps1, u32 LogicalAddr, u8 Data)
     {
         LOG("(expansion 2): %08x\n", Data);
     }
+    else if ((Translation = InCDROMRange(PhysicalAddr)).Valid)
+    {
+        LOG("(CD-ROM): %02x\n", Data);
+        CDROM_Write8(&Ps1->Cdrom, Translation.Offset, Data);
+    }
     else
     {
         TODO("write8: [%08x] <- %02x", LogicalAddr, Data);
@@ -1039,22 +2146,449 @@ void PS1_Write8(PS1 *Ps1, u32 LogicalAddr, u8 Data)
 }
 
 
+Bool8 PS1_DebugRead(PS1 *Ps1, u32 LogicalAddr, void *OutBuffer, u32 Size)
+{
+    u8 *Bytes = OutBuffer;
+    for (u32 i = 0; i < Size; i++)
+    {
+        u32 PhysicalAddr = PS1_GetPhysicalAddr(LogicalAddr + i);
+        TranslatedAddr Translation;
+        if ((Translation = InRamRange(PhysicalAddr)).Valid)
+            Bytes[i] = Ps1->Ram[Translation.Offset];
+        else if ((Translation = InBiosRange(PhysicalAddr)).Valid)
+            Bytes[i] = Ps1->Bios[Translation.Offset];
+        else return false;
+    }
+    return true;
+}
+
+Bool8 PS1_DebugWrite(PS1 *Ps1, u32 LogicalAddr, const void *Buffer, u32 Size)
+{
+    const u8 *Bytes = Buffer;
+    for (u32 i = 0; i < Size; i++)
+    {
+        TranslatedAddr Translation = InRamRange(PS1_GetPhysicalAddr(LogicalAddr + i));
+        if (!Translation.Valid)
+            return false;
+        Ps1->Ram[Translation.Offset] = Bytes[i];
+        PS1_MarkRamDirty(Ps1, Translation.Offset);
+    }
+    return true;
+}
+
+
+#ifndef PS1_NO_MAIN
+typedef struct PS1_Options
+{
+    const char *BiosFileName;
+    Bool8 Headless;
+    u64 FrameLimit; /* 0 means no limit */
+    const char *VideoDumpFileName; /* NULL: don't record */
+    u64 SnapshotFrames[32];
+    uint SnapshotCount;
+    const char *CaptureFileName; /* NULL: don't record GPU commands */
+    uint Scale; /* internal resolution multiplier of polygons, 1: native */
+    Bool8 SoftwareGL;
+    Bool8 Debugger; /* VRAM, RAM and code windows next to the main one */
+    Bool8 Unthrottled; /* run as fast as possible instead of at the console's frame rate */
+    Bool8 Monitor; /* start stopped at the debug emulator's prompt */
+    u32 Breakpoints[16]; /* logical addresses */
+    uint BreakpointCount;
+    u16 GdbPort; /* 0: no gdb stub */
+    const char *DiscFileName; /* NULL: the drive is empty */
+    Bool8 NoReverb; /* the SPU's reverb starts off, F4 toggles it in a window */
+    Bool8 NoAudio; /* don't open the sound device */
+    const char *WavFileName; /* NULL: don't record the sound */
+} PS1_Options;
+
+static void PS1_PrintUsage(const char *ProgramName)
+{
+    printf("Usage: %s <bios file> [options]\n"
+        "Options:\n"
+        "    --headless         no window, frames are kept in memory\n"
+        "    --frames <count>   exit after running <count> frames\n"
+        "    --dump-y4m <file>  record every frame to a Y4M video, - for stdout\n"
+        "    --snapshot <frame> save the given frame as snapshot_<frame>.png, can be repeated\n"
+        "                       (F12 also saves a snapshot when running in a window)\n"
+        "    --capture-gpu <file>  record GP0/GP1 writes from boot, for Replay\n"
+        "    --scale <1|2|4>    render polygons at 2x or 4x the resolution (on every core)\n"
+        "    --software-gl      draw the window with Mesa's software renderer (llvmpipe)\n"
+        "    --debugger         open the VRAM, RAM and code viewers\n"
+        "    --unthrottled      run as fast as possible\n"
+        "    --monitor          start with the debug emulator's prompt on the console, before the first instruction\n"
+        "    --break <addr>     run until the instruction at <addr> (hex) and open the prompt, can be repeated\n"
+        "    --gdb <port>       let gdb connect on 127.0.0.1:<port> (target remote :<port>)\n"
+        "    --cd <file>        insert a disc image, a .cue sheet, a single track .bin or a .cdz made by PackDisc\n"
+        "    --no-reverb        turn the SPU's reverb off (F4 toggles it when running in a window)\n"
+        "    --no-audio         don't play the sound (it's never played when headless)\n"
+        "    --record-wav <file>  record the sound to a WAV file, every frame even when unthrottled\n",
+        ProgramName
+    );
+}
+
+static Bool8 PS1_ParseOptions(PS1_Options *Options, int argc, char **argv)
+{
+    *Options = (PS1_Options) { .Scale = 1 };
+#ifdef PS1_NO_FRONTEND
+    Options->Headless = true;
+#endif /* PS1_NO_FRONTEND */
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *Arg = argv[i];
+        if (0 == strcmp(Arg, "--headless"))
+        {
+            Options->Headless = true;
+        }
+        else if (0 == strcmp(Arg, "--software-gl"))
+        {
+            Options->SoftwareGL = true;
+        }
+        else if (0 == strcmp(Arg, "--debugger"))
+        {
+            Options->Debugger = true;
+        }
+        else if (0 == strcmp(Arg, "--unthrottled"))
+        {
+            Options->Unthrottled = true;
+        }
+        else if (0 == strcmp(Arg, "--monitor"))
+        {
+            Options->Monitor = true;
+        }
+        else if (0 == strcmp(Arg, "--break") && i + 1 < argc
+        && Options->BreakpointCount < STATIC_ARRAY_SIZE(Options->Breakpoints))
+        {
+            Options->Breakpoints[Options->BreakpointCount++] = strtoul(argv[++i], NULL, 16);
+        }
+        else if (0 == strcmp(Arg, "--frames") && i + 1 < argc)
+        {
+            Options->FrameLimit = strtoull(argv[++i], NULL, 0);
+        }
+        else if (0 == strcmp(Arg, "--capture-gpu") && i + 1 < argc)
+        {
+            Options->CaptureFileName = argv[++i];
+        }
+        else if (0 == strcmp(Arg, "--scale") && i + 1 < argc)
+        {
+            Options->Scale = strtoul(argv[++i], NULL, 0);
+            if (1 != Options->Scale && 2 != Options->Scale && 4 != Options->Scale)
+            {
+                printf("Scale must be 1, 2 or 4.\n");
+                return false;
+            }
+        }
+        else if (0 == strcmp(Arg, "--dump-y4m") && i + 1 < argc)
+        {
+            Options->VideoDumpFileName = argv[++i];
+        }
+        else if (0 == strcmp(Arg, "--snapshot") && i + 1 < argc
+        && Options->SnapshotCount < STATIC_ARRAY_SIZE(Options->SnapshotFrames))
+        {
+            Options->SnapshotFrames[Options->SnapshotCount++] = strtoull(argv[++i], NULL, 0);
+        }
+        else if (0 == strcmp(Arg, "--gdb") && i + 1 < argc)
+        {
+            Options->GdbPort = (u16)strtoul(argv[++i], NULL, 0);
+        }
+        else if (0 == strcmp(Arg, "--cd") && i + 1 < argc)
+        {
+            Options->DiscFileName = argv[++i];
+        }
+        else if (0 == strcmp(Arg, "--no-reverb"))
+        {
+            Options->NoReverb = true;
+        }
+        else if (0 == strcmp(Arg, "--no-audio"))
+        {
+            Options->NoAudio = true;
+        }
+        else if (0 == strcmp(Arg, "--record-wav") && i + 1 < argc)
+        {
+            Options->WavFileName = argv[++i];
+        }
+        else if (Arg[0] != '-' && NULL == Options->BiosFileName)
+        {
+            Options->BiosFileName = Arg;
+        }
+        else
+        {
+            printf("Unknown option: %s\n", Arg);
+            return false;
+        }
+    }
+    if (Options->GdbPort && (Options->Monitor || Options->BreakpointCount))
+    {
+        printf("--gdb can't be combined with --monitor or --break, set breakpoints from gdb instead.\n");
+        return false;
+    }
+    return NULL != Options->BiosFileName;
+}
+
+static Bool8 PS1_IsSnapshotFrame(const PS1_Options *Options, u64 Frame)
+{
+    for (uint i = 0; i < Options->SnapshotCount; i++)
+    {
+        if (Options->SnapshotFrames[i] == Frame)
+            return true;
+    }
+    return false;
+}
+
+/* hands the SPU's frames of the frame that just ran to the sound output */
+static void PS1_OutputAudio(PS1 *Ps1, Audio *Sound)
+{
+    SPU_Update(&Ps1->Spu, Ps1->Gpu.Cycle);
+    i16 Frames[1024][2];
+    uint FrameCount;
+    while ((FrameCount = SPU_ReadAudio(&Ps1->Spu, Frames[0], STATIC_ARRAY_SIZE(Frames))) > 0)
+        Audio_Push(Sound, Frames[0], FrameCount);
+}
+
+
+static void PS1_MonitorPrintStop(PS1 *Ps1)
+{
+    const Monitor *Mon = Ps1->Monitor;
+    if (MONITOR_STOP_BREAKPOINT == Mon->StopReason)
+    {
+        printf("Breakpoint\n");
+    }
+    else if (MONITOR_STOP_WATCHPOINT == Mon->StopReason)
+    {
+        printf("Watchpoint: %s%u [%08x] %s %0*x\n",
+            MONITOR_WATCH_READ == Mon->WatchFlags? "read" : "write", Mon->WatchSize * 8, Mon->WatchOffset,
+            MONITOR_WATCH_READ == Mon->WatchFlags? "->" : "<-", (int)Mon->WatchSize * 2, Mon->WatchValue
+        );
+    }
+
+    char Text[64] = "????????";
+    u32 Instruction;
+    if (PS1_DebugRead(Ps1, Mon->StopPC, &Instruction, sizeof Instruction))
+        Disassemble(Instruction, Mon->StopPC, DISASM_BEAUTIFUL_REGNAME | DISASM_IMM16_AS_HEX, Text, sizeof Text);
+    printf("%08x: %s\n", Mon->StopPC, Text);
+}
+
+static void PS1_MonitorPrintRegisters(const PS1 *Ps1)
+{
+    const CPU *Cpu = &Ps1->Cpu;
+    for (uint i = 0; i < 32; i++)
+        printf("%-4s %08x%s", sBeautifulRegisterName[i], Cpu->R[i], i % 4 == 3? "\n" : "    ");
+    printf("hi   %08x    lo   %08x    sr   %08x    cause %08x    epc %08x\n",
+        Cpu->Hi, Cpu->Lo, Cpu->SR, Cpu->Cause, Cpu->EPC
+    );
+}
+
+static void PS1_MonitorPrintList(const Monitor *Mon)
+{
+    for (uint i = 0; i < Mon->BreakpointCount; i++)
+        printf("breakpoint %08x\n", Mon->Breakpoints[i]);
+    for (uint i = 0; i < Mon->WatchpointCount; i++)
+    {
+        const Monitor_Watchpoint *Watch = &Mon->Watchpoints[i];
+        printf("watchpoint %08x..%08x %s%s\n", Watch->Offset, Watch->Offset + Watch->Size - 1,
+            Watch->Flags & MONITOR_WATCH_READ? "r" : "", Watch->Flags & MONITOR_WATCH_WRITE? "w" : ""
+        );
+    }
+}
+
+/* 
+ * the debug emulator's console, on the emulation thread while the monitor is stopped;
+ * returns false when the user quits 
+ */
+static Bool8 PS1_MonitorPrompt(PS1 *Ps1)
+{
+    Monitor *Mon = Ps1->Monitor;
+    PS1_MonitorPrintStop(Ps1);
+    for (;;)
+    {
+        char Line[256];
+        printf("> ");
+        fflush(stdout);
+        if (NULL == fgets(Line, sizeof Line, stdin))
+            return false;
+
+        char Command[16], Arg1[32], Arg2[32], Arg3[32];
+        int ArgCount = sscanf(Line, "%15s %31s %31s %31s", Command, Arg1, Arg2, Arg3);
+        if (ArgCount <= 0 || 0 == strcmp(Command, "cont"))
+        {
+            /* enter steps an instruction, either way we don't stop on the instruction we're on again */
+            Mon->SingleStep = ArgCount <= 0;
+            Mon->SkipBreakpoint = true;
+            Mon->StopReason = MONITOR_RUNNING;
+            return true;
+        }
+
+        u32 Addr = ArgCount >= 2? strtoul(Arg1, NULL, 16) : 0;
+        u32 PhysicalAddr = PS1_GetPhysicalAddr(Addr);
+        if (0 == strcmp(Command, "setbp") && ArgCount >= 2)
+        {
+            if (Monitor_AddBreakpoint(Mon, PhysicalAddr))
+                printf("Breakpoint at %08x\n", PhysicalAddr);
+            else printf("Unable to add a breakpoint at %08x (already set, or too many).\n", PhysicalAddr);
+        }
+        else if (0 == strcmp(Command, "clrbp") && ArgCount >= 2)
+        {
+            if (!Monitor_RemoveBreakpoint(Mon, PhysicalAddr))
+                printf("No breakpoint at %08x.\n", PhysicalAddr);
+        }
+        else if (0 == strcmp(Command, "setwp") && ArgCount >= 2)
+        {
+            u32 Size = ArgCount >= 3? strtoul(Arg2, NULL, 0) : 4;
+            const char *Access = ArgCount >= 4? Arg3 : "w";
+            u32 Flags = (strchr(Access, 'r')? MONITOR_WATCH_READ : 0) | (strchr(Access, 'w')? MONITOR_WATCH_WRITE : 0);
+            if (!InRamRange(PhysicalAddr).Valid || 0 == Size || Size > PS1_RAM_SIZE - PhysicalAddr || 0 == Flags)
+                printf("Watchpoints are ranges of RAM, with r, w or rw access.\n");
+            else if (!Monitor_AddWatchpoint(Mon, Ps1->WatchedRamPages, PhysicalAddr, Size, Flags))
+                printf("Too many watchpoints.\n");
+            else printf("Watchpoint at %08x..%08x\n", PhysicalAddr, PhysicalAddr + Size - 1);
+        }
+        else if (0 == strcmp(Command, "clrwp") && ArgCount >= 2)
+        {
+            if (!Monitor_RemoveWatchpoint(Mon, Ps1->WatchedRamPages, PhysicalAddr))
+                printf("No watchpoint at %08x.\n", PhysicalAddr);
+        }
+        else if (0 == strcmp(Command, "list"))
+        {
+            PS1_MonitorPrintList(Mon);
+        }
+        else if (0 == strcmp(Command, "regs"))
+        {
+            PS1_MonitorPrintRegisters(Ps1);
+        }
+        else if (0 == strcmp(Command, "quit") || 0 == strcmp(Command, "q"))
+        {
+            return false;
+        }
+        else
+        {
+            printf("Commands:\n"
+                "    <enter>                        execute an instruction\n"
+                "    cont                           run until a breakpoint or watchpoint\n"
+                "    setbp <addr>                   stop before executing <addr>\n"
+                "    clrbp <addr>\n"
+                "    setwp <addr> [size] [r|w|rw]   stop after an instruction accesses RAM in <addr>..<addr>+size-1,\n"
+                "                                   4 bytes and writes by default\n"
+                "    clrwp <addr>\n"
+                "    list                           breakpoints and watchpoints\n"
+                "    regs\n"
+                "    quit\n"
+                "Addresses are hex.\n"
+            );
+        }
+    }
+}
+
+/* 
+ * PS1_RunFrame, handing control to the prompt or to gdb whenever the monitor stops;
+ * returns the length of the frame, 0 when the user quit 
+ */
+static u32 PS1_RunFrameMonitored(PS1 *Ps1, GdbStub *Gdb)
+{
+    for (;;)
+    {
+        Bool8 Stopped = Ps1->Monitor && MONITOR_RUNNING != Ps1->Monitor->StopReason;
+        if (Gdb && (Stopped || GdbStub_HaltRequested(Gdb)))
+        {
+            if (!GdbStub_Halt(Gdb))
+                return 0;
+            continue;
+        }
+        if (Stopped && !PS1_MonitorPrompt(Ps1))
+            return 0;
+
+        u32 Cycles = PS1_RunFrame(Ps1);
+        if (Cycles)
+            return Cycles;
+    }
+}
+
+#ifndef PS1_NO_FRONTEND
+/* the emulation thread, when running in a window */
+typedef struct PS1_Emulation
+{
+    PS1 *Ps1;
+    const PS1_Options *Options;
+    Capture *Cap;
+    FrameDump *Dump;
+    Display_State *DisplayState;
+    Display_Sink Sink;
+    Frontend *Fe;
+    DebugSnapshot_Buffer *Snapshots; /* NULL without the debugger windows */
+    GdbStub *Gdb; /* NULL without --gdb */
+    Audio *Sound;
+    volatile u32 Done;
+} PS1_Emulation;
+
+static void PS1_EmulationMain(void *UserData)
+{
+    PS1_Emulation *Emu = UserData;
+    PS1 *Ps1 = Emu->Ps1;
+    Frontend *Fe = Emu->Fe;
+    u64 TicksPerSecond = Platform_TicksPerSecond();
+    u64 Deadline = Platform_GetTicks();
+    for (u64 Frame = 0; 
+        !Frontend_QuitRequested(Fe) && (0 == Emu->Options->FrameLimit || Frame < Emu->Options->FrameLimit); 
+        Frame++)
+    {
+        if (PS1_IsSnapshotFrame(Emu->Options, Frame) || Frontend_SnapshotRequested(Fe))
+            FrameDump_RequestSnapshot(Emu->Dump);
+        u32 Cycles = PS1_RunFrameMonitored(Ps1, Emu->Gdb);
+        if (0 == Cycles) /* quit from the prompt */
+            break;
+        if (Emu->Cap)
+            Capture_VBlank(Emu->Cap);
+        PS1_OutputAudio(Ps1, Emu->Sound);
+        if (Frontend_ReverbToggleRequested(Fe))
+            Ps1->Spu.ReverbDisabled = !Ps1->Spu.ReverbDisabled;
+
+        GPU_Stats Stats;
+        if (Frontend_OverlayEnabled(Fe) && GPU_GetFrameStats(&Ps1->Gpu, &Stats))
+        {
+            char Text[512];
+            GPU_FormatStats(&Stats, Text, sizeof Text);
+            Frontend_SetOverlay(Fe, Text);
+        }
+        /* before the display clears the GPU's dirty tiles */
+        if (Emu->Snapshots)
+            DebugSnapshot_Update(Emu->Snapshots, Ps1, Frame);
+        Display_Output(Emu->DisplayState, &Ps1->Gpu, &Emu->Sink);
+
+        if (Emu->Options->Unthrottled)
+            continue;
+        /* 
+         * presentation no longer paces emulation, keep it at the console's frame rate on our own;
+         * the sound doesn't pace it either, its output resamples to follow this timer instead
+         */
+        Deadline += (u64)Cycles * TicksPerSecond / PS1_CPU_CLOCK;
+        u64 Now = Platform_GetTicks();
+        if (Now < Deadline)
+            Platform_Sleep((Deadline - Now) * 1000000 / TicksPerSecond);
+        else if (Now - Deadline > TicksPerSecond / 10) /* too far behind to catch up, don't run in bursts */
+            Deadline = Now;
+    }
+    Platform_AtomicStore(&Emu->Done, 1);
+}
+#endif /* PS1_NO_FRONTEND */
 
 int main(int argc, char **argv)
 {
-    if (argc < 1)
+    PS1_Options Options;
+    if (!PS1_ParseOptions(&Options, argc, argv))
     {
-        printf("Missing bios file.\n");
+        PS1_PrintUsage(argv[0]);
         return 1;
     }
 
-    PS1 Ps1 = { 0 };
-    Ps1.Bios = (u8 *)malloc(PS1_BIOS_SIZE + PS1_RAM_SIZE);
-    Ps1.Ram = Ps1.Bios + PS1_BIOS_SIZE;
+    /* too big for the stack with the MDEC's input and sound RAM */
+    static PS1 Ps1;
+    Ps1.Bios = (u8 *)malloc(PS1_BIOS_SIZE + PS1_RAM_SIZE + GPU_VRAM_SIZE);
     ASSERT(Ps1.Bios != NULL);
+    Ps1.Ram = Ps1.Bios + PS1_BIOS_SIZE;
+    Ps1.Gpu.Vram = (u16 *)(Ps1.Ram + PS1_RAM_SIZE);
+    memset(Ps1.Gpu.Vram, 0, GPU_VRAM_SIZE);
 
 
-    const char* FileName = argv[1];
+    const char* FileName = Options.BiosFileName;
     FILE* f = fopen(FileName, "rb");
     ASSERT(f && "failed to read file");
     {
@@ -1071,10 +2605,264 @@ int main(int argc, char **argv)
     }
     fclose(f);
 
+    Disc *Cd = NULL;
+    if (Options.DiscFileName)
+    {
+        Cd = malloc(sizeof *Cd);
+        if (NULL == Cd || !Disc_Open(Cd, Options.DiscFileName))
+        {
+            printf("Unable to use %s as a disc image.\n", Options.DiscFileName);
+            return 1;
+        }
+        Ps1.Cdrom.Disc = Cd;
+    }
+
+    Ps1.Spu.ReverbDisabled = Options.NoReverb;
     PS1_Reset(&Ps1);
-    while (1)
+    if (Options.Scale > 1 && !Raster_AttachUpscaler(&Ps1.Gpu, Options.Scale, Platform_CpuCount()))
+    {
+        printf("Not enough memory to render at %ux.\n", Options.Scale);
+        return 1;
+    }
+    if (Platform_CpuCount() > 1 && !MDEC_AttachWorkers(&Ps1.Mdec, Platform_CpuCount()))
+        LOG("MDEC: no worker threads, macroblocks are decoded on the emulation thread\n");
+
+    Monitor *Mon = NULL;
+    if (Options.Monitor || Options.BreakpointCount)
+    {
+        Mon = malloc(sizeof *Mon);
+        ASSERT(Mon != NULL);
+        Monitor_Init(Mon);
+        for (uint i = 0; i < Options.BreakpointCount; i++)
+            Monitor_AddBreakpoint(Mon, PS1_GetPhysicalAddr(Options.Breakpoints[i]));
+        if (Options.Monitor)
+        {
+            Mon->StopReason = MONITOR_STOP_STEP;
+            Mon->StopPC = Ps1.Cpu.NextInstructionPC;
+        }
+        Ps1.Monitor = Mon;
+    }
+
+    GdbStub *Gdb = NULL;
+    if (Options.GdbPort)
+    {
+        Gdb = malloc(sizeof *Gdb);
+        if (NULL == Gdb || !GdbStub_Start(Gdb, &Ps1, Options.GdbPort))
+        {
+            printf("Unable to listen for gdb on port %u.\n", Options.GdbPort);
+            return 1;
+        }
+        printf("Waiting for gdb on 127.0.0.1:%u, emulation runs until it connects.\n", Options.GdbPort);
+    }
+
+    Capture *Cap = NULL;
+    if (Options.CaptureFileName)
+    {
+        Cap = malloc(sizeof *Cap);
+        if (NULL == Cap || !Capture_Open(Cap, Options.CaptureFileName))
+        {
+            printf("Unable to create %s.\n", Options.CaptureFileName);
+            return 1;
+        }
+        Ps1.Gpu.Capture = Cap;
+    }
+
+    /* frames go through the frame dump first, it then passes them on to the window or memory */
+    FrameDump Dump;
+    if (!FrameDump_Init(&Dump, Options.VideoDumpFileName))
+    {
+        printf("Unable to start the frame dump.\n");
+        return 1;
+    }
+
+    /* too big for the stack with its ring */
+    static Audio Sound;
+    Audio_Backend AudioBackend = Options.Headless || Options.NoAudio? AUDIO_BACKEND_NULL : AUDIO_BACKEND_DEVICE;
+    if (!Audio_Init(&Sound, AudioBackend, Options.WavFileName))
+    {
+        printf("Unable to create %s.\n", Options.WavFileName);
+        return 1;
+    }
+
+    Display_State DisplayState = { 0 };
+    if (Options.Headless)
+    {
+        Display_MemorySink *MemorySink = calloc(1, sizeof *MemorySink);
+        ASSERT(MemorySink != NULL);
+        Display_Sink Output = Display_MemorySinkInterface(MemorySink);
+        Display_Sink Sink = FrameDump_SinkInterface(&Dump, &Output);
+        for (u64 Frame = 0; 0 == Options.FrameLimit || Frame < Options.FrameLimit; Frame++)
+        {
+            if (PS1_IsSnapshotFrame(&Options, Frame))
+                FrameDump_RequestSnapshot(&Dump);
+            if (0 == PS1_RunFrameMonitored(&Ps1, Gdb))
+                break;
+            if (Cap)
+                Capture_VBlank(Cap);
+            PS1_OutputAudio(&Ps1, &Sound);
+            Display_Output(&DisplayState, &Ps1.Gpu, &Sink);
+        }
+        if (Gdb)
+            GdbStub_Stop(Gdb);
+    }
+#ifndef PS1_NO_FRONTEND
+    else
+    {
+        /* this thread presents the frames, the emulation gets its own */
+        Frontend *Fe = malloc(sizeof *Fe);
+        if (NULL == Fe || !Frontend_Init(Fe, "PS1 Emulator", Options.SoftwareGL))
+        {
+            printf("Unable to create a window.\n");
+            return 1;
+        }
+
+        Debugger *Dbg = NULL;
+        if (Options.Debugger)
+        {
+            Dbg = malloc(sizeof *Dbg);
+            if (NULL == Dbg || !Debugger_Init(Dbg, Ps1.Bios))
+            {
+                printf("Unable to create the debugger windows.\n");
+                return 1;
+            }
+        }
+
+        Display_Sink Output = Frontend_DisplaySinkInterface(Fe);
+        PS1_Emulation Emu = {
+            .Ps1 = &Ps1,
+            .Options = &Options,
+            .Cap = Cap,
+            .Dump = &Dump,
+            .DisplayState = &DisplayState,
+            .Sink = FrameDump_SinkInterface(&Dump, &Output),
+            .Fe = Fe,
+            .Snapshots = Dbg? &Dbg->Snapshots : NULL,
+            .Gdb = Gdb,
+            .Sound = &Sound,
+        };
+        Platform_Thread EmulationThread;
+        if (!Platform_ThreadCreate(&EmulationThread, PS1_EmulationMain, &Emu))
+        {
+            printf("Unable to start the emulation thread.\n");
+            return 1;
+        }
+        while (!Platform_AtomicLoad(&Emu.Done))
+        {
+            if (!Frontend_Present(Fe))
+                break;
+            if (Dbg)
+                Debugger_Present(Dbg);
+        }
+        /* the emulation thread may be halted by gdb */
+        if (Gdb)
+            GdbStub_Stop(Gdb);
+        Platform_ThreadJoin(&EmulationThread);
+        LOG("Frontend: %llu frames emulated, %llu presented, %llu replaced before they were shown\n",
+            (unsigned long long)Fe->Frames.Published, (unsigned long long)Fe->PresentedCount, 
+            (unsigned long long)Fe->Frames.Dropped
+        );
+        if (Dbg)
+        {
+            LOG("Debugger: %llu snapshots, %llu frames ended while the viewers were busy, %.1f MB copied\n",
+                (unsigned long long)Dbg->Snapshots.Published, (unsigned long long)Dbg->Snapshots.Skipped,
+                (double)Dbg->Snapshots.BytesCopied / MB
+            );
+            Debugger_Destroy(Dbg);
+            free(Dbg);
+        }
+        Frontend_Destroy(Fe);
+        free(Fe);
+    }
+#endif /* PS1_NO_FRONTEND */
+    FrameDump_Destroy(&Dump);
+    Audio_Destroy(&Sound);
+    if (AUDIO_BACKEND_DEVICE == Sound.Backend)
+    {
+        LOG("Audio: %llu frames pushed, %llu dropped while the ring was full; "
+            "%llu played at %u Hz, %llu input frames missed, rate adjusted by %+.3f%% on average\n",
+            (unsigned long long)Sound.FramesPushed, (unsigned long long)Sound.FramesDropped,
+            (unsigned long long)Sound.FramesPlayed, Sound.DeviceRate, (unsigned long long)Sound.FramesMissed,
+            Sound.Pulls? (Sound.RatioSum / (double)Sound.Pulls - 1.0) * 100.0 : 0.0
+        );
+    }
+    if (Options.WavFileName)
+    {
+        LOG("Audio: %.1f seconds recorded to %s\n", 
+            (double)Sound.FramesPushed / AUDIO_SAMPLE_RATE, Options.WavFileName
+        );
+    }
+    Raster_DetachUpscaler(&Ps1.Gpu);
+    if (Ps1.Mdec.MacroblocksDecoded)
+    {
+        LOG("MDEC: %llu macroblocks decoded, %llu batches split between %u threads\n",
+            (unsigned long long)Ps1.Mdec.MacroblocksDecoded, (unsigned long long)Ps1.Mdec.Batches,
+            MDEC_GetThreadCount(&Ps1.Mdec)
+        );
+    }
+    MDEC_DetachWorkers(&Ps1.Mdec);
+    if (Ps1.Spu.FramesMixed)
+    {
+        LOG("SPU: %llu frames mixed, %.1f voices on at a time on average\n",
+            (unsigned long long)Ps1.Spu.FramesMixed, (double)Ps1.Spu.VoiceFrames / (double)Ps1.Spu.FramesMixed
+        );
+    }
+    if (Ps1.Spu.ReverbBlocks)
+    {
+        LOG("SPU reverb: %llu blocks, %.2f us per block, %llu of them a step at a time\n",
+            (unsigned long long)Ps1.Spu.ReverbBlocks, 
+            (double)Ps1.Spu.ReverbTicks * 1e6 / (double)Platform_TicksPerSecond() / (double)Ps1.Spu.ReverbBlocks,
+            (unsigned long long)Ps1.Spu.ReverbSerialBlocks
+        );
+    }
+    if (Cap)
+    {
+        Capture_Close(Cap);
+        LOG("GPU capture: %llu frames, %llu GP0 words, %llu GP1 words\n",
+            (unsigned long long)Cap->FrameCount, 
+            (unsigned long long)Cap->GP0WordCount, (unsigned long long)Cap->GP1WordCount
+        );
+    }
+    if (Gdb)
+    {
+        LOG("GDB stub: halted %llu times, %llu packets\n", 
+            (unsigned long long)Gdb->Halts, (unsigned long long)Gdb->PacketCount
+        );
+        Mon = &Gdb->Mon;
+    }
+    if (Mon)
+    {
+        LOG("Monitor: PC moved to another page %llu times, %llu accesses to watched pages\n",
+            (unsigned long long)Mon->PageLookups, (unsigned long long)Mon->SlowAccesses
+        );
+    }
+    if (Cd)
     {
-        CPU_Clock(&Ps1.Cpu);
+        LOG("CD-ROM: %llu sectors read, %llu times a sector wasn't cached by the read-ahead thread yet\n",
+            (unsigned long long)Ps1.Cdrom.SectorsRead, (unsigned long long)Ps1.Cdrom.SectorWaits
+        );
+        if (Ps1.Cdrom.XASectors)
+        {
+            LOG("XA-ADPCM: %llu sectors decoded, %llu frames dropped while the audio ring was full\n",
+                (unsigned long long)Ps1.Cdrom.XASectors, (unsigned long long)Ps1.Cdrom.AudioFramesDropped
+            );
+        }
+        Disc_Close(Cd);
+        if (Cd->Packed)
+        {
+            LOG("Disc: %llu hunks inflated, %llu sectors found in an inflated hunk\n",
+                (unsigned long long)Cd->HunksInflated, (unsigned long long)Cd->HunkHits
+            );
+        }
+    }
+    LOG("Display: %llu frames, %.1f%% of the displayed rows were unchanged and skipped\n",
+        (unsigned long long)DisplayState.FrameCount, 100.0 * Display_SkippedFraction(&DisplayState)
+    );
+    GPU_Stats Stats;
+    if (GPU_GetFrameStats(&Ps1.Gpu, &Stats))
+    {
+        char Text[512];
+        GPU_FormatStats(&Stats, Text, sizeof Text);
+        LOG("%s\n", Text);
     }
 
     /*  were exiting, so the OS is freeing the memory anyway,  */
@@ -1082,4 +2870,5 @@ int main(int argc, char **argv)
     /*  free(Ps1.Bios) */
     return 0;
 }
+#endif /* PS1_NO_MAIN */
 